@@ -5,15 +5,44 @@
 #include <bench/bench.h>
 
 #include <assert.h>
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <new>
 #include <regex>
 #include <numeric>
+#include <stdlib.h>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+// Count the allocations of the benchmarks. The other forms of operator new
+// and delete are implemented in terms of these.
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+uint64_t benchmark::AllocationCount()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
 
 void benchmark::ConsolePrinter::header()
 {
-    std::cout << "# Benchmark, evals, iterations, total, min, max, median" << std::endl;
+    std::cout << "# Benchmark, evals, iterations, total, min, max, median, allocations" << std::endl;
 }
 
 void benchmark::ConsolePrinter::result(const State& state)
@@ -38,8 +67,13 @@ void benchmark::ConsolePrinter::result(const State& state)
         }
     }
 
+    double allocations = 0;
+    if (!results.empty()) {
+        allocations = (double)state.m_allocations / (state.m_num_iters * results.size());
+    }
+
     std::cout << std::setprecision(6);
-    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << std::endl;
+    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << ", " << allocations << std::endl;
 }
 
 void benchmark::ConsolePrinter::footer() {}
@@ -129,6 +163,7 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
 bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
 {
     if (m_start_time != time_point()) {
+        m_allocations += AllocationCount() - m_start_allocations;
         std::chrono::duration<double> diff = current_time - m_start_time;
         m_elapsed_results.push_back(diff.count() / m_num_iters);
 
@@ -51,6 +51,9 @@ using duration = clock::duration;
 
 class Printer;
 
+//! Number of heap allocations through operator new so far
+uint64_t AllocationCount();
+
 class State
 {
 public:
@@ -60,6 +63,9 @@ public:
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
     time_point m_start_time;
+    //! Heap allocations of all the measured iterations
+    uint64_t m_allocations = 0;
+    uint64_t m_start_allocations = 0;
 
     bool UpdateTimer(time_point finish_time);
 
@@ -76,6 +82,7 @@ public:
         bool result = UpdateTimer(clock::now());
         // measure again so runtime of UpdateTimer is not included
         m_start_time = clock::now();
+        m_start_allocations = AllocationCount();
         return result;
     }
 };
@@ -107,7 +114,7 @@ public:
     virtual void footer() = 0;
 };
 
-// default printer to console, shows min, max, median.
+// default printer to console, shows min, max, median, and the allocations per iteration.
 class ConsolePrinter : public Printer
 {
 public:
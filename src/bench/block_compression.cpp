@@ -0,0 +1,37 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <blockcompression.h>
+
+#include <cassert>
+#include <vector>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+static void CompressBlock(benchmark::State& state)
+{
+    const Span<const unsigned char> block(block_bench::block413567, sizeof(block_bench::block413567));
+    std::vector<unsigned char> record;
+    while (state.KeepRunning()) {
+        CompressBlockRecord(block, record);
+    }
+}
+
+static void DecompressBlock(benchmark::State& state)
+{
+    const Span<const unsigned char> block(block_bench::block413567, sizeof(block_bench::block413567));
+    std::vector<unsigned char> record;
+    assert(CompressBlockRecord(block, record));
+    std::vector<unsigned char> data;
+    while (state.KeepRunning()) {
+        assert(DecompressBlockRecord(Span<const unsigned char>(record.data(), record.size()), data));
+    }
+}
+
+BENCHMARK(CompressBlock, 100);
+BENCHMARK(DecompressBlock, 500);
@@ -6,6 +6,7 @@
 
 #include <chainparams.h>
 #include <validation.h>
+#include <primitives/view.h>
 #include <streams.h>
 #include <consensus/validation.h>
 
@@ -55,5 +56,21 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// Parse the block into a view instead, and compute the same hashes of its
+// transactions as deserializing it does.
+static void ParseBlockViewTest(benchmark::State& state)
+{
+    const Span<const unsigned char> data(block_bench::block413567, sizeof(block_bench::block413567));
+
+    while (state.KeepRunning()) {
+        BlockView block(data);
+        for (const TransactionView& tx : block.GetTransactions()) {
+            tx.GetHash();
+            tx.GetWitnessHash();
+        }
+    }
+}
+
 BENCHMARK(DeserializeBlockTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
+BENCHMARK(ParseBlockViewTest, 130);
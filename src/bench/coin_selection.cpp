@@ -6,6 +6,7 @@
 #include <wallet/wallet.h>
 #include <wallet/coinselection.h>
 
+#include <map>
 #include <set>
 
 static void addCoin(const CAmount& nValue, const CWallet& wallet, std::vector<OutputGroup>& groups)
@@ -102,5 +103,68 @@ static void BnBExhaustion(benchmark::State& state)
     }
 }
 
+// Pool resembling the wallet of an exchange: mostly small customer deposits,
+// some medium sized ones and a few large consolidated outputs. All outputs
+// are P2PKH-sized inputs so that effective values are below their values.
+static const std::vector<OutputGroup>& ExchangePool(size_t utxos)
+{
+    static std::map<size_t, std::vector<OutputGroup>> pools;
+    std::vector<OutputGroup>& groups = pools[utxos];
+    if (!groups.empty()) return groups;
+
+    FastRandomContext rand(true);
+    CMutableTransaction tx;
+    tx.vout.resize(utxos);
+    for (CTxOut& txout : tx.vout) {
+        const uint64_t kind = rand.randrange(100);
+        if (kind < 90) {
+            txout.nValue = COIN / 1000 + rand.randrange(COIN);
+        } else if (kind < 99) {
+            txout.nValue = COIN + rand.randrange(100 * COIN);
+        } else {
+            txout.nValue = 100 * COIN + rand.randrange(10000 * COIN);
+        }
+    }
+    const CTransactionRef ptx = MakeTransactionRef(std::move(tx));
+    groups.reserve(utxos);
+    for (size_t i = 0; i < utxos; ++i) {
+        groups.emplace_back(CInputCoin(ptx, i, 148), 6, false, 0, 0);
+    }
+    return groups;
+}
+
+static void LargePoolSelection(benchmark::State& state, size_t utxos, bool use_bnb)
+{
+    const CWallet wallet("dummy", WalletDatabase::CreateDummy());
+    LOCK(wallet.cs_wallet);
+    const std::vector<OutputGroup>& groups = ExchangePool(utxos);
+
+    const CoinEligibilityFilter filter_standard(1, 6, 0);
+    const CoinSelectionParams coin_selection_params(use_bnb, 34, 148, CFeeRate(10000), 10);
+    FastRandomContext rand(true);
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool bnb_used;
+        // Payouts between 0.1 and 50 coins; BnB does not always find a changeless solution
+        const CAmount target = COIN / 10 + rand.randrange(50 * COIN);
+        bool success = wallet.SelectCoinsMinConf(target, filter_standard, groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used);
+        assert(success || use_bnb);
+    }
+}
+
+static void BnBLargePool10k(benchmark::State& state) { LargePoolSelection(state, 10000, true); }
+static void BnBLargePool100k(benchmark::State& state) { LargePoolSelection(state, 100000, true); }
+static void BnBLargePool1M(benchmark::State& state) { LargePoolSelection(state, 1000000, true); }
+static void KnapsackLargePool10k(benchmark::State& state) { LargePoolSelection(state, 10000, false); }
+static void KnapsackLargePool100k(benchmark::State& state) { LargePoolSelection(state, 100000, false); }
+static void KnapsackLargePool1M(benchmark::State& state) { LargePoolSelection(state, 1000000, false); }
+
 BENCHMARK(CoinSelection, 650);
 BENCHMARK(BnBExhaustion, 650);
+BENCHMARK(BnBLargePool10k, 50);
+BENCHMARK(BnBLargePool100k, 5);
+BENCHMARK(BnBLargePool1M, 1);
+BENCHMARK(KnapsackLargePool10k, 5);
+BENCHMARK(KnapsackLargePool100k, 1);
+BENCHMARK(KnapsackLargePool1M, 1);
@@ -0,0 +1,154 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <coins.h>
+#include <coinstrace.h>
+#include <fs.h>
+#include <random.h>
+#include <txdb.h>
+#include <util.h>
+
+#include <cassert>
+#include <vector>
+
+//! The best block of the coins written before a replay
+static const uint256 REPLAY_BASE_BLOCK = uint256S("01");
+
+/**
+ * Record a trace of simulated blocks, connected on top of 50000 existing
+ * coins: every block spends 1000 coins and adds 1200, through a child cache
+ * of the tip like ConnectBlock, and the tip is flushed every 50 blocks.
+ */
+static void RecordSimulatedTrace(const fs::path& path)
+{
+    FastRandomContext rng(true);
+    auto random_coin = [&](int height) {
+        static const size_t SCRIPT_SIZES[] = {22, 23, 25, 34};
+        const std::vector<unsigned char> script(SCRIPT_SIZES[rng.randrange(4)], 0x51);
+        return Coin(CTxOut(rng.randrange(100 * COIN), CScript(script.begin(), script.end())), height, false);
+    };
+
+    CCoinsView root;
+    CCoinsViewCache base(&root);
+    std::vector<COutPoint> coins;
+    for (int i = 0; i < 50000; ++i) {
+        coins.emplace_back(rng.rand256(), rng.randrange(3));
+        base.AddCoin(coins.back(), random_coin(rng.randrange(1000)), false);
+    }
+
+    CoinsTraceWriter trace(fsbridge::fopen(path, "wb"));
+    CCoinsViewCache tip(&base);
+    tip.SetTrace(&trace);
+    for (int height = 1000; height < 1200; ++height) {
+        CCoinsViewCache view(&tip);
+        for (int i = 0; i < 1000; ++i) {
+            const size_t pos = rng.randrange(coins.size());
+            bool spent = view.HaveCoin(coins[pos]) && view.SpendCoin(coins[pos]);
+            assert(spent);
+            coins[pos] = coins.back();
+            coins.pop_back();
+        }
+        const uint256 txid = rng.rand256();
+        for (int i = 0; i < 1200; ++i) {
+            coins.emplace_back(i % 100 ? txid : rng.rand256(), i);
+            view.AddCoin(coins.back(), random_coin(height), false);
+        }
+        view.SetBestBlock(rng.rand256());
+        view.Flush();
+        if (height % 50 == 49) tip.Flush();
+    }
+}
+
+/** The trace to replay: the one passed with -coinstrace, or a simulated one */
+static fs::path TracePath()
+{
+    if (gArgs.IsArgSet("-coinstrace")) return fs::path(gArgs.GetArg("-coinstrace", ""));
+    static const fs::path path = GetDataDir(false) / "coins.trace";
+    if (!fs::exists(path)) RecordSimulatedTrace(path);
+    return path;
+}
+
+/**
+ * Replay a coins trace through a UTXO cache on top of a fresh chainstate
+ * database, which starts out with the coins the trace read. With a cache
+ * size, the cache is flushed whenever it grows beyond it after a block, as
+ * FlushStateToDisk does, instead of when the trace recorded flushes. The cache
+ * is flushed at the end either way. Writing the initial coins is part of the
+ * measured time, and the same for every flush policy and database profile.
+ */
+static void ReplayCoinsTrace(benchmark::State& state, size_t cache_size, const DBOptions& db_options = DBOptions::Chainstate())
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const fs::path path = TracePath();
+
+    while (state.KeepRunning()) {
+        CCoinsViewDB db(8 << 20, false, true, db_options);
+        {
+            CoinsTraceReader reader(fsbridge::fopen(path, "rb"));
+            CCoinsMap coins;
+            ReadCoinsTraceBaseCoins(reader, [&](const COutPoint& outpoint, Coin&& coin) {
+                CCoinsCacheEntry& entry = coins[outpoint];
+                entry.coin = std::move(coin);
+                entry.flags = CCoinsCacheEntry::DIRTY;
+                if (coins.size() >= 100000) db.BatchWrite(coins, REPLAY_BASE_BLOCK);
+            });
+            db.BatchWrite(coins, REPLAY_BASE_BLOCK);
+        }
+
+        CCoinsViewCache tip(&db);
+        tip.SetBestBlock(REPLAY_BASE_BLOCK);
+        CoinsTraceReader reader(fsbridge::fopen(path, "rb"));
+        CoinsTraceEntry entry;
+        while (reader.Next(entry)) {
+            if (cache_size && entry.op == CoinsTraceOp::FLUSH) continue;
+            ReplayCoinsTraceEntry(tip, entry);
+            if (cache_size && entry.op == CoinsTraceOp::BATCH && tip.DynamicMemoryUsage() > cache_size) {
+                tip.Flush();
+            }
+        }
+        tip.Flush();
+    }
+}
+
+static void CoinsTraceReplay(benchmark::State& state)
+{
+    ReplayCoinsTrace(state, 0);
+}
+
+static void CoinsTraceReplay4MiB(benchmark::State& state)
+{
+    ReplayCoinsTrace(state, 4 << 20);
+}
+
+static void CoinsTraceReplay16MiB(benchmark::State& state)
+{
+    ReplayCoinsTrace(state, 16 << 20);
+}
+
+static void CoinsTraceReplayDefaultDbCache(benchmark::State& state)
+{
+    ReplayCoinsTrace(state, nDefaultDbCache << 20);
+}
+
+// The database profiles, under the flush policy that writes the most
+
+static void CoinsTraceReplay4MiBDefaultOptions(benchmark::State& state)
+{
+    ReplayCoinsTrace(state, 4 << 20, DBOptions());
+}
+
+static void CoinsTraceReplay4MiBBulkLoadOptions(benchmark::State& state)
+{
+    ReplayCoinsTrace(state, 4 << 20, DBOptions::ChainstateBulkLoad(32 << 20));
+}
+
+BENCHMARK(CoinsTraceReplay, 1);
+BENCHMARK(CoinsTraceReplay4MiB, 1);
+BENCHMARK(CoinsTraceReplay16MiB, 1);
+BENCHMARK(CoinsTraceReplayDefaultDbCache, 1);
+BENCHMARK(CoinsTraceReplay4MiBDefaultOptions, 1);
+BENCHMARK(CoinsTraceReplay4MiBBulkLoadOptions, 1);
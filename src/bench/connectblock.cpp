@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <crypto/sha256.h>
+#include <random.h>
+#include <script/script.h>
+#include <script/sigcache.h>
+#include <util.h>
+#include <validation.h>
+#include <versionbits.h>
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+//! Height of the tip the block is connected on
+static const int CONNECT_BLOCK_TIP_HEIGHT = 5000;
+
+/**
+ * Check a block of 1000 transactions, each spending three hash-locked coins,
+ * with ConnectBlock through TestBlockValidity, as getblocktemplate does. The
+ * block is connected on top of a chain of headers made up for it.
+ *
+ * The script execution cache is shrunk to its minimum, so the scripts of
+ * every transaction are run on every iteration.
+ */
+static void ConnectBlock(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const CChainParams& chainparams = Params();
+    gArgs.ForceSetArg("-maxsigcachesize", "0");
+    InitScriptExecutionCache();
+    FastRandomContext rng(true);
+
+    // The chain of block indexes, spaced so no deployment started
+    std::vector<uint256> hashes(CONNECT_BLOCK_TIP_HEIGHT + 1);
+    std::vector<CBlockIndex> chain(CONNECT_BLOCK_TIP_HEIGHT + 1);
+    for (int height = 0; height <= CONNECT_BLOCK_TIP_HEIGHT; ++height) {
+        hashes[height] = rng.rand256();
+        CBlockIndex& index = chain[height];
+        index.phashBlock = &hashes[height];
+        index.pprev = height > 0 ? &chain[height - 1] : nullptr;
+        index.nHeight = height;
+        index.nTime = chainparams.GenesisBlock().nTime + height * chainparams.GetConsensus().nPowTargetSpacing;
+        index.nBits = UintToArith256(chainparams.GetConsensus().powLimit).GetCompact();
+        index.BuildSkip();
+    }
+    CBlockIndex* tip = &chain.back();
+
+    CCoinsView root;
+    std::unique_ptr<CCoinsViewCache> coins(new CCoinsViewCache(&root));
+    CBlock block;
+    block.nVersion = VERSIONBITS_TOP_BITS;
+    block.hashPrevBlock = tip->GetBlockHash();
+    block.nTime = tip->nTime + chainparams.GetConsensus().nPowTargetSpacing;
+    block.nBits = tip->nBits;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.emplace_back();
+    coinbase.vin[0].scriptSig = CScript() << (CONNECT_BLOCK_TIP_HEIGHT + 1) << OP_0;
+    coinbase.vout.emplace_back(0, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < 1000; ++i) {
+        CMutableTransaction tx;
+        for (int j = 0; j < 3; ++j) {
+            const uint256 preimage = rng.rand256();
+            uint256 hash;
+            CSHA256().Write(preimage.begin(), preimage.size()).Finalize(hash.begin());
+            const COutPoint prevout(rng.rand256(), j);
+            const CScript script_pub_key = CScript() << OP_SHA256 << ToByteVector(hash) << OP_EQUAL;
+            coins->AddCoin(prevout, Coin(CTxOut(COIN, script_pub_key), 1, false), false);
+            tx.vin.emplace_back(prevout, CScript() << ToByteVector(preimage));
+        }
+        for (int j = 0; j < 2; ++j) {
+            tx.vout.emplace_back(COIN, CScript() << OP_DUP << OP_HASH160 << rng.randbytes(20) << OP_EQUALVERIFY << OP_CHECKSIG);
+        }
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    coins->SetBestBlock(tip->GetBlockHash());
+
+    {
+        LOCK(cs_main);
+        pcoinsTip = std::move(coins);
+        chainActive.SetTip(tip);
+        while (state.KeepRunning()) {
+            CValidationState validation_state;
+            bool valid = TestBlockValidity(validation_state, chainparams, block, tip, false, true);
+            assert(valid);
+        }
+        chainActive.SetTip(nullptr);
+        pcoinsTip.reset();
+        versionbitscache.Clear();
+    }
+
+    gArgs.ForceSetArg("-maxsigcachesize", std::to_string(DEFAULT_MAX_SIG_CACHE_SIZE));
+    InitScriptExecutionCache();
+}
+
+BENCHMARK(ConnectBlock, 40);
@@ -0,0 +1,183 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <coins.h>
+#include <dbwrapper.h>
+#include <random.h>
+#include <txdb.h>
+#include <uint256.h>
+#include <util.h>
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+/**
+ * A coins database workload, against a database with the given options. It
+ * starts out with 100000 coins, and every iteration is a block: 1000 coins are
+ * read and spent, 1200 new outputs are looked up before being added, and the
+ * changes are written in one batch.
+ */
+static void CoinsDBWorkload(benchmark::State& state, const DBOptions& db_options)
+{
+    const fs::path path = GetDataDir(false) / fs::unique_path();
+    {
+        CDBWrapper db(path, 8 << 20, false, false, true, db_options);
+        FastRandomContext rng(true);
+        std::vector<uint256> coins;
+        for (int i = 0; i < 20; ++i) {
+            CDBBatch batch(db);
+            for (int j = 0; j < 5000; ++j) {
+                coins.push_back(rng.rand256());
+                batch.Write(std::make_pair('C', coins.back()), rng.randbytes(40));
+            }
+            db.WriteBatch(batch);
+        }
+
+        std::vector<unsigned char> value;
+        while (state.KeepRunning()) {
+            CDBBatch batch(db);
+            for (int i = 0; i < 1000; ++i) {
+                const size_t pos = rng.randrange(coins.size());
+                bool found = db.Read(std::make_pair('C', coins[pos]), value);
+                assert(found);
+                batch.Erase(std::make_pair('C', coins[pos]));
+                coins[pos] = coins.back();
+                coins.pop_back();
+            }
+            for (int i = 0; i < 1200; ++i) {
+                coins.push_back(rng.rand256());
+                bool found = db.Exists(std::make_pair('C', coins.back()));
+                assert(!found);
+                batch.Write(std::make_pair('C', coins.back()), rng.randbytes(40));
+            }
+            db.WriteBatch(batch);
+        }
+    }
+    fs::remove_all(path);
+}
+
+static void CoinsDBDefaultOptions(benchmark::State& state)
+{
+    CoinsDBWorkload(state, DBOptions());
+}
+
+static void CoinsDBChainstateOptions(benchmark::State& state)
+{
+    CoinsDBWorkload(state, DBOptions::Chainstate());
+}
+
+/**
+ * Loading the block index at startup, which iterates over all of it: every
+ * iteration reads the 200000 entries of a database written beforehand.
+ */
+static void BlockIndexDBLoad(benchmark::State& state, const DBOptions& db_options)
+{
+    const fs::path path = GetDataDir(false) / fs::unique_path();
+    {
+        CDBWrapper db(path, 8 << 20, false, false, false, db_options);
+        FastRandomContext rng(true);
+        for (int i = 0; i < 20; ++i) {
+            CDBBatch batch(db);
+            for (int j = 0; j < 10000; ++j) {
+                // About the size of a serialized CDiskBlockIndex
+                batch.Write(std::make_pair('b', rng.rand256()), rng.randbytes(110));
+            }
+            db.WriteBatch(batch);
+        }
+        db.CompactRange(std::make_pair('b', uint256()), std::make_pair('c', uint256()));
+
+        std::vector<unsigned char> value;
+        while (state.KeepRunning()) {
+            std::unique_ptr<CDBIterator> it(db.NewIterator());
+            size_t count = 0;
+            for (it->Seek(std::make_pair('b', uint256())); it->Valid(); it->Next()) {
+                std::pair<char, uint256> key;
+                if (!it->GetKey(key) || key.first != 'b') break;
+                bool read = it->GetValue(value);
+                assert(read);
+                ++count;
+            }
+            assert(count == 200000);
+        }
+    }
+    fs::remove_all(path);
+}
+
+static void BlockIndexDBLoadDefaultOptions(benchmark::State& state)
+{
+    BlockIndexDBLoad(state, DBOptions());
+}
+
+static void BlockIndexDBLoadBlockIndexOptions(benchmark::State& state)
+{
+    BlockIndexDBLoad(state, DBOptions::BlockIndex());
+}
+
+/**
+ * Building a coins database from scratch, as -reindex-chainstate does: every
+ * iteration is a flush of the UTXO cache, which adds 50000 coins and spends
+ * 30000 of those added by earlier flushes.
+ */
+static void CoinsDBBuild(benchmark::State& state, const DBOptions& db_options)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    CCoinsViewDB db(8 << 20, false, true, db_options);
+    FastRandomContext rng(true);
+    const std::vector<unsigned char> script(25, 0x51);
+    std::vector<COutPoint> coins;
+    while (state.KeepRunning()) {
+        CCoinsMap map;
+        for (int i = 0; i < 30000 && !coins.empty(); ++i) {
+            const size_t pos = rng.randrange(coins.size());
+            map[coins[pos]].flags = CCoinsCacheEntry::DIRTY;
+            coins[pos] = coins.back();
+            coins.pop_back();
+        }
+        for (int i = 0; i < 50000; ++i) {
+            coins.emplace_back(rng.rand256(), rng.randrange(4));
+            CCoinsCacheEntry& entry = map[coins.back()];
+            entry.coin = Coin(CTxOut(rng.randrange(100 * COIN), CScript(script.begin(), script.end())), 1, false);
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+        }
+        bool written = db.BatchWrite(map, rng.rand256());
+        assert(written);
+    }
+}
+
+static void CoinsDBBuildChainstateOptions(benchmark::State& state)
+{
+    CoinsDBBuild(state, DBOptions::Chainstate());
+}
+
+static void CoinsDBBuildBulkLoadOptions(benchmark::State& state)
+{
+    CoinsDBBuild(state, DBOptions::ChainstateBulkLoad(32 << 20));
+}
+
+static void CoinsDBBuildSortedWrites(benchmark::State& state)
+{
+    DBOptions db_options = DBOptions::Chainstate();
+    db_options.sorted_writes = true;
+    CoinsDBBuild(state, db_options);
+}
+
+static void CoinsDBBuildLargeWriteBuffer(benchmark::State& state)
+{
+    DBOptions db_options = DBOptions::ChainstateBulkLoad(32 << 20);
+    db_options.sorted_writes = false;
+    CoinsDBBuild(state, db_options);
+}
+
+BENCHMARK(CoinsDBDefaultOptions, 20);
+BENCHMARK(CoinsDBChainstateOptions, 20);
+BENCHMARK(BlockIndexDBLoadDefaultOptions, 20);
+BENCHMARK(BlockIndexDBLoadBlockIndexOptions, 20);
+BENCHMARK(CoinsDBBuildChainstateOptions, 30);
+BENCHMARK(CoinsDBBuildBulkLoadOptions, 30);
+BENCHMARK(CoinsDBBuildSortedWrites, 30);
+BENCHMARK(CoinsDBBuildLargeWriteBuffer, 30);
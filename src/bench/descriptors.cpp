@@ -0,0 +1,49 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <key.h>
+#include <script/descriptor.h>
+#include <script/sign.h>
+#include <script/standard.h>
+
+#include <memory>
+#include <vector>
+
+static const int RANGE = 1000;
+
+static std::unique_ptr<Descriptor> ParseBenchDescriptor(FlatSigningProvider& provider)
+{
+    // Extended key decoding depends on the selected chain
+    SelectParams(CBaseChainParams::MAIN);
+    return Parse("wpkh(xpub69H7F5d8KSRgmmdJg2KhpAK8SR3DjMwAdkxj3ZuxV27CprR9LgpeyGmXUbC6wb7ERfvrnKZjXoUmmDznezpbZb7ap6r1D3tgFxHmwMkQTPH/1/2/*)", provider);
+}
+
+// Expanding a ranged descriptor one position at a time, as scantxoutset used to.
+static void ExpandDescriptor(benchmark::State& state)
+{
+    FlatSigningProvider provider;
+    const std::unique_ptr<Descriptor> desc = ParseBenchDescriptor(provider);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < RANGE; ++i) {
+            std::vector<CScript> scripts;
+            desc->Expand(i, provider, scripts, provider);
+        }
+    }
+}
+
+// Expanding the same range with ExpandRange.
+static void ExpandDescriptorRange(benchmark::State& state)
+{
+    FlatSigningProvider provider;
+    const std::unique_ptr<Descriptor> desc = ParseBenchDescriptor(provider);
+    while (state.KeepRunning()) {
+        std::vector<CScript> scripts;
+        ExpandRange(*desc, 0, RANGE, provider, scripts, provider);
+    }
+}
+
+BENCHMARK(ExpandDescriptor, 5);
+BENCHMARK(ExpandDescriptorRange, 5);
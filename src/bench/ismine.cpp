@@ -0,0 +1,40 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <keystore.h>
+#include <random.h>
+#include <script/ismine.h>
+#include <script/standard.h>
+
+#include <vector>
+
+static CScript RandomP2WPKH(FastRandomContext& rng)
+{
+    const std::vector<unsigned char> hash = rng.randbytes(20);
+    return GetScriptForDestination(WitnessV0KeyHash(uint160(hash)));
+}
+
+// Matching the outputs of a block against a keystore with many watch-only
+// scripts, of which none are mine.
+static void IsMineWatchOnly(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    CBasicKeyStore keystore;
+    for (int i = 0; i < 100000; ++i) {
+        keystore.AddWatchOnly(GetScriptForDestination(CScriptID(uint160(rng.randbytes(20)))));
+    }
+    std::vector<CScript> outputs;
+    for (int i = 0; i < 1000; ++i) {
+        outputs.push_back(RandomP2WPKH(rng));
+    }
+
+    while (state.KeepRunning()) {
+        for (const CScript& script : outputs) {
+            assert(IsMine(keystore, script) == ISMINE_NO);
+        }
+    }
+}
+
+BENCHMARK(IsMineWatchOnly, 100);
@@ -0,0 +1,126 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <core_io.h>
+#include <primitives/block.h>
+#include <rpc/jsonstream.h>
+#include <streams.h>
+#include <version.h>
+
+#include <univalue.h>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// Representative RPC payloads derived from the benchmark block:
+// - the decoded transactions, as returned by getblock with verbosity 2
+//   or by a batch of decoderawtransaction calls;
+// - a batch of sendrawtransaction requests carrying the hex transactions.
+
+static CBlock LoadBenchBlock()
+{
+    // Address encoding in TxToUniv depends on the selected chain
+    SelectParams(CBaseChainParams::MAIN);
+
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    return block;
+}
+
+static UniValue DecodedTransactions(const CBlock& block)
+{
+    UniValue txs(UniValue::VARR);
+    for (const auto& tx : block.vtx) {
+        UniValue objTx(UniValue::VOBJ);
+        TxToUniv(*tx, uint256(), objTx, true);
+        txs.push_back(objTx);
+    }
+    return txs;
+}
+
+static UniValue SendRawTransactionBatch(const CBlock& block)
+{
+    UniValue batch(UniValue::VARR);
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        UniValue params(UniValue::VARR);
+        params.push_back(EncodeHexTx(*block.vtx[i]));
+        UniValue request(UniValue::VOBJ);
+        request.pushKV("jsonrpc", "1.0");
+        request.pushKV("id", (int64_t)i);
+        request.pushKV("method", "sendrawtransaction");
+        request.pushKV("params", params);
+        batch.push_back(request);
+    }
+    return batch;
+}
+
+static void JsonWriteDecodedBlock(benchmark::State& state)
+{
+    const UniValue txs = DecodedTransactions(LoadBenchBlock());
+    while (state.KeepRunning()) {
+        std::string json = txs.write();
+        assert(!json.empty());
+    }
+}
+
+// The writer RPC replies go through
+static void JsonWriteDecodedBlockRPC(benchmark::State& state)
+{
+    const UniValue txs = DecodedTransactions(LoadBenchBlock());
+    while (state.KeepRunning()) {
+        std::string json = WriteJSON(txs);
+        assert(!json.empty());
+    }
+}
+
+static void JsonReadDecodedBlock(benchmark::State& state)
+{
+    const std::string json = DecodedTransactions(LoadBenchBlock()).write();
+    while (state.KeepRunning()) {
+        UniValue txs;
+        assert(txs.read(json));
+    }
+}
+
+// The parser JSON-RPC requests go through
+static void JsonReadDecodedBlockRPC(benchmark::State& state)
+{
+    const std::string json = DecodedTransactions(LoadBenchBlock()).write();
+    while (state.KeepRunning()) {
+        UniValue txs;
+        assert(ReadJSON(json, txs));
+    }
+}
+
+static void JsonReadRawTransactionBatch(benchmark::State& state)
+{
+    const std::string json = SendRawTransactionBatch(LoadBenchBlock()).write();
+    while (state.KeepRunning()) {
+        UniValue batch;
+        assert(batch.read(json));
+    }
+}
+
+static void JsonReadRawTransactionBatchRPC(benchmark::State& state)
+{
+    const std::string json = SendRawTransactionBatch(LoadBenchBlock()).write();
+    while (state.KeepRunning()) {
+        UniValue batch;
+        assert(ReadJSON(json, batch));
+    }
+}
+
+BENCHMARK(JsonWriteDecodedBlock, 25);
+BENCHMARK(JsonWriteDecodedBlockRPC, 25);
+BENCHMARK(JsonReadDecodedBlock, 10);
+BENCHMARK(JsonReadDecodedBlockRPC, 10);
+BENCHMARK(JsonReadRawTransactionBatch, 60);
+BENCHMARK(JsonReadRawTransactionBatchRPC, 60);
@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <key.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/standard.h>
+#include <validation.h>
+#include <wallet/blockdispatcher.h>
+#include <wallet/wallet.h>
+
+#include <memory>
+#include <vector>
+
+static const int BLOCK_TXS = 500;
+static const int KEYS_PER_WALLET = 100;
+
+static CScript RandomScript()
+{
+    const uint256 hash = GetRandHash();
+    return GetScriptForDestination(WitnessV0KeyHash(uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20))));
+}
+
+/** A block of BLOCK_TXS random transactions, a few of which pay to the wallets. */
+static std::shared_ptr<const CBlock> MakeBlock(const std::vector<CPubKey>& wallet_keys)
+{
+    auto block = std::make_shared<CBlock>();
+    for (int i = 0; i < BLOCK_TXS; ++i) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(GetRandHash(), 0);
+        tx.vout.emplace_back(COIN, RandomScript());
+        tx.vout.emplace_back(COIN, RandomScript());
+        if (i % 100 == 0) {
+            tx.vout[1].scriptPubKey = GetScriptForDestination(WitnessV0KeyHash(wallet_keys[GetRand(wallet_keys.size())].GetID()));
+        }
+        block->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+static std::vector<std::shared_ptr<CWallet>> MakeWallets(int count, std::vector<CPubKey>& wallet_keys)
+{
+    std::vector<std::shared_ptr<CWallet>> wallets;
+    for (int i = 0; i < count; ++i) {
+        auto wallet = std::make_shared<CWallet>("dummy", WalletDatabase::CreateDummy());
+        LOCK(wallet->cs_wallet);
+        for (int j = 0; j < KEYS_PER_WALLET; ++j) {
+            CKey key;
+            key.MakeNewKey(true);
+            CPubKey pubkey = key.GetPubKey();
+            wallet->AddKeyPubKey(key, pubkey);
+            wallet->LearnRelatedScripts(pubkey, OutputType::P2SH_SEGWIT);
+            wallet_keys.push_back(pubkey);
+        }
+        wallets.push_back(wallet);
+    }
+    return wallets;
+}
+
+// Cost of connecting a block with every wallet registered for validation
+// notifications on its own: each wallet checks every transaction.
+static void WalletBlockConnected(benchmark::State& state, int wallet_count)
+{
+    std::vector<CPubKey> wallet_keys;
+    const std::vector<std::shared_ptr<CWallet>> wallets = MakeWallets(wallet_count, wallet_keys);
+    const std::shared_ptr<const CBlock> block = MakeBlock(wallet_keys);
+    const uint256 block_hash = block->GetHash();
+    CBlockIndex index;
+    index.phashBlock = &block_hash;
+    while (state.KeepRunning()) {
+        for (const std::shared_ptr<CWallet>& wallet : wallets) {
+            wallet->BlockConnected(block, &index, {});
+        }
+    }
+}
+
+// Cost of connecting the same block through a WalletBlockDispatcher, which
+// matches every transaction once for all wallets.
+static void WalletDispatcherBlockConnected(benchmark::State& state, int wallet_count)
+{
+    std::vector<CPubKey> wallet_keys;
+    const std::vector<std::shared_ptr<CWallet>> wallets = MakeWallets(wallet_count, wallet_keys);
+    const std::shared_ptr<const CBlock> block = MakeBlock(wallet_keys);
+    const uint256 block_hash = block->GetHash();
+    CBlockIndex index;
+    index.phashBlock = &block_hash;
+    WalletBlockDispatcher dispatcher;
+    for (const std::shared_ptr<CWallet>& wallet : wallets) {
+        dispatcher.AttachWallet(wallet);
+    }
+    while (state.KeepRunning()) {
+        dispatcher.BlockConnected(block, &index, {});
+    }
+    for (const std::shared_ptr<CWallet>& wallet : wallets) {
+        dispatcher.DetachWallet(wallet);
+    }
+}
+
+static void WalletBlockConnected1(benchmark::State& state) { WalletBlockConnected(state, 1); }
+static void WalletBlockConnected10(benchmark::State& state) { WalletBlockConnected(state, 10); }
+static void WalletBlockConnected100(benchmark::State& state) { WalletBlockConnected(state, 100); }
+static void WalletDispatcherBlockConnected1(benchmark::State& state) { WalletDispatcherBlockConnected(state, 1); }
+static void WalletDispatcherBlockConnected10(benchmark::State& state) { WalletDispatcherBlockConnected(state, 10); }
+static void WalletDispatcherBlockConnected100(benchmark::State& state) { WalletDispatcherBlockConnected(state, 100); }
+
+BENCHMARK(WalletBlockConnected1, 20);
+BENCHMARK(WalletBlockConnected10, 2);
+BENCHMARK(WalletBlockConnected100, 1);
+BENCHMARK(WalletDispatcherBlockConnected1, 20);
+BENCHMARK(WalletDispatcherBlockConnected10, 20);
+BENCHMARK(WalletDispatcherBlockConnected100, 20);
@@ -0,0 +1,65 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcompression.h>
+
+#include <crypto/common.h>
+#include <lz4.h>
+#include <serialize.h>
+
+DecompressedBlockCache g_decompressed_block_cache(DECOMPRESSED_BLOCK_CACHE_SIZE);
+
+bool CompressBlockRecord(Span<const unsigned char> block, std::vector<unsigned char>& record)
+{
+    record.resize(4);
+    WriteLE32(record.data(), block.size());
+    LZ4Compress(block, record);
+    return record.size() < (size_t)block.size();
+}
+
+bool DecompressBlockRecord(Span<const unsigned char> record, std::vector<unsigned char>& block)
+{
+    if (record.size() < 4) return false;
+    const uint32_t size = ReadLE32(record.data());
+    if (size > MAX_SIZE) return false;
+    block.resize(size);
+    return LZ4Decompress(record.subspan(4), MakeSpan(block));
+}
+
+static uint64_t CacheKey(const CDiskBlockPos& pos)
+{
+    return ((uint64_t)pos.nFile << 32) | pos.nPos;
+}
+
+DecompressedBlockCache::BlockData DecompressedBlockCache::Get(const CDiskBlockPos& pos)
+{
+    LOCK(m_cs);
+    auto it = m_index.find(CacheKey(pos));
+    if (it == m_index.end()) return nullptr;
+    m_blocks.splice(m_blocks.begin(), m_blocks, it->second);
+    return it->second->second;
+}
+
+void DecompressedBlockCache::Insert(const CDiskBlockPos& pos, BlockData block)
+{
+    const uint64_t key = CacheKey(pos);
+    LOCK(m_cs);
+    if (block->size() > m_max_bytes || m_index.count(key)) return;
+    m_bytes += block->size();
+    m_blocks.emplace_front(key, std::move(block));
+    m_index.emplace(key, m_blocks.begin());
+    while (m_bytes > m_max_bytes) {
+        m_bytes -= m_blocks.back().second->size();
+        m_index.erase(m_blocks.back().first);
+        m_blocks.pop_back();
+    }
+}
+
+void DecompressedBlockCache::Clear()
+{
+    LOCK(m_cs);
+    m_blocks.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCOMPRESSION_H
+#define BITCOIN_BLOCKCOMPRESSION_H
+
+#include <chain.h>
+#include <span.h>
+#include <sync.h>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/** Default for -blockcompression */
+static const bool DEFAULT_BLOCK_COMPRESSION = false;
+/** Flag in the size of a block file record whose data is compressed */
+static const uint32_t BLOCK_RECORD_COMPRESSED = 0x80000000;
+/** Size of the serialized blocks kept in the decompressed block cache */
+static const size_t DECOMPRESSED_BLOCK_CACHE_SIZE = 32 << 20;
+
+/**
+ * Compress a serialized block into the data of a block file record: the size
+ * of the block as 4 byte little endian, followed by the block compressed in
+ * the LZ4 block format. Every record can be decompressed on its own. Returns
+ * false if the block does not get smaller.
+ */
+bool CompressBlockRecord(Span<const unsigned char> block, std::vector<unsigned char>& record);
+
+/** Decompress the data of a compressed block file record into the serialized block */
+bool DecompressBlockRecord(Span<const unsigned char> record, std::vector<unsigned char>& block);
+
+/**
+ * The serialized blocks of recently read compressed block file records, so
+ * blocks requested repeatedly, such as new blocks served to peers, are only
+ * decompressed once. The least recently used blocks are evicted.
+ */
+class DecompressedBlockCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char>> BlockData;
+
+    explicit DecompressedBlockCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+    BlockData Get(const CDiskBlockPos& pos);
+    void Insert(const CDiskBlockPos& pos, BlockData block);
+    void Clear();
+
+private:
+    typedef std::list<std::pair<uint64_t, BlockData>> BlockList;
+
+    CCriticalSection m_cs;
+    const size_t m_max_bytes;
+    size_t m_bytes GUARDED_BY(m_cs) = 0;
+    //! Blocks, most recently used first
+    BlockList m_blocks GUARDED_BY(m_cs);
+    std::unordered_map<uint64_t, BlockList::iterator> m_index GUARDED_BY(m_cs);
+};
+
+/** Blocks the node recently decompressed */
+extern DecompressedBlockCache g_decompressed_block_cache;
+
+#endif // BITCOIN_BLOCKCOMPRESSION_H
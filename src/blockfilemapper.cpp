@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemapper.h>
+
+#include <util.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#include <windows.h>
+#endif
+
+BlockFileMapper g_block_file_mapper(DEFAULT_MAPPED_BLOCK_FILES);
+
+MappedFile::~MappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#else
+    UnmapViewOfFile(m_data);
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    const size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the file is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const unsigned char*>(data), size));
+#else
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file) return nullptr;
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    LARGE_INTEGER size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) {
+        mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    // The mapping stays valid after the file is closed
+    fclose(file);
+    if (!mapping) return nullptr;
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+        LogPrintf("Unable to map %s: error %u\n", path.string(), GetLastError());
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const unsigned char*>(data), size.QuadPart));
+#endif
+}
+
+std::shared_ptr<const MappedFile> BlockFileMapper::Get(const fs::path& path, size_t min_size)
+{
+    const std::string key = path.string();
+    LOCK(m_cs);
+    if (m_max_files == 0) return nullptr;
+
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_mappings.splice(m_mappings.begin(), m_mappings, it->second);
+        if (it->second->second->Size() >= min_size) return it->second->second;
+        // The file may have grown since it was mapped
+        m_mappings.erase(it->second);
+        m_index.erase(it);
+    }
+
+    std::shared_ptr<const MappedFile> mapping = MappedFile::Open(path);
+    if (!mapping) return nullptr;
+    m_mappings.emplace_front(key, mapping);
+    m_index.emplace(key, m_mappings.begin());
+    Evict();
+    if (mapping->Size() < min_size) return nullptr;
+    return mapping;
+}
+
+void BlockFileMapper::Release(const fs::path& path)
+{
+    LOCK(m_cs);
+    auto it = m_index.find(path.string());
+    if (it == m_index.end()) return;
+    m_mappings.erase(it->second);
+    m_index.erase(it);
+}
+
+void BlockFileMapper::Clear()
+{
+    LOCK(m_cs);
+    m_mappings.clear();
+    m_index.clear();
+}
+
+void BlockFileMapper::SetMaxFiles(size_t max_files)
+{
+    LOCK(m_cs);
+    m_max_files = max_files;
+    Evict();
+}
+
+void BlockFileMapper::Evict()
+{
+    AssertLockHeld(m_cs);
+    while (m_mappings.size() > m_max_files) {
+        m_index.erase(m_mappings.back().first);
+        m_mappings.pop_back();
+    }
+}
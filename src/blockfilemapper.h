@@ -0,0 +1,84 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAPPER_H
+#define BITCOIN_BLOCKFILEMAPPER_H
+
+#include <fs.h>
+#include <span.h>
+#include <sync.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/** Default for -mapblockfiles; mappings of whole block files need a 64-bit address space */
+static const int DEFAULT_MAPPED_BLOCK_FILES = sizeof(void*) >= 8 ? 64 : 0;
+
+/** A read-only memory mapping of a whole file. */
+class MappedFile
+{
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /** Map the file at path. Returns nullptr if it cannot be mapped, or is empty. */
+    static std::shared_ptr<const MappedFile> Open(const fs::path& path);
+
+    Span<const unsigned char> Data() const { return Span<const unsigned char>(m_data, m_size); }
+    size_t Size() const { return m_size; }
+
+private:
+    MappedFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+
+    const unsigned char* const m_data;
+    const size_t m_size;
+};
+
+/**
+ * Memory mappings of block and undo files, for reading blocks without opening
+ * and reading the file each time.
+ *
+ * Only files that are no longer truncated may be mapped: mapped bytes must not
+ * be cut off the end of the file while the mapping is in use. A file may still
+ * grow; a mapping that does not reach far enough is replaced by a new one.
+ *
+ * Up to a configured number of files are kept mapped, evicting the least
+ * recently used mapping. Readers hold on to the mapping they read from, so it
+ * is only unmapped once they are done with it.
+ */
+class BlockFileMapper
+{
+public:
+    explicit BlockFileMapper(size_t max_files) : m_max_files(max_files) {}
+
+    /** Get a mapping of the file at path that is at least min_size bytes long.
+     * Returns nullptr if mapping is disabled, or the file cannot be mapped or
+     * is shorter. */
+    std::shared_ptr<const MappedFile> Get(const fs::path& path, size_t min_size);
+    /** Stop keeping the file at path mapped, before it is removed */
+    void Release(const fs::path& path);
+    /** Stop keeping any file mapped */
+    void Clear();
+    /** Set the number of files to keep mapped; 0 disables mapping */
+    void SetMaxFiles(size_t max_files);
+
+private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<const MappedFile>>> MappingList;
+
+    CCriticalSection m_cs;
+    size_t m_max_files GUARDED_BY(m_cs);
+    //! Mappings, most recently used first
+    MappingList m_mappings GUARDED_BY(m_cs);
+    std::unordered_map<std::string, MappingList::iterator> m_index GUARDED_BY(m_cs);
+
+    void Evict() EXCLUSIVE_LOCKS_REQUIRED(m_cs);
+};
+
+/** Mappings of the node's block and undo files */
+extern BlockFileMapper g_block_file_mapper;
+
+#endif // BITCOIN_BLOCKFILEMAPPER_H
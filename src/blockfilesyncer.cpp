@@ -0,0 +1,108 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilesyncer.h>
+
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <functional>
+
+BlockFileSyncer g_block_file_syncer;
+
+BlockFileSyncer::~BlockFileSyncer()
+{
+    Stop();
+}
+
+bool BlockFileSyncer::SyncFile(const fs::path& path)
+{
+    int64_t nStart = GetTimeMicros();
+    FILE* file = fsbridge::fopen(path, "rb+");
+    if (!file) {
+        LogPrintf("%s: unable to open %s\n", __func__, path.string());
+        return false;
+    }
+    bool status = FileCommit(file);
+    fclose(file);
+    LogPrint(BCLog::BENCH, "    - Sync %s: %.2fms\n", path.filename().string(), (GetTimeMicros() - nStart) * 0.001);
+    return status;
+}
+
+void BlockFileSyncer::Sync(const fs::path& path)
+{
+    {
+        WaitableLock lock(m_mutex);
+        if (m_thread.joinable() && !m_stop) {
+            if (std::find(m_queue.begin(), m_queue.end(), path) == m_queue.end()) {
+                m_queue.push_back(path);
+                m_cond.notify_all();
+            }
+            return;
+        }
+    }
+    if (!SyncFile(path)) {
+        WaitableLock lock(m_mutex);
+        m_failed = true;
+    }
+}
+
+void BlockFileSyncer::SyncNext(WaitableLock& lock)
+{
+    fs::path path = std::move(m_queue.front());
+    m_queue.pop_front();
+    ++m_syncing;
+    lock.unlock();
+    bool status = SyncFile(path);
+    lock.lock();
+    --m_syncing;
+    if (!status) m_failed = true;
+    m_cond.notify_all();
+}
+
+bool BlockFileSyncer::Wait()
+{
+    WaitableLock lock(m_mutex);
+    while (!m_queue.empty()) {
+        SyncNext(lock);
+    }
+    m_cond.wait(lock, [this] { return m_syncing == 0; });
+    bool status = !m_failed;
+    m_failed = false;
+    return status;
+}
+
+void BlockFileSyncer::ThreadSync()
+{
+    WaitableLock lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty()) break;
+        SyncNext(lock);
+    }
+}
+
+void BlockFileSyncer::Start()
+{
+    WaitableLock lock(m_mutex);
+    if (m_thread.joinable()) return;
+    m_stop = false;
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "blksync",
+                           std::bind(&BlockFileSyncer::ThreadSync, this));
+}
+
+void BlockFileSyncer::Stop()
+{
+    std::thread thread;
+    {
+        WaitableLock lock(m_mutex);
+        m_stop = true;
+        m_cond.notify_all();
+        thread = std::move(m_thread);
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
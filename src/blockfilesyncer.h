@@ -0,0 +1,60 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILESYNCER_H
+#define BITCOIN_BLOCKFILESYNCER_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <deque>
+#include <thread>
+
+/**
+ * Syncs block and undo files to disk on a background thread.
+ *
+ * Blocks and undo data are written to the files right away; only making them
+ * durable is deferred. Files are queued for syncing when they are finished or
+ * before the block index is written, and Wait() is a barrier for the data the
+ * block index is about to refer to, so validation only blocks on the disk when
+ * consistency requires it.
+ *
+ * Until the thread is started, and after it is stopped, files are synced when
+ * they are queued.
+ */
+class BlockFileSyncer
+{
+public:
+    ~BlockFileSyncer();
+
+    /** Queue the file at path to be synced to disk */
+    void Sync(const fs::path& path);
+    /** Wait until all queued files are synced, helping to sync them. Returns
+     * false if syncing any of them failed since the last call. */
+    bool Wait();
+
+    void Start();
+    /** Sync the remaining files and stop the thread */
+    void Stop();
+
+private:
+    CWaitableCriticalSection m_mutex;
+    CConditionVariable m_cond;
+    std::deque<fs::path> m_queue;
+    //! Number of files being synced outside of m_mutex
+    int m_syncing = 0;
+    bool m_failed = false;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    static bool SyncFile(const fs::path& path);
+    /** Sync the file at the front of the queue, releasing lock while syncing */
+    void SyncNext(WaitableLock& lock);
+    void ThreadSync();
+};
+
+/** Syncs the node's block and undo files */
+extern BlockFileSyncer g_block_file_syncer;
+
+#endif // BITCOIN_BLOCKFILESYNCER_H
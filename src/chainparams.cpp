@@ -59,6 +59,11 @@ void CChainParams::UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64
     consensus.vDeployments[d].nTimeout = nTimeout;
 }
 
+void CChainParams::UpdateAssumeutxoParameters(const uint256& block_hash, const AssumeutxoData& au_data)
+{
+    m_assumeutxo_data[block_hash] = au_data;
+}
+
 /**
  * Main network
  */
@@ -179,6 +184,11 @@ public:
             /* dTxRate  */ 0.334
         };
 
+        // UTXO snapshots allowed with -loadutxosnapshot, pinned from the
+        // output of dumptxoutset: {block hash, {txoutset_hash, nchaintx}}
+        m_assumeutxo_data = {
+        };
+
         /* disable fallback fee on mainnet */
         m_fallback_fee_enabled = false;
     }
@@ -271,6 +281,9 @@ public:
             /* dTxRate  */ 0
         };
 
+        m_assumeutxo_data = {
+        };
+
         /* enable fallback fee on testnet */
         m_fallback_fee_enabled = true;
     }
@@ -343,6 +356,9 @@ public:
             0
         };
 
+        m_assumeutxo_data = {
+        };
+
         base58Prefixes[PUBKEY_ADDRESS] = std::vector<unsigned char>(1,111);
         base58Prefixes[SCRIPT_ADDRESS] = std::vector<unsigned char>(1,196);
         base58Prefixes[SCRIPT_ADDRESS2] = std::vector<unsigned char>(1,58);
@@ -385,3 +401,8 @@ void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime,
 {
     globalChainParams->UpdateVersionBitsParameters(d, nStartTime, nTimeout);
 }
+
+void UpdateAssumeutxoParameters(const uint256& block_hash, const AssumeutxoData& au_data)
+{
+    globalChainParams->UpdateAssumeutxoParameters(block_hash, au_data);
+}
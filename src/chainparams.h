@@ -11,6 +11,7 @@
 #include <primitives/block.h>
 #include <protocol.h>
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -25,6 +26,20 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+/**
+ * What a UTXO snapshot of a block has to match to be loaded, see
+ * -loadutxosnapshot and dumptxoutset.
+ */
+struct AssumeutxoData {
+    //! The txoutset_hash dumptxoutset reports for the block
+    uint256 hash_serialized;
+    //! Total number of transactions up to and including the block
+    unsigned int nChainTx;
+};
+
+//! The UTXO snapshots that can be loaded, by the hash of their block
+typedef std::map<uint256, AssumeutxoData> MapAssumeutxo;
+
 /**
  * Holds various statistics on transactions within a chain. Used to estimate
  * verification progress during chain sync.
@@ -81,7 +96,9 @@ public:
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    const MapAssumeutxo& Assumeutxo() const { return m_assumeutxo_data; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
+    void UpdateAssumeutxoParameters(const uint256& block_hash, const AssumeutxoData& au_data);
 protected:
     CChainParams() {}
 
@@ -100,6 +117,7 @@ protected:
     bool fMineBlocksOnDemand;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumeutxo m_assumeutxo_data;
     bool m_fallback_fee_enabled;
 };
 
@@ -127,4 +145,9 @@ void SelectParams(const std::string& chain);
  */
 void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
 
+/**
+ * Allows pinning the UTXO snapshot of a block, for tests.
+ */
+void UpdateAssumeutxoParameters(const uint256& block_hash, const AssumeutxoData& au_data);
+
 #endif // BITCOIN_CHAINPARAMS_H
@@ -197,6 +197,8 @@ public:
 };
 
 
+class CoinsTraceWriter;
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -211,6 +213,9 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Where the operations on this cache are recorded, if anywhere. */
+    CoinsTraceWriter* m_trace = nullptr;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -236,6 +241,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Like GetCoin(), but coins fetched from the backing CCoinsView are not
+     * added to this cache. Meant for bulk read-only queries that should not
+     * push the working set out of the cache.
+     */
+    bool PeekCoin(const COutPoint &outpoint, Coin &coin) const;
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -274,6 +286,9 @@ public:
      */
     void Uncache(const COutPoint &outpoint);
 
+    //! Record the operations on this cache to trace, or stop recording if nullptr
+    void SetTrace(CoinsTraceWriter* trace) { m_trace = trace; }
+
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
@@ -0,0 +1,254 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstrace.h>
+
+#include <clientversion.h>
+#include <compressor.h>
+#include <script/script.h>
+#include <serialize.h>
+#include <util.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+static const uint32_t COINS_TRACE_MAGIC = 0x63727463;
+static const uint32_t COINS_TRACE_VERSION = 1;
+
+//! Flag in the flags of a batch entry whose coin is unspent
+static const unsigned char BATCH_ENTRY_UNSPENT = 0x80;
+
+/** An outpoint, with its index as a VARINT */
+class TraceOutPoint
+{
+    COutPoint& m_outpoint;
+
+public:
+    explicit TraceOutPoint(COutPoint& outpoint) : m_outpoint(outpoint) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(m_outpoint.hash);
+        READWRITE(VARINT(m_outpoint.n));
+    }
+};
+
+/**
+ * The shape of a coin: its height and coinbase flag, its compressed amount
+ * and the size of its script. The script is read back as zeros.
+ */
+class TraceCoin
+{
+    Coin& m_coin;
+
+public:
+    explicit TraceCoin(Coin& coin) : m_coin(coin) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        uint32_t code = m_coin.nHeight * 2 + m_coin.fCoinBase;
+        uint64_t amount = CompressAmount(m_coin.out.nValue);
+        uint32_t script_size = m_coin.out.scriptPubKey.size();
+        s << VARINT(code) << VARINT(amount) << VARINT(script_size);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        uint32_t code = 0;
+        uint64_t amount = 0;
+        uint32_t script_size = 0;
+        s >> VARINT(code) >> VARINT(amount) >> VARINT(script_size);
+        if (script_size > MAX_SCRIPT_SIZE) {
+            throw std::ios_base::failure("Coin script too large");
+        }
+        m_coin.nHeight = code >> 1;
+        m_coin.fCoinBase = code & 1;
+        m_coin.out.nValue = DecompressAmount(amount);
+        m_coin.out.scriptPubKey.clear();
+        m_coin.out.scriptPubKey.resize(script_size);
+    }
+};
+
+} // namespace
+
+template <typename... Args>
+void CoinsTraceWriter::Write(const Args&... args)
+{
+    if (m_file.IsNull()) return;
+    try {
+        ::SerializeMany(m_file, args...);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Failed to write coins trace, recording stopped: %s\n", __func__, e.what());
+        m_file.fclose();
+    }
+}
+
+CoinsTraceWriter::CoinsTraceWriter(FILE* file) : m_file(file, SER_DISK, CLIENT_VERSION)
+{
+    Write(COINS_TRACE_MAGIC, COINS_TRACE_VERSION);
+}
+
+void CoinsTraceWriter::WriteOutPoint(CoinsTraceOp op, const COutPoint& outpoint)
+{
+    Write((uint8_t)op, TraceOutPoint(REF(outpoint)));
+}
+
+void CoinsTraceWriter::Read(const COutPoint& outpoint, const Coin& coin)
+{
+    Write((uint8_t)CoinsTraceOp::READ, TraceOutPoint(REF(outpoint)), TraceCoin(REF(coin)));
+}
+
+void CoinsTraceWriter::Add(const COutPoint& outpoint, const Coin& coin, bool possible_overwrite)
+{
+    Write((uint8_t)CoinsTraceOp::ADD, TraceOutPoint(REF(outpoint)), possible_overwrite, TraceCoin(REF(coin)));
+}
+
+void CoinsTraceWriter::BatchWrite(const CCoinsMap& coins, const uint256& hash_block)
+{
+    // Only dirty entries have an effect on the cache
+    uint64_t count = 0;
+    for (const auto& entry : coins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY) ++count;
+    }
+    Write((uint8_t)CoinsTraceOp::BATCH, hash_block, VARINT(count));
+    for (const auto& entry : coins) {
+        if (!(entry.second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        if (entry.second.coin.IsSpent()) {
+            Write(TraceOutPoint(REF(entry.first)), entry.second.flags);
+        } else {
+            Write(TraceOutPoint(REF(entry.first)), (unsigned char)(entry.second.flags | BATCH_ENTRY_UNSPENT), TraceCoin(REF(entry.second.coin)));
+        }
+    }
+}
+
+void CoinsTraceWriter::Flush()
+{
+    Write((uint8_t)CoinsTraceOp::FLUSH);
+}
+
+CoinsTraceReader::CoinsTraceReader(FILE* file) : m_file(file, SER_DISK, CLIENT_VERSION)
+{
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    try {
+        m_file >> magic >> version;
+    } catch (const std::ios_base::failure&) {
+        throw std::runtime_error("Not a coins trace");
+    }
+    if (magic != COINS_TRACE_MAGIC) {
+        throw std::runtime_error("Not a coins trace");
+    }
+    if (version != COINS_TRACE_VERSION) {
+        throw std::runtime_error(strprintf("Unsupported coins trace version %u", version));
+    }
+}
+
+bool CoinsTraceReader::Next(CoinsTraceEntry& entry)
+{
+    const int op = fgetc(m_file.Get());
+    if (op == EOF) return false;
+    entry.op = (CoinsTraceOp)op;
+    entry.batch.clear();
+    try {
+        switch (entry.op) {
+        case CoinsTraceOp::READ:
+            m_file >> TraceOutPoint(entry.outpoint) >> TraceCoin(entry.coin);
+            break;
+        case CoinsTraceOp::ADD:
+            m_file >> TraceOutPoint(entry.outpoint) >> entry.possible_overwrite >> TraceCoin(entry.coin);
+            break;
+        case CoinsTraceOp::FETCH:
+        case CoinsTraceOp::PEEK:
+        case CoinsTraceOp::SPEND:
+        case CoinsTraceOp::UNCACHE:
+            m_file >> TraceOutPoint(entry.outpoint);
+            break;
+        case CoinsTraceOp::BATCH: {
+            uint64_t count = 0;
+            m_file >> entry.hash_block >> VARINT(count);
+            for (uint64_t i = 0; i < count; ++i) {
+                COutPoint outpoint;
+                unsigned char flags;
+                m_file >> TraceOutPoint(outpoint) >> flags;
+                CCoinsCacheEntry cache_entry;
+                if (flags & BATCH_ENTRY_UNSPENT) {
+                    m_file >> TraceCoin(cache_entry.coin);
+                }
+                cache_entry.flags = flags & ~BATCH_ENTRY_UNSPENT;
+                entry.batch.emplace_back(outpoint, std::move(cache_entry));
+            }
+            break;
+        }
+        case CoinsTraceOp::FLUSH:
+            break;
+        default:
+            throw std::runtime_error(strprintf("Unknown coins trace operation %d", op));
+        }
+    } catch (const std::ios_base::failure& e) {
+        throw std::runtime_error(strprintf("Malformed coins trace: %s", e.what()));
+    }
+    return true;
+}
+
+void ReadCoinsTraceBaseCoins(CoinsTraceReader& reader, const std::function<void(const COutPoint&, Coin&&)>& fn)
+{
+    uint32_t min_added_height = std::numeric_limits<uint32_t>::max();
+    CoinsTraceEntry entry;
+    while (reader.Next(entry)) {
+        if (entry.op == CoinsTraceOp::READ) {
+            if (entry.coin.nHeight < min_added_height) fn(entry.outpoint, std::move(entry.coin));
+        } else if (entry.op == CoinsTraceOp::ADD) {
+            min_added_height = std::min<uint32_t>(min_added_height, entry.coin.nHeight);
+        } else if (entry.op == CoinsTraceOp::BATCH) {
+            for (const auto& coin : entry.batch) {
+                if (coin.second.coin.IsSpent()) continue;
+                min_added_height = std::min<uint32_t>(min_added_height, coin.second.coin.nHeight);
+            }
+        }
+    }
+}
+
+void ReplayCoinsTraceEntry(CCoinsViewCache& cache, CoinsTraceEntry& entry)
+{
+    switch (entry.op) {
+    case CoinsTraceOp::READ:
+        break;
+    case CoinsTraceOp::FETCH:
+        cache.AccessCoin(entry.outpoint);
+        break;
+    case CoinsTraceOp::PEEK: {
+        Coin coin;
+        cache.PeekCoin(entry.outpoint, coin);
+        break;
+    }
+    case CoinsTraceOp::ADD:
+        cache.AddCoin(entry.outpoint, std::move(entry.coin), entry.possible_overwrite);
+        break;
+    case CoinsTraceOp::SPEND:
+        cache.SpendCoin(entry.outpoint);
+        break;
+    case CoinsTraceOp::UNCACHE:
+        cache.Uncache(entry.outpoint);
+        break;
+    case CoinsTraceOp::BATCH: {
+        CCoinsMap coins;
+        for (auto& coin : entry.batch) {
+            coins.emplace(coin.first, std::move(coin.second));
+        }
+        cache.BatchWrite(coins, entry.hash_block);
+        break;
+    }
+    case CoinsTraceOp::FLUSH:
+        cache.Flush();
+        break;
+    }
+}
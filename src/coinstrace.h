@@ -0,0 +1,117 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTRACE_H
+#define BITCOIN_COINSTRACE_H
+
+#include <coins.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <uint256.h>
+
+#include <functional>
+#include <stdint.h>
+#include <stdio.h>
+#include <utility>
+#include <vector>
+
+/** Operations on a CCoinsViewCache recorded in a coins trace */
+enum class CoinsTraceOp : uint8_t {
+    //! A coin was read from the backing view into the cache
+    READ = 1,
+    //! GetCoin, HaveCoin or AccessCoin
+    FETCH = 2,
+    //! PeekCoin
+    PEEK = 3,
+    ADD = 4,
+    SPEND = 5,
+    UNCACHE = 6,
+    //! A child cache was flushed into the cache
+    BATCH = 7,
+    //! The cache was flushed into the backing view
+    FLUSH = 8,
+};
+
+/**
+ * Records the operations on a CCoinsViewCache to a file, so the access
+ * pattern of real validation can be replayed later, against other cache
+ * sizes and flush policies, without syncing the chain again.
+ *
+ * Coins are recorded only by their shape: height, coinbase flag, amount and
+ * script size, which is all that affects the cost of storing them. Recording
+ * stops, with an error logged, if the file cannot be written. Like the cache
+ * it is attached to, a writer is not thread-safe.
+ *
+ * The file starts with a header, followed by one entry per operation: the
+ * operation, and the outpoint, coin or batch of coins it applies to.
+ */
+class CoinsTraceWriter
+{
+public:
+    //! Takes ownership of the file
+    explicit CoinsTraceWriter(FILE* file);
+
+    void Read(const COutPoint& outpoint, const Coin& coin);
+    void Fetch(const COutPoint& outpoint) { WriteOutPoint(CoinsTraceOp::FETCH, outpoint); }
+    void Peek(const COutPoint& outpoint) { WriteOutPoint(CoinsTraceOp::PEEK, outpoint); }
+    void Add(const COutPoint& outpoint, const Coin& coin, bool possible_overwrite);
+    void Spend(const COutPoint& outpoint) { WriteOutPoint(CoinsTraceOp::SPEND, outpoint); }
+    void Uncache(const COutPoint& outpoint) { WriteOutPoint(CoinsTraceOp::UNCACHE, outpoint); }
+    void BatchWrite(const CCoinsMap& coins, const uint256& hash_block);
+    void Flush();
+
+private:
+    CAutoFile m_file;
+
+    void WriteOutPoint(CoinsTraceOp op, const COutPoint& outpoint);
+    template <typename... Args>
+    void Write(const Args&... args);
+};
+
+/** A recorded operation, as read back from a coins trace */
+struct CoinsTraceEntry {
+    CoinsTraceOp op;
+    COutPoint outpoint;
+    //! The coin read or added, with an empty script of the recorded size
+    Coin coin;
+    bool possible_overwrite = false;
+    uint256 hash_block;
+    //! The dirty entries of a batch
+    std::vector<std::pair<COutPoint, CCoinsCacheEntry>> batch;
+};
+
+/** Reads the operations recorded by a CoinsTraceWriter */
+class CoinsTraceReader
+{
+public:
+    /** Takes ownership of the file. Throws std::runtime_error if it is not a coins trace. */
+    explicit CoinsTraceReader(FILE* file);
+
+    /**
+     * Read the next entry. Returns false at the end of the trace, and throws
+     * std::runtime_error if the trace is malformed or truncated.
+     */
+    bool Next(CoinsTraceEntry& entry);
+
+private:
+    CAutoFile m_file;
+};
+
+/**
+ * Read a trace from the start, and call fn for each coin the backing view has
+ * to contain before it can be replayed: the coins read from the backing view,
+ * other than those the trace added itself. The trace adds coins at the
+ * heights of the blocks it connects, so those are told apart as coins at or
+ * above the lowest height added so far. Coins read repeatedly are passed
+ * repeatedly.
+ */
+void ReadCoinsTraceBaseCoins(CoinsTraceReader& reader, const std::function<void(const COutPoint&, Coin&&)>& fn);
+
+/**
+ * Apply a recorded operation to a cache. READ entries have no effect: they
+ * only tell which coins the backing view must contain for the replay.
+ */
+void ReplayCoinsTraceEntry(CCoinsViewCache& cache, CoinsTraceEntry& entry);
+
+#endif // BITCOIN_COINSTRACE_H
@@ -93,13 +93,28 @@ public:
 // using only serialization with and without witness data. As witness_size
 // is equal to total_size - stripped_size, this formula is identical to:
 // weight = (stripped_size * 3) + total_size.
+// Transactions cache both sizes, so these do not serialize them again.
 static inline int64_t GetTransactionWeight(const CTransaction& tx)
 {
-    return ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR - 1) + ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    return (int64_t)tx.GetStrippedSize() * (WITNESS_SCALE_FACTOR - 1) + tx.GetTotalSize();
 }
 static inline int64_t GetBlockWeight(const CBlock& block)
 {
-    return ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR - 1) + ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    // The header and the number of transactions are the same in both serializations
+    int64_t weight = (::GetSerializeSize(CBlockHeader(), SER_NETWORK, PROTOCOL_VERSION) + GetSizeOfCompactSize(block.vtx.size())) * WITNESS_SCALE_FACTOR;
+    for (const auto& tx : block.vtx) {
+        weight += GetTransactionWeight(*tx);
+    }
+    return weight;
+}
+/** The size of a block serialized without witness data */
+static inline int64_t GetBlockStrippedSize(const CBlock& block)
+{
+    int64_t size = ::GetSerializeSize(CBlockHeader(), SER_NETWORK, PROTOCOL_VERSION) + GetSizeOfCompactSize(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        size += tx->GetStrippedSize();
+    }
+    return size;
 }
 static inline int64_t GetTransactionInputWeight(const CTxIn& txin)
 {
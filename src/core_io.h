@@ -18,6 +18,18 @@ struct PartiallySignedTransaction;
 class uint256;
 class UniValue;
 
+/** Type tags of the compact binary encoding of UniValue, see EncodeBinaryUniv */
+enum BinaryUnivTag : unsigned char {
+    BINUNIV_NULL = 0,
+    BINUNIV_FALSE = 1,
+    BINUNIV_TRUE = 2,
+    BINUNIV_INT = 3, //!< int64_t, little endian
+    BINUNIV_NUM = 4, //!< any other number, as decimal string
+    BINUNIV_STR = 5, //!< string
+    BINUNIV_ARR = 6, //!< CompactSize count, followed by the values
+    BINUNIV_OBJ = 7, //!< CompactSize count, followed by key string and value pairs
+};
+
 // core_read.cpp
 CScript ParseScript(const std::string& s);
 std::string ScriptToAsmStr(const CScript& script, const bool fAttemptSighashDecode = false);
@@ -36,5 +48,11 @@ std::string SighashToStr(unsigned char sighash_type);
 void ScriptPubKeyToUniv(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 void ScriptToUniv(const CScript& script, UniValue& out, bool include_address);
 void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_hex = true, int serialize_flags = 0);
+/**
+ * Encode a UniValue compactly: a type tag (BinaryUnivTag) followed by the
+ * payload, using the same primitives as network serialization. Strings are
+ * length-prefixed byte arrays and may carry raw serialized objects.
+ */
+std::string EncodeBinaryUniv(const UniValue& value);
 
 #endif // BITCOIN_CORE_IO_H
@@ -182,7 +182,7 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
     entry.pushKV("txid", tx.GetHash().GetHex());
     entry.pushKV("hash", tx.GetWitnessHash().GetHex());
     entry.pushKV("version", tx.nVersion);
-    entry.pushKV("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    entry.pushKV("size", (int)tx.GetTotalSize());
     entry.pushKV("vsize", (GetTransactionWeight(tx) + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR);
     entry.pushKV("weight", GetTransactionWeight(tx));
     entry.pushKV("locktime", (int64_t)tx.nLockTime);
@@ -236,3 +236,50 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
         entry.pushKV("hex", EncodeHexTx(tx, serialize_flags)); // The hex-encoded transaction. Used the name "hex" to be consistent with the verbose output of "getrawtransaction".
     }
 }
+
+template <typename Stream>
+static void BinaryUnivToStream(Stream& s, const UniValue& value)
+{
+    int64_t n;
+    switch (value.getType()) {
+    case UniValue::VNULL:
+        s << (unsigned char)BINUNIV_NULL;
+        break;
+    case UniValue::VBOOL:
+        s << (unsigned char)(value.isTrue() ? BINUNIV_TRUE : BINUNIV_FALSE);
+        break;
+    case UniValue::VNUM:
+        // Only use the fixed size encoding if it reproduces the exact same text
+        if (ParseInt64(value.getValStr(), &n) && i64tostr(n) == value.getValStr()) {
+            s << (unsigned char)BINUNIV_INT << n;
+        } else {
+            s << (unsigned char)BINUNIV_NUM << value.getValStr();
+        }
+        break;
+    case UniValue::VSTR:
+        s << (unsigned char)BINUNIV_STR << value.getValStr();
+        break;
+    case UniValue::VARR:
+        s << (unsigned char)BINUNIV_ARR;
+        WriteCompactSize(s, value.size());
+        for (const UniValue& item : value.getValues()) {
+            BinaryUnivToStream(s, item);
+        }
+        break;
+    case UniValue::VOBJ:
+        s << (unsigned char)BINUNIV_OBJ;
+        WriteCompactSize(s, value.size());
+        for (size_t i = 0; i < value.size(); ++i) {
+            s << value.getKeys()[i];
+            BinaryUnivToStream(s, value.getValues()[i]);
+        }
+        break;
+    }
+}
+
+std::string EncodeBinaryUniv(const UniValue& value)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    BinaryUnivToStream(ss, value);
+    return ss.str();
+}
@@ -97,12 +97,47 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+DBOptions DBOptions::Chainstate()
+{
+    // Point lookups and batched writes, as the defaults assume. Replaying a
+    // coins trace (bench/coins_trace.cpp) is no faster with larger tables.
+    return DBOptions();
+}
+
+DBOptions DBOptions::ChainstateBulkLoad(size_t write_buffer_size)
+{
+    DBOptions db_options = Chainstate();
+    db_options.write_buffer_size = write_buffer_size;
+    db_options.sorted_writes = true;
+    return db_options;
+}
+
+DBOptions DBOptions::BlockIndex()
+{
+    DBOptions db_options;
+    // Iterated over, and hardly ever looked up by key: larger blocks and no
+    // bloom filters.
+    db_options.block_size = 64 << 10;
+    db_options.bloom_bits = 0;
+    return db_options;
+}
+
+DBOptions DBOptions::TxIndex()
+{
+    // Point lookups by txid, as the defaults assume
+    return DBOptions();
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const DBOptions& db_options)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.write_buffer_size = db_options.write_buffer_size ? db_options.write_buffer_size : nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_size = db_options.block_size;
+    options.max_file_size = db_options.max_file_size;
+    if (db_options.bloom_bits > 0) {
+        options.filter_policy = leveldb::NewBloomFilterPolicy(db_options.bloom_bits);
+    }
     options.compression = leveldb::kNoCompression;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -114,7 +149,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const DBOptions& db_options)
     : m_name(fs::basename(path))
 {
     penv = nullptr;
@@ -122,7 +157,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, db_options);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
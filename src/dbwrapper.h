@@ -27,6 +27,44 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB tuning of a database for its access pattern. The defaults are
+ * LevelDB's own, with a bloom filter.
+ */
+struct DBOptions
+{
+    //! Approximate size of the data packed into each table block
+    size_t block_size = 4 << 10;
+    //! Bits per key of the bloom filter of each table, or 0 for no filter
+    int bloom_bits = 10;
+    //! Size at which LevelDB starts a new table file
+    size_t max_file_size = 2 << 20;
+    //! Size of the in-memory table writes are collected in before they are
+    //! written out as a sorted table, or 0 for a quarter of the cache size
+    size_t write_buffer_size = 0;
+    //! Whether the coins database writes each flush of the UTXO cache in key
+    //! order, at the cost of sorting it first. The tables written are the same
+    //! either way, but LevelDB inserts runs of ascending keys into its
+    //! in-memory table faster: each insertion walks the same nodes as the one
+    //! before, which are still in the CPU cache.
+    bool sorted_writes = false;
+
+    /** For the coins database: random point lookups of small records */
+    static DBOptions Chainstate();
+    /**
+     * For the coins database while it is built from scratch: as Chainstate,
+     * with sorted writes and a write buffer of the given size. The larger
+     * buffer turns the flushes of the UTXO cache into fewer and larger level-0
+     * tables, which leaves LevelDB less to compact. On its own it slows down
+     * insertion into the in-memory table, which sorted writes make up for.
+     */
+    static DBOptions ChainstateBulkLoad(size_t write_buffer_size);
+    /** For the block index: read by iterating over all of it at startup */
+    static DBOptions BlockIndex();
+    /** For the transaction index: point lookups by txid */
+    static DBOptions TxIndex();
+};
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -220,8 +258,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] db_options  LevelDB tuning for the access pattern of the database.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const DBOptions& db_options = DBOptions());
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
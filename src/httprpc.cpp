@@ -5,8 +5,10 @@
 #include <httprpc.h>
 
 #include <chainparams.h>
+#include <core_io.h>
 #include <httpserver.h>
 #include <key_io.h>
+#include <rpc/jsonstream.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <random.h>
@@ -19,7 +21,7 @@
 
 #include <memory>
 
-#include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/algorithm/string.hpp> // boost::trim, boost::split
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
@@ -66,7 +68,56 @@ static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static std::unique_ptr<HTTPRPCTimerInterface> httpRPCTimerInterface;
 
-static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
+/** Content type with which clients request, and receive, replies in the
+ * binary encoding (see EncodeBinaryUniv) instead of JSON */
+static const char* BINARY_RPC_CONTENT_TYPE = "application/x-litecoin-rpc";
+
+bool AcceptsBinaryRPCReply(const std::string& accept)
+{
+    // Quality, in thousandths, of the binary encoding and of the most
+    // specific media range that covers JSON
+    int64_t binary_q = 0;
+    int64_t json_q = 0;
+    int json_specificity = 0;
+    std::vector<std::string> ranges;
+    boost::split(ranges, accept, boost::is_any_of(","));
+    for (const std::string& range : ranges) {
+        std::vector<std::string> params;
+        boost::split(params, range, boost::is_any_of(";"));
+        std::string type = boost::to_lower_copy(boost::trim_copy(params[0]));
+        int64_t q = 1000;
+        for (size_t i = 1; i < params.size(); ++i) {
+            std::string param = boost::trim_copy(params[i]);
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                if (!ParseFixedPoint(param.substr(2), 3, &q) || q > 1000) q = 0;
+            }
+        }
+        if (type == BINARY_RPC_CONTENT_TYPE) {
+            binary_q = q;
+        } else {
+            const int specificity = type == "application/json" ? 3 : type == "application/*" ? 2 : type == "*/*" ? 1 : 0;
+            if (specificity > json_specificity) {
+                json_specificity = specificity;
+                json_q = q;
+            }
+        }
+    }
+    return binary_q > 0 && binary_q >= json_q;
+}
+
+/** Send a reply in the encoding negotiated by the client */
+static void WriteRPCReply(HTTPRequest* req, int nStatus, const UniValue& reply, bool fBinary)
+{
+    if (fBinary) {
+        req->WriteHeader("Content-Type", BINARY_RPC_CONTENT_TYPE);
+        req->WriteReply(nStatus, EncodeBinaryUniv(reply));
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(nStatus, WriteJSON(reply) + "\n");
+    }
+}
+
+static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const JSONRPCRequest& jreq)
 {
     // Send error reply from json-rpc error object
     int nStatus = HTTP_INTERNAL_SERVER_ERROR;
@@ -77,10 +128,7 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     else if (code == RPC_METHOD_NOT_FOUND)
         nStatus = HTTP_NOT_FOUND;
 
-    std::string strReply = JSONRPCReply(NullUniValue, objError, id);
-
-    req->WriteHeader("Content-Type", "application/json");
-    req->WriteReply(nStatus, strReply);
+    WriteRPCReply(req, nStatus, JSONRPCReplyObj(NullUniValue, objError, jreq.id), jreq.fBinary);
 }
 
 //This function checks username and password against -rpcauth
@@ -144,6 +192,64 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+/**
+ * Execute a single request and send the JSON reply. Methods with large results
+ * may write them to a stream instead of returning them. The reply only
+ * switches to chunked encoding once the first chunk is full, so short results
+ * still go out in one piece. Errors before that point are thrown to the caller.
+ */
+static bool ExecJSONRPCStreaming(HTTPRequest* req, JSONRPCRequest& jreq)
+{
+    bool chunked = false;
+    JSONStreamWriter stream([req, &chunked](std::string&& chunk) {
+        if (!chunked) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReplyStart(HTTP_OK);
+            chunked = true;
+        }
+        if (!req->WriteReplyChunk(std::move(chunk))) {
+            // Stops the method; the reply is ended below
+            throw std::runtime_error("Client did not read the reply");
+        }
+    });
+    stream.BeginObject();
+    stream.Key("result");
+    const size_t nValuesBefore = stream.ValuesWritten();
+    jreq.stream = &stream;
+
+    UniValue result;
+    bool streamed;
+    try {
+        result = tableRPC.execute(jreq);
+        streamed = stream.ValuesWritten() != nValuesBefore;
+        if (streamed) {
+            stream.KeyValue("error", NullUniValue);
+            stream.KeyValue("id", jreq.id);
+            stream.EndObject();
+        }
+    } catch (...) {
+        if (!chunked) throw;
+        // Too late for an error reply; the client sees a truncated body
+        LogPrintf("ThreadRPCServer error while streaming reply to %s\n", jreq.peerAddr);
+        req->WriteReplyEnd();
+        return false;
+    }
+
+    if (!streamed) {
+        WriteRPCReply(req, HTTP_OK, JSONRPCReplyObj(result, NullUniValue, jreq.id), false);
+        return true;
+    }
+    std::string strReply = stream.TakeBuffer() + "\n";
+    if (chunked) {
+        req->WriteReplyChunk(std::move(strReply));
+        req->WriteReplyEnd();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strReply);
+    }
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -174,38 +280,41 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
+    // Clients opt in to the binary reply encoding through the Accept header
+    jreq.fBinary = AcceptsBinaryRPCReply(req->GetHeader("accept").second);
+
     try {
         // Parse request
         UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
+        if (!ReadJSON(req->ReadBody(), valRequest))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
         // Set the URI
         jreq.URI = req->GetURI();
 
-        std::string strReply;
+        UniValue reply;
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            if (!jreq.fBinary) {
+                return ExecJSONRPCStreaming(req, jreq);
+            }
             UniValue result = tableRPC.execute(jreq);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            reply = JSONRPCReplyObj(result, NullUniValue, jreq.id);
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
+            reply = JSONRPCExecBatch(jreq, valRequest.get_array());
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+        WriteRPCReply(req, HTTP_OK, reply, jreq.fBinary);
     } catch (const UniValue& objError) {
-        JSONErrorReply(req, objError, jreq.id);
+        JSONErrorReply(req, objError, jreq);
         return false;
     } catch (const std::exception& e) {
-        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq);
         return false;
     }
     return true;
@@ -32,4 +32,10 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Whether the Accept header of a request asks for replies in the binary
+ * encoding. The binary content type has to be listed explicitly, with a
+ * quality no lower than that of the most specific range covering JSON.
+ */
+bool AcceptsBinaryRPCReply(const std::string& accept);
+
 #endif
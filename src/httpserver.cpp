@@ -13,7 +13,10 @@
 #include <sync.h>
 #include <ui_interface.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -148,6 +151,10 @@ static WorkQueue<HTTPClosure>* workQueue = nullptr;
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 std::vector<evhttp_bound_socket *> boundSockets;
+//! Seconds a chunked reply waits for the client to read before giving up
+static int replyTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
+//! Set when the server is interrupted, to stop chunked replies waiting for clients
+static std::atomic<bool> replyInterrupted{false};
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -388,7 +395,9 @@ bool InitHTTPServer()
         return false;
     }
 
-    evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    replyTimeout = gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    replyInterrupted = false;
+    evhttp_set_timeout(http, replyTimeout);
     evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, nullptr);
@@ -454,6 +463,7 @@ void InterruptHTTPServer()
     }
     if (workQueue)
         workQueue->Interrupt();
+    replyInterrupted = true;
 }
 
 void StopHTTPServer()
@@ -527,12 +537,18 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStreaming(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStreaming) {
+        // A chunked reply that was abandoned half-way cannot be turned into an
+        // error reply anymore; end it so that the client sees a truncated body.
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -578,6 +594,21 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket after a reply was sent. This is the
+ * second part of the libevent workaround in http_request_cb.
+ */
+static void ReenableReading(evhttp_connection* conn)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -585,27 +616,126 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !replyStreaming && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
+        ReenableReading(conn);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+/* Chunked replies are sent in the same way: every part is handed to the main
+ * http thread in its own event. Events triggered from a single worker are
+ * processed in order, so the chunks arrive in the order they were written.
+ *
+ * The worker does not get ahead of the client by more than
+ * MAX_HTTP_REPLY_BYTES_PENDING: libevent calls back once it has written all
+ * the parts handed to it to the socket, and the worker waits for that before
+ * queueing more.
+ */
+struct HTTPReplyFlow
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    //! Bytes queued by the worker
+    uint64_t queued = 0;
+    //! Bytes handed to libevent by the main http thread
+    uint64_t handed = 0;
+    //! Bytes libevent has written to the socket
+    uint64_t sent = 0;
+};
+
+/** Called by libevent once everything handed to it was written to the socket */
+static void http_reply_chunk_sent_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyFlow* flow = static_cast<HTTPReplyFlow*>(arg);
+    {
+        std::lock_guard<std::mutex> lock(flow->mutex);
+        flow->sent = flow->handed;
+    }
+    flow->cond.notify_all();
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !replyStreaming && req);
+    replyFlow = std::make_shared<HTTPReplyFlow>();
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    replyStreaming = true;
+}
+
+bool HTTPRequest::WriteReplyChunk(std::string&& strChunk)
+{
+    assert(replyStreaming && req);
+    if (strChunk.empty()) {
+        // An empty chunk would terminate the chunked encoding
+        return true;
+    }
+    {
+        std::unique_lock<std::mutex> lock(replyFlow->mutex);
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(replyTimeout);
+        while (replyFlow->queued - replyFlow->sent > MAX_HTTP_REPLY_BYTES_PENDING) {
+            if (replyInterrupted || std::chrono::steady_clock::now() >= deadline) {
+                LogPrint(BCLog::HTTP, "Client %s did not read the reply, ending it early\n", GetPeer().ToString());
+                return false;
             }
+            // Wake up now and then to notice the server being interrupted
+            replyFlow->cond.wait_for(lock, std::chrono::milliseconds(100));
         }
+        replyFlow->queued += strChunk.size();
+    }
+    auto req_copy = req;
+    auto flow = replyFlow;
+    auto chunk = std::make_shared<std::string>(std::move(strChunk));
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, flow, chunk]{
+        struct evbuffer* evb = evbuffer_new();
+        assert(evb);
+        evbuffer_add(evb, chunk->data(), chunk->size());
+        {
+            std::lock_guard<std::mutex> lock(flow->mutex);
+            flow->handed += chunk->size();
+        }
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_chunk_sent_cb, flow.get());
+#else
+        // Without the callback the parts are only held back until they are
+        // handed to libevent.
+        evhttp_send_reply_chunk(req_copy, evb);
+        http_reply_chunk_sent_cb(nullptr, flow.get());
+#endif
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(replyStreaming && req);
+    auto req_copy = req;
+    // Keeps the flow alive for the callback of the last chunk:
+    // evhttp_send_reply_end replaces it with its own.
+    auto flow = replyFlow;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, flow]{
+        // The request may be freed by evhttp_send_reply_end
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        evhttp_send_reply_end(req_copy);
+        ReenableReading(conn);
     });
     ev->trigger(nullptr);
+    replyStreaming = false;
     replySent = true;
     req = nullptr; // transferred back to main thread
 }
@@ -8,15 +8,19 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+/** Maximum number of bytes of a chunked reply queued for a client that it has not read yet */
+static const size_t MAX_HTTP_REPLY_BYTES_PENDING = 1024 * 1024;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyFlow;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -59,6 +63,9 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyStreaming;
+    //! Bytes of the chunked reply on their way to the client
+    std::shared_ptr<HTTPReplyFlow> replyFlow;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -114,6 +121,34 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply.
+     * nStatus is the HTTP status code to send. The body is sent incrementally
+     * with WriteReplyChunk and completed with WriteReplyEnd.
+     *
+     * @note Call WriteHeader before this, and neither WriteReply nor
+     * WriteHeader afterwards.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Queue the next part of a chunked reply for sending.
+     * Waits until the client has read all but MAX_HTTP_REPLY_BYTES_PENDING
+     * bytes of the earlier parts, so a slow client does not make the whole
+     * reply pile up in memory. Returns false without queueing anything if
+     * the client read nothing for the server timeout, or the server is
+     * shutting down; the reply should then be ended.
+     */
+    bool WriteReplyChunk(std::string&& strChunk);
+
+    /**
+     * Complete a chunked reply.
+     *
+     * @note As with WriteReply, this gives the request back to the main
+     * thread; do not call any other HTTPRequest methods afterwards.
+     */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
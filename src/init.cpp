@@ -11,9 +11,13 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <blockcompression.h>
+#include <blockfilemapper.h>
+#include <blockfilesyncer.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <coinstrace.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
 #include <fs.h>
@@ -62,6 +66,7 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include <zmq/zmqabstractnotifier.h>
 #include <zmq/zmqnotificationinterface.h>
 #include <zmq/zmqrpc.h>
 #endif
@@ -96,8 +101,8 @@ public:
 void DummyWalletInit::AddWalletOptions() const
 {
     std::vector<std::string> opts = {"-addresstype", "-changetype", "-disablewallet", "-discardfee=<amt>", "-fallbackfee=<amt>",
-        "-keypool=<n>", "-mintxfee=<amt>", "-paytxfee=<amt>", "-rescan", "-salvagewallet", "-spendzeroconfchange",  "-txconfirmtarget=<n>",
-        "-upgradewallet", "-wallet=<path>", "-walletbroadcast", "-walletdir=<dir>", "-walletnotify=<cmd>", "-walletrbf", "-zapwallettxes=<mode>",
+        "-keypool=<n>", "-mintxfee=<amt>", "-paytxfee=<amt>", "-rescan", "-rescanthreads=<n>", "-salvagewallet", "-spendzeroconfchange",  "-txconfirmtarget=<n>",
+        "-upgradewallet", "-wallet=<path>", "-walletbackend=<backend>", "-walletbroadcast", "-walletdir=<dir>", "-walletnotify=<cmd>", "-walletrbf", "-zapwallettxes=<mode>",
         "-dblogsize=<n>", "-flushwallet", "-privdb", "-walletrejectlongchains"};
     gArgs.AddHiddenArgs(opts);
 }
@@ -167,6 +172,11 @@ public:
 };
 
 static std::unique_ptr<CCoinsViewErrorCatcher> pcoinscatcher;
+static std::unique_ptr<CoinsTraceWriter> g_coins_trace;
+//! Cache size of the coins database
+static int64_t g_coins_db_cache = 0;
+//! Size of the coins database write buffers while it is rebuilt in bulk-load mode, or 0
+static int64_t g_coins_db_write_buffer = 0;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
 static boost::thread_group threadGroup;
@@ -268,7 +278,9 @@ void Shutdown()
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        g_coins_trace.reset();
     }
+    g_block_file_syncer.Stop();
     g_wallet_init_interface.Stop();
 
 #if ENABLE_ZMQ
@@ -363,6 +375,7 @@ void SetupServerArgs()
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify blocks directory (default: <datadir>/blocks)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcompression", strprintf("Store new blocks compressed in the block files; blocks stored either way can be read. Versions without this option cannot read compressed blocks, so once it has been used, downgrading requires a new block download (default: %u)", DEFAULT_BLOCK_COMPRESSION), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksonly", strprintf("Whether to operate in a blocks only mode (default: %u)", DEFAULT_BLOCKSONLY), true, OptionsCategory::OPTIONS);
@@ -374,6 +387,8 @@ void SetupServerArgs()
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-loadblock=<file>", "Imports blocks from external blk000??.dat file on startup", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadutxosnapshot=<file>", "Replace the chain state with a UTXO snapshot written by dumptxoutset on startup, if it is behind the block of the snapshot. Only snapshots of blocks pinned in this release can be loaded, once the headers up to the block are synced. The blocks before it are neither validated nor downloaded. This mode is incompatible with -txindex", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-mapblockfiles=<n>", strprintf("Keep up to <n> block and undo files memory-mapped for reading blocks from them (0 to disable, default: %u)", DEFAULT_MAPPED_BLOCK_FILES), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> megabytes (default: %u)", DEFAULT_MAX_MEMPOOL_SIZE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), false, OptionsCategory::OPTIONS);
@@ -389,8 +404,8 @@ void SetupServerArgs()
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), false, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", false, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk. Until the next restart, part of -dbcache goes to larger chain state database write buffers", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. Until the next restart, part of -dbcache goes to larger chain state database write buffers", false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", false, OptionsCategory::OPTIONS);
 #else
@@ -447,11 +462,23 @@ void SetupServerArgs()
     gArgs.AddArg("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubsequence=<address>", "Enable publish hash block and tx sequence in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubsequencehwm=<n>", strprintf("Set publish hash sequence message high water mark (default: %d)", DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubsequence=<address>");
+    hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
+    hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
+    hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
+    hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
+    hidden_args.emplace_back("-zmqpubsequencehwm=<n>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
@@ -459,6 +486,7 @@ void SetupServerArgs()
     gArgs.AddArg("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-coinstrace=<file>", "Record the operations on the UTXO cache to <file>, to be replayed by bench_litecoin -coinstrace", true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used", true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages", true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT), true, OptionsCategory::DEBUG_TEST);
@@ -634,6 +662,34 @@ static void CleanupBlockRevFiles()
     }
 }
 
+/**
+ * Once the coins database has been rebuilt in bulk-load mode, reopen it with
+ * its regular options and give the memory of its write buffers back to the
+ * UTXO cache, so the sync that follows gets all of -dbcache.
+ */
+static void EndCoinsDBBulkLoad()
+{
+    if (!g_coins_db_write_buffer) return;
+    while (!ShutdownRequested()) {
+        {
+            LOCK(cs_main);
+            // RPC calls iterate over cursors without cs_main; wait for them
+            if (!pcoinsdbview->HasOpenCursors()) {
+                // Leaves the UTXO cache without unwritten coins
+                FlushStateToDisk();
+                pcoinsdbview.reset();
+                pcoinsdbview.reset(new CCoinsViewDB(g_coins_db_cache, false, false, DBOptions::Chainstate()));
+                pcoinscatcher->SetBackend(*pcoinsdbview);
+                nCoinCacheUsage += 2 * g_coins_db_write_buffer;
+                g_coins_db_write_buffer = 0;
+                LogPrintf("Chain state database rebuilt, using %.1fMiB for in-memory UTXO set from now on\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+                return;
+            }
+        }
+        MilliSleep(100);
+    }
+}
+
 static void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     const CChainParams& chainparams = Params();
@@ -696,6 +752,8 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
         StartShutdown();
         return;
     }
+    // The chain state has caught up with the blocks on disk
+    EndCoinsDBBulkLoad();
 
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
@@ -940,6 +998,14 @@ bool AppInitParameterInteraction()
             return InitError(_("Prune mode is incompatible with -txindex."));
     }
 
+    // a chainstate loaded from a UTXO snapshot has no blocks to index or rebuild it from
+    if (gArgs.IsArgSet("-loadutxosnapshot")) {
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+            return InitError(_("-loadutxosnapshot is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-reindex", false) || gArgs.GetBoolArg("-reindex-chainstate", false))
+            return InitError(_("-loadutxosnapshot is incompatible with -reindex and -reindex-chainstate."));
+    }
+
     // -bind and -whitebind can't be set when not listening
     size_t nUserBind = gArgs.GetArgs("-bind").size() + gArgs.GetArgs("-whitebind").size();
     if (nUserBind != 0 && !gArgs.GetBoolArg("-listen", DEFAULT_LISTEN)) {
@@ -1055,6 +1121,9 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    g_block_file_mapper.SetMaxFiles(std::max<int64_t>(0, gArgs.GetArg("-mapblockfiles", DEFAULT_MAPPED_BLOCK_FILES)));
+    fBlockCompression = gArgs.GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1276,6 +1345,9 @@ bool AppInitMain()
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(mempool);
 
+    // Start the thread syncing block and undo files to disk
+    g_block_file_syncer.Start();
+
     /* Register RPC commands regardless of -server setting so they will be
      * available in the GUI RPC console even if external calls are disabled.
      */
@@ -1434,6 +1506,16 @@ bool AppInitMain()
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
+    // When the chain state is rebuilt, open the coins database with larger
+    // write buffers and sorted writes (DBOptions::ChainstateBulkLoad), which
+    // the UTXO cache gives up memory for until the rebuild is done.
+    int64_t nCoinDBWriteBuffer = 0;
+    if (fReindex || fReindexChainState) {
+        nCoinDBWriteBuffer = std::min(nTotalCache / 8, nMaxCoinsDBWriteBuffer << 20);
+        nTotalCache -= 2 * nCoinDBWriteBuffer; // up to two write buffers may be held in memory simultaneously
+    }
+    g_coins_db_cache = nCoinDBCache;
+    g_coins_db_write_buffer = nCoinDBWriteBuffer;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
@@ -1442,8 +1524,21 @@ bool AppInitMain()
         LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
     }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (nCoinDBWriteBuffer) {
+        LogPrintf("* Using 2x %.1fMiB for chain state database write buffers while it is rebuilt\n", nCoinDBWriteBuffer * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
+    if (gArgs.IsArgSet("-coinstrace")) {
+        const fs::path trace_path = AbsPathForConfigVal(gArgs.GetArg("-coinstrace", ""));
+        FILE* file = fsbridge::fopen(trace_path, "wb");
+        if (!file) {
+            return InitError(strprintf(_("Cannot write coins trace %s"), trace_path.string()));
+        }
+        g_coins_trace.reset(new CoinsTraceWriter(file));
+        LogPrintf("Recording UTXO cache operations to %s\n", trace_path.string());
+    }
+
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
@@ -1508,7 +1603,22 @@ bool AppInitMain()
                 // At this point we're either in reindex or we've loaded a useful
                 // block tree into mapBlockIndex!
 
-                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState));
+                if (pindexSnapshotBase && fReindexChainState) {
+                    return InitError(_("The chain state was loaded from a UTXO snapshot and cannot be rebuilt from the blocks. Use -reindex to download them all again."));
+                }
+
+                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState,
+                    nCoinDBWriteBuffer ? DBOptions::ChainstateBulkLoad(nCoinDBWriteBuffer) : DBOptions::Chainstate()));
+                std::string snapshot_error;
+                if (gArgs.IsArgSet("-loadutxosnapshot")) {
+                    if (!ActivateUTXOSnapshot(AbsPathForConfigVal(gArgs.GetArg("-loadutxosnapshot", "")), nCoinDBCache, chainparams, snapshot_error)) {
+                        if (ShutdownRequested()) break;
+                        return InitError(snapshot_error);
+                    }
+                }
+                if (!CheckSnapshotChainstate(chainparams, snapshot_error)) {
+                    return InitError(snapshot_error);
+                }
                 pcoinscatcher.reset(new CCoinsViewErrorCatcher(pcoinsdbview.get()));
 
                 // If necessary, upgrade from older database format.
@@ -1526,6 +1636,7 @@ bool AppInitMain()
 
                 // The on-disk coinsdb is now in a good state, create the cache
                 pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinsTip->SetTrace(g_coins_trace.get());
 
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
@@ -1617,6 +1728,9 @@ bool AppInitMain()
 
     // ********************************************************* Step 8: start indexers
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        if (pindexSnapshotBase) {
+            return InitError(_("The chain state was loaded from a UTXO snapshot, which is incompatible with -txindex."));
+        }
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
@@ -1628,6 +1742,10 @@ bool AppInitMain()
 
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
+    if (pindexSnapshotBase) {
+        LogPrintf("Unsetting NODE_NETWORK, the chain state was loaded from a UTXO snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
     if (fPruneMode) {
         LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
         nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
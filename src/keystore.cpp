@@ -5,8 +5,123 @@
 
 #include <keystore.h>
 
+#include <crypto/ripemd160.h>
+#include <hash.h>
+#include <random.h>
 #include <util.h>
 
+#include <limits>
+#include <string.h>
+
+//! Entries the filter of a new keystore has room for
+static const size_t KEYSTORE_FILTER_INITIAL_ENTRIES = 1024;
+
+KeyStoreFilter::Table::Table(size_t words) : m_words(words), m_data(new std::atomic<uint64_t>[words]())
+{
+}
+
+void KeyStoreFilter::Table::Insert(uint64_t fingerprint)
+{
+    // The high half picks the word, the low bits the 4 bits in it
+    const uint64_t mask = (uint64_t{1} << (fingerprint & 63)) | (uint64_t{1} << ((fingerprint >> 6) & 63)) |
+                          (uint64_t{1} << ((fingerprint >> 12) & 63)) | (uint64_t{1} << ((fingerprint >> 18) & 63));
+    m_data[((fingerprint >> 32) * m_words) >> 32].fetch_or(mask, std::memory_order_release);
+}
+
+bool KeyStoreFilter::Table::Contains(uint64_t fingerprint) const
+{
+    const uint64_t mask = (uint64_t{1} << (fingerprint & 63)) | (uint64_t{1} << ((fingerprint >> 6) & 63)) |
+                          (uint64_t{1} << ((fingerprint >> 12) & 63)) | (uint64_t{1} << ((fingerprint >> 18) & 63));
+    return (m_data[((fingerprint >> 32) * m_words) >> 32].load(std::memory_order_acquire) & mask) == mask;
+}
+
+KeyStoreFilter::KeyStoreFilter() : m_k0(GetRand(std::numeric_limits<uint64_t>::max())), m_k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+    m_tables.push_back(MakeUnique<Table>(KEYSTORE_FILTER_INITIAL_ENTRIES / ENTRIES_PER_WORD));
+    m_table.store(m_tables.back().get());
+}
+
+uint64_t KeyStoreFilter::Fingerprint(const unsigned char* data, size_t size) const
+{
+    return CSipHasher(m_k0, m_k1).Write(data, size).Finalize();
+}
+
+void KeyStoreFilter::Insert(uint64_t fingerprint)
+{
+    m_fingerprints.push_back(fingerprint);
+    Table* table = m_table.load(std::memory_order_relaxed);
+    if (m_fingerprints.size() <= table->m_words * ENTRIES_PER_WORD) {
+        table->Insert(fingerprint);
+        return;
+    }
+
+    // Readers may still be using the full table, so it is kept around
+    std::unique_ptr<Table> grown = MakeUnique<Table>(table->m_words * 2);
+    for (uint64_t entry : m_fingerprints) {
+        grown->Insert(entry);
+    }
+    m_table.store(grown.get(), std::memory_order_release);
+    m_tables.push_back(std::move(grown));
+}
+
+/** Get the key ID or script ID a script pays to, for the script types
+ * that can be mine other than as watch-only scripts. */
+static bool GetFilterId(const CScript& script, uint160& id)
+{
+    const size_t size = script.size();
+    if (size == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        // P2PKH
+        memcpy(id.begin(), &script[3], 20);
+        return true;
+    }
+    if (script.IsPayToScriptHash()) {
+        memcpy(id.begin(), &script[2], 20);
+        return true;
+    }
+    if (size == 22 && script[0] == OP_0 && script[1] == 20) {
+        // P2WPKH: mine through the key
+        memcpy(id.begin(), &script[2], 20);
+        return true;
+    }
+    if (size == 34 && script[0] == OP_0 && script[1] == 32) {
+        // P2WSH: mine through the witness script
+        CRIPEMD160().Write(&script[2], 32).Finalize(id.begin());
+        return true;
+    }
+    if ((size == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE + 2 || size == CPubKey::PUBLIC_KEY_SIZE + 2) &&
+        script[0] == size - 2 && script[size - 1] == OP_CHECKSIG) {
+        // P2PK
+        CHash160().Write(&script[1], size - 2).Finalize(id.begin());
+        return true;
+    }
+    return false;
+}
+
+void KeyStoreFilter::Insert(const uint160& id)
+{
+    Insert(Fingerprint(id.begin(), id.size()));
+}
+
+void KeyStoreFilter::InsertWatchOnly(const CScript& script)
+{
+    Insert(Fingerprint(script.data(), script.size()));
+    // A watch-only P2PKH script also makes the P2WPKH output of its key watch-only
+    uint160 id;
+    if (GetFilterId(script, id)) Insert(id);
+    m_have_watch_only.store(true, std::memory_order_release);
+}
+
+bool KeyStoreFilter::MayBeMine(const CScript& script) const
+{
+    const Table* table = m_table.load(std::memory_order_acquire);
+    if (m_have_watch_only.load(std::memory_order_acquire) && table->Contains(Fingerprint(script.data(), script.size()))) {
+        return true;
+    }
+    uint160 id;
+    return GetFilterId(script, id) && table->Contains(Fingerprint(id.begin(), id.size()));
+}
+
 void CBasicKeyStore::ImplicitlyLearnRelatedKeyScripts(const CPubKey& pubkey)
 {
     AssertLockHeld(cs_KeyStore);
@@ -29,6 +144,7 @@ void CBasicKeyStore::ImplicitlyLearnRelatedKeyScripts(const CPubKey& pubkey)
         // This does not use AddCScript, as it may be overridden.
         CScriptID id(script);
         mapScripts[id] = std::move(script);
+        m_filter.Insert(id);
     }
 }
 
@@ -52,7 +168,9 @@ bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    m_filter.Insert(pubkey.GetID());
     ImplicitlyLearnRelatedKeyScripts(pubkey);
+    ++m_generation;
     return true;
 }
 
@@ -90,6 +208,8 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    m_filter.Insert(CScriptID(redeemScript));
+    ++m_generation;
     return true;
 }
 
@@ -141,11 +261,13 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    m_filter.InsertWatchOnly(dest);
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey)) {
         mapWatchKeys[pubKey.GetID()] = pubKey;
         ImplicitlyLearnRelatedKeyScripts(pubKey);
     }
+    ++m_generation;
     return true;
 }
 
@@ -157,6 +279,7 @@ bool CBasicKeyStore::RemoveWatchOnly(const CScript &dest)
     if (ExtractPubKey(dest, pubKey)) {
         mapWatchKeys.erase(pubKey.GetID());
     }
+    ++m_generation;
     // Related CScripts are not removed; having superfluous scripts around is
     // harmless (see comment in ImplicitlyLearnRelatedKeyScripts).
     return true;
@@ -174,6 +297,12 @@ bool CBasicKeyStore::HaveWatchOnly() const
     return (!setWatchOnly.empty());
 }
 
+uint64_t CBasicKeyStore::GetGeneration() const
+{
+    LOCK(cs_KeyStore);
+    return m_generation;
+}
+
 CKeyID GetKeyForDestination(const CKeyStore& store, const CTxDestination& dest)
 {
     // Only supports destinations which map to single public keys, i.e. P2PKH,
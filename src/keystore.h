@@ -13,6 +13,10 @@
 #include <script/standard.h>
 #include <sync.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include <boost/signals2/signal.hpp>
 
 /** A virtual base class for key stores */
@@ -36,6 +40,58 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest) =0;
     virtual bool HaveWatchOnly(const CScript &dest) const =0;
     virtual bool HaveWatchOnly() const =0;
+
+    //! Cheap check run by IsMine() first: false if the script cannot be mine
+    virtual bool MayBeMine(const CScript& script) const { return true; }
+};
+
+/**
+ * Filter over the key IDs, script IDs and watch-only scripts of a keystore,
+ * which rejects most scriptPubKeys that cannot be mine without solving them
+ * or taking the keystore lock. It may match scripts that are not mine, but
+ * matches every script IsMine() accepts at the top level.
+ *
+ * This is a blocked bloom filter: an entry sets 4 bits of one 64-bit word.
+ * Entries are never removed, and the filter is rebuilt with twice the
+ * capacity once it is full. Readers are lock-free; writers must be
+ * serialized by the caller.
+ */
+class KeyStoreFilter
+{
+public:
+    KeyStoreFilter();
+
+    //! Add a key ID or script ID
+    void Insert(const uint160& id);
+    //! Add a watch-only script
+    void InsertWatchOnly(const CScript& script);
+
+    bool MayBeMine(const CScript& script) const;
+
+private:
+    struct Table
+    {
+        explicit Table(size_t words);
+        const size_t m_words;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_data;
+
+        void Insert(uint64_t fingerprint);
+        bool Contains(uint64_t fingerprint) const;
+    };
+
+    //! Number of entries per 64-bit word of a table
+    static const size_t ENTRIES_PER_WORD = 4;
+
+    const uint64_t m_k0, m_k1;
+    std::atomic<Table*> m_table;
+    std::atomic<bool> m_have_watch_only{false};
+    //! The current table and the ones it replaced, which readers may still be using
+    std::vector<std::unique_ptr<Table>> m_tables;
+    //! Fingerprints of all entries, to fill a new table with
+    std::vector<uint64_t> m_fingerprints;
+
+    uint64_t Fingerprint(const unsigned char* data, size_t size) const;
+    void Insert(uint64_t fingerprint);
 };
 
 /** Basic key store, that keeps keys in an address->secret map */
@@ -53,6 +109,10 @@ protected:
     WatchKeyMap mapWatchKeys GUARDED_BY(cs_KeyStore);
     ScriptMap mapScripts GUARDED_BY(cs_KeyStore);
     WatchOnlySet setWatchOnly GUARDED_BY(cs_KeyStore);
+    //! Bumped whenever a key, script or watch-only entry is added or removed
+    uint64_t m_generation GUARDED_BY(cs_KeyStore) = 0;
+    //! Filled as keys, scripts and watch-only entries are added, under cs_KeyStore
+    KeyStoreFilter m_filter;
 
     void ImplicitlyLearnRelatedKeyScripts(const CPubKey& pubkey) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
 
@@ -72,6 +132,11 @@ public:
     bool RemoveWatchOnly(const CScript &dest) override;
     bool HaveWatchOnly(const CScript &dest) const override;
     bool HaveWatchOnly() const override;
+
+    bool MayBeMine(const CScript& script) const override { return m_filter.MayBeMine(script); }
+
+    //! Returns a counter that changes whenever the set of keys, scripts or watch-only entries changes
+    uint64_t GetGeneration() const;
 };
 
 /** Return the CKeyID of the key involved in a script (if there is a unique one). */
@@ -0,0 +1,133 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <lz4.h>
+
+#include <crypto/common.h>
+
+#include <string.h>
+
+namespace {
+
+static const size_t MIN_MATCH = 4;
+//! The last match must start at least this many bytes before the end
+static const size_t MF_LIMIT = 12;
+//! The last bytes are always literals
+static const size_t LAST_LITERALS = 5;
+static const size_t MAX_DISTANCE = 65535;
+static const int HASH_LOG = 14;
+
+inline uint32_t Hash(const unsigned char* p)
+{
+    return (ReadLE32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/** Write the remainder of a length that did not fit in its 4 token bits */
+void WriteLength(size_t length, std::vector<unsigned char>& out)
+{
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(length);
+}
+
+void WriteSequence(const unsigned char* literals, size_t literal_length, size_t offset, size_t match_length, std::vector<unsigned char>& out)
+{
+    const size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+    out.push_back((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15));
+    if (literal_length >= 15) WriteLength(literal_length - 15, out);
+    out.insert(out.end(), literals, literals + literal_length);
+    if (!match_length) return;
+    out.push_back(offset & 0xff);
+    out.push_back(offset >> 8);
+    if (match_code >= 15) WriteLength(match_code - 15, out);
+}
+
+/** Read the remainder of a length that did not fit in its 4 token bits */
+bool ReadLength(const unsigned char*& in, const unsigned char* end, size_t& length)
+{
+    unsigned char byte;
+    do {
+        if (in == end) return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+void LZ4Compress(Span<const unsigned char> data, std::vector<unsigned char>& out)
+{
+    const unsigned char* const base = data.data();
+    const size_t size = data.size();
+    out.reserve(out.size() + size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > MF_LIMIT) {
+        // Positions plus one of the last occurrence of each hashed 4 bytes
+        std::vector<uint32_t> table(1 << HASH_LOG, 0);
+        const size_t match_limit = size - LAST_LITERALS;
+        size_t pos = 0;
+        while (pos + MF_LIMIT <= size) {
+            const uint32_t h = Hash(base + pos);
+            const size_t candidate = table[h];
+            table[h] = pos + 1;
+            if (candidate == 0 || pos - (candidate - 1) > MAX_DISTANCE ||
+                ReadLE32(base + candidate - 1) != ReadLE32(base + pos)) {
+                ++pos;
+                continue;
+            }
+            const size_t ref = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (pos + length < match_limit && base[ref + length] == base[pos + length]) {
+                ++length;
+            }
+            WriteSequence(base + anchor, pos - anchor, pos - ref, length, out);
+            pos += length;
+            anchor = pos;
+        }
+    }
+    WriteSequence(base + anchor, size - anchor, 0, 0, out);
+}
+
+bool LZ4Decompress(Span<const unsigned char> block, Span<unsigned char> out)
+{
+    const unsigned char* in = block.data();
+    const unsigned char* const in_end = in + block.size();
+    unsigned char* op = out.data();
+    unsigned char* const op_end = op + out.size();
+
+    while (in < in_end) {
+        const unsigned char token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !ReadLength(in, in_end, literal_length)) return false;
+        if (literal_length > (size_t)(in_end - in) || literal_length > (size_t)(op_end - op)) return false;
+        memcpy(op, in, literal_length);
+        in += literal_length;
+        op += literal_length;
+        // The last sequence has no match
+        if (in == in_end) break;
+
+        if (in_end - in < 2) return false;
+        const size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (size_t)(op - out.data())) return false;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !ReadLength(in, in_end, match_length)) return false;
+        match_length += MIN_MATCH;
+        if (match_length > (size_t)(op_end - op)) return false;
+        const unsigned char* match = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            // Overlapping matches repeat the last offset bytes
+            while (match_length--) *op++ = *match++;
+        }
+    }
+    return op == op_end;
+}
@@ -0,0 +1,25 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LZ4_H
+#define BITCOIN_LZ4_H
+
+#include <span.h>
+
+#include <vector>
+
+/**
+ * Compression in the LZ4 block format: sequences of literals and matches
+ * with a 64 KiB window, without a frame or checksum around them. Compression
+ * is a fast single pass; decompression is a bounds-checked copy loop.
+ */
+
+/** Compress data, appending the compressed block to out */
+void LZ4Compress(Span<const unsigned char> data, std::vector<unsigned char>& out);
+
+/** Decompress a compressed block into out, which must be exactly the size of
+ * the data. Returns false if the block is malformed or has a different size. */
+bool LZ4Decompress(Span<const unsigned char> block, Span<unsigned char> out);
+
+#endif // BITCOIN_LZ4_H
@@ -6,6 +6,7 @@
 #include <primitives/transaction.h>
 
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 #include <utilstrencodings.h>
 
@@ -75,10 +76,65 @@ uint256 CTransaction::ComputeWitnessHash() const
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+struct CTransaction::Deserialized
+{
+    CMutableTransaction tx;
+    uint256 hash;
+    uint256 witness_hash;
+    unsigned int stripped_size;
+    unsigned int total_size;
+};
+
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
-CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
-CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{}, m_stripped_size{0}, m_total_size{0} {}
+CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()},
+    m_stripped_size{(unsigned int)::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)}, m_total_size{(unsigned int)::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION)} {}
+CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()},
+    m_stripped_size{(unsigned int)::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)}, m_total_size{(unsigned int)::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION)} {}
+CTransaction::CTransaction(Deserialized&& tx) : vin(std::move(tx.tx.vin)), vout(std::move(tx.tx.vout)), nVersion(tx.tx.nVersion), nLockTime(tx.tx.nLockTime), hash{tx.hash}, m_witness_hash{tx.witness_hash},
+    m_stripped_size{tx.stripped_size}, m_total_size{tx.total_size} {}
+CTransaction::CTransaction(deserialize_type, SpanReader& s) : CTransaction(DeserializeFrom(s)) {}
+CTransaction::CTransaction(deserialize_type, CDataStream& s) : CTransaction(DeserializeFrom(s)) {}
+
+CTransaction::Deserialized CTransaction::DeserializeFrom(SpanReader& s)
+{
+    const Span<const unsigned char> data = s.GetRemaining();
+    Deserialized result{CMutableTransaction(deserialize, s), {}, {}, 0, 0};
+    const Span<const unsigned char> serialized = data.first(data.size() - s.size());
+    const CMutableTransaction& tx = result.tx;
+
+    // The serialization is the one with witnesses if it has the marker and
+    // flag, see UnserializeTransaction, and the one without them otherwise.
+    // Serializations with the marker and flag but no witnesses are valid, and
+    // have to be hashed without them as well.
+    size_t witness_size = 0;
+    const bool extended = !(s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS) && serialized.size() > 5 && serialized[4] == 0 && serialized[5] != 0;
+    if (extended) {
+        witness_size = 2; // marker and flag
+        for (const CTxIn& txin : tx.vin) {
+            witness_size += ::GetSerializeSize(txin.scriptWitness.stack, SER_NETWORK, PROTOCOL_VERSION);
+        }
+        CHash256()
+            .Write(serialized.data(), 4) // nVersion
+            .Write(serialized.data() + 6, serialized.size() - 8 - witness_size) // vin and vout
+            .Write(serialized.data() + serialized.size() - 4, 4) // nLockTime
+            .Finalize(result.hash.begin());
+    } else {
+        result.hash = Hash(serialized.begin(), serialized.end());
+    }
+    result.witness_hash = tx.HasWitness() ? Hash(serialized.begin(), serialized.end()) : result.hash;
+    result.stripped_size = serialized.size() - witness_size;
+    result.total_size = tx.HasWitness() ? serialized.size() : result.stripped_size;
+    return result;
+}
+
+CTransaction::Deserialized CTransaction::DeserializeFrom(CDataStream& s)
+{
+    SpanReader reader(s.GetType(), s.GetVersion(), Span<const unsigned char>((const unsigned char*)s.data(), s.size()));
+    Deserialized result = DeserializeFrom(reader);
+    s.ignore(s.size() - reader.size());
+    return result;
+}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -91,11 +147,6 @@ CAmount CTransaction::GetValueOut() const
     return nValueOut;
 }
 
-unsigned int CTransaction::GetTotalSize() const
-{
-    return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
-}
-
 std::string CTransaction::ToString() const
 {
     std::string str;
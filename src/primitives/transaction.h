@@ -175,6 +175,8 @@ public:
 };
 
 struct CMutableTransaction;
+class CDataStream;
+class SpanReader;
 
 /**
  * Basic transaction serialization format:
@@ -287,10 +289,19 @@ private:
     /** Memory only. */
     const uint256 hash;
     const uint256 m_witness_hash;
+    //! Sizes of the serialization without and with witnesses
+    const unsigned int m_stripped_size;
+    const unsigned int m_total_size;
 
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
 
+    /** A transaction deserialized from memory, with the hashes and sizes of the bytes it was read from */
+    struct Deserialized;
+    explicit CTransaction(Deserialized&& tx);
+    static Deserialized DeserializeFrom(SpanReader& s);
+    static Deserialized DeserializeFrom(CDataStream& s);
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -308,6 +319,9 @@ public:
      *  Unserialize is not possible, since it would require overwriting const fields. */
     template <typename Stream>
     CTransaction(deserialize_type, Stream& s) : CTransaction(CMutableTransaction(deserialize, s)) {}
+    /** Deserialize from memory, hashing the bytes read instead of serializing the transaction again */
+    CTransaction(deserialize_type, SpanReader& s);
+    CTransaction(deserialize_type, CDataStream& s);
 
     bool IsNull() const {
         return vin.empty() && vout.empty();
@@ -326,7 +340,10 @@ public:
      * "Total Size" defined in BIP141 and BIP144.
      * @return Total transaction size in bytes
      */
-    unsigned int GetTotalSize() const;
+    unsigned int GetTotalSize() const { return m_total_size; }
+
+    /** Get the size of the transaction serialized without witness data, "Base transaction size" in BIP141 */
+    unsigned int GetStrippedSize() const { return m_stripped_size; }
 
     bool IsCoinBase() const
     {
@@ -0,0 +1,183 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/view.h>
+
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <hash.h>
+
+#include <algorithm>
+#include <ios>
+#include <memory>
+
+namespace {
+
+//! Lower bound of the size of a serialized transaction
+static const size_t MIN_SERIALIZABLE_TRANSACTION_SIZE = MIN_SERIALIZABLE_TRANSACTION_WEIGHT / WITNESS_SCALE_FACTOR;
+
+/** Skip inputs as CTxIn deserializes them */
+void SkipInputs(SpanReader& s, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; ++i) {
+        s.ignore(32 + 4); // prevout
+        s.ignore(ReadCompactSize(s)); // scriptSig
+        s.ignore(4); // nSequence
+    }
+}
+
+/** Skip outputs as CTxOut deserializes them */
+void SkipOutputs(SpanReader& s, uint64_t count)
+{
+    for (uint64_t i = 0; i < count; ++i) {
+        s.ignore(8); // nValue
+        s.ignore(ReadCompactSize(s)); // scriptPubKey
+    }
+}
+
+} // namespace
+
+TransactionView::TransactionView(Span<const unsigned char> data)
+{
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, data);
+    auto pos = [&]() { return data.size() - s.size(); };
+
+    // Mirrors UnserializeTransaction, see there
+    s >> m_version;
+    unsigned char flags = 0;
+    m_inputs_pos = pos();
+    m_input_count = ReadCompactSize(s);
+    if (m_input_count == 0) {
+        s >> flags;
+        if (flags != 0) {
+            m_extended = true;
+            m_inputs_pos = pos();
+            m_input_count = ReadCompactSize(s);
+            SkipInputs(s, m_input_count);
+            m_outputs_pos = pos();
+            m_output_count = ReadCompactSize(s);
+            SkipOutputs(s, m_output_count);
+        } else {
+            // The empty vin was followed by an empty vout, read as the flags
+            m_outputs_pos = m_inputs_pos + 1;
+        }
+    } else {
+        SkipInputs(s, m_input_count);
+        m_outputs_pos = pos();
+        m_output_count = ReadCompactSize(s);
+        SkipOutputs(s, m_output_count);
+    }
+    m_witness_pos = pos();
+    if (flags & 1) {
+        flags ^= 1;
+        for (uint64_t i = 0; i < m_input_count; ++i) {
+            const uint64_t stack_size = ReadCompactSize(s);
+            for (uint64_t j = 0; j < stack_size; ++j) {
+                s.ignore(ReadCompactSize(s));
+            }
+            if (stack_size > 0) m_has_witness = true;
+        }
+    }
+    if (flags) {
+        throw std::ios_base::failure("Unknown transaction optional data");
+    }
+    m_lock_time_pos = pos();
+    s >> m_lock_time;
+    m_data = data.first(pos());
+}
+
+Span<const unsigned char> TransactionView::ReadScript(SpanReader& s)
+{
+    const Span<const unsigned char> rest = s.GetRemaining();
+    const uint64_t size = ReadCompactSize(s);
+    const size_t start = rest.size() - s.size();
+    s.ignore(size);
+    return rest.subspan(start, size);
+}
+
+const uint256& TransactionView::GetHash() const
+{
+    if (m_hash.IsNull()) {
+        if (!m_extended) {
+            m_hash = Hash(m_data.begin(), m_data.end());
+        } else {
+            // The serialization without the marker, flag and witnesses
+            CHash256()
+                .Write(m_data.data(), m_inputs_pos - 2)
+                .Write(m_data.data() + m_inputs_pos, m_witness_pos - m_inputs_pos)
+                .Write(m_data.data() + m_lock_time_pos, m_data.size() - m_lock_time_pos)
+                .Finalize(m_hash.begin());
+        }
+    }
+    return m_hash;
+}
+
+const uint256& TransactionView::GetWitnessHash() const
+{
+    if (!m_has_witness) return GetHash();
+    if (m_witness_hash.IsNull()) {
+        m_witness_hash = Hash(m_data.begin(), m_data.end());
+    }
+    return m_witness_hash;
+}
+
+size_t TransactionView::GetStrippedSize() const
+{
+    if (!m_extended) return m_data.size();
+    return m_data.size() - 2 - (m_lock_time_pos - m_witness_pos);
+}
+
+size_t TransactionView::GetTotalSize() const
+{
+    // Without witnesses, CTransaction is serialized without the marker and flag
+    return m_has_witness ? m_data.size() : GetStrippedSize();
+}
+
+int64_t TransactionView::GetWeight() const
+{
+    return GetStrippedSize() * (WITNESS_SCALE_FACTOR - 1) + GetTotalSize();
+}
+
+CTransactionRef TransactionView::Materialize() const
+{
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_data);
+    return std::make_shared<const CTransaction>(deserialize, s);
+}
+
+BlockView::BlockView(Span<const unsigned char> data)
+{
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, data);
+    s >> m_header;
+    const uint64_t tx_count = ReadCompactSize(s);
+    m_txs.reserve(std::min<uint64_t>(tx_count, s.size() / MIN_SERIALIZABLE_TRANSACTION_SIZE));
+    for (uint64_t i = 0; i < tx_count; ++i) {
+        m_txs.emplace_back(s.GetRemaining());
+        s.ignore(m_txs.back().GetBytes().size());
+    }
+    m_data = data.first(data.size() - s.size());
+}
+
+uint256 BlockView::GetHash() const
+{
+    static const size_t HEADER_SIZE = 80;
+    return Hash(m_data.begin(), m_data.begin() + HEADER_SIZE);
+}
+
+uint256 BlockView::ComputeMerkleRoot(bool* mutated) const
+{
+    std::vector<uint256> leaves;
+    leaves.reserve(m_txs.size());
+    for (const TransactionView& tx : m_txs) {
+        leaves.push_back(tx.GetHash());
+    }
+    return ::ComputeMerkleRoot(std::move(leaves), mutated);
+}
+
+CBlock BlockView::Materialize() const
+{
+    CBlock block;
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_data);
+    s >> block;
+    return block;
+}
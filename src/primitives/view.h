@@ -0,0 +1,138 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PRIMITIVES_VIEW_H
+#define BITCOIN_PRIMITIVES_VIEW_H
+
+#include <amount.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <span.h>
+#include <streams.h>
+#include <uint256.h>
+#include <version.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A read-only view of a serialized transaction, with witness, that refers to
+ * the buffer it was parsed from instead of copying its inputs, outputs and
+ * witnesses into objects. The buffer has to outlive the view.
+ *
+ * Parsing checks that the serialization is well-formed as
+ * UnserializeTransaction does, and records where its parts start. The hashes
+ * are computed from the serialized bytes the first time they are needed, so a
+ * view is not safe to share between threads until they have been.
+ */
+class TransactionView
+{
+public:
+    /** Parse the transaction at the start of data. Throws std::ios_base::failure if it is malformed. */
+    explicit TransactionView(Span<const unsigned char> data);
+
+    /** The serialization of the transaction, and nothing after it */
+    Span<const unsigned char> GetBytes() const { return m_data; }
+
+    int32_t GetVersion() const { return m_version; }
+    uint32_t GetLockTime() const { return m_lock_time; }
+    size_t GetInputCount() const { return m_input_count; }
+    size_t GetOutputCount() const { return m_output_count; }
+    bool HasWitness() const { return m_has_witness; }
+
+    const uint256& GetHash() const;
+    const uint256& GetWitnessHash() const;
+
+    /** The sizes and weight CTransaction would have */
+    size_t GetTotalSize() const;
+    size_t GetStrippedSize() const;
+    int64_t GetWeight() const;
+
+    /** Call fn(prevout, script_sig, sequence) for each input */
+    template <typename Fn>
+    void ForEachInput(Fn fn) const
+    {
+        SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_data.subspan(m_inputs_pos));
+        ReadCompactSize(s);
+        for (size_t i = 0; i < m_input_count; ++i) {
+            COutPoint prevout;
+            uint32_t sequence;
+            s >> prevout;
+            const Span<const unsigned char> script_sig = ReadScript(s);
+            s >> sequence;
+            fn(prevout, script_sig, sequence);
+        }
+    }
+
+    /** Call fn(value, script_pub_key) for each output */
+    template <typename Fn>
+    void ForEachOutput(Fn fn) const
+    {
+        SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_data.subspan(m_outputs_pos));
+        ReadCompactSize(s);
+        for (size_t i = 0; i < m_output_count; ++i) {
+            CAmount value;
+            s >> value;
+            fn(value, ReadScript(s));
+        }
+    }
+
+    /** Deserialize the transaction into a CTransaction */
+    CTransactionRef Materialize() const;
+
+private:
+    Span<const unsigned char> m_data;
+    int32_t m_version;
+    uint32_t m_lock_time;
+    uint64_t m_input_count = 0;
+    uint64_t m_output_count = 0;
+    //! Whether the serialization has the marker and flag of the witness format
+    bool m_extended = false;
+    //! Whether any input has a witness
+    bool m_has_witness = false;
+    //! Offsets of the number of inputs, the number of outputs, the witnesses and the lock time
+    size_t m_inputs_pos;
+    size_t m_outputs_pos;
+    size_t m_witness_pos;
+    size_t m_lock_time_pos;
+
+    mutable uint256 m_hash;
+    mutable uint256 m_witness_hash;
+
+    /** Read a script, and return the span of its bytes */
+    static Span<const unsigned char> ReadScript(SpanReader& s);
+};
+
+/**
+ * A read-only view of a serialized block, with witnesses, whose transactions
+ * are views into the same buffer. The buffer has to outlive the view.
+ */
+class BlockView
+{
+public:
+    /** Parse the block at the start of data. Throws std::ios_base::failure if it is malformed. */
+    explicit BlockView(Span<const unsigned char> data);
+
+    /** The serialization of the block, and nothing after it */
+    Span<const unsigned char> GetBytes() const { return m_data; }
+
+    const CBlockHeader& GetHeader() const { return m_header; }
+    uint256 GetHash() const;
+    const std::vector<TransactionView>& GetTransactions() const { return m_txs; }
+
+    /** The merkle root of the transactions, see BlockMerkleRoot */
+    uint256 ComputeMerkleRoot(bool* mutated = nullptr) const;
+
+    /** Deserialize the block into a CBlock */
+    CBlock Materialize() const;
+
+private:
+    Span<const unsigned char> m_data;
+    CBlockHeader m_header;
+    std::vector<TransactionView> m_txs;
+};
+
+#endif // BITCOIN_PRIMITIVES_VIEW_H
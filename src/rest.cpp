@@ -19,11 +19,15 @@
 #include <utilstrencodings.h>
 #include <version.h>
 
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 
 #include <univalue.h>
 
-static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const size_t MAX_GETUTXOS_OUTPOINTS = 10000; //allow a max of 10000 outpoints to be queried at once
+static const long MAX_REST_BLOCKRANGE_COUNT = 1000; //allow a max of 1000 blocks to be fetched at once
+static const size_t REST_BLOCKRANGE_CHUNK_SIZE = 64 * 1024; //collect small blocks into chunks of this size
 
 enum class RetFormat {
     UNDEF,
@@ -61,6 +65,16 @@ struct CCoin {
     }
 };
 
+/** Read-only view of a coins cache that doesn't add the coins it looks up to the cache */
+class CCoinsViewCachePeek : public CCoinsView
+{
+    const CCoinsViewCache& m_cache;
+
+public:
+    explicit CCoinsViewCachePeek(const CCoinsViewCache& cache) : m_cache(cache) {}
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override { return m_cache.PeekCoin(outpoint, coin); }
+};
+
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
     req->WriteHeader("Content-Type", "text/plain");
@@ -208,7 +222,11 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    // With witnesses, the serialized block is the one stored on disk, which
+    // then does not need to be deserialized
+    const bool raw = (rf == RetFormat::BINARY || rf == RetFormat::HEX) && !(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS);
     CBlock block;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     CBlockIndex* pblockindex = nullptr;
     {
         LOCK(cs_main);
@@ -220,12 +238,17 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (raw) {
+            std::vector<uint8_t> data;
+            if (!ReadCheckedRawBlockFromDisk(data, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            ssBlock.write((const char*)data.data(), data.size());
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (!raw) ssBlock << block;
 
     switch (rf) {
     case RetFormat::BINARY: {
@@ -270,6 +293,85 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+static bool rest_blockrange(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/blockrange/<height>/<count>.<ext>.");
+
+    int32_t height;
+    if (!ParseInt32(path[0], &height) || height < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[0]);
+
+    long count = strtol(path[1].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_REST_BLOCKRANGE_COUNT)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    std::vector<const CBlockIndex*> blocks;
+    blocks.reserve(count);
+    {
+        LOCK(cs_main);
+        if (height > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+
+        for (const CBlockIndex* pindex = chainActive[height]; pindex != nullptr && blocks.size() < (unsigned long)count; pindex = chainActive.Next(pindex)) {
+            if (IsBlockPruned(pindex))
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            blocks.push_back(pindex);
+        }
+    }
+
+    // Blocks are read and sent one chunk at a time, and WriteReplyChunk waits
+    // for the client to read the earlier ones, so at most a few chunks of the
+    // reply are held in memory. Once the first chunk is out errors can no
+    // longer be reported, and the client sees a truncated reply instead.
+    req->WriteHeader("Content-Type", rf == RetFormat::BINARY ? "application/octet-stream" : "text/plain");
+    req->WriteReplyStart(HTTP_OK);
+
+    CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    auto send_chunk = [req, rf, &ssBlocks]() {
+        const bool sent = req->WriteReplyChunk(rf == RetFormat::BINARY ? ssBlocks.str() : HexStr(ssBlocks.begin(), ssBlocks.end()));
+        ssBlocks.clear();
+        return sent;
+    };
+    for (const CBlockIndex* pindex : blocks) {
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            if (!IsBlockPruned(pindex)) pos = pindex->GetBlockPos();
+        }
+        // The block is read without cs_main, so it may be pruned meanwhile:
+        // reading it then fails or finds another block.
+        CBlock block;
+        if (pos.IsNull() || !ReadBlockFromDisk(block, pos, Params().GetConsensus()) || block.GetHash() != pindex->GetBlockHash()) {
+            LogPrintf("%s: failed to read block %s, truncating reply\n", __func__, pindex->GetBlockHash().ToString());
+            req->WriteReplyEnd();
+            return false;
+        }
+        ssBlocks << block;
+        if (ssBlocks.size() >= REST_BLOCKRANGE_CHUNK_SIZE && !send_chunk()) {
+            req->WriteReplyEnd();
+            return false;
+        }
+    }
+    if (!ssBlocks.empty() && !send_chunk()) {
+        req->WriteReplyEnd();
+        return false;
+    }
+    if (rf == RetFormat::HEX) req->WriteReplyChunk("\n");
+    req->WriteReplyEnd();
+    return true;
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const JSONRPCRequest& request);
 
@@ -493,23 +595,31 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     bitmap.resize((vOutPoints.size() + 7) / 8);
     {
         auto process_utxos = [&vOutPoints, &outs, &hits](const CCoinsView& view, const CTxMemPool& mempool) {
-            for (const COutPoint& vOutPoint : vOutPoints) {
-                Coin coin;
-                bool hit = !mempool.isSpent(vOutPoint) && view.GetCoin(vOutPoint, coin);
-                hits.push_back(hit);
-                if (hit) outs.emplace_back(std::move(coin));
+            // Look the outpoints up in key order, so coins that are not cached
+            // are read from the database with mostly sequential access
+            std::vector<size_t> order(vOutPoints.size());
+            for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+            std::sort(order.begin(), order.end(), [&vOutPoints](size_t a, size_t b) { return vOutPoints[a] < vOutPoints[b]; });
+
+            std::vector<Coin> coins(vOutPoints.size());
+            hits.assign(vOutPoints.size(), false);
+            for (const size_t i : order) {
+                hits[i] = !mempool.isSpent(vOutPoints[i]) && view.GetCoin(vOutPoints[i], coins[i]);
+            }
+            for (size_t i = 0; i < coins.size(); ++i) {
+                if (hits[i]) outs.emplace_back(std::move(coins[i]));
             }
         };
 
         if (fCheckMemPool) {
             // use db+mempool as cache backend in case user likes to query mempool
             LOCK2(cs_main, mempool.cs);
-            CCoinsViewCache& viewChain = *pcoinsTip;
+            CCoinsViewCachePeek viewChain(*pcoinsTip);
             CCoinsViewMemPool viewMempool(&viewChain, mempool);
             process_utxos(viewMempool, mempool);
         } else {
             LOCK(cs_main);  // no need to lock mempool!
-            process_utxos(*pcoinsTip, CTxMemPool());
+            process_utxos(CCoinsViewCachePeek(*pcoinsTip), CTxMemPool());
         }
 
         for (size_t i = 0; i < hits.size(); ++i) {
@@ -588,6 +698,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blockrange/", rest_blockrange},
       {"/rest/getutxos", rest_getutxos},
 };
 
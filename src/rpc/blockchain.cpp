@@ -19,6 +19,7 @@
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <script/descriptor.h>
 #include <streams.h>
@@ -27,6 +28,7 @@
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <utxosnapshot.h>
 #include <hash.h>
 #include <validationinterface.h>
 #include <warnings.h>
@@ -120,7 +122,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
     result.pushKV("confirmations", confirmations);
-    result.pushKV("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+    result.pushKV("strippedsize", (int)GetBlockStrippedSize(block));
     result.pushKV("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
     result.pushKV("weight", (int)::GetBlockWeight(block));
     result.pushKV("height", blockindex->nHeight);
@@ -156,6 +158,35 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+void blockToJSON(JSONStreamWriter& stream, const CBlock& block, const CBlockIndex* blockindex)
+{
+    // Reuse the layout of the summary and write the detailed transactions one
+    // at a time. Only the summary needs cs_main: writing to the stream waits
+    // for the client to read the reply.
+    UniValue summary;
+    {
+        LOCK(cs_main);
+        summary = blockToJSON(block, blockindex, false);
+    }
+    const std::vector<std::string>& keys = summary.getKeys();
+    stream.BeginObject();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (keys[i] != "tx") {
+            stream.KeyValue(keys[i], summary[i]);
+            continue;
+        }
+        stream.Key("tx");
+        stream.BeginArray();
+        for (const auto& tx : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
+            stream.Value(objTx);
+        }
+        stream.EndArray();
+    }
+    stream.EndObject();
+}
+
 static UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -459,20 +490,65 @@ UniValue mempoolToJSON(bool fVerbose)
     }
 }
 
+void mempoolToJSON(JSONStreamWriter& stream, bool fVerbose)
+{
+    if (fVerbose)
+    {
+        // Take the mempool lock per entry only, so a slow reader of the
+        // stream does not hold up transaction acceptance and block connection.
+        // Entries removed in the meantime are skipped.
+        std::vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        stream.BeginObject();
+        for (const uint256& hash : vtxid)
+        {
+            UniValue info(UniValue::VOBJ);
+            {
+                LOCK(mempool.cs);
+                const auto it = mempool.mapTx.find(hash);
+                if (it == mempool.mapTx.end()) continue;
+                entryToJSON(info, *it);
+            }
+            stream.KeyValue(hash.ToString(), info);
+        }
+        stream.EndObject();
+    }
+    else
+    {
+        std::vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        stream.BeginArray();
+        for (const uint256& hash : vtxid)
+            stream.Value(hash.ToString());
+        stream.EndArray();
+    }
+}
+
 static UniValue getrawmempool(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() > 1)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
             "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n"
             "\nArguments:\n"
-            "1. verbose (boolean, optional, default=false) True for a json object, false for array of transaction ids\n"
+            "1. verbose           (boolean, optional, default=false) True for a json object, false for array of transaction ids\n"
+            "2. mempool_sequence  (boolean, optional, default=false) If verbose=false, returns a json object with transaction list and mempool sequence number attached.\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{                            (json object)\n"
+            "  \"txids\" : [                (json array of string)\n"
+            "    \"transactionid\"          (string) The transaction id\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"mempool_sequence\" : n     (numeric) The mempool sequence value, as in the ZMQ sequence notifications\n"
+            "}\n"
             "\nResult: (for verbose = true):\n"
             "{                           (json object)\n"
             "  \"transactionid\" : {       (json object)\n"
@@ -488,6 +564,25 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
+    bool include_mempool_sequence = false;
+    if (!request.params[1].isNull())
+        include_mempool_sequence = request.params[1].get_bool();
+
+    if (include_mempool_sequence) {
+        if (fVerbose) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+        }
+        LOCK(mempool.cs);
+        UniValue o(UniValue::VOBJ);
+        o.pushKV("txids", mempoolToJSON(false));
+        o.pushKV("mempool_sequence", (int64_t)mempool.GetSequence());
+        return o;
+    }
+
+    if (request.stream) {
+        mempoolToJSON(*request.stream, fVerbose);
+        return NullUniValue;
+    }
     return mempoolToJSON(fVerbose);
 }
 
@@ -730,8 +825,7 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << pblockindex->GetBlockHeader();
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        return SerializedResult(request, ssBlock);
     }
 
     return blockheaderToJSON(pblockindex);
@@ -756,6 +850,21 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
     return block;
 }
 
+/** The serialization of a block with witnesses, read from disk without deserializing it */
+static std::vector<uint8_t> GetRawBlockChecked(const CBlockIndex* pblockindex)
+{
+    std::vector<uint8_t> data;
+    if (IsBlockPruned(pblockindex)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
+
+    if (!ReadCheckedRawBlockFromDisk(data, pblockindex, Params().MessageStart())) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+
+    return data;
+}
+
 static UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -807,8 +916,6 @@ static UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"e2acdf2dd19a702e5d12a925f1e984b01e47a933562ca893656d4afb38b44ee3\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -820,22 +927,37 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    const CBlockIndex* pblockindex = LookupBlockIndex(hash);
-    if (!pblockindex) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-    }
+    const CBlockIndex* pblockindex;
+    CBlock block;
+    {
+        LOCK(cs_main);
 
-    const CBlock block = GetBlockChecked(pblockindex);
+        pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
 
-    if (verbosity <= 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        if (verbosity <= 0 && !(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS)) {
+            return SerializedResult(request, CDataStream(GetRawBlockChecked(pblockindex), SER_NETWORK, PROTOCOL_VERSION));
+        }
+
+        block = GetBlockChecked(pblockindex);
+
+        if (verbosity <= 0)
+        {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            return SerializedResult(request, ssBlock);
+        }
+
+        if (verbosity < 2 || !request.stream) {
+            return blockToJSON(block, pblockindex, verbosity >= 2);
+        }
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    // Streamed without cs_main
+    blockToJSON(*request.stream, block, pblockindex);
+    return NullUniValue;
 }
 
 struct CCoinsStats
@@ -870,10 +992,9 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
     ss << VARINT(0u);
 }
 
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+//! Calculate statistics about the unspent transaction output set, read through a cursor over view
+static bool GetUTXOStats(CCoinsView *view, std::unique_ptr<CCoinsViewCursor> pcursor, CCoinsStats &stats)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
     assert(pcursor);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
@@ -984,8 +1105,15 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    CCoinsView* view;
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        view = pcoinsdbview.get();
+        pcursor.reset(view->Cursor());
+    }
+    if (GetUTXOStats(view, std::move(pcursor), stats)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
@@ -1968,6 +2096,75 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the UTXO set at the tip of the chain to a snapshot, which can be loaded with -loadutxosnapshot.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) Path of the snapshot, relative to the data directory. It must not exist.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,        (numeric) The number of coins written to the snapshot\n"
+            "  \"base_hash\": \"hash\",      (string) The hash of the block the snapshot is the UTXO set of\n"
+            "  \"base_height\": n,          (numeric) The height of that block\n"
+            "  \"path\": \"path\",           (string) The absolute path of the snapshot\n"
+            "  \"txoutset_hash\": \"hash\",  (string) The hash of the UTXO set, to pin the snapshot with\n"
+            "  \"nchaintx\": n              (numeric) The number of transactions up to the block, to pin the snapshot with\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+    // Written under another name, so a snapshot that exists is complete
+    const fs::path temppath = path.string() + ".incomplete";
+    CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unable to open " + temppath.string() + " for writing");
+    }
+
+    // The cursor reads a snapshot of the database, so the chain can move on
+    // while the coins are written
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        tip = LookupBlockIndex(pcursor->GetBestBlock());
+        assert(tip);
+    }
+
+    SnapshotMetadata metadata;
+    uint256 hash;
+    try {
+        hash = WriteUTXOSnapshot(file, *pcursor, metadata);
+        file.fclose();
+        fs::rename(temppath, path);
+    } catch (const std::exception& e) {
+        file.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Unable to write UTXO snapshot: %s", e.what()));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", (int64_t)metadata.m_coins_count);
+    ret.pushKV("base_hash", tip->GetBlockHash().GetHex());
+    ret.pushKV("base_height", tip->nHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("txoutset_hash", hash.GetHex());
+    ret.pushKV("nchaintx", (int64_t)tip->nChainTx);
+    return ret;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
@@ -2128,13 +2325,11 @@ UniValue scantxoutset(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Invalid descriptor '%s'", desc_str));
             }
             if (!desc->IsRange()) range = 0;
-            for (int i = 0; i <= range; ++i) {
-                std::vector<CScript> scripts;
-                if (!desc->Expand(i, provider, scripts, provider)) {
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
-                }
-                needles.insert(scripts.begin(), scripts.end());
+            std::vector<CScript> scripts;
+            if (!ExpandRange(*desc, 0, range + 1, provider, scripts, provider)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
             }
+            needles.insert(scripts.begin(), scripts.end());
         }
 
         // Scan the unspent transaction output set for inputs
@@ -2182,6 +2377,7 @@ UniValue scantxoutset(const JSONRPCRequest& request)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
@@ -2196,7 +2392,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose", "mempool_sequence"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
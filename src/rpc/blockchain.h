@@ -11,6 +11,7 @@
 
 class CBlock;
 class CBlockIndex;
+class JSONStreamWriter;
 class UniValue;
 
 static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
@@ -30,12 +31,18 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
 
+/** Block description including transaction details, written to a stream */
+void blockToJSON(JSONStreamWriter& stream, const CBlock& block, const CBlockIndex* blockindex);
+
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
 
 /** Mempool to JSON */
 UniValue mempoolToJSON(bool fVerbose = false);
 
+/** Mempool to JSON, written to a stream */
+void mempoolToJSON(JSONStreamWriter& stream, bool fVerbose);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -0,0 +1,490 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <univalue.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+/** Append str as a JSON string, escaped as UniValue::write() does */
+void WriteString(const std::string& str, std::string& out)
+{
+    static const char* HEX = "0123456789abcdef";
+    out += '"';
+    // Copy runs of characters that need no escaping in one go
+    const char* run = str.data();
+    const char* const end = str.data() + str.size();
+    for (const char* p = run; p != end; ++p) {
+        const unsigned char ch = *p;
+        if (ch >= 0x20 && ch != '"' && ch != '\\' && ch != 0x7f) continue;
+        out.append(run, p - run);
+        run = p + 1;
+        switch (ch) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\f': out += "\\f"; break;
+        case '\r': out += "\\r"; break;
+        default:
+            out += "\\u00";
+            out += HEX[ch >> 4];
+            out += HEX[ch & 0xf];
+        }
+    }
+    out.append(run, end - run);
+    out += '"';
+}
+
+/** Append the compact JSON of value, appending nested values to the same buffer */
+void WriteValue(const UniValue& value, std::string& out)
+{
+    switch (value.getType()) {
+    case UniValue::VNULL:
+        out += "null";
+        break;
+    case UniValue::VBOOL:
+        out += value.isTrue() ? "true" : "false";
+        break;
+    case UniValue::VNUM:
+        out += value.getValStr();
+        break;
+    case UniValue::VSTR:
+        WriteString(value.getValStr(), out);
+        break;
+    case UniValue::VARR: {
+        out += '[';
+        const std::vector<UniValue>& values = value.getValues();
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i > 0) out += ',';
+            WriteValue(values[i], out);
+        }
+        out += ']';
+        break;
+    }
+    case UniValue::VOBJ: {
+        out += '{';
+        const std::vector<std::string>& keys = value.getKeys();
+        const std::vector<UniValue>& values = value.getValues();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (i > 0) out += ',';
+            WriteString(keys[i], out);
+            out += ':';
+            WriteValue(values[i], out);
+        }
+        out += '}';
+        break;
+    }
+    }
+}
+
+/**
+ * Builds a string value, decoding UTF-8 and collating UTF-16 surrogate pairs
+ * by the same rules as UniValue::read(), so both accept the same strings.
+ */
+class StringDecoder
+{
+public:
+    explicit StringDecoder(std::string& str) : m_str(str) {}
+
+    /** Append a run of characters below 0x80 */
+    void PushASCII(const char* begin, const char* end)
+    {
+        if (m_state == 0) {
+            m_str.append(begin, end);
+        } else {
+            // Not a continuation of the open UTF-8 sequence
+            for (const char* p = begin; p != end; ++p) PushByte(*p);
+        }
+    }
+
+    /** Append one byte, which may be part of a UTF-8 sequence */
+    void PushByte(unsigned char ch)
+    {
+        if (m_state == 0) {
+            if (ch < 0x80) {
+                m_str += ch;
+            } else if (ch < 0xc0) {
+                m_valid = false;
+            } else if (ch < 0xe0) {
+                m_codepoint = (ch & 0x1f) << 6;
+                m_state = 6;
+            } else if (ch < 0xf0) {
+                m_codepoint = (ch & 0x0f) << 12;
+                m_state = 12;
+            } else if (ch < 0xf8) {
+                m_codepoint = (ch & 0x07) << 18;
+                m_state = 18;
+            } else {
+                m_valid = false;
+            }
+        } else {
+            if ((ch & 0xc0) != 0x80) m_valid = false;
+            m_state -= 6;
+            m_codepoint |= (ch & 0x3f) << m_state;
+            if (m_state == 0) PushCodepoint(m_codepoint);
+        }
+    }
+
+    /** Append a code point, which may be half of a UTF-16 surrogate pair */
+    void PushCodepoint(unsigned int codepoint)
+    {
+        if (m_state) m_valid = false;
+        if (codepoint >= 0xd800 && codepoint < 0xdc00) {
+            if (m_surrogate) m_valid = false;
+            else m_surrogate = codepoint;
+        } else if (codepoint >= 0xdc00 && codepoint < 0xe000) {
+            if (m_surrogate) {
+                AppendUTF8(0x10000 | ((m_surrogate - 0xd800) << 10) | (codepoint - 0xdc00));
+                m_surrogate = 0;
+            } else {
+                m_valid = false;
+            }
+        } else {
+            if (m_surrogate) m_valid = false;
+            else AppendUTF8(codepoint);
+        }
+    }
+
+    /** Whether the string was valid and ends outside any sequence */
+    bool Finalize() const { return m_valid && !m_state && !m_surrogate; }
+
+private:
+    void AppendUTF8(unsigned int codepoint)
+    {
+        if (codepoint <= 0x7f) {
+            m_str += (char)codepoint;
+        } else if (codepoint <= 0x7ff) {
+            m_str += (char)(0xc0 | (codepoint >> 6));
+            m_str += (char)(0x80 | (codepoint & 0x3f));
+        } else if (codepoint <= 0xffff) {
+            m_str += (char)(0xe0 | (codepoint >> 12));
+            m_str += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+            m_str += (char)(0x80 | (codepoint & 0x3f));
+        } else if (codepoint <= 0x1fffff) {
+            m_str += (char)(0xf0 | (codepoint >> 18));
+            m_str += (char)(0x80 | ((codepoint >> 12) & 0x3f));
+            m_str += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+            m_str += (char)(0x80 | (codepoint & 0x3f));
+        }
+    }
+
+    std::string& m_str;
+    bool m_valid = true;
+    unsigned int m_codepoint = 0;
+    /** Bit position of the next UTF-8 continuation byte, or 0 */
+    int m_state = 0;
+    /** First half of an open surrogate pair, or 0 */
+    unsigned int m_surrogate = 0;
+};
+
+bool IsDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+/**
+ * Parser behind ReadJSON. Strings are scanned a run of plain characters at a
+ * time, and values are read in place into their parents.
+ */
+class JSONReader
+{
+public:
+    JSONReader(const char* begin, const char* end) : m_p(begin), m_end(end) {}
+
+    bool Read(UniValue& value)
+    {
+        value.setNull();
+        // Objects and arrays that are still open. Each member is added to its
+        // parent before it is read and filled in place, as copying a completed
+        // member into its parent would copy all of its children as well.
+        std::vector<UniValue*> open;
+        UniValue* next = &value;
+
+        while (true) {
+            // Read a value into *next, descending into objects and arrays
+            if (!SkipSpace()) return false;
+            const char ch = *m_p;
+            if (ch == '{' || ch == '[') {
+                ++m_p;
+                if (open.size() >= MAX_JSON_DEPTH) return false;
+                if (ch == '{') next->setObject();
+                else next->setArray();
+                open.push_back(next);
+                if (!SkipSpace()) return false;
+                if (*m_p != (ch == '{' ? '}' : ']')) {
+                    next = AddMember(*next);
+                    if (!next) return false;
+                    continue;
+                }
+                ++m_p;
+                open.pop_back();
+            } else if (ch == '"') {
+                std::string str;
+                if (!ReadString(str)) return false;
+                next->setStr(str);
+            } else if (ch == '-' || IsDigit(ch)) {
+                std::string num;
+                if (!ReadNumber(num)) return false;
+                *next = UniValue(UniValue::VNUM, num);
+            } else if (ReadKeyword("null")) {
+            } else if (ReadKeyword("true")) {
+                next->setBool(true);
+            } else if (ReadKeyword("false")) {
+                next->setBool(false);
+            } else {
+                return false;
+            }
+
+            // Move on to the next member, closing the objects and arrays that
+            // end here
+            while (true) {
+                if (open.empty()) {
+                    // Nothing may follow the top level value
+                    return !SkipSpace();
+                }
+                UniValue& parent = *open.back();
+                if (!SkipSpace()) return false;
+                if (*m_p == ',') {
+                    ++m_p;
+                    next = AddMember(parent);
+                    if (!next) return false;
+                    break;
+                }
+                if (*m_p != (parent.isObject() ? '}' : ']')) return false;
+                ++m_p;
+                open.pop_back();
+            }
+        }
+    }
+
+private:
+    /**
+     * Append a null member to an object (reading its key) or array, and
+     * return it to be filled in. UniValue only hands out const references to
+     * its members, but they are not const objects. The member stays in place
+     * until the next one is appended.
+     */
+    UniValue* AddMember(UniValue& parent)
+    {
+        if (parent.isObject()) {
+            std::string key;
+            if (!ReadKey(key)) return nullptr;
+            parent.__pushKV(key, NullUniValue);
+        } else {
+            parent.push_back(NullUniValue);
+        }
+        return const_cast<UniValue*>(&parent.getValues().back());
+    }
+
+    /** Skip whitespace; return whether anything follows it */
+    bool SkipSpace()
+    {
+        while (m_p != m_end && json_isspace(*m_p)) ++m_p;
+        return m_p != m_end;
+    }
+
+    bool ReadKeyword(const char* keyword)
+    {
+        const size_t len = strlen(keyword);
+        if ((size_t)(m_end - m_p) < len || memcmp(m_p, keyword, len) != 0) return false;
+        m_p += len;
+        return true;
+    }
+
+    /** Read an object key and the colon after it */
+    bool ReadKey(std::string& key)
+    {
+        key.clear();
+        if (!SkipSpace() || *m_p != '"' || !ReadString(key)) return false;
+        if (!SkipSpace() || *m_p != ':') return false;
+        ++m_p;
+        return true;
+    }
+
+    bool ReadString(std::string& str)
+    {
+        ++m_p; // opening quote
+        StringDecoder decoder(str);
+        while (true) {
+            // Copy the run of characters that need no decoding in one go
+            const char* run = m_p;
+            while (m_p != m_end) {
+                const unsigned char ch = *m_p;
+                if (ch < 0x20 || ch >= 0x80 || ch == '"' || ch == '\\') break;
+                ++m_p;
+            }
+            decoder.PushASCII(run, m_p);
+            if (m_p == m_end) return false;
+
+            const unsigned char ch = *m_p++;
+            if (ch == '"') return decoder.Finalize();
+            if (ch < 0x20) return false;
+            if (ch >= 0x80) {
+                decoder.PushByte(ch);
+                continue;
+            }
+            // Escape sequence
+            if (m_p == m_end) return false;
+            switch (*m_p++) {
+            case '"': decoder.PushByte('"'); break;
+            case '\\': decoder.PushByte('\\'); break;
+            case '/': decoder.PushByte('/'); break;
+            case 'b': decoder.PushByte('\b'); break;
+            case 'f': decoder.PushByte('\f'); break;
+            case 'n': decoder.PushByte('\n'); break;
+            case 'r': decoder.PushByte('\r'); break;
+            case 't': decoder.PushByte('\t'); break;
+            case 'u': {
+                if (m_end - m_p < 4) return false;
+                unsigned int codepoint = 0;
+                for (int i = 0; i < 4; ++i) {
+                    const char digit = *m_p++;
+                    codepoint <<= 4;
+                    if (IsDigit(digit)) codepoint |= digit - '0';
+                    else if (digit >= 'a' && digit <= 'f') codepoint |= digit - 'a' + 10;
+                    else if (digit >= 'A' && digit <= 'F') codepoint |= digit - 'A' + 10;
+                    else return false;
+                }
+                decoder.PushCodepoint(codepoint);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+    }
+
+    /** Read a number, keeping its text as UniValue does */
+    bool ReadNumber(std::string& num)
+    {
+        const char* const begin = m_p;
+        if (*m_p == '-') ++m_p;
+        if (m_p == m_end || !IsDigit(*m_p)) return false;
+        // No leading zeros
+        if (*m_p == '0' && m_p + 1 != m_end && IsDigit(m_p[1])) return false;
+        while (m_p != m_end && IsDigit(*m_p)) ++m_p;
+        if (m_p != m_end && *m_p == '.') {
+            ++m_p;
+            if (m_p == m_end || !IsDigit(*m_p)) return false;
+            while (m_p != m_end && IsDigit(*m_p)) ++m_p;
+        }
+        if (m_p != m_end && (*m_p == 'e' || *m_p == 'E')) {
+            ++m_p;
+            if (m_p != m_end && (*m_p == '-' || *m_p == '+')) ++m_p;
+            if (m_p == m_end || !IsDigit(*m_p)) return false;
+            while (m_p != m_end && IsDigit(*m_p)) ++m_p;
+        }
+        num.assign(begin, m_p);
+        return true;
+    }
+
+    const char* m_p;
+    const char* const m_end;
+};
+
+} // namespace
+
+std::string WriteJSON(const UniValue& value)
+{
+    std::string out;
+    WriteValue(value, out);
+    return out;
+}
+
+bool ReadJSON(const std::string& json, UniValue& value)
+{
+    return JSONReader(json.data(), json.data() + json.size()).Read(value);
+}
+
+JSONStreamWriter::JSONStreamWriter(Sink sink, size_t chunk_size) :
+    m_sink(std::move(sink)), m_chunk_size(chunk_size), m_after_key(false), m_flushed(0), m_values(0)
+{
+    m_buffer.reserve(m_chunk_size);
+}
+
+void JSONStreamWriter::BeginValue()
+{
+    ++m_values;
+    if (m_after_key) {
+        m_after_key = false;
+        return;
+    }
+    if (!m_empty.empty()) {
+        if (!m_empty.back()) m_buffer += ',';
+        m_empty.back() = false;
+    }
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    m_buffer += '{';
+    m_empty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!m_empty.empty() && !m_after_key);
+    m_empty.pop_back();
+    m_buffer += '}';
+    MaybeFlush();
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    m_buffer += '[';
+    m_empty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!m_empty.empty() && !m_after_key);
+    m_empty.pop_back();
+    m_buffer += ']';
+    MaybeFlush();
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!m_empty.empty() && !m_after_key);
+    if (!m_empty.back()) m_buffer += ',';
+    m_empty.back() = false;
+    WriteString(key, m_buffer);
+    m_buffer += ':';
+    m_after_key = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    WriteValue(value, m_buffer);
+    MaybeFlush();
+}
+
+void JSONStreamWriter::MaybeFlush()
+{
+    if (m_buffer.size() >= m_chunk_size) Flush();
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (m_buffer.empty()) return;
+    m_flushed += m_buffer.size();
+    m_sink(TakeBuffer());
+}
+
+std::string JSONStreamWriter::TakeBuffer()
+{
+    std::string chunk;
+    chunk.swap(m_buffer);
+    m_buffer.reserve(m_chunk_size);
+    return chunk;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Default number of buffered bytes after which a JSONStreamWriter hands its output to the sink */
+static const size_t DEFAULT_JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Compact JSON of value, the same as UniValue::write() produces. Nested values
+ * are appended to one buffer instead of being written to strings of their own
+ * and copied into their parents, and strings are escaped a run at a time.
+ */
+std::string WriteJSON(const UniValue& value);
+
+/** Deepest nesting of objects and arrays ReadJSON accepts */
+static const size_t MAX_JSON_DEPTH = 512;
+
+/**
+ * Parse json into value, accepting the same documents as UniValue::read() and
+ * producing the same values, except that nesting deeper than MAX_JSON_DEPTH is
+ * rejected (freeing a deeper value recurses once per level), and so is a lone
+ * minus sign. Strings are
+ * scanned a run of plain characters at a time rather than character by
+ * character. value is only meaningful on success.
+ */
+bool ReadJSON(const std::string& json, UniValue& value);
+
+/**
+ * Incremental JSON writer.
+ *
+ * Produces the same compact output as UniValue::write() without requiring the
+ * whole document to exist as a UniValue tree. Output is buffered and passed to
+ * the sink each time the buffer grows beyond the chunk size, so a large result
+ * only ever occupies one chunk (plus the element currently being written).
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(std::string&& chunk)> Sink;
+
+    explicit JSONStreamWriter(Sink sink, size_t chunk_size = DEFAULT_JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write an object key. Must be followed by exactly one value. */
+    void Key(const std::string& key);
+    /** Write a complete value (which may itself be an object or array). */
+    void Value(const UniValue& value);
+    void KeyValue(const std::string& key, const UniValue& value)
+    {
+        Key(key);
+        Value(value);
+    }
+
+    /** Pass all buffered output to the sink. */
+    void Flush();
+    /** Return and clear buffered output without passing it to the sink. */
+    std::string TakeBuffer();
+
+    /** Number of bytes that have been passed to the sink so far. */
+    size_t BytesFlushed() const { return m_flushed; }
+    /** Number of values (including objects and arrays) written so far. */
+    size_t ValuesWritten() const { return m_values; }
+
+private:
+    void BeginValue();
+    void MaybeFlush();
+
+    Sink m_sink;
+    size_t m_chunk_size;
+    std::string m_buffer;
+    /** For every open object/array, whether it has no members yet */
+    std::vector<bool> m_empty;
+    bool m_after_key;
+    size_t m_flushed;
+    size_t m_values;
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
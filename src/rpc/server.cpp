@@ -9,6 +9,7 @@
 #include <key_io.h>
 #include <random.h>
 #include <shutdown.h>
+#include <streams.h>
 #include <sync.h>
 #include <ui_interface.h>
 #include <util.h>
@@ -412,13 +413,21 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
+UniValue JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
     UniValue ret(UniValue::VARR);
     for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
         ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
 
-    return ret.write() + "\n";
+    return ret;
+}
+
+UniValue SerializedResult(const JSONRPCRequest& request, const CDataStream& ss)
+{
+    if (request.fBinary) {
+        return ss.str();
+    }
+    return HexStr(ss.begin(), ss.end());
 }
 
 /**
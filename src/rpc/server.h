@@ -19,7 +19,9 @@
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 
+class CDataStream;
 class CRPCCommand;
+class JSONStreamWriter;
 
 namespace RPCServer
 {
@@ -46,8 +48,19 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /**
+     * If set, the method may write its result to this stream instead of
+     * returning it. Methods that do so return NullUniValue.
+     */
+    JSONStreamWriter* stream;
+    /**
+     * Whether the client asked for the compact binary reply encoding. In that
+     * case results that are serialized objects are returned as raw bytes
+     * instead of hex (see SerializedResult).
+     */
+    bool fBinary;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), stream(nullptr), fBinary(false) {}
     void parse(const UniValue& valRequest);
 };
 
@@ -201,7 +214,13 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
+UniValue JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
+
+/**
+ * Result for a serialized object: hex encoded, or the raw bytes if the
+ * request uses the binary reply encoding.
+ */
+UniValue SerializedResult(const JSONRPCRequest& request, const CDataStream& ss);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -13,6 +13,10 @@
 #include <util.h>
 #include <utilstrencodings.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <vector>
@@ -92,6 +96,8 @@ class BIP32PubkeyProvider final : public PubkeyProvider
     CExtPubKey m_extkey;
     KeyPath m_path;
     DeriveType m_derive;
+    //! The extended public key at m_path, when it can be derived without private keys
+    CExtPubKey m_path_extkey;
 
     bool GetExtKey(const SigningProvider& arg, CExtKey& ret) const
     {
@@ -115,7 +121,16 @@ class BIP32PubkeyProvider final : public PubkeyProvider
     }
 
 public:
-    BIP32PubkeyProvider(const CExtPubKey& extkey, KeyPath path, DeriveType derive) : m_extkey(extkey), m_path(std::move(path)), m_derive(derive) {}
+    BIP32PubkeyProvider(const CExtPubKey& extkey, KeyPath path, DeriveType derive) : m_extkey(extkey), m_path(std::move(path)), m_derive(derive)
+    {
+        // Derive the path once, rather than for every position
+        if (!IsHardened()) {
+            m_path_extkey = m_extkey;
+            for (auto entry : m_path) {
+                m_path_extkey.Derive(m_path_extkey, entry);
+            }
+        }
+    }
     bool IsRange() const override { return m_derive != DeriveType::NO; }
     size_t GetSize() const override { return 33; }
     bool GetPubKey(int pos, const SigningProvider& arg, CPubKey& out) const override
@@ -130,11 +145,7 @@ public:
             if (m_derive == DeriveType::HARDENED) key.Derive(key, pos | 0x80000000UL);
             out = key.Neuter().pubkey;
         } else {
-            // TODO: optimize by caching
-            CExtPubKey key = m_extkey;
-            for (auto entry : m_path) {
-                key.Derive(key, entry);
-            }
+            CExtPubKey key = m_path_extkey;
             if (m_derive == DeriveType::UNHARDENED) key.Derive(key, pos);
             assert(m_derive != DeriveType::HARDENED);
             out = key.pubkey;
@@ -564,3 +575,32 @@ std::unique_ptr<Descriptor> Parse(const std::string& descriptor, FlatSigningProv
     if (sp.size() == 0 && ret) return ret;
     return nullptr;
 }
+
+/** Maximum number of threads ExpandRange uses */
+static const int MAX_EXPAND_THREADS = 16;
+/** Minimum number of positions expanded by each thread of ExpandRange */
+static const int MIN_POSITIONS_PER_THREAD = 16;
+
+bool ExpandRange(const Descriptor& descriptor, int begin, int end, const SigningProvider& provider, std::vector<CScript>& output_scripts, FlatSigningProvider& out)
+{
+    if (begin >= end) return true;
+    const int count = end - begin;
+    std::vector<std::vector<CScript>> scripts(count);
+    std::vector<FlatSigningProvider> pos_outs(count);
+    std::atomic<bool> failed{false};
+    ParallelFor(count, MAX_EXPAND_THREADS, MIN_POSITIONS_PER_THREAD, [&](size_t i) {
+        if (failed) return;
+        if (!descriptor.Expand(begin + i, provider, scripts[i], pos_outs[i])) failed = true;
+    });
+    if (failed) return false;
+
+    for (std::vector<CScript>& pos_scripts : scripts) {
+        std::move(pos_scripts.begin(), pos_scripts.end(), std::back_inserter(output_scripts));
+    }
+    for (const FlatSigningProvider& pos_out : pos_outs) {
+        out.scripts.insert(pos_out.scripts.begin(), pos_out.scripts.end());
+        out.pubkeys.insert(pos_out.pubkeys.begin(), pos_out.pubkeys.end());
+        out.keys.insert(pos_out.keys.begin(), pos_out.keys.end());
+    }
+    return true;
+}
@@ -51,5 +51,13 @@ struct Descriptor {
 /** Parse a descriptor string. Included private keys are put in out. Returns nullptr if parsing fails. */
 std::unique_ptr<Descriptor> Parse(const std::string& descriptor, FlatSigningProvider& out);
 
+/** Expand a descriptor at every position in [begin, end), on several threads for large ranges.
+ *
+ * The scriptPubKeys of all positions are appended to output_scripts, in order of position.
+ * out is only written to once all positions are expanded, so it may be equal to provider.
+ * Returns false if expanding any position fails.
+ */
+bool ExpandRange(const Descriptor& descriptor, int begin, int end, const SigningProvider& provider, std::vector<CScript>& output_scripts, FlatSigningProvider& out);
+
 #endif // BITCOIN_SCRIPT_DESCRIPTOR_H
 
@@ -344,7 +344,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, SCRIPT_ERR_MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                stack.push_back(std::move(vchPushValue));
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -897,7 +897,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     else if (opcode == OP_HASH256)
                         CHash256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     popstack(stack);
-                    stack.push_back(vchHash);
+                    stack.push_back(std::move(vchHash));
                 }
                 break;
 
@@ -1487,7 +1487,8 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
     if (!EvalScript(stack, scriptSig, flags, checker, SigVersion::BASE, serror))
         // serror is set
         return false;
-    if (flags & SCRIPT_VERIFY_P2SH)
+    // The stack is only evaluated again against the redeem script of P2SH
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash())
         stackCopy = stack;
     if (!EvalScript(stack, scriptPubKey, flags, checker, SigVersion::BASE, serror))
         // serror is set
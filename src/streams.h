@@ -8,6 +8,7 @@
 
 #include <support/allocators/zeroafterfree.h>
 #include <serialize.h>
+#include <span.h>
 
 #include <algorithm>
 #include <assert.h>
@@ -139,6 +140,51 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for reading from an existing byte span, without copying it. */
+class SpanReader
+{
+public:
+    SpanReader(int nTypeIn, int nVersionIn, Span<const unsigned char> data) : nType(nTypeIn), nVersion(nVersionIn), m_data(data) {}
+
+    template<typename T>
+    SpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.size() == 0; }
+    //! The data that has not been read yet
+    Span<const unsigned char> GetRemaining() const { return m_data; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n > (size_t)m_data.size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+
+    void ignore(size_t n)
+    {
+        if (n > (size_t)m_data.size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(n);
+    }
+
+private:
+    const int nType;
+    const int nVersion;
+    Span<const unsigned char> m_data;
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+#define BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Monotonic arena for short-lived objects that die together, such as the
+ * temporaries of connecting a block.
+ *
+ * Memory is handed out by bumping a pointer through chunks obtained from the
+ * heap. Deallocations are ignored, and all memory is released at once when the
+ * arena is destroyed. Allocations larger than a quarter of a chunk get a chunk
+ * of their own, so they do not waste the rest of the current one.
+ *
+ * Not thread-safe.
+ */
+class MonotonicArena
+{
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+    explicit MonotonicArena(size_t chunk_size = DEFAULT_CHUNK_SIZE) : m_chunk_size(chunk_size) {}
+
+    MonotonicArena(const MonotonicArena& other) = delete;
+    MonotonicArena& operator=(const MonotonicArena& other) = delete;
+
+    /** Allocate size bytes aligned to align, which is a power of two not above that of operator new */
+    void* Allocate(size_t size, size_t align)
+    {
+        assert(align > 0 && (align & (align - 1)) == 0 && align <= alignof(max_align_t));
+        m_used += size;
+        if (size > m_chunk_size / 4) {
+            return NewChunk(size);
+        }
+        uintptr_t pos = Align(m_pos, align);
+        if (m_pos == nullptr || pos + size > reinterpret_cast<uintptr_t>(m_end)) {
+            m_pos = NewChunk(m_chunk_size);
+            m_end = m_pos + m_chunk_size;
+            pos = Align(m_pos, align);
+        }
+        m_pos = reinterpret_cast<char*>(pos + size);
+        return reinterpret_cast<void*>(pos);
+    }
+
+    /** Bytes handed out so far */
+    size_t UsedBytes() const { return m_used; }
+    /** Number of chunks obtained from the heap */
+    size_t ChunkCount() const { return m_chunks.size(); }
+
+private:
+    const size_t m_chunk_size;
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    //! Free space of the current chunk
+    char* m_pos = nullptr;
+    char* m_end = nullptr;
+    size_t m_used = 0;
+
+    static uintptr_t Align(const char* pos, size_t align)
+    {
+        return (reinterpret_cast<uintptr_t>(pos) + align - 1) & ~uintptr_t(align - 1);
+    }
+
+    char* NewChunk(size_t size)
+    {
+        m_chunks.emplace_back(new char[size]);
+        return m_chunks.back().get();
+    }
+};
+
+/**
+ * STL allocator that allocates from a MonotonicArena, or from the heap if it
+ * has none. Containers that are copied get no arena, so the copies can
+ * outlive it; moved containers keep theirs.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator() noexcept {}
+    explicit ArenaAllocator(MonotonicArena* arena) noexcept : m_arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.GetArena()) {}
+
+    T* allocate(size_t n)
+    {
+        if (m_arena == nullptr) return std::allocator<T>().allocate(n);
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_alloc();
+        return static_cast<T*>(m_arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (m_arena == nullptr) std::allocator<T>().deallocate(p, n);
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    MonotonicArena* GetArena() const { return m_arena; }
+
+private:
+    MonotonicArena* m_arena = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.GetArena() == b.GetArena(); }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.GetArena() != b.GetArena(); }
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
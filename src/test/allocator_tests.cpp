@@ -4,10 +4,12 @@
 
 #include <util.h>
 
+#include <support/allocators/arena.h>
 #include <support/allocators/secure.h>
 #include <test/test_bitcoin.h>
 
 #include <memory>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -128,6 +130,56 @@ BOOST_AUTO_TEST_CASE(arena_tests)
     BOOST_CHECK(b.stats().free == synth_size);
 }
 
+BOOST_AUTO_TEST_CASE(monotonic_arena_tests)
+{
+    MonotonicArena arena(1024);
+    BOOST_CHECK_EQUAL(arena.ChunkCount(), 0U);
+
+    // Allocations are aligned and bumped through the same chunk
+    char* a = static_cast<char*>(arena.Allocate(3, 1));
+    char* b = static_cast<char*>(arena.Allocate(8, 8));
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(b) % 8, 0U);
+    BOOST_CHECK(b >= a + 3 && b < a + 16);
+    BOOST_CHECK_EQUAL(arena.ChunkCount(), 1U);
+    BOOST_CHECK_EQUAL(arena.UsedBytes(), 11U);
+
+    // Large allocations get a chunk of their own, and do not end the current one
+    arena.Allocate(1000, 16);
+    BOOST_CHECK_EQUAL(arena.ChunkCount(), 2U);
+    char* c = static_cast<char*>(arena.Allocate(1, 1));
+    BOOST_CHECK(c == b + 8);
+
+    // A full chunk is followed by another one
+    for (int i = 0; i < 8; ++i) arena.Allocate(200, 8);
+    BOOST_CHECK_EQUAL(arena.ChunkCount(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(arena_allocator_tests)
+{
+    MonotonicArena arena;
+    std::vector<int, ArenaAllocator<int>> v{ArenaAllocator<int>(&arena)};
+    for (int i = 0; i < 1000; ++i) v.push_back(i);
+    BOOST_CHECK_EQUAL(arena.ChunkCount(), 1U);
+    BOOST_CHECK(arena.UsedBytes() >= 1000 * sizeof(int));
+
+    // Copies are on the heap, moves keep the arena
+    std::vector<int, ArenaAllocator<int>> copy(v);
+    BOOST_CHECK(copy.get_allocator().GetArena() == nullptr);
+    BOOST_CHECK(copy == v);
+    const size_t used = arena.UsedBytes();
+    std::vector<int, ArenaAllocator<int>> moved(std::move(v));
+    BOOST_CHECK(moved.get_allocator().GetArena() == &arena);
+    BOOST_CHECK(moved == copy);
+    BOOST_CHECK_EQUAL(arena.UsedBytes(), used);
+
+    // Copy assignment keeps the allocator of the target
+    copy = moved;
+    BOOST_CHECK(copy.get_allocator().GetArena() == nullptr);
+    moved = std::move(copy);
+    BOOST_CHECK(moved.get_allocator().GetArena() == nullptr);
+    BOOST_CHECK_EQUAL(moved.size(), 1000U);
+}
+
 /** Mock LockedPageAllocator for testing */
 class TestLockedPageAllocator: public LockedPageAllocator
 {
@@ -0,0 +1,198 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcompression.h>
+#include <chainparams.h>
+#include <crypto/common.h>
+#include <lz4.h>
+#include <streams.h>
+#include <validation.h>
+#include <test/test_bitcoin.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompression_tests, BasicTestingSetup)
+
+static Span<const unsigned char> ConstSpan(const std::vector<unsigned char>& v)
+{
+    return Span<const unsigned char>(v.data(), v.size());
+}
+
+static std::vector<unsigned char> RandomData(size_t size)
+{
+    std::vector<unsigned char> data(size);
+    for (unsigned char& c : data) c = InsecureRandBits(8);
+    return data;
+}
+
+static void CheckRoundTrip(const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> compressed;
+    LZ4Compress(ConstSpan(data), compressed);
+    std::vector<unsigned char> decompressed(data.size());
+    BOOST_CHECK(LZ4Decompress(ConstSpan(compressed), MakeSpan(decompressed)));
+    BOOST_CHECK(decompressed == data);
+
+    // Decompressing into a buffer of the wrong size fails
+    std::vector<unsigned char> shorter(data.size() ? data.size() - 1 : 0);
+    BOOST_CHECK(data.empty() || !LZ4Decompress(ConstSpan(compressed), MakeSpan(shorter)));
+    std::vector<unsigned char> longer(data.size() + 1);
+    BOOST_CHECK(!LZ4Decompress(ConstSpan(compressed), MakeSpan(longer)));
+}
+
+BOOST_AUTO_TEST_CASE(lz4_roundtrip)
+{
+    for (size_t size : {0, 1, 4, 12, 13, 17, 100, 1000, 70000, 300000}) {
+        CheckRoundTrip(RandomData(size));
+        CheckRoundTrip(std::vector<unsigned char>(size, 0));
+
+        std::vector<unsigned char> pattern(size);
+        for (size_t i = 0; i < size; ++i) pattern[i] = i % 7;
+        CheckRoundTrip(pattern);
+    }
+
+    // Repeats both within and beyond the 64 KiB window
+    std::vector<unsigned char> data = RandomData(50000);
+    const std::vector<unsigned char> chunk = RandomData(1000);
+    for (int i = 0; i < 100; ++i) {
+        data.insert(data.end(), chunk.begin(), chunk.end());
+        const std::vector<unsigned char> noise = RandomData(InsecureRandRange(2000));
+        data.insert(data.end(), noise.begin(), noise.end());
+    }
+    data.insert(data.end(), data.begin(), data.begin() + 50000);
+    std::vector<unsigned char> compressed;
+    LZ4Compress(ConstSpan(data), compressed);
+    BOOST_CHECK(compressed.size() < data.size() * 3 / 4);
+    CheckRoundTrip(data);
+}
+
+BOOST_AUTO_TEST_CASE(lz4_decompress)
+{
+    // A literal, a match of 8 bytes one back that overlaps itself, and 5 literals
+    const std::vector<unsigned char> block = {0x14, 'a', 0x01, 0x00, 0x50, 'b', 'b', 'b', 'b', 'b'};
+    std::vector<unsigned char> out(14);
+    BOOST_CHECK(LZ4Decompress(ConstSpan(block), MakeSpan(out)));
+    BOOST_CHECK(std::string(out.begin(), out.end()) == "aaaaaaaaabbbbb");
+
+    // Offsets of zero or before the start of the output are invalid
+    std::vector<unsigned char> bad = block;
+    bad[2] = 0;
+    BOOST_CHECK(!LZ4Decompress(ConstSpan(bad), MakeSpan(out)));
+    bad[2] = 2;
+    BOOST_CHECK(!LZ4Decompress(ConstSpan(bad), MakeSpan(out)));
+
+    // Truncated blocks are invalid
+    std::vector<unsigned char> data = RandomData(1000);
+    data.insert(data.end(), data.begin(), data.end());
+    std::vector<unsigned char> compressed;
+    LZ4Compress(ConstSpan(data), compressed);
+    std::vector<unsigned char> decompressed(data.size());
+    for (size_t size = 0; size < compressed.size(); ++size) {
+        BOOST_CHECK(!LZ4Decompress(ConstSpan(compressed).first(size), MakeSpan(decompressed)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_record)
+{
+    std::vector<unsigned char> block(1000, 'x');
+    std::vector<unsigned char> record;
+    BOOST_CHECK(CompressBlockRecord(ConstSpan(block), record));
+    std::vector<unsigned char> decompressed;
+    BOOST_CHECK(DecompressBlockRecord(ConstSpan(record), decompressed));
+    BOOST_CHECK(decompressed == block);
+
+    // Incompressible blocks are not stored compressed
+    block = RandomData(1000);
+    BOOST_CHECK(!CompressBlockRecord(ConstSpan(block), record));
+    BOOST_CHECK(DecompressBlockRecord(ConstSpan(record), decompressed));
+    BOOST_CHECK(decompressed == block);
+
+    // Records need the size of the block, within the deserialization limit
+    BOOST_CHECK(!DecompressBlockRecord(ConstSpan(record).first(3), decompressed));
+    WriteLE32(record.data(), MAX_SIZE + 1);
+    BOOST_CHECK(!DecompressBlockRecord(ConstSpan(record), decompressed));
+}
+
+BOOST_AUTO_TEST_CASE(decompressed_block_cache)
+{
+    DecompressedBlockCache cache(100);
+    auto block = [](unsigned char c) { return std::make_shared<const std::vector<unsigned char>>(40, c); };
+    cache.Insert(CDiskBlockPos(0, 8), block('a'));
+    cache.Insert(CDiskBlockPos(1, 8), block('b'));
+    BOOST_CHECK_EQUAL(cache.Get(CDiskBlockPos(0, 8))->front(), 'a');
+    BOOST_CHECK(!cache.Get(CDiskBlockPos(0, 9)));
+
+    // The least recently used block is evicted
+    cache.Insert(CDiskBlockPos(0, 100), block('c'));
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 8)));
+    BOOST_CHECK(!cache.Get(CDiskBlockPos(1, 8)));
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 100)));
+
+    // Blocks larger than the cache are not kept
+    cache.Insert(CDiskBlockPos(2, 8), std::make_shared<const std::vector<unsigned char>>(101, 'd'));
+    BOOST_CHECK(!cache.Get(CDiskBlockPos(2, 8)));
+    BOOST_CHECK(cache.Get(CDiskBlockPos(0, 8)));
+
+    cache.Clear();
+    BOOST_CHECK(!cache.Get(CDiskBlockPos(0, 8)));
+}
+
+BOOST_AUTO_TEST_CASE(read_compressed_block)
+{
+    SetDataDir("read_compressed_block");
+    ClearDatadirCache();
+    g_decompressed_block_cache.Clear();
+
+    const CChainParams& params = Params();
+    const CBlock& genesis = params.GenesisBlock();
+    std::vector<unsigned char> block;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, block, 0, genesis);
+    std::vector<unsigned char> record;
+    BOOST_REQUIRE(CompressBlockRecord(ConstSpan(block), record));
+
+    // The block stored both uncompressed and compressed
+    std::vector<unsigned char> file;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, file, file.size(), params.MessageStart(), (uint32_t)block.size());
+    const CDiskBlockPos raw_pos(0, file.size());
+    file.insert(file.end(), block.begin(), block.end());
+    CVectorWriter(SER_DISK, CLIENT_VERSION, file, file.size(), params.MessageStart(), (uint32_t)(record.size() | BLOCK_RECORD_COMPRESSED));
+    const CDiskBlockPos compressed_pos(0, file.size());
+    file.insert(file.end(), record.begin(), record.end());
+
+    const fs::path path = GetBlockPosFilename(CDiskBlockPos(0, 0), "blk");
+    CAutoFile(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION).write((const char*)file.data(), file.size());
+
+    for (const CDiskBlockPos& pos : {raw_pos, compressed_pos}) {
+        CBlock read;
+        BOOST_CHECK(ReadBlockFromDisk(read, pos, params.GetConsensus()));
+        BOOST_CHECK_EQUAL(read.GetHash(), genesis.GetHash());
+
+        std::vector<uint8_t> raw;
+        BOOST_CHECK(ReadRawBlockFromDisk(raw, pos, params.MessageStart()));
+        BOOST_CHECK(raw == block);
+
+        CBlockHeader header;
+        CTransactionRef tx;
+        BOOST_CHECK(ReadTxFromDisk(header, tx, pos, GetSizeOfCompactSize(genesis.vtx.size())));
+        BOOST_CHECK_EQUAL(header.GetHash(), genesis.GetHash());
+        BOOST_CHECK_EQUAL(tx->GetHash(), genesis.vtx[0]->GetHash());
+    }
+
+    // Only the decompressed block is cached
+    BOOST_CHECK(!g_decompressed_block_cache.Get(raw_pos));
+    BOOST_CHECK(g_decompressed_block_cache.Get(compressed_pos));
+
+    // A malformed compressed record cannot be read
+    g_decompressed_block_cache.Clear();
+    file[compressed_pos.nPos] ^= 1;
+    CAutoFile(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION).write((const char*)file.data(), file.size());
+    CBlock read;
+    BOOST_CHECK(!ReadBlockFromDisk(read, compressed_pos, params.GetConsensus()));
+    std::vector<uint8_t> raw;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, compressed_pos, params.MessageStart()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemapper.h>
+#include <test/test_bitcoin.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemapper_tests, BasicTestingSetup)
+
+static void AppendToFile(const fs::path& path, const std::vector<unsigned char>& data)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(mapped_file)
+{
+    const fs::path dir = SetDataDir("mapped_file");
+    const std::vector<unsigned char> data = {1, 2, 3, 4, 5};
+    AppendToFile(dir / "file", data);
+
+    std::shared_ptr<const MappedFile> file = MappedFile::Open(dir / "file");
+    BOOST_REQUIRE(file);
+    BOOST_CHECK(file->Data() == MakeSpan(data));
+
+    // Missing and empty files are not mapped
+    BOOST_CHECK(!MappedFile::Open(dir / "missing"));
+    AppendToFile(dir / "empty", {});
+    BOOST_CHECK(!MappedFile::Open(dir / "empty"));
+}
+
+BOOST_AUTO_TEST_CASE(block_file_mapper)
+{
+    const fs::path dir = SetDataDir("block_file_mapper");
+    for (const char* name : {"a", "b", "c"}) {
+        AppendToFile(dir / name, std::vector<unsigned char>(100, name[0]));
+    }
+
+    BlockFileMapper mapper(2);
+    std::shared_ptr<const MappedFile> a = mapper.Get(dir / "a", 100);
+    BOOST_REQUIRE(a);
+    BOOST_CHECK(mapper.Get(dir / "a", 50) == a);
+    BOOST_CHECK(!mapper.Get(dir / "a", 101));
+
+    // The file grew: it is mapped again
+    AppendToFile(dir / "a", std::vector<unsigned char>(100, 'a'));
+    std::shared_ptr<const MappedFile> a2 = mapper.Get(dir / "a", 200);
+    BOOST_REQUIRE(a2);
+    BOOST_CHECK(a2 != a);
+    BOOST_CHECK_EQUAL(a2->Size(), 200U);
+    // The old mapping stays readable while it is in use
+    BOOST_CHECK_EQUAL(a->Size(), 100U);
+    BOOST_CHECK_EQUAL(a->Data()[99], 'a');
+
+    // The least recently used mapping is evicted
+    std::shared_ptr<const MappedFile> b = mapper.Get(dir / "b", 100);
+    BOOST_CHECK(mapper.Get(dir / "a", 200) == a2);
+    std::shared_ptr<const MappedFile> c = mapper.Get(dir / "c", 100);
+    BOOST_CHECK(mapper.Get(dir / "a", 200) == a2);
+    BOOST_CHECK(mapper.Get(dir / "b", 100) != b);
+    BOOST_CHECK_EQUAL(b->Data()[0], 'b');
+
+    mapper.Release(dir / "a");
+    BOOST_CHECK(mapper.Get(dir / "a", 200) != a2);
+
+    // Mapping can be disabled
+    mapper.SetMaxFiles(0);
+    BOOST_CHECK(!mapper.Get(dir / "a", 100));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
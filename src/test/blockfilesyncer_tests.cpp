@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilesyncer.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilesyncer_tests, BasicTestingSetup)
+
+static void CreateFile(const fs::path& path)
+{
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite("data", 1, 4, file), 4U);
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(block_file_syncer)
+{
+    const fs::path dir = SetDataDir("block_file_syncer");
+    CreateFile(dir / "blk00000.dat");
+    CreateFile(dir / "rev00000.dat");
+
+    BlockFileSyncer syncer;
+
+    // Without the thread files are synced right away
+    syncer.Sync(dir / "blk00000.dat");
+    BOOST_CHECK(syncer.Wait());
+    syncer.Sync(dir / "missing.dat");
+    BOOST_CHECK(!syncer.Wait());
+    // Failures are only reported once
+    BOOST_CHECK(syncer.Wait());
+
+    syncer.Start();
+    for (int i = 0; i < 100; ++i) {
+        syncer.Sync(dir / "blk00000.dat");
+        syncer.Sync(dir / "rev00000.dat");
+    }
+    BOOST_CHECK(syncer.Wait());
+    syncer.Sync(dir / "missing.dat");
+    syncer.Sync(dir / "blk00000.dat");
+    BOOST_CHECK(!syncer.Wait());
+    BOOST_CHECK(syncer.Wait());
+
+    // Stopping syncs what is still queued, and later files are synced right away
+    syncer.Sync(dir / "missing.dat");
+    syncer.Stop();
+    BOOST_CHECK(!syncer.Wait());
+    syncer.Sync(dir / "rev00000.dat");
+    BOOST_CHECK(syncer.Wait());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <coins.h>
 #include <script/standard.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <utilstrencodings.h>
@@ -190,6 +191,12 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         // Once every 1000 iterations and at the end, verify the full cache.
         if (InsecureRandRange(1000) == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
             for (const auto& entry : result) {
+                // PeekCoin must agree with the cache without populating it
+                const bool cached = stack.back()->HaveCoinInCache(entry.first);
+                Coin peeked;
+                BOOST_CHECK(stack.back()->PeekCoin(entry.first, peeked) == !entry.second.IsSpent());
+                BOOST_CHECK(entry.second.IsSpent() || peeked == entry.second);
+                BOOST_CHECK(stack.back()->HaveCoinInCache(entry.first) == cached);
                 bool have = stack.back()->HaveCoin(entry.first);
                 const Coin& coin = stack.back()->AccessCoin(entry.first);
                 BOOST_CHECK(have == !coin.IsSpent());
@@ -855,4 +862,68 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_db_sorted_writes)
+{
+    // A database written in key order ends up with the same coins
+    CCoinsViewDB unsorted(1 << 20, true);
+    CCoinsViewDB sorted(1 << 20, true, false, DBOptions::ChainstateBulkLoad(1 << 20));
+    std::vector<COutPoint> spent;
+    for (int block = 1; block <= 3; ++block) {
+        CCoinsMap coins;
+        for (int i = 0; i < 1000; ++i) {
+            const COutPoint outpoint(InsecureRand256(), InsecureRandRange(3));
+            CCoinsCacheEntry& entry = coins[outpoint];
+            entry.coin = Coin(CTxOut(InsecureRandRange(100 * COIN), CScript() << OP_TRUE), block, false);
+            // Coins which are not dirty are not written
+            entry.flags = InsecureRandBool() ? CCoinsCacheEntry::DIRTY : 0;
+            if (entry.flags && InsecureRandBool()) spent.push_back(outpoint);
+        }
+        // Spend some of the coins written by the previous blocks
+        for (const COutPoint& outpoint : spent) {
+            CCoinsCacheEntry& entry = coins[outpoint];
+            entry.coin.Clear();
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+        CCoinsMap sorted_coins = coins;
+        const uint256 hash_block = InsecureRand256();
+        BOOST_CHECK(unsorted.BatchWrite(coins, hash_block));
+        BOOST_CHECK(sorted.BatchWrite(sorted_coins, hash_block));
+        BOOST_CHECK(coins.empty() && sorted_coins.empty());
+        BOOST_CHECK(sorted.GetBestBlock() == hash_block);
+    }
+
+    std::unique_ptr<CCoinsViewCursor> unsorted_cursor(unsorted.Cursor());
+    std::unique_ptr<CCoinsViewCursor> sorted_cursor(sorted.Cursor());
+    size_t count = 0;
+    for (; unsorted_cursor->Valid(); unsorted_cursor->Next(), sorted_cursor->Next(), ++count) {
+        BOOST_REQUIRE(sorted_cursor->Valid());
+        COutPoint unsorted_key, sorted_key;
+        Coin unsorted_coin, sorted_coin;
+        BOOST_CHECK(unsorted_cursor->GetKey(unsorted_key) && sorted_cursor->GetKey(sorted_key));
+        BOOST_CHECK(unsorted_cursor->GetValue(unsorted_coin) && sorted_cursor->GetValue(sorted_coin));
+        BOOST_CHECK(unsorted_key == sorted_key);
+        BOOST_CHECK(unsorted_coin.out == sorted_coin.out);
+        BOOST_CHECK_EQUAL(static_cast<uint32_t>(unsorted_coin.nHeight), static_cast<uint32_t>(sorted_coin.nHeight));
+    }
+    BOOST_CHECK(!sorted_cursor->Valid());
+    BOOST_CHECK(count > 0);
+    for (const COutPoint& outpoint : spent) {
+        BOOST_CHECK(!sorted.HaveCoin(outpoint));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_open_cursors)
+{
+    // The database knows whether it is safe to close (see EndCoinsDBBulkLoad)
+    CCoinsViewDB db(1 << 20, true);
+    BOOST_CHECK(!db.HasOpenCursors());
+    std::unique_ptr<CCoinsViewCursor> first(db.Cursor());
+    std::unique_ptr<CCoinsViewCursor> second(db.Cursor());
+    BOOST_CHECK(db.HasOpenCursors());
+    first.reset();
+    BOOST_CHECK(db.HasOpenCursors());
+    second.reset();
+    BOOST_CHECK(!db.HasOpenCursors());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,253 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <coinstrace.h>
+#include <fs.h>
+#include <script/script.h>
+#include <util.h>
+#include <test/test_bitcoin.h>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    explicit CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    //! The unspent coins in the cache, by their shape
+    std::map<COutPoint, std::tuple<uint32_t, CAmount, size_t>> Shapes() const
+    {
+        std::map<COutPoint, std::tuple<uint32_t, CAmount, size_t>> shapes;
+        for (const auto& entry : cacheCoins) {
+            const Coin& coin = entry.second.coin;
+            if (coin.IsSpent()) continue;
+            shapes.emplace(entry.first, std::make_tuple((uint32_t)coin.nHeight, coin.out.nValue, coin.out.scriptPubKey.size()));
+        }
+        return shapes;
+    }
+};
+
+Coin RandomCoin(int height)
+{
+    const std::vector<unsigned char> script(1 + InsecureRandRange(40), OP_TRUE);
+    return Coin(CTxOut(InsecureRandRange(100 * COIN), CScript(script.begin(), script.end())), height, InsecureRandBool());
+}
+
+/**
+ * Connect blocks to tip through a child cache per block, like ConnectBlock:
+ * check and spend existing coins, some created in the same block, and add new
+ * ones. The tip is flushed every few blocks.
+ */
+void SimulateBlocks(CCoinsViewCache& tip, std::vector<COutPoint>& coins, int start_height, int blocks)
+{
+    for (int height = start_height; height < start_height + blocks; ++height) {
+        CCoinsViewCache view(&tip);
+        for (int i = 0; i < 20; ++i) {
+            const size_t pos = InsecureRandRange(coins.size());
+            BOOST_CHECK(view.HaveCoin(coins[pos]));
+            BOOST_CHECK(view.SpendCoin(coins[pos]));
+            coins[pos] = coins.back();
+            coins.pop_back();
+        }
+        for (int i = 0; i < 25; ++i) {
+            const COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+            view.AddCoin(outpoint, RandomCoin(height), false);
+            if (InsecureRandRange(5) == 0) {
+                BOOST_CHECK(view.SpendCoin(outpoint));
+            } else {
+                coins.push_back(outpoint);
+            }
+        }
+        view.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(view.Flush());
+
+        Coin coin;
+        tip.PeekCoin(coins[InsecureRandRange(coins.size())], coin);
+        tip.Uncache(coins[InsecureRandRange(coins.size())]);
+        if (height % 10 == 9) BOOST_CHECK(tip.Flush());
+    }
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinstrace_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(trace_roundtrip)
+{
+    SetDataDir("trace_roundtrip");
+    ClearDatadirCache();
+    const fs::path path = GetDataDir() / "coins.trace";
+
+    CCoinsView root;
+    CCoinsViewCache base(&root);
+    const COutPoint existing(InsecureRand256(), 3);
+    const Coin existing_coin = RandomCoin(7);
+    base.AddCoin(existing, Coin(existing_coin), false);
+
+    const COutPoint added(InsecureRand256(), 300);
+    const Coin added_coin = RandomCoin(8);
+    const uint256 hash_block = InsecureRand256();
+    {
+        CoinsTraceWriter trace(fsbridge::fopen(path, "wb"));
+        CCoinsViewCache tip(&base);
+        tip.SetTrace(&trace);
+        BOOST_CHECK(tip.HaveCoin(existing));
+        tip.AddCoin(added, Coin(added_coin), true);
+        {
+            CCoinsViewCache view(&tip);
+            BOOST_CHECK(view.SpendCoin(existing));
+            view.SetBestBlock(hash_block);
+            BOOST_CHECK(view.Flush());
+        }
+        tip.Uncache(added);
+        BOOST_CHECK(tip.Flush());
+        // Unspendable coins are not added, so not recorded either
+        tip.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript() << OP_RETURN), 8, false), false);
+        tip.SetTrace(nullptr);
+        BOOST_CHECK(tip.HaveCoin(added));
+    }
+
+    CoinsTraceReader reader(fsbridge::fopen(path, "rb"));
+    CoinsTraceEntry entry;
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::FETCH);
+    BOOST_CHECK(entry.outpoint == existing);
+
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::READ);
+    BOOST_CHECK(entry.outpoint == existing);
+    BOOST_CHECK(entry.coin.nHeight == existing_coin.nHeight);
+    BOOST_CHECK(entry.coin.fCoinBase == existing_coin.fCoinBase);
+    BOOST_CHECK_EQUAL(entry.coin.out.nValue, existing_coin.out.nValue);
+    BOOST_CHECK_EQUAL(entry.coin.out.scriptPubKey.size(), existing_coin.out.scriptPubKey.size());
+
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::ADD);
+    BOOST_CHECK(entry.outpoint == added);
+    BOOST_CHECK(entry.possible_overwrite);
+    BOOST_CHECK(entry.coin.nHeight == added_coin.nHeight);
+    BOOST_CHECK_EQUAL(entry.coin.out.nValue, added_coin.out.nValue);
+    BOOST_CHECK_EQUAL(entry.coin.out.scriptPubKey.size(), added_coin.out.scriptPubKey.size());
+
+    // The child cache reads through the tip, then flushes the spent coin into it
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::FETCH);
+    BOOST_CHECK(entry.outpoint == existing);
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::BATCH);
+    BOOST_CHECK(entry.hash_block == hash_block);
+    BOOST_REQUIRE_EQUAL(entry.batch.size(), 1U);
+    BOOST_CHECK(entry.batch[0].first == existing);
+    BOOST_CHECK(entry.batch[0].second.coin.IsSpent());
+    BOOST_CHECK_EQUAL(entry.batch[0].second.flags, CCoinsCacheEntry::DIRTY);
+
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::UNCACHE);
+    BOOST_CHECK(entry.outpoint == added);
+    BOOST_REQUIRE(reader.Next(entry));
+    BOOST_CHECK(entry.op == CoinsTraceOp::FLUSH);
+    BOOST_CHECK(!reader.Next(entry));
+}
+
+BOOST_AUTO_TEST_CASE(trace_replay)
+{
+    SetDataDir("trace_replay");
+    ClearDatadirCache();
+    const fs::path path = GetDataDir() / "coins.trace";
+
+    // Record blocks connected on top of existing coins
+    CCoinsView root;
+    CCoinsViewCacheTest base(&root);
+    std::vector<COutPoint> coins;
+    for (int i = 0; i < 500; ++i) {
+        coins.emplace_back(InsecureRand256(), InsecureRandRange(4));
+        base.AddCoin(coins.back(), RandomCoin(InsecureRandRange(100)), false);
+    }
+    {
+        CoinsTraceWriter trace(fsbridge::fopen(path, "wb"));
+        CCoinsViewCache tip(&base);
+        tip.SetTrace(&trace);
+        SimulateBlocks(tip, coins, 100, 40);
+    }
+
+    // Replay them on top of the coins the trace read
+    CCoinsViewCacheTest replay_base(&root);
+    {
+        CoinsTraceReader reader(fsbridge::fopen(path, "rb"));
+        ReadCoinsTraceBaseCoins(reader, [&](const COutPoint& outpoint, Coin&& coin) {
+            BOOST_CHECK(coin.nHeight < 100);
+            replay_base.AddCoin(outpoint, std::move(coin), true);
+        });
+    }
+    CCoinsViewCache replay_tip(&replay_base);
+    CoinsTraceReader reader(fsbridge::fopen(path, "rb"));
+    CoinsTraceEntry entry;
+    while (reader.Next(entry)) {
+        ReplayCoinsTraceEntry(replay_tip, entry);
+    }
+    BOOST_CHECK_EQUAL(replay_tip.GetCacheSize(), 0U);
+
+    // Every coin the blocks left or added ends up in the same shape, except
+    // for those never touched by the trace, which the replay never read
+    const auto shapes = base.Shapes();
+    const auto replay_shapes = replay_base.Shapes();
+    BOOST_CHECK_LT(replay_shapes.size(), shapes.size());
+    for (const auto& shape : replay_shapes) {
+        const auto it = shapes.find(shape.first);
+        BOOST_REQUIRE(it != shapes.end());
+        BOOST_CHECK(it->second == shape.second);
+    }
+    for (const auto& shape : shapes) {
+        if (std::get<0>(shape.second) >= 100) BOOST_CHECK(replay_shapes.count(shape.first));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(trace_malformed)
+{
+    SetDataDir("trace_malformed");
+    ClearDatadirCache();
+    const fs::path path = GetDataDir() / "coins.trace";
+
+    {
+        CoinsTraceWriter trace(fsbridge::fopen(path, "wb"));
+        trace.Add(COutPoint(InsecureRand256(), 0), RandomCoin(1), false);
+    }
+    std::vector<char> data(fs::file_size(path));
+    FILE* file = fsbridge::fopen(path, "rb");
+    BOOST_REQUIRE_EQUAL(fread(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+
+    auto read_all = [&](const std::vector<char>& trace) {
+        file = fsbridge::fopen(path, "wb");
+        fwrite(trace.data(), 1, trace.size(), file);
+        fclose(file);
+        CoinsTraceReader reader(fsbridge::fopen(path, "rb"));
+        CoinsTraceEntry entry;
+        while (reader.Next(entry)) {}
+    };
+    read_all(data);
+
+    // Truncated entries and headers
+    for (size_t size = 0; size < data.size(); ++size) {
+        if (size == 8) continue;
+        BOOST_CHECK_THROW(read_all(std::vector<char>(data.begin(), data.begin() + size)), std::runtime_error);
+    }
+    // Unknown operations
+    std::vector<char> bad = data;
+    bad[8] = 0;
+    BOOST_CHECK_THROW(read_all(bad), std::runtime_error);
+    // Not a trace
+    bad = data;
+    bad[0] ^= 1;
+    BOOST_CHECK_THROW(read_all(bad), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
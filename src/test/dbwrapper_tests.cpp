@@ -197,6 +197,35 @@ BOOST_AUTO_TEST_CASE(existing_data_reindex)
     BOOST_CHECK_EQUAL(res3.ToString(), in2.ToString());
 }
 
+// Data written with one profile of options can be read with any other.
+BOOST_AUTO_TEST_CASE(db_options_profiles)
+{
+    fs::path ph = SetDataDir("db_options_profiles");
+    const std::vector<DBOptions> profiles = {DBOptions(), DBOptions::Chainstate(), DBOptions::ChainstateBulkLoad(1 << 20), DBOptions::BlockIndex(), DBOptions::TxIndex()};
+
+    std::vector<uint256> values;
+    for (size_t i = 0; i < profiles.size(); ++i) {
+        CDBWrapper dbw(ph, (1 << 20), false, false, true, profiles[i]);
+        // Enough data to fill several table blocks
+        CDBBatch batch(dbw);
+        for (int j = 0; j < 1000; ++j) {
+            values.push_back(InsecureRand256());
+            batch.Write(std::make_pair(i, j), values.back());
+        }
+        BOOST_CHECK(dbw.WriteBatch(batch, true));
+        // Rewrite all tables with this profile
+        dbw.CompactRange(std::make_pair(size_t{0}, 0), std::make_pair(profiles.size(), 0));
+
+        for (size_t k = 0; k <= i; ++k) {
+            for (int j = 0; j < 1000; ++j) {
+                uint256 res;
+                BOOST_CHECK(dbw.Read(std::make_pair(k, j), res));
+                BOOST_CHECK(res == values[k * 1000 + j]);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(iterator_ordering)
 {
     fs::path ph = SetDataDir("iterator_ordering");
@@ -103,6 +103,22 @@ void Check(const std::string& prv, const std::string& pub, int flags, const std:
 
         }
     }
+
+    // Check that expanding all positions at once gives the same scripts, in order.
+    if (flags & RANGE) {
+        for (int t = 0; t < 2; ++t) {
+            FlatSigningProvider key_provider = (flags & HARDENED) ? keys_priv : keys_pub;
+            std::vector<CScript> spks;
+            BOOST_CHECK((t ? parse_priv : parse_pub)->IsRange());
+            BOOST_CHECK(ExpandRange(*(t ? parse_priv : parse_pub), 0, scripts.size(), key_provider, spks, key_provider));
+            std::vector<std::string> ref;
+            for (const auto& pos_scripts : scripts) ref.insert(ref.end(), pos_scripts.begin(), pos_scripts.end());
+            BOOST_CHECK_EQUAL(spks.size(), ref.size());
+            for (size_t n = 0; n < spks.size() && n < ref.size(); ++n) {
+                BOOST_CHECK_EQUAL(ref[n], HexStr(spks[n].begin(), spks[n].end()));
+            }
+        }
+    }
 }
 
 }
@@ -160,4 +176,37 @@ BOOST_AUTO_TEST_CASE(descriptor_test)
     CheckUnparsable("wsh(wsh(pk(T4nzXGboJCdz6WbmgZjRFkwwb5QACn5FjEqiBpdzvWBva3PMLwte)))", "wsh(wsh(pk(02a5e85e848c4107607d7b8522018d6dffa6b40aad853ae634f95cded666dd1d8c)))"); // Cannot embed P2WSH inside P2WSH
 }
 
+// Expanding a large range on several threads gives the scripts and solving
+// data of expanding each position on its own.
+BOOST_AUTO_TEST_CASE(descriptor_expand_range)
+{
+    for (const std::string& str : {"wpkh(xpub69H7F5d8KSRgmmdJg2KhpAK8SR3DjMwAdkxj3ZuxV27CprR9LgpeyGmXUbC6wb7ERfvrnKZjXoUmmDznezpbZb7ap6r1D3tgFxHmwMkQTPH/1/2/*)",
+                                   "sh(wpkh(xprv9s21ZrQH143K3QTDL4LXw2F7HEK3wJUD2nW2nRk4stbPy6cq3jPPqjiChkVvvNKmPGJxWUtg6LnF5kejMRNNU3TGtRBeJgk33yuGBxrMPHi/10/20/30/40/*'))"}) {
+        FlatSigningProvider keys;
+        auto desc = Parse(str, keys);
+        BOOST_REQUIRE(desc);
+        std::vector<CScript> spks;
+        FlatSigningProvider out;
+        BOOST_CHECK(ExpandRange(*desc, 5, 505, keys, spks, out));
+
+        std::vector<CScript> ref;
+        FlatSigningProvider ref_out;
+        for (int i = 5; i < 505; ++i) {
+            std::vector<CScript> pos_spks;
+            BOOST_CHECK(desc->Expand(i, keys, pos_spks, ref_out));
+            ref.insert(ref.end(), pos_spks.begin(), pos_spks.end());
+        }
+        BOOST_CHECK(spks == ref);
+        BOOST_CHECK(out.pubkeys == ref_out.pubkeys);
+        BOOST_CHECK(out.scripts == ref_out.scripts);
+    }
+
+    // Hardened derivation without the private key fails
+    FlatSigningProvider keys;
+    auto desc = Parse("sh(wpkh(xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8/10/20/30/40/*'))", keys);
+    BOOST_REQUIRE(desc);
+    std::vector<CScript> spks;
+    BOOST_CHECK(!ExpandRange(*desc, 0, 100, keys, spks, keys));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,8 +6,11 @@
 #include <rpc/client.h>
 
 #include <core_io.h>
+#include <httprpc.h>
 #include <key_io.h>
 #include <netbase.h>
+#include <streams.h>
+#include <version.h>
 
 #include <test/test_bitcoin.h>
 
@@ -17,6 +20,7 @@
 #include <univalue.h>
 
 #include <rpc/blockchain.h>
+#include <rpc/jsonstream.h>
 
 UniValue CallRPC(std::string args)
 {
@@ -416,4 +420,232 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    UniValue expected(UniValue::VOBJ);
+    UniValue arr(UniValue::VARR);
+    arr.push_back(1);
+    arr.push_back("two\n\"quoted\"");
+    arr.push_back(UniValue(UniValue::VOBJ));
+    expected.pushKV("empty", UniValue(UniValue::VARR));
+    expected.pushKV("a\tkey", arr);
+    expected.pushKV("null", NullUniValue);
+
+    std::string out;
+    size_t chunks = 0;
+    JSONStreamWriter stream([&](std::string&& chunk) { out += chunk; ++chunks; }, 4);
+    stream.BeginObject();
+    stream.Key("empty");
+    stream.BeginArray();
+    stream.EndArray();
+    stream.Key("a\tkey");
+    stream.BeginArray();
+    stream.Value(1);
+    stream.Value("two\n\"quoted\"");
+    stream.BeginObject();
+    stream.EndObject();
+    stream.EndArray();
+    stream.KeyValue("null", NullUniValue);
+    stream.EndObject();
+    BOOST_CHECK(chunks > 1);
+    BOOST_CHECK_EQUAL(stream.BytesFlushed(), out.size());
+    out += stream.TakeBuffer();
+    BOOST_CHECK_EQUAL(out, expected.write());
+    BOOST_CHECK_EQUAL(stream.ValuesWritten(), 7U);
+
+    // Nothing is handed to the sink until a chunk is full
+    chunks = 0;
+    JSONStreamWriter small([&](std::string&& chunk) { ++chunks; });
+    small.BeginArray();
+    small.Value("abc");
+    small.EndArray();
+    BOOST_CHECK_EQUAL(chunks, 0U);
+    BOOST_CHECK_EQUAL(small.TakeBuffer(), "[\"abc\"]");
+    small.Flush();
+    BOOST_CHECK_EQUAL(chunks, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_write_json)
+{
+    // Every character UniValue escapes, plus multi-byte UTF-8
+    std::string str;
+    for (int ch = 0; ch < 0x80; ++ch) str += (char)ch;
+    str += "\xc3\xa9";
+
+    UniValue value(UniValue::VOBJ);
+    UniValue arr(UniValue::VARR);
+    arr.push_back(str);
+    arr.push_back(-1.5);
+    arr.push_back(true);
+    arr.push_back(false);
+    arr.push_back(NullUniValue);
+    arr.push_back(UniValue(UniValue::VARR));
+    value.pushKV(str, arr);
+    value.pushKV("empty", UniValue(UniValue::VOBJ));
+    BOOST_CHECK_EQUAL(WriteJSON(value), value.write());
+    BOOST_CHECK_EQUAL(WriteJSON(UniValue(str)), UniValue(str).write());
+    BOOST_CHECK_EQUAL(WriteJSON(NullUniValue), "null");
+}
+
+BOOST_AUTO_TEST_CASE(rpc_read_json)
+{
+    // ReadJSON accepts and rejects the same documents as UniValue::read and
+    // produces the same values
+    const std::vector<std::string> docs{
+        "{}", "[]", " [ ] ", "null", "true", "false", "0", "-0", "1.5e-3", "-12E+2", "\"\"",
+        "{\"a\":1,\"b\":[true,false,null],\"a\":{\"c\":\"d\"}}",
+        "[[[[]],{}],[1,[2,[3]]],\"x\"]",
+        " \t\r\n{ \"k\" : [ 1 , 2 ] } \n",
+        "\"esc \\\"\\\\\\/\\b\\f\\n\\r\\t\\u0041\\u00e9\\u20ac\"",
+        "\"\\uD834\\uDD1E\"", "\"\\ud834x\\udd1e\"", "\"\\uD834\"", "\"\\uDD1E\"", "\"\\uD834\\uD834\"",
+        "\"\xc3\xa9\xe2\x82\xac\xf0\x9d\x84\x9e\"", "\"\xc3\"", "\"\xc3x\"", "\"\x80\"", "\"\xf8\"", "\"\xed\xa0\xb4\xed\xb4\x9e\"",
+        "\"\\u00\"", "\"\\uzzzz\"", "\"\\x\"", "\"a\nb\"", "\"abc",
+        "01", "-a", "[-]", "1.", "1e", "1e+", ".5", "+1", "nul", "nulll", "True",
+        "[1,]", "[,1]", "[1 2]", "{\"a\":1,}", "{,}", "{\"a\"}", "{\"a\":}", "{\"a\" 1}", "{1:2}",
+        "[\"a\":1]", "{\"a\":1:2}", "[}", "{]", "[1]]", "{}{}", "1 2", "", " ", "[", "{\"a\":[1}",
+    };
+    for (const std::string& doc : docs) {
+        UniValue expected, value;
+        const bool ok = expected.read(doc);
+        BOOST_CHECK_MESSAGE(ReadJSON(doc, value) == ok, doc);
+        if (ok) {
+            BOOST_CHECK_EQUAL(value.getType(), expected.getType());
+            BOOST_CHECK_EQUAL(value.write(), expected.write());
+        }
+    }
+
+    // UniValue::read takes a lone minus sign at the end of the input for a number
+    UniValue value;
+    BOOST_CHECK(!ReadJSON("-", value));
+
+    // Nesting is limited
+    const std::string deepest = std::string(MAX_JSON_DEPTH, '[') + std::string(MAX_JSON_DEPTH, ']');
+    BOOST_CHECK(ReadJSON(deepest, value));
+    BOOST_CHECK(!ReadJSON(deepest.substr(1), value));
+    BOOST_CHECK(!ReadJSON("[" + deepest + "]", value));
+}
+
+/** Maximum nesting depth accepted by DecodeBinaryUniv */
+static const unsigned int MAX_BINARY_UNIV_DEPTH = 512;
+
+template <typename Stream>
+static UniValue BinaryUnivFromStream(Stream& s, unsigned int depth)
+{
+    if (depth > MAX_BINARY_UNIV_DEPTH) {
+        throw std::ios_base::failure("BinaryUnivFromStream(): nesting too deep");
+    }
+    unsigned char tag;
+    s >> tag;
+    switch (tag) {
+    case BINUNIV_NULL:
+        return NullUniValue;
+    case BINUNIV_FALSE:
+        return UniValue(false);
+    case BINUNIV_TRUE:
+        return UniValue(true);
+    case BINUNIV_INT: {
+        int64_t n;
+        s >> n;
+        return UniValue(n);
+    }
+    case BINUNIV_NUM: {
+        std::string str;
+        s >> str;
+        UniValue num;
+        if (!num.setNumStr(str)) {
+            throw std::ios_base::failure("BinaryUnivFromStream(): invalid number");
+        }
+        return num;
+    }
+    case BINUNIV_STR: {
+        std::string str;
+        s >> str;
+        return UniValue(str);
+    }
+    case BINUNIV_ARR: {
+        UniValue arr(UniValue::VARR);
+        for (uint64_t n = ReadCompactSize(s); n > 0; --n) {
+            arr.push_back(BinaryUnivFromStream(s, depth + 1));
+        }
+        return arr;
+    }
+    case BINUNIV_OBJ: {
+        UniValue obj(UniValue::VOBJ);
+        for (uint64_t n = ReadCompactSize(s); n > 0; --n) {
+            std::string key;
+            s >> key;
+            obj.__pushKV(key, BinaryUnivFromStream(s, depth + 1));
+        }
+        return obj;
+    }
+    default:
+        throw std::ios_base::failure("BinaryUnivFromStream(): unknown type tag");
+    }
+}
+
+/** Decode a reply in the binary encoding, as a client would */
+static bool DecodeBinaryUniv(UniValue& value, const std::string& data)
+{
+    CDataStream ss(data.data(), data.data() + data.size(), SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        value = BinaryUnivFromStream(ss, 0);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return ss.empty();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_binary_encoding)
+{
+    UniValue value(UniValue::VOBJ);
+    UniValue arr(UniValue::VARR);
+    arr.push_back(NullUniValue);
+    arr.push_back(true);
+    arr.push_back(false);
+    arr.push_back((int64_t)-5);
+    arr.push_back(UniValue(UniValue::VNUM, "-0"));
+    arr.push_back(UniValue(UniValue::VNUM, "1e100"));
+    value.pushKV("result", arr);
+    value.pushKV("amount", ValueFromAmount(123456789));
+    value.pushKV("raw", std::string("\x00\xff\x01", 3));
+
+    const std::string data = EncodeBinaryUniv(value);
+    UniValue decoded;
+    BOOST_CHECK(DecodeBinaryUniv(decoded, data));
+    BOOST_CHECK_EQUAL(decoded.write(), value.write());
+    BOOST_CHECK_EQUAL(decoded["raw"].get_str(), std::string("\x00\xff\x01", 3));
+
+    // Integers use a fixed size encoding, other numbers keep their text
+    BOOST_CHECK_EQUAL(HexStr(EncodeBinaryUniv(UniValue((int64_t)-2))), "03feffffffffffffff");
+    BOOST_CHECK_EQUAL(HexStr(EncodeBinaryUniv(ValueFromAmount(COIN))), "040a312e3030303030303030");
+    BOOST_CHECK_EQUAL(HexStr(EncodeBinaryUniv(arr[4])), "04022d30");
+
+    // Truncated, trailing and unknown data is rejected
+    BOOST_CHECK(!DecodeBinaryUniv(decoded, data.substr(0, data.size() - 1)));
+    BOOST_CHECK(!DecodeBinaryUniv(decoded, data + '\x00'));
+    BOOST_CHECK(!DecodeBinaryUniv(decoded, "\x08"));
+    BOOST_CHECK(!DecodeBinaryUniv(decoded, ""));
+    BOOST_CHECK(!DecodeBinaryUniv(decoded, std::string(1000, '\x06') + std::string(1000, '\x01')));
+}
+
+BOOST_AUTO_TEST_CASE(rpc_binary_accept)
+{
+    BOOST_CHECK(AcceptsBinaryRPCReply("application/x-litecoin-rpc"));
+    BOOST_CHECK(AcceptsBinaryRPCReply(" Application/X-Litecoin-RPC "));
+    BOOST_CHECK(AcceptsBinaryRPCReply("application/x-litecoin-rpc, application/json"));
+    BOOST_CHECK(AcceptsBinaryRPCReply("application/json;q=0.5,application/x-litecoin-rpc"));
+    BOOST_CHECK(AcceptsBinaryRPCReply("application/x-litecoin-rpc; charset=binary; q=0.9, */*; q=0.1"));
+    BOOST_CHECK(AcceptsBinaryRPCReply("*/*, application/x-litecoin-rpc"));
+
+    BOOST_CHECK(!AcceptsBinaryRPCReply(""));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("*/*"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/*"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/json"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/x-litecoin-rpc;q=0"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/x-litecoin-rpc;q=0.5, application/json"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/x-litecoin-rpc;q=0.5, application/*;q=0.8"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/x-litecoin-rpc;q=bad"));
+    BOOST_CHECK(!AcceptsBinaryRPCReply("application/x-litecoin-rpc-foo"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
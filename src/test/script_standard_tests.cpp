@@ -743,4 +743,68 @@ BOOST_AUTO_TEST_CASE(script_standard_IsMine)
     }
 }
 
+static CScript RandomP2PKH()
+{
+    const uint256 hash = InsecureRand256();
+    return GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20))));
+}
+
+// The keystore filter matches everything IsMine() accepts, also after it grew
+// past its initial capacity, and little else.
+BOOST_AUTO_TEST_CASE(script_standard_IsMine_filter)
+{
+    CBasicKeyStore keystore;
+    std::vector<CScript> mine;
+    for (int i = 0; i < 50; ++i) {
+        CKey key;
+        key.MakeNewKey(i % 10 != 0);
+        const CPubKey pubkey = key.GetPubKey();
+        keystore.AddKey(key);
+        mine.push_back(GetScriptForRawPubKey(pubkey));
+        mine.push_back(GetScriptForDestination(pubkey.GetID()));
+        if (pubkey.IsCompressed()) {
+            const CScript witness_script = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+            mine.push_back(witness_script);
+            mine.push_back(GetScriptForDestination(CScriptID(witness_script)));
+        }
+    }
+    for (int i = 0; i < 3000; ++i) {
+        const CScript script = RandomP2PKH();
+        keystore.AddWatchOnly(script);
+        mine.push_back(script);
+    }
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript multisig = GetScriptForMultisig(1, {key.GetPubKey()});
+    keystore.AddCScript(multisig);
+    mine.push_back(GetScriptForDestination(CScriptID(multisig)));
+    mine.push_back(GetScriptForDestination(WitnessV0ScriptHash(multisig)));
+    keystore.AddCScript(mine.back());
+    keystore.AddWatchOnly(multisig);
+    mine.push_back(multisig);
+
+    for (const CScript& script : mine) {
+        BOOST_CHECK(IsMine(keystore, script) != ISMINE_NO);
+        BOOST_CHECK(keystore.MayBeMine(script));
+    }
+    // Removed watch-only scripts may still match, so nothing is missed
+    keystore.RemoveWatchOnly(mine.back());
+    BOOST_CHECK(keystore.MayBeMine(mine.back()));
+
+    int matched = 0;
+    for (int i = 0; i < 10000; ++i) {
+        const CScript script = RandomP2PKH();
+        if (keystore.MayBeMine(script)) {
+            ++matched;
+        } else {
+            BOOST_CHECK_EQUAL(IsMine(keystore, script), ISMINE_NO);
+        }
+    }
+    BOOST_CHECK_LT(matched, 200);
+
+    CScript nonstandard;
+    nonstandard << OP_9 << OP_ADD << OP_11 << OP_EQUAL;
+    BOOST_CHECK(!CBasicKeyStore().MayBeMine(nonstandard));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -68,6 +68,28 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    const std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+    SpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, MakeSpan(vch));
+    BOOST_CHECK_EQUAL(reader.size(), 6U);
+    unsigned char a, b;
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 255);
+    BOOST_CHECK_EQUAL(reader.size(), 4U);
+
+    uint32_t c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 0x06050403U);
+    BOOST_CHECK(reader.empty());
+
+    // Reading past the end throws, and does not consume anything
+    SpanReader short_reader(SER_NETWORK, INIT_PROTO_VERSION, MakeSpan(vch).first(3));
+    BOOST_CHECK_THROW(short_reader >> c, std::ios_base::failure);
+    BOOST_CHECK_EQUAL(short_reader.size(), 3U);
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
@@ -677,6 +677,34 @@ BOOST_AUTO_TEST_CASE(test_witness)
     CheckWithFlag(output1, input1, STANDARD_SCRIPT_VERIFY_FLAGS, true);
 }
 
+BOOST_AUTO_TEST_CASE(test_sign_with_precomputed_data)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    const CScript p2pkh = GetScriptForDestination(key.GetPubKey().GetID());
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()));
+
+    CMutableTransaction mtx;
+    std::vector<CTxOut> spent;
+    for (uint32_t i = 0; i < 4; i++) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+        mtx.vout.emplace_back(CENT, p2pkh);
+        spent.emplace_back((i + 1) * CENT, i % 2 ? p2wpkh : p2pkh);
+    }
+
+    // Signatures are deterministic, so using the precomputed hashes must give the same ones
+    const PrecomputedTransactionData txdata(mtx);
+    for (uint32_t i = 0; i < mtx.vin.size(); i++) {
+        SignatureData sigdata, sigdata_precomputed;
+        BOOST_CHECK(ProduceSignature(keystore, MutableTransactionSignatureCreator(&mtx, i, spent[i].nValue), spent[i].scriptPubKey, sigdata));
+        BOOST_CHECK(ProduceSignature(keystore, MutableTransactionSignatureCreator(&mtx, i, spent[i].nValue, &txdata), spent[i].scriptPubKey, sigdata_precomputed));
+        BOOST_CHECK(sigdata.scriptSig == sigdata_precomputed.scriptSig);
+        BOOST_CHECK(sigdata.scriptWitness.stack == sigdata_precomputed.scriptWitness.stack);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_IsStandard)
 {
     LOCK(cs_main);
@@ -768,4 +796,71 @@ BOOST_AUTO_TEST_CASE(test_IsStandard)
     BOOST_CHECK(!IsStandardTx(t, reason));
 }
 
+static void CheckDeserializedFromMemory(const CTransaction& tx, const CTransaction& expected)
+{
+    BOOST_CHECK(tx.GetHash() == expected.GetHash());
+    BOOST_CHECK(tx.GetWitnessHash() == expected.GetWitnessHash());
+    BOOST_CHECK_EQUAL(tx.GetTotalSize(), ::GetSerializeSize(expected, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(tx.GetStrippedSize(), ::GetSerializeSize(expected, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+    BOOST_CHECK_EQUAL(expected.GetTotalSize(), tx.GetTotalSize());
+    BOOST_CHECK_EQUAL(expected.GetStrippedSize(), tx.GetStrippedSize());
+}
+
+BOOST_AUTO_TEST_CASE(test_deserialize_from_memory)
+{
+    // Transactions deserialized from memory are hashed and sized from the
+    // bytes they were read from, which has to give the same results
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    mtx.nLockTime = InsecureRand32();
+    for (int i = 0; i < 3; ++i) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), i), CScript() << i << OP_TRUE, InsecureRand32());
+        mtx.vout.emplace_back(i * COIN, CScript() << OP_TRUE);
+    }
+    const CTransaction legacy(mtx);
+    mtx.vin[1].scriptWitness.stack = {{1, 2, 3}, {}};
+    const CTransaction witness(mtx);
+
+    for (const CTransaction* expected : {&legacy, &witness}) {
+        for (int version : {PROTOCOL_VERSION, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS}) {
+            CMutableTransaction stripped(*expected);
+            for (CTxIn& txin : stripped.vin) txin.scriptWitness.SetNull();
+            const CTransaction without_witness(stripped);
+            CDataStream ss(SER_NETWORK, version);
+            ss << *expected << uint8_t{42};
+            const std::vector<unsigned char> data(ss.begin(), ss.end());
+
+            SpanReader reader(SER_NETWORK, version, Span<const unsigned char>(data.data(), data.size()));
+            const CTransaction from_span(deserialize, reader);
+            BOOST_CHECK_EQUAL(reader.size(), 1);
+            const CTransaction from_stream(deserialize, ss);
+            BOOST_CHECK_EQUAL(ss.size(), 1);
+            const CTransaction& reference = version & SERIALIZE_TRANSACTION_NO_WITNESS ? without_witness : *expected;
+            CheckDeserializedFromMemory(from_span, reference);
+            CheckDeserializedFromMemory(from_stream, reference);
+        }
+    }
+
+    // The witness serialization without witnesses is hashed without the marker and flag
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << legacy;
+    std::vector<unsigned char> data(ss.begin(), ss.end());
+    data.insert(data.end() - 4, legacy.vin.size(), 0);
+    const unsigned char marker[] = {0, 1};
+    data.insert(data.begin() + 4, marker, marker + 2);
+    SpanReader reader(SER_NETWORK, PROTOCOL_VERSION, Span<const unsigned char>(data.data(), data.size()));
+    CheckDeserializedFromMemory(CTransaction(deserialize, reader), legacy);
+    BOOST_CHECK(reader.empty());
+
+    // Blocks deserialized from memory have the same weight
+    CBlock block;
+    block.vtx = {MakeTransactionRef(legacy), MakeTransactionRef(witness)};
+    CDataStream block_ss(SER_NETWORK, PROTOCOL_VERSION);
+    block_ss << block;
+    CBlock read_block;
+    block_ss >> read_block;
+    BOOST_CHECK_EQUAL(GetBlockWeight(read_block), ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR - 1) + ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(GetBlockStrippedSize(read_block), ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
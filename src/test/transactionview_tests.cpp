@@ -0,0 +1,173 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <primitives/view.h>
+#include <streams.h>
+#include <version.h>
+#include <test/test_bitcoin.h>
+
+#include <ios>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+std::vector<unsigned char> RandomBytes(size_t max_size)
+{
+    std::vector<unsigned char> bytes(InsecureRandRange(max_size + 1));
+    for (unsigned char& byte : bytes) byte = InsecureRandBits(8);
+    return bytes;
+}
+
+CMutableTransaction RandomTransaction(bool witness)
+{
+    CMutableTransaction tx;
+    tx.nVersion = InsecureRand32();
+    tx.nLockTime = InsecureRand32();
+    // Without inputs, the outputs would be read as the flags of the witness format
+    const int inputs = 1 + InsecureRandRange(3);
+    for (int i = 0; i < inputs; ++i) {
+        const std::vector<unsigned char> script = RandomBytes(300);
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), InsecureRand32()), CScript(script.begin(), script.end()), InsecureRand32());
+        if (witness && InsecureRandBool()) {
+            for (int j = InsecureRandRange(4); j >= 0; --j) {
+                tx.vin.back().scriptWitness.stack.push_back(RandomBytes(100));
+            }
+        }
+    }
+    const int outputs = InsecureRandRange(4);
+    for (int i = 0; i < outputs; ++i) {
+        const std::vector<unsigned char> script = RandomBytes(100);
+        tx.vout.emplace_back(InsecureRandRange(100 * COIN), CScript(script.begin(), script.end()));
+    }
+    return tx;
+}
+
+template <typename T>
+std::vector<unsigned char> Serialize(const T& obj)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0) << obj;
+    return data;
+}
+
+void CheckView(const TransactionView& view, const CTransaction& tx)
+{
+    BOOST_CHECK(view.GetHash() == tx.GetHash());
+    BOOST_CHECK(view.GetWitnessHash() == tx.GetWitnessHash());
+    BOOST_CHECK_EQUAL(view.HasWitness(), tx.HasWitness());
+    BOOST_CHECK_EQUAL(view.GetVersion(), tx.nVersion);
+    BOOST_CHECK_EQUAL(view.GetLockTime(), tx.nLockTime);
+    BOOST_CHECK_EQUAL(view.GetTotalSize(), tx.GetTotalSize());
+    BOOST_CHECK_EQUAL(view.GetStrippedSize(), ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+    BOOST_CHECK_EQUAL(view.GetWeight(), GetTransactionWeight(tx));
+
+    BOOST_REQUIRE_EQUAL(view.GetInputCount(), tx.vin.size());
+    size_t i = 0;
+    view.ForEachInput([&](const COutPoint& prevout, Span<const unsigned char> script_sig, uint32_t sequence) {
+        BOOST_CHECK(prevout == tx.vin[i].prevout);
+        BOOST_CHECK(CScript(script_sig.begin(), script_sig.end()) == tx.vin[i].scriptSig);
+        BOOST_CHECK_EQUAL(sequence, tx.vin[i].nSequence);
+        ++i;
+    });
+    BOOST_CHECK_EQUAL(i, tx.vin.size());
+    BOOST_REQUIRE_EQUAL(view.GetOutputCount(), tx.vout.size());
+    i = 0;
+    view.ForEachOutput([&](CAmount value, Span<const unsigned char> script_pub_key) {
+        BOOST_CHECK(CTxOut(value, CScript(script_pub_key.begin(), script_pub_key.end())) == tx.vout[i]);
+        ++i;
+    });
+    BOOST_CHECK_EQUAL(i, tx.vout.size());
+
+    BOOST_CHECK(*view.Materialize() == tx);
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(transactionview_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(transaction_view)
+{
+    for (int i = 0; i < 200; ++i) {
+        const CTransaction tx(RandomTransaction(i % 2));
+        std::vector<unsigned char> data = Serialize(tx);
+        const size_t size = data.size();
+        // The view ends with the transaction
+        data.push_back(0);
+        const TransactionView view(Span<const unsigned char>(data.data(), data.size()));
+        BOOST_CHECK_EQUAL(view.GetBytes().size(), size);
+        CheckView(view, tx);
+    }
+
+    // A transaction without inputs and outputs
+    CMutableTransaction empty;
+    const std::vector<unsigned char> data = Serialize(CTransaction(empty));
+    const TransactionView view(Span<const unsigned char>(data.data(), data.size()));
+    CheckView(view, CTransaction(empty));
+
+    // The witness format with no witnesses at all
+    CMutableTransaction tx = RandomTransaction(false);
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0), CScript(), 0);
+    std::vector<unsigned char> extended = Serialize(CTransaction(tx));
+    const std::vector<unsigned char> witnesses(tx.vin.size(), 0);
+    extended.insert(extended.end() - 4, witnesses.begin(), witnesses.end());
+    const unsigned char marker[] = {0, 1};
+    extended.insert(extended.begin() + 4, marker, marker + 2);
+    const TransactionView extended_view(Span<const unsigned char>(extended.data(), extended.size()));
+    BOOST_CHECK_EQUAL(extended_view.GetBytes().size(), extended.size());
+    CheckView(extended_view, CTransaction(tx));
+}
+
+BOOST_AUTO_TEST_CASE(transaction_view_malformed)
+{
+    CMutableTransaction tx = RandomTransaction(true);
+    tx.vin.emplace_back(COutPoint(InsecureRand256(), 0), CScript(), 0);
+    tx.vin.back().scriptWitness.stack.push_back({1});
+    std::vector<unsigned char> data = Serialize(CTransaction(tx));
+    for (size_t size = 0; size < data.size(); ++size) {
+        BOOST_CHECK_THROW(TransactionView(Span<const unsigned char>(data.data(), size)), std::ios_base::failure);
+    }
+
+    // Unknown flags
+    BOOST_REQUIRE_EQUAL(data[5], 1);
+    data[5] = 3;
+    BOOST_CHECK_THROW(TransactionView(Span<const unsigned char>(data.data(), data.size())), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(block_view)
+{
+    CBlock block;
+    block.nVersion = InsecureRand32();
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = InsecureRand32();
+    block.nBits = InsecureRand32();
+    block.nNonce = InsecureRand32();
+    for (int i = 0; i < 50; ++i) {
+        block.vtx.push_back(MakeTransactionRef(RandomTransaction(i % 2)));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    const std::vector<unsigned char> data = Serialize(block);
+    const BlockView view(Span<const unsigned char>(data.data(), data.size()));
+    BOOST_CHECK_EQUAL(view.GetBytes().size(), data.size());
+    BOOST_CHECK(view.GetHash() == block.GetHash());
+    BOOST_CHECK(view.GetHeader().GetHash() == block.GetHash());
+    BOOST_CHECK(view.ComputeMerkleRoot() == block.hashMerkleRoot);
+    BOOST_REQUIRE_EQUAL(view.GetTransactions().size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        CheckView(view.GetTransactions()[i], *block.vtx[i]);
+    }
+    BOOST_CHECK(Serialize(view.Materialize()) == data);
+
+    for (size_t size = 0; size < data.size(); size += 1 + InsecureRandRange(100)) {
+        BOOST_CHECK_THROW(BlockView(Span<const unsigned char>(data.data(), size)), std::ios_base::failure);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,7 +11,9 @@
 #include <utilmoneystr.h>
 #include <test/test_bitcoin.h>
 
+#include <atomic>
 #include <stdint.h>
+#include <thread>
 #include <vector>
 #ifndef WIN32
 #include <signal.h>
@@ -1217,4 +1219,23 @@ BOOST_AUTO_TEST_CASE(test_DirIsWritable)
     fs::remove(tmpdirname);
 }
 
+BOOST_AUTO_TEST_CASE(test_ParallelFor)
+{
+    for (size_t count : {0, 1, 15, 16, 1000}) {
+        std::vector<std::atomic<int>> calls(count);
+        for (auto& c : calls) c = 0;
+        ParallelFor(count, 8, 4, [&](size_t i) { ++calls[i]; });
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(calls[i], 1);
+        }
+    }
+
+    // Few items, or a single thread allowed, run on the calling thread only
+    const std::thread::id self = std::this_thread::get_id();
+    bool other_thread = false;
+    ParallelFor(100, 1, 1, [&](size_t i) { if (std::this_thread::get_id() != self) other_thread = true; });
+    ParallelFor(100, 8, 100, [&](size_t i) { if (std::this_thread::get_id() != self) other_thread = true; });
+    BOOST_CHECK(!other_thread);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,308 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <fs.h>
+#include <script/script.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+#include <utxosnapshot.h>
+#include <validation.h>
+#include <versionbits.h>
+#include <test/test_bitcoin.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! The coins of a view, read through its cursor
+std::map<COutPoint, Coin> ReadCoins(const CCoinsView& view)
+{
+    std::map<COutPoint, Coin> coins;
+    std::unique_ptr<CCoinsViewCursor> cursor(view.Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(key) && cursor->GetValue(coin));
+        coins.emplace(key, std::move(coin));
+    }
+    return coins;
+}
+
+/** Fill a chainstate database with coins of transactions with several outputs */
+void AddRandomCoins(CCoinsViewDB& db, const uint256& hash_block)
+{
+    CCoinsViewCache cache(&db);
+    for (int i = 0; i < 300; ++i) {
+        const uint256 txid = InsecureRand256();
+        const bool coinbase = InsecureRandBool();
+        const int height = InsecureRandRange(1000);
+        const uint32_t outputs = 1 + InsecureRandRange(5);
+        for (uint32_t n = 0; n < outputs; ++n) {
+            const std::vector<unsigned char> script(1 + InsecureRandRange(40), OP_TRUE);
+            cache.AddCoin(COutPoint(txid, n * 3), Coin(CTxOut(InsecureRandRange(100 * COIN), CScript(script.begin(), script.end())), height, coinbase), false);
+        }
+    }
+    cache.SetBestBlock(hash_block);
+    BOOST_REQUIRE(cache.Flush());
+}
+
+/** Write the coins of db to a snapshot, and return the hash of the UTXO set */
+uint256 DumpSnapshot(const fs::path& path, CCoinsViewDB& db, SnapshotMetadata& metadata)
+{
+    CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    return WriteUTXOSnapshot(file, *cursor, metadata);
+}
+
+std::vector<char> ReadFile(const fs::path& path)
+{
+    std::vector<char> data(fs::file_size(path));
+    FILE* file = fsbridge::fopen(path, "rb");
+    BOOST_REQUIRE_EQUAL(fread(data.data(), 1, data.size(), file), data.size());
+    fclose(file);
+    return data;
+}
+
+/** Read the header of a snapshot, and check its coins */
+bool CheckSnapshot(const fs::path& path, const std::vector<char>& data, const AssumeutxoData& au_data)
+{
+    FILE* file = fsbridge::fopen(path, "wb");
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+    CAutoFile snapshot(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadata;
+    snapshot >> metadata;
+    std::string error;
+    return CheckUTXOSnapshot(snapshot, metadata, au_data, error);
+}
+
+/** Reload the block index from the block tree database, as on startup */
+void ReloadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    UnloadBlockIndex();
+    BOOST_REQUIRE(LoadBlockIndex(chainparams));
+}
+
+/** A block on top of prev spending prevout, which is locked by OP_TRUE */
+CBlock MakeBlock(const CBlockIndex* prev, const COutPoint& prevout)
+{
+    CBlock block;
+    block.nVersion = VERSIONBITS_TOP_BITS;
+    block.hashPrevBlock = prev->GetBlockHash();
+    block.nTime = prev->nTime + Params().GetConsensus().nPowTargetSpacing;
+    block.nBits = prev->nBits;
+    CMutableTransaction coinbase;
+    coinbase.vin.emplace_back();
+    coinbase.vin[0].scriptSig = CScript() << (prev->nHeight + 1) << OP_0;
+    coinbase.vout.emplace_back(0, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    SetDataDir("snapshot_roundtrip");
+    ClearDatadirCache();
+    const fs::path path = GetDataDir() / "utxo.dat";
+
+    const uint256 base = InsecureRand256();
+    CCoinsViewDB source(1 << 20, true);
+    AddRandomCoins(source, base);
+    SnapshotMetadata metadata;
+    const uint256 hash = DumpSnapshot(path, source, metadata);
+    const std::map<COutPoint, Coin> coins = ReadCoins(source);
+    BOOST_CHECK(metadata.m_base_blockhash == base);
+    BOOST_CHECK_EQUAL(metadata.m_coins_count, coins.size());
+
+    // The hash commits to the heights of the coins
+    {
+        UTXOSetHasher hasher(base);
+        bool first = true;
+        for (const auto& coin : coins) {
+            Coin changed = coin.second;
+            if (first) changed.nHeight = changed.nHeight + 1;
+            first = false;
+            hasher.Add(coin.first, std::move(changed));
+        }
+        BOOST_CHECK(hasher.GetHash() != hash);
+    }
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata read_metadata;
+    file >> read_metadata;
+    BOOST_CHECK(read_metadata.m_base_blockhash == base);
+    BOOST_CHECK_EQUAL(read_metadata.m_coins_count, metadata.m_coins_count);
+    std::string error;
+    BOOST_REQUIRE(CheckUTXOSnapshot(file, read_metadata, AssumeutxoData{hash, 0}, error));
+
+    // Coins already in the database are kept
+    CCoinsViewDB loaded(1 << 20, true);
+    std::vector<std::pair<COutPoint, Coin>> existing{{COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false)}};
+    BOOST_REQUIRE(loaded.WriteSnapshotCoins(existing, base));
+    BOOST_CHECK(loaded.GetBestBlock().IsNull());
+    BOOST_CHECK(loaded.GetHeadBlocks() == std::vector<uint256>({base, uint256()}));
+
+    BOOST_REQUIRE(LoadUTXOSnapshot(file, read_metadata, loaded, error));
+    BOOST_CHECK(loaded.GetBestBlock() == base);
+    BOOST_CHECK(loaded.GetHeadBlocks().empty());
+    std::map<COutPoint, Coin> loaded_coins = ReadCoins(loaded);
+    BOOST_CHECK(loaded_coins.erase(existing[0].first));
+    BOOST_REQUIRE_EQUAL(loaded_coins.size(), coins.size());
+    for (const auto& coin : coins) {
+        const auto it = loaded_coins.find(coin.first);
+        BOOST_REQUIRE(it != loaded_coins.end());
+        BOOST_CHECK(it->second.out == coin.second.out);
+        BOOST_CHECK(it->second.nHeight == coin.second.nHeight);
+        BOOST_CHECK(it->second.fCoinBase == coin.second.fCoinBase);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_malformed)
+{
+    SetDataDir("snapshot_malformed");
+    ClearDatadirCache();
+    const fs::path path = GetDataDir() / "utxo.dat";
+    const fs::path checked_path = GetDataDir() / "checked.dat";
+
+    CCoinsViewDB source(1 << 20, true);
+    AddRandomCoins(source, InsecureRand256());
+    SnapshotMetadata metadata;
+    const AssumeutxoData au_data{DumpSnapshot(path, source, metadata), 0};
+    const std::vector<char> data = ReadFile(path);
+    BOOST_CHECK(CheckSnapshot(checked_path, data, au_data));
+
+    // Another hash is pinned
+    BOOST_CHECK(!CheckSnapshot(checked_path, data, AssumeutxoData{InsecureRand256(), 0}));
+
+    // Truncated coins and headers, and data after the coins
+    const size_t header_size = sizeof(SNAPSHOT_MAGIC) + 2 + 4 + 32 + 8;
+    for (size_t size = header_size; size < data.size(); size += 1 + InsecureRandRange(50)) {
+        BOOST_CHECK(!CheckSnapshot(checked_path, std::vector<char>(data.begin(), data.begin() + size), au_data));
+    }
+    BOOST_CHECK_THROW(CheckSnapshot(checked_path, std::vector<char>(data.begin(), data.begin() + header_size - 1), au_data), std::ios_base::failure);
+    std::vector<char> bad = data;
+    bad.push_back(0);
+    BOOST_CHECK(!CheckSnapshot(checked_path, bad, au_data));
+
+    // Changed coins, and not a snapshot
+    bad = data;
+    bad[header_size + 40] ^= 1;
+    BOOST_CHECK(!CheckSnapshot(checked_path, bad, au_data));
+    for (size_t pos : {0, 5, 7}) {
+        bad = data;
+        bad[pos] ^= 1;
+        BOOST_CHECK_THROW(CheckSnapshot(checked_path, bad, au_data), std::ios_base::failure);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(snapshot_activate, TestingSetup)
+{
+    const CChainParams& chainparams = Params();
+    const fs::path path = GetDataDir() / "utxo.dat";
+    LOCK(cs_main);
+
+    // Headers of 10 blocks on top of the genesis block, the last of which is
+    // the base of the snapshot, as stored by a node that synced them
+    const int base_height = 10;
+    std::vector<uint256> hashes(base_height + 1);
+    std::vector<CBlockIndex> headers(base_height + 1);
+    for (int height = 1; height <= base_height; ++height) {
+        CBlockHeader header;
+        header.nVersion = VERSIONBITS_TOP_BITS;
+        header.hashPrevBlock = height > 1 ? hashes[height - 1] : chainparams.GenesisBlock().GetHash();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = chainparams.GenesisBlock().nTime + height * chainparams.GetConsensus().nPowTargetSpacing;
+        header.nBits = chainparams.GenesisBlock().nBits;
+        hashes[height] = header.GetHash();
+        headers[height] = CBlockIndex(header);
+        headers[height].phashBlock = &hashes[height];
+        headers[height].pprev = height > 1 ? &headers[height - 1] : chainActive.Genesis();
+        headers[height].nHeight = height;
+        headers[height].RaiseValidity(BLOCK_VALID_TREE);
+    }
+    FlushStateToDisk();
+    std::vector<const CBlockIndex*> header_indexes;
+    for (int height = 1; height <= base_height; ++height) {
+        header_indexes.push_back(&headers[height]);
+    }
+    BOOST_REQUIRE(pblocktree->WriteBatchSync({}, 0, header_indexes));
+    ReloadBlockIndex(chainparams);
+    CBlockIndex* base = LookupBlockIndex(hashes[base_height]);
+    BOOST_REQUIRE(base && base->nHeight == base_height);
+
+    // A snapshot of the base with a coin to spend, pinned for this network
+    const COutPoint prevout(InsecureRand256(), 1);
+    CCoinsViewDB source(1 << 20, true);
+    {
+        CCoinsViewCache cache(&source);
+        cache.AddCoin(prevout, Coin(CTxOut(2 * COIN, CScript() << OP_TRUE), 5, false), false);
+        cache.SetBestBlock(base->GetBlockHash());
+        BOOST_REQUIRE(cache.Flush());
+    }
+    AddRandomCoins(source, base->GetBlockHash());
+    SnapshotMetadata metadata;
+    const unsigned int chain_tx = 42;
+    UpdateAssumeutxoParameters(base->GetBlockHash(), AssumeutxoData{DumpSnapshot(path, source, metadata), chain_tx});
+
+    // A load interrupted after some coins were written is not taken for a
+    // chainstate, and can be restarted
+    std::vector<std::pair<COutPoint, Coin>> some_coins{{COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false)}};
+    BOOST_REQUIRE(pcoinsdbview->WriteSnapshotCoins(some_coins, base->GetBlockHash()));
+    std::string error;
+    BOOST_CHECK(!CheckSnapshotChainstate(chainparams, error));
+    BOOST_CHECK(error.find("-loadutxosnapshot") != std::string::npos);
+    pcoinsTip.reset();
+    BOOST_REQUIRE_MESSAGE(ActivateUTXOSnapshot(path, 1 << 20, chainparams, error), error);
+    BOOST_CHECK(CheckSnapshotChainstate(chainparams, error));
+    BOOST_CHECK(pindexSnapshotBase == base);
+    BOOST_CHECK_EQUAL(base->nChainTx, chain_tx);
+    BOOST_CHECK(pcoinsdbview->GetBestBlock() == base->GetBlockHash());
+
+    // The base is read back from the block tree database, and recorded on
+    // startup if the node stopped right after the coins were written
+    ReloadBlockIndex(chainparams);
+    base = LookupBlockIndex(hashes[base_height]);
+    BOOST_CHECK(pindexSnapshotBase == base);
+    BOOST_CHECK_EQUAL(base->nChainTx, chain_tx);
+    BOOST_REQUIRE(pblocktree->WriteSnapshotBase(uint256(), 0));
+    ReloadBlockIndex(chainparams);
+    base = LookupBlockIndex(hashes[base_height]);
+    BOOST_CHECK(!pindexSnapshotBase);
+    BOOST_REQUIRE(CheckSnapshotChainstate(chainparams, error));
+    BOOST_CHECK(pindexSnapshotBase == base);
+    BOOST_CHECK_EQUAL(base->nChainTx, chain_tx);
+
+    // Blocks on top of the base are connected with the coins of the snapshot.
+    // Proof of work is not checked, the headers are made up.
+    pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+    BOOST_REQUIRE(LoadChainTip(chainparams));
+    BOOST_CHECK(chainActive.Tip() == base);
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidity(state, chainparams, MakeBlock(base, prevout), base, false, true));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(!TestBlockValidity(state, chainparams, MakeBlock(base, COutPoint(InsecureRand256(), 1)), base, false, true));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-missingorspent");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
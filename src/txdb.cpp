@@ -14,6 +14,7 @@
 #include <util.h>
 #include <ui_interface.h>
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -28,6 +29,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_SNAPSHOT_BASE = 'S';
 
 namespace {
 
@@ -53,7 +55,7 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const DBOptions& db_options) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, db_options), m_sorted_writes(db_options.sorted_writes)
 {
 }
 
@@ -105,7 +107,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    auto write_entry = [&](CCoinsMap::iterator it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -115,8 +117,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        mapCoins.erase(it);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -129,6 +130,31 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
                 }
             }
         }
+    };
+
+    if (m_sorted_writes) {
+        // Write the dirty coins in key order, which LevelDB inserts into its
+        // in-memory table faster (see DBOptions::sorted_writes).
+        std::vector<CCoinsMap::iterator> dirty;
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+            CCoinsMap::iterator itOld = it++;
+            if (itOld->second.flags & CCoinsCacheEntry::DIRTY) {
+                dirty.push_back(itOld);
+            } else {
+                count++;
+                mapCoins.erase(itOld);
+            }
+        }
+        std::sort(dirty.begin(), dirty.end(), [](const CCoinsMap::iterator& a, const CCoinsMap::iterator& b) {
+            return a->first < b->first;
+        });
+        for (const CCoinsMap::iterator& it : dirty) {
+            write_entry(it);
+        }
+    } else {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+            write_entry(it++);
+        }
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
@@ -141,12 +167,22 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::WriteSnapshotCoins(const std::vector<std::pair<COutPoint, Coin>>& coins, const uint256& hashBlock) {
+    CDBBatch batch(db);
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, uint256()});
+    for (const auto& coin : coins) {
+        batch.Write(CoinEntry(&coin.first), coin.second);
+    }
+    return db.WriteBatch(batch);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe, false, DBOptions::BlockIndex()) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -170,7 +206,7 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock(), m_open_cursors);
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
@@ -246,6 +282,20 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteSnapshotBase(const uint256& hash, unsigned int nChainTx) {
+    return Write(DB_SNAPSHOT_BASE, std::make_pair(hash, nChainTx), true);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(uint256& hash, unsigned int& nChainTx) {
+    std::pair<uint256, unsigned int> base;
+    if (!Read(DB_SNAPSHOT_BASE, base)) {
+        return false;
+    }
+    hash = base.first;
+    nChainTx = base.second;
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
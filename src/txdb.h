@@ -11,6 +11,7 @@
 #include <chain.h>
 #include <primitives/block.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
@@ -39,14 +40,20 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max size of each coin DB write buffer while the chain state is rebuilt (MiB)
+static const int64_t nMaxCoinsDBWriteBuffer = 64;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! Whether BatchWrite writes the coins in key order (DBOptions::sorted_writes)
+    const bool m_sorted_writes;
+    //! Number of cursors over the database that have not been destroyed yet
+    mutable std::atomic<int> m_open_cursors{0};
 public:
-    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const DBOptions& db_options = DBOptions::Chainstate());
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -55,16 +62,29 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Write coins of a UTXO snapshot of a block. Until a BatchWrite to that
+     * block, the database is marked as being replayed to it from nothing.
+     */
+    bool WriteSnapshotCoins(const std::vector<std::pair<COutPoint, Coin>>& coins, const uint256& hashBlock);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    /**
+     * Whether cursors over the database are still open, which it must outlive.
+     * Cursors over pcoinsdbview are opened under cs_main, so while that is
+     * held this can only change from true to false.
+     */
+    bool HasOpenCursors() const { return m_open_cursors > 0; }
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
 public:
-    ~CCoinsViewDBCursor() {}
+    ~CCoinsViewDBCursor() { --m_open_cursors; }
 
     bool GetKey(COutPoint &key) const override;
     bool GetValue(Coin &coin) const override;
@@ -74,10 +94,11 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, std::atomic<int>& open_cursors):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), m_open_cursors(open_cursors) { ++m_open_cursors; }
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    std::atomic<int>& m_open_cursors;
 
     friend class CCoinsViewDB;
 };
@@ -95,6 +116,9 @@ public:
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! The block a UTXO snapshot was loaded at, and its number of transactions up to it
+    bool WriteSnapshotBase(const uint256& hash, unsigned int nChainTx);
+    bool ReadSnapshotBase(uint256& hash, unsigned int& nChainTx);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
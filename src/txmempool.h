@@ -450,6 +450,7 @@ private:
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
+    mutable uint64_t m_sequence_number GUARDED_BY(cs); //!< incremented for every transaction added to or removed from the pool
 
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -632,6 +633,21 @@ public:
         return mapTx.size();
     }
 
+    /**
+     * The mempool sequence number. It is attached to the added and removed
+     * notifications, so that external listeners can line up a getrawmempool
+     * snapshot with the notification stream.
+     */
+    uint64_t GetSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_sequence_number;
+    }
+
+    uint64_t GetAndIncrementSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_sequence_number++;
+    }
+
     uint64_t GetTotalTxSize() const
     {
         LOCK(cs);
@@ -651,7 +667,7 @@ public:
     size_t DynamicMemoryUsage() const;
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
-    boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason, uint64_t mempool_sequence)> NotifyEntryRemoved;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -10,6 +10,7 @@
 #include <consensus/consensus.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <support/allocators/arena.h>
 
 /** Undo information for a CTxIn
  *
@@ -68,7 +69,11 @@ class CTxUndo
 {
 public:
     // undo information for all txins
-    std::vector<Coin> vprevout;
+    std::vector<Coin, ArenaAllocator<Coin>> vprevout;
+
+    CTxUndo() {}
+    /** Allocate the undo information from arena, which has to outlive it */
+    explicit CTxUndo(MonotonicArena* arena) : vprevout(ArenaAllocator<Coin>(arena)) {}
 
     template <typename Stream>
     void Serialize(Stream& s) const {
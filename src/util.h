@@ -22,12 +22,14 @@
 #include <utiltime.h>
 #include <utilmemory.h>
 
+#include <algorithm>
 #include <atomic>
 #include <exception>
 #include <map>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -314,6 +316,36 @@ std::string HelpMessageOpt(const std::string& option, const std::string& message
  */
 int GetNumCores();
 
+/**
+ * Call fn(i) for every i in [0, count), spreading the calls over up to
+ * max_threads threads (the calling thread included, and no more than there
+ * are cores) with at least min_per_thread calls each. Returns when all calls
+ * are done. Calls on different threads run concurrently and in no particular
+ * order, and fn must not throw.
+ */
+template <typename Fn>
+void ParallelFor(size_t count, int max_threads, size_t min_per_thread, const Fn& fn)
+{
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+
+    const size_t per_thread = std::max<size_t>(1, min_per_thread);
+    const int num_threads = (int)std::max<size_t>(1, std::min({(size_t)std::max(1, GetNumCores()), (size_t)std::max(1, max_threads), count / per_thread}));
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
 void RenameThread(const char* name);
 
 /**
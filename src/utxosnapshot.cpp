@@ -0,0 +1,184 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <utxosnapshot.h>
+
+#include <shutdown.h>
+#include <txdb.h>
+#include <util.h>
+#include <version.h>
+
+#include <stdexcept>
+#include <stdio.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+//! Number of coins written to the chainstate database at once while loading a snapshot
+static const size_t SNAPSHOT_LOAD_BATCH_COINS = 100000;
+
+/** Read the coins of a snapshot, and call fn for each of them */
+template <typename Fn>
+void ReadSnapshotCoins(CAutoFile& file, uint64_t coins_count, Fn fn)
+{
+    uint64_t read = 0;
+    while (read < coins_count) {
+        uint256 txid;
+        uint64_t count = 0;
+        file >> txid >> VARINT(count);
+        if (count == 0 || count > coins_count - read) {
+            throw std::ios_base::failure("Bad number of coins");
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t n = 0;
+            Coin coin;
+            file >> VARINT(n) >> coin;
+            fn(COutPoint(txid, n), std::move(coin));
+        }
+        read += count;
+    }
+    if (fgetc(file.Get()) != EOF) {
+        throw std::ios_base::failure("Data after the coins");
+    }
+}
+
+} // namespace
+
+UTXOSetHasher::UTXOSetHasher(const uint256& hash_block) : m_ss(SER_GETHASH, PROTOCOL_VERSION)
+{
+    m_ss << hash_block;
+}
+
+void UTXOSetHasher::Add(const COutPoint& outpoint, Coin coin)
+{
+    if (!m_outputs.empty() && outpoint.hash != m_txid) ApplyOutputs();
+    m_txid = outpoint.hash;
+    m_outputs[outpoint.n] = std::move(coin);
+}
+
+void UTXOSetHasher::ApplyOutputs()
+{
+    m_ss << m_txid;
+    for (const auto& output : m_outputs) {
+        const uint32_t code = output.second.nHeight * 2 + output.second.fCoinBase;
+        m_ss << VARINT(output.first + 1);
+        m_ss << VARINT(code);
+        m_ss << output.second.out.scriptPubKey;
+        m_ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+    }
+    m_ss << VARINT(0u);
+    m_outputs.clear();
+}
+
+uint256 UTXOSetHasher::GetHash()
+{
+    if (!m_outputs.empty()) ApplyOutputs();
+    return m_ss.GetHash();
+}
+
+uint256 WriteUTXOSnapshot(CAutoFile& file, CCoinsViewCursor& cursor, SnapshotMetadata& metadata)
+{
+    metadata.m_base_blockhash = cursor.GetBestBlock();
+    metadata.m_coins_count = 0;
+    // Rewritten with the number of coins once they are all written
+    file << metadata;
+
+    UTXOSetHasher hasher(metadata.m_base_blockhash);
+    uint256 txid;
+    std::vector<std::pair<uint32_t, Coin>> coins;
+    auto write_coins = [&]() {
+        uint64_t count = coins.size();
+        file << txid << VARINT(count);
+        for (const auto& coin : coins) {
+            file << VARINT(coin.first) << coin.second;
+        }
+        coins.clear();
+    };
+    for (; cursor.Valid(); cursor.Next()) {
+        COutPoint key;
+        Coin coin;
+        if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+            throw std::runtime_error("Unable to read the UTXO set");
+        }
+        if (!coins.empty() && key.hash != txid) write_coins();
+        txid = key.hash;
+        hasher.Add(key, coin);
+        coins.emplace_back(key.n, std::move(coin));
+        ++metadata.m_coins_count;
+    }
+    if (!coins.empty()) write_coins();
+
+    if (fseek(file.Get(), 0, SEEK_SET)) {
+        throw std::ios_base::failure("Unable to rewrite the snapshot header");
+    }
+    file << metadata;
+    return hasher.GetHash();
+}
+
+bool CheckUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, const AssumeutxoData& au_data, std::string& error)
+{
+    try {
+        const long coins_pos = ftell(file.Get());
+        UTXOSetHasher hasher(metadata.m_base_blockhash);
+        ReadSnapshotCoins(file, metadata.m_coins_count, [&](const COutPoint& outpoint, Coin&& coin) {
+            hasher.Add(outpoint, std::move(coin));
+        });
+        const uint256 hash = hasher.GetHash();
+        if (hash != au_data.hash_serialized) {
+            error = strprintf("UTXO snapshot hash %s does not match %s, the one expected for block %s",
+                hash.ToString(), au_data.hash_serialized.ToString(), metadata.m_base_blockhash.ToString());
+            return false;
+        }
+        if (coins_pos < 0 || fseek(file.Get(), coins_pos, SEEK_SET)) {
+            throw std::ios_base::failure("Unable to rewind the snapshot");
+        }
+    } catch (const std::exception& e) {
+        error = strprintf("Unable to read UTXO snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, CCoinsViewDB& db, std::string& error)
+{
+    const uint256& base = metadata.m_base_blockhash;
+    LogPrintf("Loading %u coins from the UTXO snapshot of block %s...\n", metadata.m_coins_count, base.ToString());
+    try {
+        std::vector<std::pair<COutPoint, Coin>> coins;
+        uint64_t loaded = 0;
+        int report_done = 0;
+        auto write_coins = [&]() {
+            if (!db.WriteSnapshotCoins(coins, base)) {
+                throw std::runtime_error("Unable to write to the chainstate database");
+            }
+            loaded += coins.size();
+            coins.clear();
+            const int percentage_done = loaded * 100 / metadata.m_coins_count;
+            if (report_done < percentage_done / 10) {
+                LogPrintf("[%d%%]...", percentage_done); /* Continued */
+                report_done = percentage_done / 10;
+            }
+            if (ShutdownRequested()) {
+                throw std::runtime_error("Interrupted");
+            }
+        };
+        ReadSnapshotCoins(file, metadata.m_coins_count, [&](const COutPoint& outpoint, Coin&& coin) {
+            coins.emplace_back(outpoint, std::move(coin));
+            if (coins.size() >= SNAPSHOT_LOAD_BATCH_COINS) write_coins();
+        });
+        if (!coins.empty()) write_coins();
+        LogPrintf("[DONE].\n");
+
+        // Mark the database as consistent with the base block
+        CCoinsMap no_coins;
+        if (!db.BatchWrite(no_coins, base)) {
+            throw std::runtime_error("Unable to write to the chainstate database");
+        }
+    } catch (const std::exception& e) {
+        error = strprintf("Unable to load UTXO snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
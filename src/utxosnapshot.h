@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include <chainparams.h>
+#include <coins.h>
+#include <hash.h>
+#include <primitives/transaction.h>
+#include <protocol.h>
+#include <serialize.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <uint256.h>
+
+#include <ios>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+class CCoinsViewDB;
+
+static const unsigned char SNAPSHOT_MAGIC[] = {'u', 't', 'x', 'o', 0xff};
+static const uint16_t SNAPSHOT_VERSION = 1;
+
+/**
+ * The header of a UTXO snapshot file, written by dumptxoutset and loaded with
+ * -loadutxosnapshot. It is followed by the coins, grouped by txid: the txid,
+ * the number of its coins, and for each of them its output index and the coin.
+ */
+class SnapshotMetadata
+{
+public:
+    //! The block the snapshot is the UTXO set of
+    uint256 m_base_blockhash;
+    uint64_t m_coins_count = 0;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << Params().MessageStart() << m_base_blockhash << m_coins_count;
+    }
+
+    /** Throws std::ios_base::failure if the file is not a snapshot of this network's chain */
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char magic[sizeof(SNAPSHOT_MAGIC)];
+        uint16_t version;
+        CMessageHeader::MessageStartChars network;
+        s >> magic >> version >> network;
+        if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic))) {
+            throw std::ios_base::failure("Not a UTXO snapshot");
+        }
+        if (version != SNAPSHOT_VERSION) {
+            throw std::ios_base::failure(strprintf("Unsupported UTXO snapshot version %u", version));
+        }
+        if (memcmp(network, Params().MessageStart(), sizeof(network))) {
+            throw std::ios_base::failure("UTXO snapshot of another network");
+        }
+        s >> m_base_blockhash >> m_coins_count;
+    }
+};
+
+/**
+ * Hashes a UTXO set like gettxoutsetinfo's hash_serialized_2 does, except for
+ * the height and coinbase flag of the coins: hash_serialized_2 only commits to
+ * whether the first coin of a transaction is at height 0 and not a coinbase,
+ * while a snapshot has to commit to both for every coin, as they decide when
+ * it can be spent.
+ */
+class UTXOSetHasher
+{
+public:
+    explicit UTXOSetHasher(const uint256& hash_block);
+
+    /** Add a coin. Coins have to be added in the order of the chainstate: by txid, then output index. */
+    void Add(const COutPoint& outpoint, Coin coin);
+    uint256 GetHash();
+
+private:
+    CHashWriter m_ss;
+    uint256 m_txid;
+    std::map<uint32_t, Coin> m_outputs;
+
+    void ApplyOutputs();
+};
+
+/**
+ * Write the coins of a cursor to a snapshot, after a header with the block
+ * they are the UTXO set of. Fills in the number of coins written, and returns
+ * the hash of the UTXO set. Throws std::ios_base::failure if the file cannot be
+ * written, and std::runtime_error if the cursor cannot be read.
+ */
+uint256 WriteUTXOSnapshot(CAutoFile& file, CCoinsViewCursor& cursor, SnapshotMetadata& metadata);
+
+/**
+ * Check the coins of a snapshot, whose header has already been read, against
+ * the hash pinned for its base block, and rewind the file to the coins.
+ */
+bool CheckUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, const AssumeutxoData& au_data, std::string& error);
+
+/**
+ * Load the coins of a checked snapshot into a chainstate database. The coins
+ * are added to those in the database, which is consistent with the base block
+ * of the snapshot once they are all written, and marked as being replayed to
+ * it until then. Stops with an error if shutdown is requested.
+ */
+bool LoadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata, CCoinsViewDB& db, std::string& error);
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
@@ -6,6 +6,9 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockcompression.h>
+#include <blockfilemapper.h>
+#include <blockfilesyncer.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,6 +17,7 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <hash.h>
 #include <index/txindex.h>
@@ -23,12 +27,14 @@
 #include <pow.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <primitives/view.h>
 #include <random.h>
 #include <reverse_iterator.h>
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <script/standard.h>
 #include <shutdown.h>
+#include <support/allocators/arena.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
@@ -38,6 +44,7 @@
 #include <util.h>
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
+#include <utxosnapshot.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
@@ -186,6 +193,13 @@ public:
 
     void PruneBlockIndexCandidates();
 
+    /**
+     * Count the transactions up to the base block of a UTXO snapshot without
+     * having their blocks, and make it and the blocks after it that we have
+     * data for candidates for the tip.
+     */
+    void LinkSnapshotBase(CBlockIndex* base, unsigned int nChainTx) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     void UnloadBlockIndex();
 
 private:
@@ -217,6 +231,7 @@ CCriticalSection cs_main;
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
 CChain& chainActive = g_chainstate.chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
+CBlockIndex *pindexSnapshotBase = nullptr;
 CWaitableCriticalSection g_best_block_mutex;
 CConditionVariable g_best_block_cv;
 uint256 g_best_block;
@@ -225,6 +240,9 @@ std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
+/** Whether the block files hold compressed records, which older versions cannot read */
+static std::atomic_bool fHaveCompressedBlocks(false);
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
@@ -272,6 +290,10 @@ namespace {
 
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
+
+    /** Block and undo files written to since they were last queued for syncing. */
+    std::set<int> setUnsyncedBlockFiles;
+    std::set<int> setUnsyncedUndoFiles;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -584,7 +606,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     // Do not work on transactions that are too small.
     // A transaction with 1 segwit input and 1 P2WPHK output has non-witness size of 82 bytes.
     // Transactions smaller than this are not relayed to reduce unnecessary malloc overhead.
-    if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE)
+    if (tx.GetStrippedSize() < MIN_STANDARD_TX_NONWITNESS_SIZE)
         return state.DoS(0, false, REJECT_NONSTANDARD, "tx-size-small");
 
     // Only accept nLockTime-using transactions that can be mined in the next
@@ -969,7 +991,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
     }
 
-    GetMainSignals().TransactionAddedToMempool(ptx);
+    GetMainSignals().TransactionAddedToMempool(ptx, pool.GetAndIncrementSequence());
 
     return true;
 }
@@ -1052,7 +1074,8 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+/** Write block to disk, or the compressed record of it if given */
+static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, const std::vector<unsigned char>* compressed = nullptr)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1060,7 +1083,7 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
+    unsigned int nSize = compressed ? compressed->size() | BLOCK_RECORD_COMPRESSED : GetSerializeSize(fileout, block);
     fileout << messageStart << nSize;
 
     // Write block
@@ -1068,23 +1091,138 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (compressed) {
+        fileout.write((const char*)compressed->data(), compressed->size());
+    } else {
+        fileout << block;
+    }
 
     return true;
 }
 
+/**
+ * Find the record at pos of a block or undo file in the file's memory mapping,
+ * using the size in the header in front of it, and the extra bytes following
+ * it. Returns nullptr if the file is not mapped: the last file is still being
+ * written to and truncated, and is read from the file instead. Block records
+ * pass compressed, to be told whether the record is compressed.
+ */
+static std::shared_ptr<const MappedFile> MapDiskRecord(const CDiskBlockPos& pos, const char* prefix, size_t extra, Span<const unsigned char>& record, bool* compressed = nullptr)
+{
+    if (pos.IsNull() || pos.nPos < 8) return nullptr;
+    {
+        LOCK(cs_LastBlockFile);
+        if ((int)pos.nFile >= nLastBlockFile) return nullptr;
+    }
+    const fs::path path = GetBlockPosFilename(pos, prefix);
+    std::shared_ptr<const MappedFile> file = g_block_file_mapper.Get(path, pos.nPos);
+    if (!file) return nullptr;
+    uint32_t nSize = ReadLE32(file->Data().data() + pos.nPos - 4);
+    if (compressed) {
+        *compressed = nSize & BLOCK_RECORD_COMPRESSED;
+        nSize &= ~BLOCK_RECORD_COMPRESSED;
+    }
+    const size_t end = pos.nPos + (size_t)nSize + extra;
+    if (end > file->Size()) {
+        // Undo files are appended to until the blocks of their block file are connected
+        file = g_block_file_mapper.Get(path, end);
+        if (!file) return nullptr;
+    }
+    record = file->Data().subspan(pos.nPos, end - extra - pos.nPos);
+    return file;
+}
+
+/** Decompress the compressed block record at pos, and keep the block in the cache */
+static DecompressedBlockCache::BlockData DecompressBlock(const CDiskBlockPos& pos, Span<const unsigned char> record)
+{
+    std::shared_ptr<std::vector<unsigned char>> block = std::make_shared<std::vector<unsigned char>>();
+    if (!DecompressBlockRecord(record, *block)) {
+        throw std::ios_base::failure("malformed compressed block record");
+    }
+    g_decompressed_block_cache.Insert(pos, block);
+    return block;
+}
+
+/**
+ * Find the serialized block at pos in memory: in the decompressed block cache,
+ * or in the mapping of its file, decompressing it if its record is compressed.
+ * The returned object keeps data valid. Returns nullptr if the block is to be
+ * read from the file. Throws if the record is invalid.
+ */
+static std::shared_ptr<const void> MapBlock(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start, Span<const unsigned char>& data)
+{
+    if (DecompressedBlockCache::BlockData block = g_decompressed_block_cache.Get(pos)) {
+        data = MakeSpan(*block);
+        return block;
+    }
+
+    Span<const unsigned char> record;
+    bool compressed;
+    std::shared_ptr<const MappedFile> file = MapDiskRecord(pos, "blk", 0, record, &compressed);
+    if (!file) return nullptr;
+    const unsigned char* blk_start = record.data() - 8;
+    if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+        throw std::ios_base::failure(strprintf("block magic mismatch: %s versus expected %s",
+                HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE)));
+    }
+    if ((uint64_t)record.size() > MAX_SIZE) {
+        throw std::ios_base::failure(strprintf("block data is larger than maximum deserialization size: %s versus %s", record.size(), MAX_SIZE));
+    }
+    if (!compressed) {
+        data = record;
+        return file;
+    }
+    DecompressedBlockCache::BlockData block = DecompressBlock(pos, record);
+    data = MakeSpan(*block);
+    return block;
+}
+
+/**
+ * Read the size of the block record at pos from filein, which is positioned
+ * in front of it. Returns the block if the record is compressed, and nullptr
+ * with filein positioned at an uncompressed block otherwise.
+ */
+static DecompressedBlockCache::BlockData ReadBlockRecord(CAutoFile& filein, const CDiskBlockPos& pos)
+{
+    unsigned int nSize;
+    filein >> nSize;
+    if (!(nSize & BLOCK_RECORD_COMPRESSED)) return nullptr;
+    nSize &= ~BLOCK_RECORD_COMPRESSED;
+    if (nSize > MAX_SIZE) {
+        throw std::ios_base::failure("compressed block record is larger than maximum deserialization size");
+    }
+    std::vector<unsigned char> record(nSize);
+    filein.read((char*)record.data(), nSize);
+    return DecompressBlock(pos, Span<const unsigned char>(record.data(), record.size()));
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
-    // Read block
     try {
-        filein >> block;
+        Span<const unsigned char> data;
+        if (const std::shared_ptr<const void> holder = MapBlock(pos, Params().MessageStart(), data)) {
+            // Read block from memory
+            SpanReader reader(SER_DISK, CLIENT_VERSION, data);
+            reader >> block;
+        } else {
+            // Open history file to read, in front of the record size
+            CDiskBlockPos hpos = pos;
+            hpos.nPos -= 4;
+            CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+            // Read block
+            if (const DecompressedBlockCache::BlockData decompressed = ReadBlockRecord(filein, pos)) {
+                SpanReader reader(SER_DISK, CLIENT_VERSION, MakeSpan(*decompressed));
+                reader >> block;
+            } else {
+                filein >> block;
+            }
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1115,6 +1253,16 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    try {
+        Span<const unsigned char> data;
+        if (const std::shared_ptr<const void> holder = MapBlock(pos, message_start, data)) {
+            block.assign(data.begin(), data.end());
+            return true;
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+    }
+
     CDiskBlockPos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1134,6 +1282,8 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos,
                     HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
         }
 
+        const bool compressed = blk_size & BLOCK_RECORD_COMPRESSED;
+        blk_size &= ~BLOCK_RECORD_COMPRESSED;
         if (blk_size > MAX_SIZE) {
             return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
                     blk_size, MAX_SIZE);
@@ -1141,6 +1291,10 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos,
 
         block.resize(blk_size); // Zeroing of memory is intentional here
         filein.read((char*)block.data(), blk_size);
+        if (compressed) {
+            const DecompressedBlockCache::BlockData decompressed = DecompressBlock(pos, Span<const unsigned char>(block.data(), block.size()));
+            block.assign(decompressed->begin(), decompressed->end());
+        }
     } catch(const std::exception& e) {
         return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
     }
@@ -1159,6 +1313,60 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+bool ReadCheckedRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    if (!ReadRawBlockFromDisk(block, pindex, message_start)) {
+        return false;
+    }
+
+    try {
+        const BlockView view(Span<const unsigned char>(block.data(), block.size()));
+        if (view.GetBytes().size() != block.size() || view.GetHash() != pindex->GetBlockHash()) {
+            return error("%s: Block read from disk is not block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s for block %s", __func__, e.what(), pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool ReadTxFromDisk(CBlockHeader& header, CTransactionRef& tx, const CDiskBlockPos& pos, unsigned int nTxOffset)
+{
+    auto read_tx = [&](Span<const unsigned char> data) {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, data);
+        reader >> header;
+        reader.ignore(nTxOffset);
+        reader >> tx;
+    };
+
+    try {
+        Span<const unsigned char> data;
+        if (const std::shared_ptr<const void> holder = MapBlock(pos, Params().MessageStart(), data)) {
+            read_tx(data);
+            return true;
+        }
+
+        CDiskBlockPos hpos = pos;
+        hpos.nPos -= 4;
+        CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        }
+        if (const DecompressedBlockCache::BlockData decompressed = ReadBlockRecord(filein, pos)) {
+            read_tx(MakeSpan(*decompressed));
+        } else {
+            filein >> header;
+            if (fseek(filein.Get(), nTxOffset, SEEK_CUR)) {
+                return error("%s: fseek(...) failed", __func__);
+            }
+            filein >> tx;
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1496,6 +1704,30 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
         return error("%s: no undo data available", __func__);
     }
 
+    // The undo data is followed by its checksum
+    Span<const unsigned char> record;
+    if (const std::shared_ptr<const MappedFile> file = MapDiskRecord(pos, "rev", 32, record)) {
+        uint256 hashChecksum;
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(record.end(), 32)) >> hashChecksum;
+            hasher << pindex->pprev->GetBlockHash();
+            hasher.write((const char*)record.data(), record.size());
+            SpanReader reader(SER_DISK, CLIENT_VERSION, record);
+            reader >> blockundo;
+            if (!reader.empty()) throw std::ios_base::failure("undo data shorter than its record");
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        // Verify checksum
+        if (hashChecksum != hasher.GetHash())
+            return error("%s: Checksum mismatch", __func__);
+
+        return true;
+    }
+
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -1633,6 +1865,12 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/**
+ * Queue the block and undo files that were written to for syncing to disk in
+ * the background. Callers that need the data on disk wait for
+ * g_block_file_syncer. With fFinalize the last files are first truncated to
+ * the size used, as no more blocks will be added to them.
+ */
 void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
@@ -1640,25 +1878,32 @@ void static FlushBlockFile(bool fFinalize = false)
     CDiskBlockPos posOld(nLastBlockFile, 0);
     bool status = true;
 
-    FILE *fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
+    if (fFinalize) {
+        FILE *fileOld = OpenBlockFile(posOld);
+        if (fileOld) {
             status &= TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        status &= FileCommit(fileOld);
-        fclose(fileOld);
-    }
+            fclose(fileOld);
+        }
 
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
+        fileOld = OpenUndoFile(posOld);
+        if (fileOld) {
             status &= TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        status &= FileCommit(fileOld);
-        fclose(fileOld);
+            fclose(fileOld);
+        }
     }
 
     if (!status) {
         AbortNode("Flushing block file to disk failed. This is likely the result of an I/O error.");
     }
+
+    for (int nFile : setUnsyncedBlockFiles) {
+        g_block_file_syncer.Sync(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    }
+    setUnsyncedBlockFiles.clear();
+    for (int nFile : setUnsyncedUndoFiles) {
+        g_block_file_syncer.Sync(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "rev"));
+    }
+    setUnsyncedUndoFiles.clear();
 }
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
@@ -1973,6 +2218,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
+    // The undo information and the precomputed transaction data only live
+    // until the block is connected, and are released at once with the arena.
+    // It is declared first, so the script checks still running on an early
+    // return only see memory that is kept alive.
+    MonotonicArena arena;
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
@@ -1982,8 +2232,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
+    std::vector<PrecomputedTransactionData, ArenaAllocator<PrecomputedTransactionData>> txdata{ArenaAllocator<PrecomputedTransactionData>(&arena)};
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    std::vector<CScriptCheck> vChecks;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -2028,17 +2279,17 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         txdata.emplace_back(tx);
         if (!tx.IsCoinBase())
         {
-            std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
+            vChecks.clear();
         }
 
         CTxUndo undoDummy;
         if (i > 0) {
-            blockundo.vtxundo.push_back(CTxUndo());
+            blockundo.vtxundo.emplace_back(&arena);
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
     }
@@ -2145,6 +2396,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
+            if (!g_block_file_syncer.Wait()) {
+                return AbortNode(state, "Flushing block file to disk failed. This is likely the result of an I/O error.");
+            }
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -3014,8 +3268,10 @@ static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int
     vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
     if (fKnown)
         vinfoBlockFile[nFile].nSize = std::max(pos.nPos + nAddSize, vinfoBlockFile[nFile].nSize);
-    else
+    else {
         vinfoBlockFile[nFile].nSize += nAddSize;
+        setUnsyncedBlockFiles.insert(nFile);
+    }
 
     if (!fKnown) {
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
@@ -3050,6 +3306,7 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     pos.nPos = vinfoBlockFile[nFile].nUndoSize;
     nNewSize = vinfoBlockFile[nFile].nUndoSize += nAddSize;
     setDirtyFileInfo.insert(nFile);
+    setUnsyncedUndoFiles.insert(nFile);
 
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
@@ -3113,7 +3370,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     // checks that use witness data may be performed here.
 
     // Size limits
-    if (block.vtx.empty() || block.vtx.size() * WITNESS_SCALE_FACTOR > MAX_BLOCK_WEIGHT || ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * WITNESS_SCALE_FACTOR > MAX_BLOCK_WEIGHT)
+    if (block.vtx.empty() || block.vtx.size() * WITNESS_SCALE_FACTOR > MAX_BLOCK_WEIGHT || GetBlockStrippedSize(block) * WITNESS_SCALE_FACTOR > MAX_BLOCK_WEIGHT)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-length", false, "size limits failed");
 
     // First transaction must be coinbase, the rest must not be
@@ -3432,9 +3689,33 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
+/** Record that the block files hold compressed blocks, before the first one is written or indexed */
+static void NoteCompressedBlocks()
+{
+    if (!fHaveCompressedBlocks.exchange(true)) {
+        pblocktree->WriteFlag("compressedblockfiles", true);
+    }
+}
+
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
 static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const CDiskBlockPos* dbp) {
     unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    // New blocks are stored compressed if enabled and that makes them smaller.
+    // Blocks already on disk may be stored compressed too, so their size can
+    // overestimate their record: that only leaves a gap after the last one of
+    // a file.
+    std::vector<unsigned char> compressed;
+    bool fCompressed = false;
+    if (dbp == nullptr && fBlockCompression) {
+        std::vector<unsigned char> data;
+        data.reserve(nBlockSize);
+        CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0, block);
+        fCompressed = CompressBlockRecord(Span<const unsigned char>(data.data(), data.size()), compressed);
+        if (fCompressed) {
+            nBlockSize = compressed.size();
+            NoteCompressedBlocks();
+        }
+    }
     CDiskBlockPos blockPos;
     if (dbp != nullptr)
         blockPos = *dbp;
@@ -3443,7 +3724,7 @@ static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CCh
         return CDiskBlockPos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
+        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart(), fCompressed ? &compressed : nullptr)) {
             AbortNode("Failed to write block");
             return CDiskBlockPos();
         }
@@ -3644,6 +3925,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_block_file_mapper.Release(GetBlockPosFilename(pos, "blk"));
+        g_block_file_mapper.Release(GetBlockPosFilename(pos, "rev"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3828,6 +4111,10 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
 
     boost::this_thread::interruption_point();
 
+    uint256 snapshot_base;
+    unsigned int snapshot_chain_tx = 0;
+    blocktree.ReadSnapshotBase(snapshot_base, snapshot_chain_tx);
+
     // Calculate nChainWork
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -3844,7 +4131,11 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
-        if (pindex->nTx > 0) {
+        if (pindex->GetBlockHash() == snapshot_base) {
+            // The chainstate was loaded from a UTXO snapshot of this block
+            pindex->nChainTx = snapshot_chain_tx;
+            pindexSnapshotBase = pindex;
+        } else if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3860,7 +4151,7 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
-        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == nullptr))
+        if ((pindex->IsValid(BLOCK_VALID_TRANSACTIONS) || pindex == pindexSnapshotBase) && (pindex->nChainTx || pindex->pprev == nullptr))
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
@@ -3918,6 +4209,13 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether blocks have ever been stored compressed
+    bool have_compressed_blocks = false;
+    pblocktree->ReadFlag("compressedblockfiles", have_compressed_blocks);
+    fHaveCompressedBlocks = have_compressed_blocks;
+    if (have_compressed_blocks)
+        LogPrintf("LoadBlockIndexDB(): Block files contain compressed blocks, which versions before -blockcompression cannot read\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -3998,9 +4296,9 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
         if (pindex->nHeight <= chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+        if ((fPruneMode || pindexSnapshotBase) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, or loaded from a UTXO snapshot, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (no data)\n", pindex->nHeight);
             break;
         }
         CBlock block;
@@ -4159,7 +4457,8 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
 
     // Note that during -reindex-chainstate we are called with an empty chainActive!
 
-    int nHeight = 1;
+    // Blocks up to the base of a UTXO snapshot have no data, and are not validated
+    int nHeight = pindexSnapshotBase && chainActive.Contains(pindexSnapshotBase) ? pindexSnapshotBase->nHeight + 1 : 1;
     while (nHeight <= chainActive.Height()) {
         // Although SCRIPT_VERIFY_WITNESS is now generally enforced on all
         // blocks in ConnectBlock, we don't need to go back and
@@ -4278,12 +4577,17 @@ void UnloadBlockIndex()
     chainActive.SetTip(nullptr);
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
+    pindexSnapshotBase = nullptr;
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    g_block_file_mapper.Clear();
+    g_decompressed_block_cache.Clear();
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    setUnsyncedBlockFiles.clear();
+    setUnsyncedUndoFiles.clear();
     versionbitscache.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
@@ -4294,6 +4598,7 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    fHaveCompressedBlocks = false;
 
     g_chainstate.UnloadBlockIndex();
 }
@@ -4320,6 +4625,135 @@ bool LoadBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+void CChainState::LinkSnapshotBase(CBlockIndex* base, unsigned int nChainTx)
+{
+    base->nChainTx = nChainTx;
+    // The chainstate is at the base, whose block we do not have
+    setBlockIndexCandidates.insert(base);
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(base);
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        if (pindex != base) {
+            pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+            if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS)) {
+                setBlockIndexCandidates.insert(pindex);
+            }
+        }
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            queue.push_back(range.first->second);
+            range.first = mapBlocksUnlinked.erase(range.first);
+        }
+    }
+}
+
+bool ActivateUTXOSnapshot(const fs::path& path, size_t coins_db_cache, const CChainParams& chainparams, std::string& error)
+{
+    AssertLockHeld(cs_main);
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        error = strprintf(_("Cannot open UTXO snapshot %s"), path.string());
+        return false;
+    }
+    SnapshotMetadata metadata;
+    try {
+        file >> metadata;
+    } catch (const std::exception& e) {
+        error = strprintf(_("Unable to read UTXO snapshot %s: %s"), path.string(), e.what());
+        return false;
+    }
+
+    const uint256& base_hash = metadata.m_base_blockhash;
+    const auto au_data = chainparams.Assumeutxo().find(base_hash);
+    if (au_data == chainparams.Assumeutxo().end()) {
+        error = strprintf(_("The UTXO snapshot of block %s cannot be loaded, only those of the blocks pinned in this release can"), base_hash.ToString());
+        return false;
+    }
+    CBlockIndex* base = LookupBlockIndex(base_hash);
+    if (!base) {
+        error = strprintf(_("The headers up to block %s have to be synced before its UTXO snapshot can be loaded"), base_hash.ToString());
+        return false;
+    }
+    if (base->nStatus & BLOCK_FAILED_MASK) {
+        error = strprintf(_("The UTXO snapshot is of block %s, which is invalid"), base_hash.ToString());
+        return false;
+    }
+
+    // The snapshot replaces the chainstate only if it is behind it, on the same
+    // chain. A chainstate being replayed to a block is as far as that block,
+    // unless that is the base: the load of the snapshot was interrupted then.
+    uint256 best_block = pcoinsdbview->GetBestBlock();
+    const std::vector<uint256> heads = pcoinsdbview->GetHeadBlocks();
+    if (best_block.IsNull() && !heads.empty() && heads[0] != base_hash) {
+        best_block = heads[0];
+    }
+    const CBlockIndex* tip = LookupBlockIndex(best_block);
+    if (tip && tip->GetAncestor(base->nHeight) == base) {
+        LogPrintf("%s: chainstate is at or past block %s of the UTXO snapshot, not loading it\n", __func__, base_hash.ToString());
+        return true;
+    }
+    if (tip && base->GetAncestor(tip->nHeight) != tip) {
+        error = strprintf(_("The chainstate is at block %s, which is not an ancestor of block %s of the UTXO snapshot"), tip->GetBlockHash().ToString(), base_hash.ToString());
+        return false;
+    }
+
+    if (!CheckUTXOSnapshot(file, metadata, au_data->second, error)) {
+        return false;
+    }
+    pcoinsdbview.reset();
+    pcoinsdbview.reset(new CCoinsViewDB(coins_db_cache, false, true));
+    if (!LoadUTXOSnapshot(file, metadata, *pcoinsdbview, error)) {
+        return false;
+    }
+    // The base is recorded once the coins are all written, so it is never
+    // taken for that of a complete chainstate. CheckSnapshotChainstate finds
+    // the loads interrupted before or after this.
+    if (!pblocktree->WriteSnapshotBase(base_hash, au_data->second.nChainTx)) {
+        error = _("Failed to write to block index database");
+        return false;
+    }
+    g_chainstate.LinkSnapshotBase(base, au_data->second.nChainTx);
+    pindexSnapshotBase = base;
+    LogPrintf("%s: loaded the UTXO snapshot of block %s at height %d\n", __func__, base_hash.ToString(), base->nHeight);
+    return true;
+}
+
+bool CheckSnapshotChainstate(const CChainParams& chainparams, std::string& error)
+{
+    AssertLockHeld(cs_main);
+
+    // Only a chainstate loaded from a UTXO snapshot is ever at a block whose
+    // data we do not have: blocks are pruned far enough behind the tip.
+    const std::vector<uint256> heads = pcoinsdbview->GetHeadBlocks();
+    const CBlockIndex* replayed = heads.empty() ? nullptr : LookupBlockIndex(heads[0]);
+    if (replayed && !(replayed->nStatus & BLOCK_HAVE_DATA)) {
+        error = strprintf(_("Loading the UTXO snapshot of block %s was interrupted. Restart with -loadutxosnapshot to load it again, or use -reindex to download all the blocks."), heads[0].ToString());
+        return false;
+    }
+    CBlockIndex* tip = LookupBlockIndex(pcoinsdbview->GetBestBlock());
+    if (!tip || (tip->nStatus & BLOCK_HAVE_DATA) || tip == pindexSnapshotBase) {
+        return true;
+    }
+
+    // The snapshot was loaded, but the node stopped before recording its base
+    const auto au_data = chainparams.Assumeutxo().find(tip->GetBlockHash());
+    if (au_data == chainparams.Assumeutxo().end()) {
+        error = strprintf(_("The chain state was loaded from a UTXO snapshot of block %s, which is not pinned in this release. Use -reindex to download all the blocks."), tip->GetBlockHash().ToString());
+        return false;
+    }
+    if (!pblocktree->WriteSnapshotBase(tip->GetBlockHash(), au_data->second.nChainTx)) {
+        error = _("Failed to write to block index database");
+        return false;
+    }
+    g_chainstate.LinkSnapshotBase(tip, au_data->second.nChainTx);
+    pindexSnapshotBase = tip;
+    LogPrintf("%s: recorded block %s as the base of the UTXO snapshot\n", __func__, tip->GetBlockHash().ToString());
+    return true;
+}
+
 bool CChainState::LoadGenesisBlock(const CChainParams& chainparams)
 {
     LOCK(cs_main);
@@ -4368,6 +4802,7 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
             nRewind++; // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
             unsigned int nSize = 0;
+            bool fCompressed = false;
             try {
                 // locate a header
                 unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
@@ -4378,7 +4813,9 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                     continue;
                 // read size
                 blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                fCompressed = nSize & BLOCK_RECORD_COMPRESSED;
+                nSize &= ~BLOCK_RECORD_COMPRESSED;
+                if (nSize < (fCompressed ? 4 : 80) || nSize > MAX_BLOCK_SERIALIZED_SIZE)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
@@ -4393,7 +4830,18 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock& block = *pblock;
-                blkdat >> block;
+                if (fCompressed) {
+                    NoteCompressedBlocks();
+                    std::vector<unsigned char> record(nSize);
+                    blkdat.read((char*)record.data(), nSize);
+                    std::vector<unsigned char> data;
+                    if (!DecompressBlockRecord(Span<const unsigned char>(record.data(), record.size()), data)) {
+                        throw std::ios_base::failure("malformed compressed block record");
+                    }
+                    SpanReader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(data.data(), data.size())) >> block;
+                } else {
+                    blkdat >> block;
+                }
                 nRewind = blkdat.GetPos();
 
                 uint256 hash = block.GetHash();
@@ -4488,6 +4936,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         return;
     }
 
+    // The blocks up to the base of a UTXO snapshot break the assumptions
+    // about which blocks have data and are linked.
+    if (pindexSnapshotBase) {
+        return;
+    }
+
     // Build forward-pointing map of the entire block tree.
     std::multimap<CBlockIndex*,CBlockIndex*> forward;
     for (auto& entry : mapBlockIndex) {
@@ -179,6 +179,9 @@ extern arith_uint256 nMinimumChainWork;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
+/** The base block of the UTXO snapshot the chainstate was loaded from, if any. Blocks up to it have no data. */
+extern CBlockIndex *pindexSnapshotBase;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
@@ -187,6 +190,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** True if new blocks are stored compressed (-blockcompression). */
+extern bool fBlockCompression;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -393,6 +398,10 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Read the serialization of a block, and check that it is well-formed and has the hash of pindex, without deserializing it */
+bool ReadCheckedRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/** Read the header of the block at pos, and the transaction nTxOffset bytes after it */
+bool ReadTxFromDisk(CBlockHeader& header, CTransactionRef& tx, const CDiskBlockPos& pos, unsigned int nTxOffset);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -428,6 +437,20 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/**
+ * Replace the chainstate database with a UTXO snapshot, if it is behind the
+ * snapshot's base block. The snapshot has to match the hash pinned for that
+ * block in the chain parameters, and the headers up to it have to be known.
+ */
+bool ActivateUTXOSnapshot(const fs::path& path, size_t coins_db_cache, const CChainParams& chainparams, std::string& error) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Check the chainstate database is not a UTXO snapshot whose load was
+ * interrupted, and record the base of a snapshot loaded just before the node
+ * stopped. Run before replaying blocks, once the block index is loaded.
+ */
+bool CheckSnapshotChainstate(const CChainParams& chainparams, std::string& error) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
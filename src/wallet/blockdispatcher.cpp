@@ -0,0 +1,268 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/blockdispatcher.h>
+
+#include <primitives/block.h>
+#include <script/standard.h>
+#include <validation.h>
+#include <wallet/wallet.h>
+
+#include <algorithm>
+
+WalletBlockDispatcher g_wallet_dispatcher;
+
+template <typename Index, typename Id>
+static void AddToIndex(Index& index, const Id& id, CWallet* wallet)
+{
+    std::vector<CWallet*>& wallets = index[id];
+    if (std::find(wallets.begin(), wallets.end(), wallet) == wallets.end()) wallets.push_back(wallet);
+}
+
+template <typename Index, typename Id>
+static void LookupInIndex(const Index& index, const Id& id, std::vector<CWallet*>& wallets)
+{
+    auto it = index.find(id);
+    if (it != index.end()) wallets.insert(wallets.end(), it->second.begin(), it->second.end());
+}
+
+template <typename Index>
+static void RemoveFromIndex(Index& index, CWallet* wallet)
+{
+    for (auto it = index.begin(); it != index.end();) {
+        std::vector<CWallet*>& wallets = it->second;
+        wallets.erase(std::remove(wallets.begin(), wallets.end(), wallet), wallets.end());
+        if (wallets.empty()) {
+            it = index.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void WalletBlockDispatcher::AttachWallet(const std::shared_ptr<CWallet>& wallet)
+{
+    LOCK(wallet->cs_wallet);
+    std::shared_ptr<const CWalletScanFilter> filter = wallet->GetScanFilter();
+    LOCK(m_cs);
+    AttachedWallet attached;
+    attached.wallet = wallet;
+    attached.generation = filter->m_generation;
+    // Transactions added from now on are indexed as they are added
+    attached.transaction_changed = wallet->NotifyTransactionChanged.connect(
+        [this](CWallet* wallet, const uint256& hash, ChangeType status) {
+            if (status == CT_NEW) OnTransactionChanged(wallet, hash);
+        });
+    m_wallets.push_back(std::move(attached));
+
+    AddKeys(wallet.get(), *filter);
+    for (const auto& entry : wallet->mapWallet) {
+        AddTransaction(wallet.get(), entry.second);
+    }
+}
+
+void WalletBlockDispatcher::DetachWallet(const std::shared_ptr<CWallet>& wallet)
+{
+    LOCK2(m_cs_dispatch, m_cs);
+    auto it = std::find_if(m_wallets.begin(), m_wallets.end(), [&](const AttachedWallet& attached) { return attached.wallet == wallet; });
+    if (it == m_wallets.end()) return;
+    it->transaction_changed.disconnect();
+    m_wallets.erase(it);
+
+    RemoveFromIndex(m_script_index, wallet.get());
+    RemoveFromIndex(m_tx_index, wallet.get());
+}
+
+std::vector<std::shared_ptr<CWallet>> WalletBlockDispatcher::GetWallets()
+{
+    LOCK(m_cs);
+    std::vector<std::shared_ptr<CWallet>> wallets;
+    for (const AttachedWallet& attached : m_wallets) {
+        wallets.push_back(attached.wallet);
+    }
+    return wallets;
+}
+
+WalletBlockDispatcher::WalletSnapshot WalletBlockDispatcher::UpdateIndex()
+{
+    WalletSnapshot snapshot;
+    {
+        LOCK(m_cs);
+        for (const AttachedWallet& attached : m_wallets) {
+            snapshot.emplace_back(attached.wallet, attached.generation);
+        }
+    }
+    for (auto& entry : snapshot) {
+        if (entry.first->GetGeneration() == entry.second) continue;
+        std::shared_ptr<const CWalletScanFilter> filter = entry.first->GetScanFilter();
+        LOCK(m_cs);
+        auto it = std::find_if(m_wallets.begin(), m_wallets.end(), [&](const AttachedWallet& attached) { return attached.wallet == entry.first; });
+        if (it == m_wallets.end()) continue;
+        AddKeys(entry.first.get(), *filter);
+        it->generation = entry.second = filter->m_generation;
+    }
+    return snapshot;
+}
+
+void WalletBlockDispatcher::AddKeys(CWallet* wallet, const CWalletScanFilter& filter)
+{
+    AssertLockHeld(m_cs);
+    for (const CKeyID& id : filter.GetKeys()) {
+        AddToIndex(m_script_index, id, wallet);
+    }
+    for (const CScriptID& id : filter.GetScripts()) {
+        AddToIndex(m_script_index, id, wallet);
+    }
+    for (const CScript& script : filter.GetWatchOnly()) {
+        AddToIndex(m_script_index, CScriptID(script), wallet);
+        m_have_watch_only = true;
+    }
+}
+
+void WalletBlockDispatcher::AddTransaction(CWallet* wallet, const CWalletTx& wtx)
+{
+    AssertLockHeld(m_cs);
+    // Spends of the transaction's outputs, and conflicts with its inputs
+    AddToIndex(m_tx_index, wtx.GetHash(), wallet);
+    if (wtx.IsCoinBase()) return;
+    for (const CTxIn& txin : wtx.tx->vin) {
+        AddToIndex(m_tx_index, txin.prevout.hash, wallet);
+    }
+}
+
+void WalletBlockDispatcher::OnTransactionChanged(CWallet* wallet, const uint256& hash)
+{
+    LOCK(wallet->cs_wallet);
+    const CWalletTx* wtx = wallet->GetWalletTx(hash);
+    if (!wtx) return;
+    LOCK(m_cs);
+    if (std::none_of(m_wallets.begin(), m_wallets.end(), [&](const AttachedWallet& attached) { return attached.wallet.get() == wallet; })) return;
+    AddTransaction(wallet, *wtx);
+}
+
+void WalletBlockDispatcher::Match(const std::vector<CTransactionRef>& txs, std::vector<size_t> WalletMatches::*positions, std::map<CWallet*, WalletMatches>& matches)
+{
+    AssertLockHeld(m_cs);
+    std::vector<CWallet*> tx_wallets;
+    for (size_t pos = 0; pos < txs.size(); ++pos) {
+        const CTransaction& tx = *txs[pos];
+        tx_wallets.clear();
+        for (const CTxOut& txout : tx.vout) {
+            uint160 id;
+            if (CWalletScanFilter::GetScanId(txout.scriptPubKey, id) != CWalletScanFilter::IdType::NONE) {
+                LookupInIndex(m_script_index, id, tx_wallets);
+            }
+            if (m_have_watch_only) {
+                LookupInIndex(m_script_index, CScriptID(txout.scriptPubKey), tx_wallets);
+            }
+        }
+        LookupInIndex(m_tx_index, tx.GetHash(), tx_wallets);
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin) {
+                LookupInIndex(m_tx_index, txin.prevout.hash, tx_wallets);
+            }
+        }
+        if (tx_wallets.empty()) continue;
+
+        std::sort(tx_wallets.begin(), tx_wallets.end());
+        tx_wallets.erase(std::unique(tx_wallets.begin(), tx_wallets.end()), tx_wallets.end());
+        for (CWallet* wallet : tx_wallets) {
+            (matches[wallet].*positions).push_back(pos);
+        }
+    }
+}
+
+void WalletBlockDispatcher::TransactionAddedToMempool(const CTransactionRef& ptx, uint64_t mempool_sequence)
+{
+    LOCK(m_cs_dispatch);
+    const WalletSnapshot wallets = UpdateIndex();
+    std::map<CWallet*, WalletMatches> matches;
+    {
+        LOCK(m_cs);
+        Match({ptx}, &WalletMatches::txs, matches);
+    }
+    for (const auto& entry : wallets) {
+        auto it = matches.find(entry.first.get());
+        if (it != matches.end()) {
+            it->second.generation = entry.second;
+            entry.first->TransactionAddedToMempool(ptx, it->second);
+        } else if (entry.first->GetGeneration() != entry.second) {
+            // Keys were added since UpdateIndex(); let the wallet match the transaction itself
+            WalletMatches none;
+            none.generation = entry.second;
+            entry.first->TransactionAddedToMempool(ptx, none);
+        }
+    }
+}
+
+void WalletBlockDispatcher::TransactionRemovedFromMempool(const CTransactionRef& ptx, uint64_t mempool_sequence)
+{
+    LOCK(m_cs_dispatch);
+    std::vector<CWallet*> tx_wallets;
+    std::vector<std::shared_ptr<CWallet>> wallets;
+    {
+        LOCK(m_cs);
+        LookupInIndex(m_tx_index, ptx->GetHash(), tx_wallets);
+        for (const AttachedWallet& attached : m_wallets) {
+            if (std::count(tx_wallets.begin(), tx_wallets.end(), attached.wallet.get())) wallets.push_back(attached.wallet);
+        }
+    }
+    for (const std::shared_ptr<CWallet>& wallet : wallets) {
+        wallet->TransactionRemovedFromMempool(ptx, mempool_sequence);
+    }
+}
+
+void WalletBlockDispatcher::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    LOCK(m_cs_dispatch);
+    const WalletSnapshot wallets = UpdateIndex();
+    std::map<CWallet*, WalletMatches> matches;
+    {
+        LOCK(m_cs);
+        Match(txnConflicted, &WalletMatches::conflicted, matches);
+        Match(block->vtx, &WalletMatches::txs, matches);
+    }
+
+    // Every wallet gets the notification, to keep track of the last block processed
+    LOCK(cs_main);
+    for (const auto& entry : wallets) {
+        WalletMatches& wallet_matches = matches[entry.first.get()];
+        wallet_matches.generation = entry.second;
+        entry.first->BlockConnected(*block, pindex, txnConflicted, wallet_matches);
+    }
+}
+
+void WalletBlockDispatcher::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    LOCK(m_cs_dispatch);
+    const WalletSnapshot wallets = UpdateIndex();
+    std::map<CWallet*, WalletMatches> matches;
+    {
+        LOCK(m_cs);
+        Match(block->vtx, &WalletMatches::txs, matches);
+    }
+
+    LOCK(cs_main);
+    for (const auto& entry : wallets) {
+        WalletMatches& wallet_matches = matches[entry.first.get()];
+        wallet_matches.generation = entry.second;
+        entry.first->BlockDisconnected(*block, wallet_matches);
+    }
+}
+
+void WalletBlockDispatcher::ChainStateFlushed(const CBlockLocator& locator)
+{
+    LOCK(m_cs_dispatch);
+    for (const std::shared_ptr<CWallet>& wallet : GetWallets()) {
+        wallet->ChainStateFlushed(locator);
+    }
+}
+
+void WalletBlockDispatcher::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman)
+{
+    LOCK(m_cs_dispatch);
+    for (const std::shared_ptr<CWallet>& wallet : GetWallets()) {
+        wallet->ResendWalletTransactions(nBestBlockTime, connman);
+    }
+}
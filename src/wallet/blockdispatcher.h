@@ -0,0 +1,100 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_BLOCKDISPATCHER_H
+#define BITCOIN_WALLET_BLOCKDISPATCHER_H
+
+#include <crypto/common.h>
+#include <sync.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+class CWallet;
+class CWalletTx;
+class CWalletScanFilter;
+struct WalletMatches;
+
+/**
+ * Delivers validation notifications to the loaded wallets.
+ *
+ * Registering every wallet with the validation interface makes each of them
+ * run IsMine() over every transaction of every block, so the cost per block
+ * grows with the number of loaded wallets. The dispatcher instead keeps one
+ * index from the key IDs, script IDs and watch-only scripts of all wallets,
+ * and from the txids their transactions create or spend outputs of, to the
+ * wallets they belong to. Each transaction is looked up in it once, and a
+ * wallet only processes the transactions that matched it.
+ *
+ * Like CWalletScanFilter, the index errs on the side of matching: keys and
+ * transactions are only removed from it when their wallet is detached.
+ */
+class WalletBlockDispatcher final : public CValidationInterface
+{
+public:
+    /** Start delivering notifications to wallet */
+    void AttachWallet(const std::shared_ptr<CWallet>& wallet);
+    /** Stop delivering notifications to wallet. Waits for the notification
+     * being delivered, if any, so the caller keeps the last reference to it. */
+    void DetachWallet(const std::shared_ptr<CWallet>& wallet);
+
+    void TransactionAddedToMempool(const CTransactionRef& ptx, uint64_t mempool_sequence) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx, uint64_t mempool_sequence) override;
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+    void ChainStateFlushed(const CBlockLocator& locator) override;
+    void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
+
+private:
+    struct Hasher
+    {
+        template <unsigned int BITS>
+        size_t operator()(const base_blob<BITS>& hash) const { return ReadLE64(hash.begin()); }
+    };
+
+    struct AttachedWallet
+    {
+        std::shared_ptr<CWallet> wallet;
+        //! Keystore generation of the keys in the index
+        uint64_t generation;
+        boost::signals2::connection transaction_changed;
+    };
+
+    //! A wallet and the keystore generation of its keys in the index
+    typedef std::vector<std::pair<std::shared_ptr<CWallet>, uint64_t>> WalletSnapshot;
+
+    //! Held while delivering a notification; taken before m_cs, cs_main and cs_wallet
+    CCriticalSection m_cs_dispatch;
+    CCriticalSection m_cs;
+    std::vector<AttachedWallet> m_wallets GUARDED_BY(m_cs);
+    //! Key IDs, script IDs and watch-only script IDs to the wallets that have them
+    std::unordered_map<uint160, std::vector<CWallet*>, Hasher> m_script_index GUARDED_BY(m_cs);
+    //! Txids of wallet transactions and of the outputs they spend to the wallets that have them
+    std::unordered_map<uint256, std::vector<CWallet*>, Hasher> m_tx_index GUARDED_BY(m_cs);
+    //! Whether any attached wallet has had watch-only scripts
+    bool m_have_watch_only GUARDED_BY(m_cs) = false;
+
+    std::vector<std::shared_ptr<CWallet>> GetWallets();
+    /** Add the keys of wallets whose keystore changed to the index, and return
+     * the attached wallets. Must not be called with m_cs held, as the wallet
+     * keystores are locked. */
+    WalletSnapshot UpdateIndex();
+    void AddKeys(CWallet* wallet, const CWalletScanFilter& filter) EXCLUSIVE_LOCKS_REQUIRED(m_cs);
+    void AddTransaction(CWallet* wallet, const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(m_cs);
+    void OnTransactionChanged(CWallet* wallet, const uint256& hash);
+    /** Add the positions of the transactions of txs that match a wallet to the
+     * positions member of the wallet's matches */
+    void Match(const std::vector<CTransactionRef>& txs, std::vector<size_t> WalletMatches::*positions, std::map<CWallet*, WalletMatches>& matches) EXCLUSIVE_LOCKS_REQUIRED(m_cs);
+};
+
+/** Dispatcher of the wallets loaded by the node */
+extern WalletBlockDispatcher g_wallet_dispatcher;
+
+#endif // BITCOIN_WALLET_BLOCKDISPATCHER_H
@@ -19,5 +19,8 @@ void CCoinControl::SetNull()
     m_confirm_target.reset();
     m_signal_bip125_rbf.reset();
     m_fee_mode = FeeEstimateMode::UNSET;
+    m_max_selection_tries.reset();
+    m_selection_timeout.reset();
+    m_batch_payout = false;
 }
 
@@ -36,6 +36,12 @@ public:
     bool m_avoid_partial_spends;
     //! Fee estimation mode to control arguments to estimateSmartFee
     FeeEstimateMode m_fee_mode;
+    //! Override the maximum number of branch and bound tries (DEFAULT_BNB_TRIES) if set
+    boost::optional<size_t> m_max_selection_tries;
+    //! Limit the time in milliseconds spent searching for a better input set if set
+    boost::optional<int64_t> m_selection_timeout;
+    //! Select coins only once, for transactions paying many recipients
+    bool m_batch_payout;
 
     CCoinControl()
     {
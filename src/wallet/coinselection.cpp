@@ -5,14 +5,9 @@
 #include <wallet/coinselection.h>
 #include <util.h>
 #include <utilmoneystr.h>
+#include <utiltime.h>
 
-// Descending order comparator
-struct {
-    bool operator()(const OutputGroup& a, const OutputGroup& b) const
-    {
-        return a.effective_value > b.effective_value;
-    }
-} descending;
+#include <numeric>
 
 /*
  * This is the Branch and Bound Coin Selection algorithm designed by Murch. It searches for an input
@@ -42,9 +37,12 @@ struct {
  * The Branch and Bound algorithm is described in detail in Murch's Master Thesis:
  * https://murch.one/wp-content/uploads/2016/11/erhardt2016coinselection.pdf
  *
- * @param const std::vector<CInputCoin>& utxo_pool The set of UTXOs that we are choosing from.
- *        These UTXOs will be sorted in descending order by effective value and the CInputCoins'
- *        values are their effective values.
+ * The search itself runs on compact arrays of effective values and waste that are sorted in
+ * descending order of effective value once up front. UTXOs whose effective value alone exceeds the
+ * upper bound of the target range can never be part of a solution and are pruned at that point.
+ *
+ * @param const std::vector<OutputGroup>& utxo_pool The set of UTXOs that we are choosing from.
+ *        The groups' effective values are the values used for the selection.
  * @param const CAmount& target_value This is the value that we want to select. It is the lower
  *        bound of the range.
  * @param const CAmount& cost_of_change This is the cost of creating and spending a change output.
@@ -55,44 +53,65 @@ struct {
  *        that were selected.
  * @param CAmount not_input_fees -> The fees that need to be paid for the outputs and fixed size
  *        overhead (version, locktime, marker and flag)
+ * @param const CoinSelectionBudget& budget -> The maximum number of tries and the deadline after
+ *        which the best solution found so far is returned.
  */
 
-static const size_t TOTAL_TRIES = 100000;
-
-bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees)
+bool SelectCoinsBnB(const std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees, const CoinSelectionBudget& budget)
 {
     out_set.clear();
     CAmount curr_value = 0;
 
-    std::vector<bool> curr_selection; // select the utxo at this index
-    curr_selection.reserve(utxo_pool.size());
     CAmount actual_target = not_input_fees + target_value;
 
-    // Calculate curr_available_value
+    // Prune the utxos that overshoot the target range on their own and calculate curr_available_value
+    std::vector<size_t> index;
+    index.reserve(utxo_pool.size());
     CAmount curr_available_value = 0;
-    for (const OutputGroup& utxo : utxo_pool) {
+    for (size_t i = 0; i < utxo_pool.size(); ++i) {
+        const OutputGroup& utxo = utxo_pool[i];
         // Assert that this utxo is not negative. It should never be negative, effective value calculation should have removed it
         assert(utxo.effective_value > 0);
+        if (utxo.effective_value > actual_target + cost_of_change) continue;
+        index.push_back(i);
         curr_available_value += utxo.effective_value;
     }
-    if (curr_available_value < actual_target) {
+    if (index.empty() || curr_available_value < actual_target) {
         return false;
     }
 
-    // Sort the utxo_pool
-    std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    // Sort the remaining utxos by descending effective value and copy what the search needs into compact arrays
+    std::sort(index.begin(), index.end(), [&utxo_pool](size_t a, size_t b) {
+        return utxo_pool[a].effective_value > utxo_pool[b].effective_value;
+    });
+    const size_t pool_size = index.size();
+    std::vector<CAmount> values(pool_size);
+    std::vector<CAmount> wastes(pool_size);
+    for (size_t i = 0; i < pool_size; ++i) {
+        values[i] = utxo_pool[index[i]].effective_value;
+        wastes[i] = utxo_pool[index[i]].fee - utxo_pool[index[i]].long_term_fee;
+    }
+    // The ratio of fee to long term fee is the same for all utxos, so the waste of all of them has the same sign
+    const bool waste_increases = wastes[0] > 0;
 
+    std::vector<bool> curr_selection; // select the utxo at this index
+    curr_selection.reserve(pool_size);
     CAmount curr_waste = 0;
     std::vector<bool> best_selection;
     CAmount best_waste = MAX_MONEY;
 
     // Depth First search loop for choosing the UTXOs
-    for (size_t i = 0; i < TOTAL_TRIES; ++i) {
+    for (size_t i = 0; i < budget.max_tries; ++i) {
+        // Give up on finding a better solution once the deadline has passed
+        if (budget.deadline && i % 1024 == 0 && i > 0 && GetTimeMicros() > budget.deadline) {
+            break;
+        }
+
         // Conditions for starting a backtrack
         bool backtrack = false;
         if (curr_value + curr_available_value < actual_target ||                // Cannot possibly reach target with the amount remaining in the curr_available_value.
             curr_value > actual_target + cost_of_change ||    // Selected value is out of range, go back and try other branch
-            (curr_waste > best_waste && (utxo_pool.at(0).fee - utxo_pool.at(0).long_term_fee) > 0)) { // Don't select things which we know will be more wasteful if the waste is increasing
+            (curr_waste > best_waste && waste_increases)) { // Don't select things which we know will be more wasteful if the waste is increasing
             backtrack = true;
         } else if (curr_value >= actual_target) {       // Selected value is within range
             curr_waste += (curr_value - actual_target); // This is the excess value which is added to the waste for the below comparison
@@ -102,7 +121,7 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
             // explore any more UTXOs to avoid burning money like that.
             if (curr_waste <= best_waste) {
                 best_selection = curr_selection;
-                best_selection.resize(utxo_pool.size());
+                best_selection.resize(pool_size);
                 best_waste = curr_waste;
             }
             curr_waste -= (curr_value - actual_target); // Remove the excess value as we will be selecting different coins now
@@ -114,7 +133,7 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
             // Walk backwards to find the last included UTXO that still needs to have its omission branch traversed.
             while (!curr_selection.empty() && !curr_selection.back()) {
                 curr_selection.pop_back();
-                curr_available_value += utxo_pool.at(curr_selection.size()).effective_value;
+                curr_available_value += values[curr_selection.size()];
             }
 
             if (curr_selection.empty()) { // We have walked back to the first utxo and no branch is untraversed. All solutions searched
@@ -123,26 +142,25 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
 
             // Output was included on previous iterations, try excluding now.
             curr_selection.back() = false;
-            OutputGroup& utxo = utxo_pool.at(curr_selection.size() - 1);
-            curr_value -= utxo.effective_value;
-            curr_waste -= utxo.fee - utxo.long_term_fee;
+            const size_t pos = curr_selection.size() - 1;
+            curr_value -= values[pos];
+            curr_waste -= wastes[pos];
         } else { // Moving forwards, continuing down this branch
-            OutputGroup& utxo = utxo_pool.at(curr_selection.size());
+            const size_t pos = curr_selection.size();
 
             // Remove this utxo from the curr_available_value utxo amount
-            curr_available_value -= utxo.effective_value;
+            curr_available_value -= values[pos];
 
-            // Avoid searching a branch if the previous UTXO has the same value and same waste and was excluded. Since the ratio of fee to
-            // long term fee is the same, we only need to check if one of those values match in order to know that the waste is the same.
+            // Avoid searching a branch if the previous UTXO has the same value and same waste and was excluded.
             if (!curr_selection.empty() && !curr_selection.back() &&
-                utxo.effective_value == utxo_pool.at(curr_selection.size() - 1).effective_value &&
-                utxo.fee == utxo_pool.at(curr_selection.size() - 1).fee) {
+                values[pos] == values[pos - 1] &&
+                wastes[pos] == wastes[pos - 1]) {
                 curr_selection.push_back(false);
             } else {
                 // Inclusion branch first (Largest First Exploration)
                 curr_selection.push_back(true);
-                curr_value += utxo.effective_value;
-                curr_waste += utxo.fee - utxo.long_term_fee;
+                curr_value += values[pos];
+                curr_waste += wastes[pos];
             }
         }
     }
@@ -155,33 +173,36 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
     // Set output set
     value_ret = 0;
     for (size_t i = 0; i < best_selection.size(); ++i) {
-        if (best_selection.at(i)) {
-            util::insert(out_set, utxo_pool.at(i).m_outputs);
-            value_ret += utxo_pool.at(i).m_value;
+        if (best_selection[i]) {
+            const OutputGroup& utxo = utxo_pool[index[i]];
+            util::insert(out_set, utxo.m_outputs);
+            value_ret += utxo.m_value;
         }
     }
 
     return true;
 }
 
-static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const CAmount& nTotalLower, const CAmount& nTargetValue,
-                                  std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
+static void ApproximateBestSubset(const std::vector<CAmount>& values, const CAmount& nTotalLower, const CAmount& nTargetValue,
+                                  std::vector<char>& vfBest, CAmount& nBest, int64_t deadline, int iterations = 1000)
 {
     std::vector<char> vfIncluded;
 
-    vfBest.assign(groups.size(), true);
+    vfBest.assign(values.size(), true);
     nBest = nTotalLower;
 
     FastRandomContext insecure_rand;
 
     for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
     {
-        vfIncluded.assign(groups.size(), false);
+        if (deadline && nRep > 0 && GetTimeMicros() > deadline) break;
+
+        vfIncluded.assign(values.size(), false);
         CAmount nTotal = 0;
         bool fReachedTarget = false;
         for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
         {
-            for (unsigned int i = 0; i < groups.size(); i++)
+            for (unsigned int i = 0; i < values.size(); i++)
             {
                 //The solver here uses a randomized algorithm,
                 //the randomness serves no real security purpose but is just
@@ -191,7 +212,7 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
                 //the selection random.
                 if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
                 {
-                    nTotal += groups[i].m_value;
+                    nTotal += values[i];
                     vfIncluded[i] = true;
                     if (nTotal >= nTargetValue)
                     {
@@ -201,7 +222,7 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
                             nBest = nTotal;
                             vfBest = vfIncluded;
                         }
-                        nTotal -= groups[i].m_value;
+                        nTotal -= values[i];
                         vfIncluded[i] = false;
                     }
                 }
@@ -210,35 +231,39 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
     }
 }
 
-bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
+bool KnapsackSolver(const CAmount& nTargetValue, const std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionBudget& budget)
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
+    // Shuffle and sort indices into groups rather than the groups themselves
+    std::vector<size_t> order(groups.size());
+    std::iota(order.begin(), order.end(), 0);
+    random_shuffle(order.begin(), order.end(), GetRandInt);
+
     // List of values less than target
-    boost::optional<OutputGroup> lowest_larger;
-    std::vector<OutputGroup> applicable_groups;
+    const OutputGroup* lowest_larger = nullptr;
+    std::vector<size_t> applicable_groups;
     CAmount nTotalLower = 0;
 
-    random_shuffle(groups.begin(), groups.end(), GetRandInt);
-
-    for (const OutputGroup& group : groups) {
+    for (size_t i : order) {
+        const OutputGroup& group = groups[i];
         if (group.m_value == nTargetValue) {
             util::insert(setCoinsRet, group.m_outputs);
             nValueRet += group.m_value;
             return true;
         } else if (group.m_value < nTargetValue + MIN_CHANGE) {
-            applicable_groups.push_back(group);
+            applicable_groups.push_back(i);
             nTotalLower += group.m_value;
         } else if (!lowest_larger || group.m_value < lowest_larger->m_value) {
-            lowest_larger = group;
+            lowest_larger = &group;
         }
     }
 
     if (nTotalLower == nTargetValue) {
-        for (const auto& group : applicable_groups) {
-            util::insert(setCoinsRet, group.m_outputs);
-            nValueRet += group.m_value;
+        for (size_t i : applicable_groups) {
+            util::insert(setCoinsRet, groups[i].m_outputs);
+            nValueRet += groups[i].m_value;
         }
         return true;
     }
@@ -251,13 +276,19 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
     }
 
     // Solve subset sum by stochastic approximation
-    std::sort(applicable_groups.begin(), applicable_groups.end(), descending);
+    std::stable_sort(applicable_groups.begin(), applicable_groups.end(), [&groups](size_t a, size_t b) {
+        return groups[a].effective_value > groups[b].effective_value;
+    });
+    std::vector<CAmount> values(applicable_groups.size());
+    for (size_t i = 0; i < applicable_groups.size(); ++i) {
+        values[i] = groups[applicable_groups[i]].m_value;
+    }
     std::vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue, vfBest, nBest);
+    ApproximateBestSubset(values, nTotalLower, nTargetValue, vfBest, nBest, budget.deadline);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE) {
-        ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+        ApproximateBestSubset(values, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, budget.deadline);
     }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
@@ -269,8 +300,8 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
     } else {
         for (unsigned int i = 0; i < applicable_groups.size(); i++) {
             if (vfBest[i]) {
-                util::insert(setCoinsRet, applicable_groups[i].m_outputs);
-                nValueRet += applicable_groups[i].m_value;
+                util::insert(setCoinsRet, groups[applicable_groups[i]].m_outputs);
+                nValueRet += values[i];
             }
         }
 
@@ -278,7 +309,7 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
             LogPrint(BCLog::SELECTCOINS, "SelectCoins() best subset: "); /* Continued */
             for (unsigned int i = 0; i < applicable_groups.size(); i++) {
                 if (vfBest[i]) {
-                    LogPrint(BCLog::SELECTCOINS, "%s ", FormatMoney(applicable_groups[i].m_value)); /* Continued */
+                    LogPrint(BCLog::SELECTCOINS, "%s ", FormatMoney(values[i])); /* Continued */
                 }
             }
             LogPrint(BCLog::SELECTCOINS, "total %s\n", FormatMoney(nBest));
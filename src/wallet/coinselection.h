@@ -13,6 +13,8 @@
 static const CAmount MIN_CHANGE = CENT;
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
+//! default maximum number of branch and bound tries
+static const size_t DEFAULT_BNB_TRIES = 100000;
 
 class CInputCoin {
 public:
@@ -93,9 +95,18 @@ struct OutputGroup
     bool EligibleForSpending(const CoinEligibilityFilter& eligibility_filter) const;
 };
 
-bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees);
+/** Limits on the search effort of the coin selection algorithms. */
+struct CoinSelectionBudget
+{
+    //! Maximum number of branch and bound tries
+    size_t max_tries{DEFAULT_BNB_TRIES};
+    //! Time (in microseconds, see GetTimeMicros) after which a search returns the best solution found so far, 0 for no deadline
+    int64_t deadline{0};
+};
+
+bool SelectCoinsBnB(const std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees, const CoinSelectionBudget& budget = CoinSelectionBudget());
 
 // Original coin selection algorithm as a fallback
-bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
+bool KnapsackSolver(const CAmount& nTargetValue, const std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionBudget& budget = CoinSelectionBudget());
 
 #endif // BITCOIN_WALLET_COINSELECTION_H
@@ -220,13 +220,8 @@ bool CCryptoKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
         return CBasicKeyStore::AddKeyPubKey(key, pubkey);
     }
 
-    if (IsLocked()) {
-        return false;
-    }
-
     std::vector<unsigned char> vchCryptedSecret;
-    CKeyingMaterial vchSecret(key.begin(), key.end());
-    if (!EncryptSecret(vMasterKey, vchSecret, pubkey.GetHash(), vchCryptedSecret)) {
+    if (!EncryptKey(key, pubkey, vchCryptedSecret)) {
         return false;
     }
 
@@ -236,6 +231,17 @@ bool CCryptoKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
     return true;
 }
 
+bool CCryptoKeyStore::EncryptKey(const CKey& key, const CPubKey& pubkey, std::vector<unsigned char>& vchCryptedSecret) const
+{
+    LOCK(cs_KeyStore);
+    if (!IsCrypted() || IsLocked()) {
+        return false;
+    }
+
+    CKeyingMaterial vchSecret(key.begin(), key.end());
+    return EncryptSecret(vMasterKey, vchSecret, pubkey.GetHash(), vchCryptedSecret);
+}
+
 
 bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
@@ -245,7 +251,9 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
     }
 
     mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+    m_filter.Insert(vchPubKey.GetID());
     ImplicitlyLearnRelatedKeyScripts(vchPubKey);
+    ++m_generation;
     return true;
 }
 
@@ -9,6 +9,7 @@
 #include <hash.h>
 #include <protocol.h>
 #include <utilstrencodings.h>
+#include <wallet/leveldb.h>
 #include <wallet/walletutil.h>
 
 #include <stdint.h>
@@ -443,7 +444,7 @@ void BerkeleyEnvironment::CheckpointLSN(const std::string& strFile)
 }
 
 
-BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
+BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr), m_cursor(nullptr)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -535,15 +536,170 @@ void BerkeleyBatch::Flush()
     env->dbenv->txn_checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
 }
 
-void BerkeleyDatabase::IncrementUpdateCounter()
+void WalletDatabase::IncrementUpdateCounter()
 {
     ++nUpdateCounter;
 }
 
+bool BerkeleyBatch::ReadKey(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    if (!pdb)
+        return false;
+
+    Dbt datKey((void*)ssKey.data(), ssKey.size());
+
+    // Read
+    Dbt datValue;
+    datValue.set_flags(DB_DBT_MALLOC);
+    int ret = pdb->get(activeTxn, &datKey, &datValue, 0);
+    if (datValue.get_data() == nullptr) {
+        return false;
+    }
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+    // Clear and free memory
+    memory_cleanse(datValue.get_data(), datValue.get_size());
+    free(datValue.get_data());
+    return ret == 0;
+}
+
+bool BerkeleyBatch::WriteKey(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!pdb)
+        return true;
+    if (fReadOnly)
+        assert(!"Write called on database in read-only mode");
+
+    Dbt datKey((void*)ssKey.data(), ssKey.size());
+    Dbt datValue((void*)ssValue.data(), ssValue.size());
+
+    // Write
+    int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+    return (ret == 0);
+}
+
+bool BerkeleyBatch::EraseKey(const CDataStream& ssKey)
+{
+    if (!pdb)
+        return false;
+    if (fReadOnly)
+        assert(!"Erase called on database in read-only mode");
+
+    Dbt datKey((void*)ssKey.data(), ssKey.size());
+
+    // Erase
+    int ret = pdb->del(activeTxn, &datKey, 0);
+    return (ret == 0 || ret == DB_NOTFOUND);
+}
+
+bool BerkeleyBatch::HasKey(const CDataStream& ssKey)
+{
+    if (!pdb)
+        return false;
+
+    Dbt datKey((void*)ssKey.data(), ssKey.size());
+
+    // Exists
+    int ret = pdb->exists(activeTxn, &datKey, 0);
+    return (ret == 0);
+}
+
+bool BerkeleyBatch::StartCursor()
+{
+    assert(!m_cursor);
+    if (!pdb)
+        return false;
+    int ret = pdb->cursor(nullptr, &m_cursor, 0);
+    return ret == 0;
+}
+
+bool BerkeleyBatch::ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete, bool setRange)
+{
+    complete = false;
+    if (m_cursor == nullptr) return false;
+    // Read at cursor
+    Dbt datKey;
+    unsigned int fFlags = DB_NEXT;
+    if (setRange) {
+        datKey.set_data(ssKey.data());
+        datKey.set_size(ssKey.size());
+        fFlags = DB_SET_RANGE;
+    }
+    Dbt datValue;
+    datKey.set_flags(DB_DBT_MALLOC);
+    datValue.set_flags(DB_DBT_MALLOC);
+    int ret = m_cursor->get(&datKey, &datValue, fFlags);
+    if (ret == DB_NOTFOUND) {
+        complete = true;
+        return true;
+    }
+    if (ret != 0 || datKey.get_data() == nullptr || datValue.get_data() == nullptr)
+        return false;
+
+    // Convert to streams
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write((char*)datKey.get_data(), datKey.get_size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+    // Clear and free memory
+    memory_cleanse(datKey.get_data(), datKey.get_size());
+    memory_cleanse(datValue.get_data(), datValue.get_size());
+    free(datKey.get_data());
+    free(datValue.get_data());
+    return true;
+}
+
+void BerkeleyBatch::CloseCursor()
+{
+    if (!m_cursor) return;
+    m_cursor->close();
+    m_cursor = nullptr;
+}
+
+bool BerkeleyBatch::TxnBegin()
+{
+    // A dummy database writes nothing, so it has nothing to commit or abort
+    if (!env)
+        return true;
+    if (!pdb || activeTxn)
+        return false;
+    DbTxn* ptxn = env->TxnBegin();
+    if (!ptxn)
+        return false;
+    activeTxn = ptxn;
+    return true;
+}
+
+bool BerkeleyBatch::TxnCommit()
+{
+    if (!env)
+        return true;
+    if (!pdb || !activeTxn)
+        return false;
+    int ret = activeTxn->commit(0);
+    activeTxn = nullptr;
+    return (ret == 0);
+}
+
+bool BerkeleyBatch::TxnAbort()
+{
+    if (!env)
+        return true;
+    if (!pdb || !activeTxn)
+        return false;
+    int ret = activeTxn->abort();
+    activeTxn = nullptr;
+    return (ret == 0);
+}
+
 void BerkeleyBatch::Close()
 {
     if (!pdb)
         return;
+    CloseCursor();
     if (activeTxn)
         activeTxn->abort();
     activeTxn = nullptr;
@@ -606,17 +762,17 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
-                    if (pcursor)
+                    if (db.StartCursor())
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-                            int ret1 = db.ReadAtCursor(pcursor, ssKey, ssValue);
-                            if (ret1 == DB_NOTFOUND) {
-                                pcursor->close();
+                            bool complete;
+                            bool ret1 = db.ReadAtCursor(ssKey, ssValue, complete);
+                            if (complete) {
+                                db.CloseCursor();
                                 break;
-                            } else if (ret1 != 0) {
-                                pcursor->close();
+                            } else if (!ret1) {
+                                db.CloseCursor();
                                 fSuccess = false;
                                 break;
                             }
@@ -746,11 +902,21 @@ bool BerkeleyBatch::PeriodicFlush(BerkeleyDatabase& database)
     return ret;
 }
 
+std::unique_ptr<DatabaseBatch> BerkeleyDatabase::MakeBatch(const char* pszMode, bool fFlushOnClose)
+{
+    return MakeUnique<BerkeleyBatch>(*this, pszMode, fFlushOnClose);
+}
+
 bool BerkeleyDatabase::Rewrite(const char* pszSkip)
 {
     return BerkeleyBatch::Rewrite(*this, pszSkip);
 }
 
+bool BerkeleyDatabase::PeriodicFlush()
+{
+    return BerkeleyBatch::PeriodicFlush(*this);
+}
+
 bool BerkeleyDatabase::Backup(const std::string& strDest)
 {
     if (IsDummy()) {
@@ -799,3 +965,21 @@ void BerkeleyDatabase::Flush(bool shutdown)
         if (shutdown) env = nullptr;
     }
 }
+
+std::unique_ptr<WalletDatabase> WalletDatabase::Create(const fs::path& path)
+{
+    if (UseLevelDBWallet(path)) {
+        return MakeUnique<LevelDBDatabase>(path);
+    }
+    return MakeUnique<BerkeleyDatabase>(path);
+}
+
+std::unique_ptr<WalletDatabase> WalletDatabase::CreateDummy()
+{
+    return MakeUnique<BerkeleyDatabase>();
+}
+
+std::unique_ptr<WalletDatabase> WalletDatabase::CreateMock()
+{
+    return MakeUnique<BerkeleyDatabase>("", true /* mock */);
+}
@@ -0,0 +1,331 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/leveldb.h>
+
+#include <clientversion.h>
+#include <dbwrapper.h>
+#include <util.h>
+#include <utilstrencodings.h>
+
+#include <string.h>
+
+namespace {
+
+/** The wallet serializes its keys and values itself; this writes those bytes
+ * to a CDBWrapper key or value as they are, without a length prefix.
+ */
+class RawBytes
+{
+    const char* m_data;
+    size_t m_size;
+
+public:
+    explicit RawBytes(const CDataStream& stream) : m_data(stream.data()), m_size(stream.size()) {}
+    RawBytes(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write(m_data, m_size);
+    }
+};
+
+/** Reads a whole CDBWrapper key or value into a wallet record stream. */
+class RawRecord
+{
+    CDataStream& m_stream;
+
+public:
+    explicit RawRecord(CDataStream& stream) : m_stream(stream) {}
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        const size_t size = s.size();
+        m_stream.clear();
+        m_stream.resize(size);
+        s.read(m_stream.data(), size);
+    }
+};
+
+CSerializeData ToSerializeData(const CDataStream& stream)
+{
+    return CSerializeData(stream.begin(), stream.end());
+}
+
+} // namespace
+
+bool UseLevelDBWallet(const fs::path& wallet_path)
+{
+    if (fs::is_directory(wallet_path / LEVELDB_WALLET_DIRNAME)) return true;
+    // Existing BerkeleyDB wallets keep their format, whatever -walletbackend says
+    if (fs::is_regular_file(wallet_path) || fs::exists(wallet_path / "wallet.dat")) return false;
+    return gArgs.GetArg("-walletbackend", DEFAULT_WALLET_BACKEND) == "leveldb";
+}
+
+LevelDBDatabase::LevelDBDatabase(const fs::path& wallet_path, bool mock)
+    : m_path(wallet_path / LEVELDB_WALLET_DIRNAME),
+      m_db(std::make_shared<CDBWrapper>(m_path, LEVELDB_WALLET_CACHE_SIZE, mock /* fMemory */))
+{
+}
+
+LevelDBDatabase::~LevelDBDatabase()
+{
+}
+
+std::unique_ptr<DatabaseBatch> LevelDBDatabase::MakeBatch(const char* pszMode, bool fFlushOnClose)
+{
+    const bool read_only = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
+    std::unique_ptr<DatabaseBatch> batch = MakeUnique<LevelDBBatch>(m_db, read_only);
+    if (m_db && strchr(pszMode, 'c') && !batch->Exists(std::string("version"))) {
+        batch->WriteVersion(CLIENT_VERSION);
+    }
+    return batch;
+}
+
+bool LevelDBDatabase::Rewrite(const char* pszSkip)
+{
+    if (!m_db) return true;
+    LogPrintf("LevelDBDatabase::Rewrite: Rewriting %s...\n", m_path.string());
+    try {
+        CDBBatch batch(*m_db);
+        if (pszSkip) {
+            // Records with a common key prefix are adjacent in LevelDB
+            const size_t skip_len = strlen(pszSkip);
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            RawRecord key(ssKey);
+            std::unique_ptr<CDBIterator> it(m_db->NewIterator());
+            for (it->Seek(RawBytes(pszSkip, skip_len)); it->Valid(); it->Next()) {
+                if (!it->GetKey(key) || ssKey.size() < skip_len || memcmp(ssKey.data(), pszSkip, skip_len) != 0) break;
+                batch.Erase(RawBytes(ssKey));
+            }
+        }
+        batch.Write(std::string("version"), CLIENT_VERSION);
+        m_db->WriteBatch(batch, true);
+        // Compacting the whole key range flushes the log to a table file and
+        // drops erased and overwritten records from every level
+        m_db->CompactRange(RawBytes("", 0), RawBytes("\xff", 1));
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBDatabase::Rewrite: Failed to rewrite %s: %s\n", m_path.string(), e.what());
+        return false;
+    }
+    LogPrintf("LevelDBDatabase::Rewrite: Rewrite of %s succeeded\n", m_path.string());
+    return true;
+}
+
+bool LevelDBDatabase::Backup(const std::string& strDest)
+{
+    if (!m_db) return false;
+
+    fs::path pathDest(strDest);
+    // A directory that is not itself a LevelDB database gets the database inside of it
+    if (fs::is_directory(pathDest) && !fs::exists(pathDest / "CURRENT")) {
+        pathDest /= LEVELDB_WALLET_DIRNAME;
+    }
+    try {
+        if (fs::exists(pathDest) && fs::equivalent(m_path, pathDest)) {
+            LogPrintf("cannot backup to wallet source file %s\n", pathDest.string());
+            return false;
+        }
+
+        CDBWrapper backup(pathDest, LEVELDB_WALLET_CACHE_SIZE, false /* fMemory */, true /* fWipe */);
+        CDBBatch batch(backup);
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        RawRecord key(ssKey);
+        RawRecord value(ssValue);
+        // The iterator reads from an implicit snapshot, so concurrent wallet writes are either fully in the copy or not at all
+        std::unique_ptr<CDBIterator> it(m_db->NewIterator());
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            if (!it->GetKey(key) || !it->GetValue(value)) {
+                LogPrintf("error copying %s to %s - unreadable record\n", m_path.string(), pathDest.string());
+                return false;
+            }
+            batch.Write(RawBytes(ssKey), RawBytes(ssValue));
+            if (batch.SizeEstimate() > LEVELDB_WALLET_CACHE_SIZE) {
+                backup.WriteBatch(batch);
+                batch.Clear();
+            }
+        }
+        backup.WriteBatch(batch, true);
+        LogPrintf("copied %s to %s\n", m_path.string(), pathDest.string());
+        return true;
+    } catch (const std::exception& e) {
+        LogPrintf("error copying %s to %s - %s\n", m_path.string(), pathDest.string(), e.what());
+        return false;
+    }
+}
+
+void LevelDBDatabase::Flush(bool shutdown)
+{
+    if (!m_db) return;
+    try {
+        m_db->Sync();
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBDatabase::Flush: Failed to sync %s: %s\n", m_path.string(), e.what());
+    }
+    if (shutdown) {
+        m_db.reset();
+    }
+}
+
+bool LevelDBDatabase::PeriodicFlush()
+{
+    if (!m_db) return true;
+    try {
+        return m_db->Sync();
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBDatabase::PeriodicFlush: Failed to sync %s: %s\n", m_path.string(), e.what());
+        return false;
+    }
+}
+
+LevelDBBatch::LevelDBBatch(std::shared_ptr<CDBWrapper> db, bool read_only)
+    : m_db(std::move(db)), m_read_only(read_only)
+{
+}
+
+LevelDBBatch::~LevelDBBatch()
+{
+    Close();
+}
+
+void LevelDBBatch::Close()
+{
+    CloseCursor();
+    TxnAbort();
+    m_db.reset();
+}
+
+bool LevelDBBatch::ReadKey(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    if (!m_db) return false;
+    if (m_txn) {
+        auto it = m_txn_changes.find(ToSerializeData(ssKey));
+        if (it != m_txn_changes.end()) {
+            if (!it->second.m_exists) return false;
+            ssValue.write(it->second.m_value.data(), it->second.m_value.size());
+            return true;
+        }
+    }
+    try {
+        RawRecord value(ssValue);
+        return m_db->Read(RawBytes(ssKey), value);
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBBatch::ReadKey: %s\n", e.what());
+        return false;
+    }
+}
+
+bool LevelDBBatch::WriteKey(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!m_db) return true;
+    if (m_read_only) assert(!"Write called on database in read-only mode");
+    if (!fOverwrite && HasKey(ssKey)) return false;
+    try {
+        if (m_txn) {
+            m_txn->Write(RawBytes(ssKey), RawBytes(ssValue));
+            m_txn_changes[ToSerializeData(ssKey)] = TxnChange{true, ToSerializeData(ssValue)};
+            return true;
+        }
+        return m_db->Write(RawBytes(ssKey), RawBytes(ssValue));
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBBatch::WriteKey: %s\n", e.what());
+        return false;
+    }
+}
+
+bool LevelDBBatch::EraseKey(const CDataStream& ssKey)
+{
+    if (!m_db) return true;
+    if (m_read_only) assert(!"Erase called on database in read-only mode");
+    try {
+        if (m_txn) {
+            m_txn->Erase(RawBytes(ssKey));
+            m_txn_changes[ToSerializeData(ssKey)] = TxnChange{false, CSerializeData()};
+            return true;
+        }
+        return m_db->Erase(RawBytes(ssKey));
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBBatch::EraseKey: %s\n", e.what());
+        return false;
+    }
+}
+
+bool LevelDBBatch::HasKey(const CDataStream& ssKey)
+{
+    if (!m_db) return false;
+    if (m_txn) {
+        auto it = m_txn_changes.find(ToSerializeData(ssKey));
+        if (it != m_txn_changes.end()) return it->second.m_exists;
+    }
+    try {
+        return m_db->Exists(RawBytes(ssKey));
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBBatch::HasKey: %s\n", e.what());
+        return false;
+    }
+}
+
+bool LevelDBBatch::StartCursor()
+{
+    if (!m_db) return false;
+    m_cursor.reset(m_db->NewIterator());
+    m_cursor->SeekToFirst();
+    return true;
+}
+
+bool LevelDBBatch::ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete, bool setRange)
+{
+    complete = false;
+    if (!m_cursor) return false;
+    if (setRange) {
+        m_cursor->Seek(RawBytes(ssKey));
+    }
+    if (!m_cursor->Valid()) {
+        complete = true;
+        return true;
+    }
+    RawRecord key(ssKey);
+    RawRecord value(ssValue);
+    if (!m_cursor->GetKey(key) || !m_cursor->GetValue(value)) return false;
+    m_cursor->Next();
+    return true;
+}
+
+void LevelDBBatch::CloseCursor()
+{
+    m_cursor.reset();
+}
+
+bool LevelDBBatch::TxnBegin()
+{
+    if (!m_db || m_txn) return false;
+    m_txn = MakeUnique<CDBBatch>(*m_db);
+    return true;
+}
+
+bool LevelDBBatch::TxnCommit()
+{
+    if (!m_db || !m_txn) return false;
+    bool ret;
+    try {
+        ret = m_db->WriteBatch(*m_txn);
+    } catch (const dbwrapper_error& e) {
+        LogPrintf("LevelDBBatch::TxnCommit: %s\n", e.what());
+        ret = false;
+    }
+    m_txn.reset();
+    m_txn_changes.clear();
+    return ret;
+}
+
+bool LevelDBBatch::TxnAbort()
+{
+    if (!m_txn) return false;
+    m_txn.reset();
+    m_txn_changes.clear();
+    return true;
+}
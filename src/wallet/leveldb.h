@@ -0,0 +1,107 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_LEVELDB_H
+#define BITCOIN_WALLET_LEVELDB_H
+
+#include <wallet/db.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+class CDBBatch;
+class CDBIterator;
+class CDBWrapper;
+
+//! -walletbackend default
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
+//! Name of the LevelDB database inside a wallet directory
+static const char* const LEVELDB_WALLET_DIRNAME = "wallet.ldb";
+//! LevelDB block cache and write buffer size of a wallet database
+static const size_t LEVELDB_WALLET_CACHE_SIZE = 8 << 20;
+
+/** Whether the wallet at wallet_path is, or will be created as, a LevelDB wallet. */
+bool UseLevelDBWallet(const fs::path& wallet_path);
+
+/** A wallet database stored in LevelDB.
+ *
+ * Writes are appended to the LevelDB log and merged into the sorted tables by
+ * LevelDB's background compaction, so there is no equivalent of the
+ * BerkeleyDB checkpointing on flush. Loading a wallet is a sequential scan of
+ * the (memory mapped) table files.
+ */
+class LevelDBDatabase : public WalletDatabase
+{
+    friend class LevelDBBatch;
+public:
+    /** Open the database of the wallet at wallet_path, or a temporary in-memory one if mock */
+    explicit LevelDBDatabase(const fs::path& wallet_path, bool mock = false);
+    ~LevelDBDatabase() override;
+
+    std::unique_ptr<DatabaseBatch> MakeBatch(const char* pszMode = "r+", bool fFlushOnClose = true) override;
+
+    /** Erase the records starting with pszSkip if non-zero and compact the
+     * entire database, so that no erased record remains on disk.
+     */
+    bool Rewrite(const char* pszSkip=nullptr) override;
+
+    /** Copy all records to a new LevelDB database in the directory strDest.
+     */
+    bool Backup(const std::string& strDest) override;
+
+    void Flush(bool shutdown) override;
+    bool PeriodicFlush() override;
+
+private:
+    fs::path m_path;
+    //! Shared with the batches, which may outlive a shutdown flush
+    std::shared_ptr<CDBWrapper> m_db;
+};
+
+/** RAII class that provides access to a LevelDB wallet database.
+ *
+ * Between TxnBegin and TxnCommit, changes are queued in a LevelDB write batch
+ * that is applied atomically on commit. Reads within the transaction see its
+ * changes, cursors do not (like a BerkeleyDB cursor opened outside of the
+ * transaction).
+ */
+class LevelDBBatch : public DatabaseBatch
+{
+public:
+    LevelDBBatch(std::shared_ptr<CDBWrapper> db, bool read_only);
+    ~LevelDBBatch() override;
+
+    void Flush() override {}
+    void Close() override;
+
+    bool StartCursor() override;
+    bool ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete, bool setRange = false) override;
+    void CloseCursor() override;
+
+    bool TxnBegin() override;
+    bool TxnCommit() override;
+    bool TxnAbort() override;
+
+protected:
+    bool ReadKey(const CDataStream& ssKey, CDataStream& ssValue) override;
+    bool WriteKey(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite) override;
+    bool EraseKey(const CDataStream& ssKey) override;
+    bool HasKey(const CDataStream& ssKey) override;
+
+private:
+    /** A change made in the active transaction; an erase if !m_exists */
+    struct TxnChange {
+        bool m_exists;
+        CSerializeData m_value;
+    };
+
+    std::shared_ptr<CDBWrapper> m_db;
+    bool m_read_only;
+    std::unique_ptr<CDBIterator> m_cursor;
+    std::unique_ptr<CDBBatch> m_txn;
+    std::map<CSerializeData, TxnChange> m_txn_changes;
+};
+
+#endif // BITCOIN_WALLET_LEVELDB_H
@@ -807,7 +807,107 @@ UniValue dumpwallet(const JSONRPCRequest& request)
 }
 
 
-static UniValue ProcessImport(CWallet * const pwallet, const UniValue& data, const int64_t timestamp) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+/** A private key of an import request, decoded before the wallet is locked */
+struct ImportKey
+{
+    CKey key;
+    CPubKey pubkey;
+};
+
+/**
+ * Decode the private keys of all import requests, and derive their public
+ * keys. This is most of the work of importing private keys and needs no
+ * lock, so it is spread over several threads. Entries that are not valid
+ * private keys decode to invalid keys, which ProcessImport reports.
+ */
+static std::vector<std::vector<ImportKey>> DecodeImportKeys(const UniValue& requests)
+{
+    std::vector<std::vector<ImportKey>> decoded(requests.size());
+    std::vector<std::pair<ImportKey*, std::string>> work_items;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const UniValue& data = requests[i];
+        if (!data.isObject() || !data.exists("keys") || !data["keys"].isArray()) continue;
+        const UniValue& keys = data["keys"];
+        decoded[i].resize(keys.size());
+        for (size_t j = 0; j < keys.size(); ++j) {
+            if (keys[j].isStr()) work_items.emplace_back(&decoded[i][j], keys[j].get_str());
+        }
+    }
+
+    ParallelFor(work_items.size(), MAX_KEY_THREADS, MIN_KEYS_PER_THREAD, [&](size_t i) {
+        ImportKey& import_key = *work_items[i].first;
+        import_key.key = DecodeSecret(work_items[i].second);
+        if (!import_key.key.IsValid()) return;
+        import_key.pubkey = import_key.key.GetPubKey();
+        assert(import_key.key.VerifyPubKey(import_key.pubkey));
+    });
+    return decoded;
+}
+
+/**
+ * The imports of an importmulti call, staged to be written to the wallet
+ * database in one transaction and added to the wallet once it is committed.
+ * As a key store, it is the wallet with the imports staged so far, so each
+ * request is checked as if the earlier ones had been imported.
+ */
+class StagedImports : public CBasicKeyStore
+{
+public:
+    CWallet::Imports imports;
+
+    explicit StagedImports(const CWallet& wallet) : m_wallet(wallet) {}
+
+    void StageWatchOnly(const CScript& script, int64_t timestamp)
+    {
+        CBasicKeyStore::AddWatchOnly(script);
+        imports.watch_only[script] = timestamp;
+    }
+
+    bool StageScript(const CScript& script)
+    {
+        if (!CBasicKeyStore::AddCScript(script)) return false;
+        imports.scripts.push_back(script);
+        return true;
+    }
+
+    void StageLabel(const CTxDestination& dest, const std::string& label)
+    {
+        imports.labels[dest] = label;
+    }
+
+    bool StageKey(const CKey& key, const CPubKey& pubkey, int64_t timestamp)
+    {
+        if (m_wallet.IsCrypted()) {
+            std::vector<unsigned char> crypted_secret;
+            if (!m_wallet.EncryptKey(key, pubkey, crypted_secret)) return false;
+            imports.keys.crypted_secrets.push_back(std::move(crypted_secret));
+        }
+        CBasicKeyStore::AddKeyPubKey(key, pubkey);
+        imports.keys.secrets.push_back(key);
+        imports.keys.pubkeys.push_back(pubkey);
+        imports.keys.metadata.emplace_back(timestamp);
+        // the key replaces watch-only scripts for it
+        for (const CScript& script : {GetScriptForDestination(pubkey.GetID()), GetScriptForRawPubKey(pubkey)}) {
+            CBasicKeyStore::RemoveWatchOnly(script);
+            imports.watch_only.erase(script);
+        }
+        return true;
+    }
+
+    bool GetPubKey(const CKeyID& address, CPubKey& pubkey) const override { return CBasicKeyStore::GetPubKey(address, pubkey) || m_wallet.GetPubKey(address, pubkey); }
+    bool HaveKey(const CKeyID& address) const override { return CBasicKeyStore::HaveKey(address) || m_wallet.HaveKey(address); }
+    bool GetKey(const CKeyID& address, CKey& key) const override { return CBasicKeyStore::GetKey(address, key) || m_wallet.GetKey(address, key); }
+    bool HaveCScript(const CScriptID& hash) const override { return CBasicKeyStore::HaveCScript(hash) || m_wallet.HaveCScript(hash); }
+    bool GetCScript(const CScriptID& hash, CScript& script) const override { return CBasicKeyStore::GetCScript(hash, script) || m_wallet.GetCScript(hash, script); }
+    bool HaveWatchOnly(const CScript& script) const override { return CBasicKeyStore::HaveWatchOnly(script) || m_wallet.HaveWatchOnly(script); }
+    bool HaveWatchOnly() const override { return CBasicKeyStore::HaveWatchOnly() || m_wallet.HaveWatchOnly(); }
+    bool MayBeMine(const CScript& script) const override { return CBasicKeyStore::MayBeMine(script) || m_wallet.MayBeMine(script); }
+
+private:
+    const CWallet& m_wallet;
+};
+
+static UniValue ProcessImport(CWallet * const pwallet, StagedImports& staged, const UniValue& data, const std::vector<ImportKey>& import_keys, const int64_t timestamp) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
 {
     try {
         bool success = false;
@@ -889,63 +989,51 @@ static UniValue ProcessImport(CWallet * const pwallet, const UniValue& data, con
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid P2SH address / script");
             }
 
-            pwallet->MarkDirty();
-
-            if (!pwallet->AddWatchOnly(redeemScript, timestamp)) {
-                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
-            }
+            staged.StageWatchOnly(redeemScript, timestamp);
 
             CScriptID redeem_id(redeemScript);
-            if (!pwallet->HaveCScript(redeem_id) && !pwallet->AddCScript(redeemScript)) {
+            if (!staged.HaveCScript(redeem_id) && !staged.StageScript(redeemScript)) {
                 throw JSONRPCError(RPC_WALLET_ERROR, "Error adding p2sh redeemScript to wallet");
             }
 
             CScript redeemDestination = GetScriptForDestination(redeem_id);
 
-            if (::IsMine(*pwallet, redeemDestination) == ISMINE_SPENDABLE) {
+            if (::IsMine(staged, redeemDestination) == ISMINE_SPENDABLE) {
                 throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
             }
 
-            pwallet->MarkDirty();
-
-            if (!pwallet->AddWatchOnly(redeemDestination, timestamp)) {
-                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
-            }
+            staged.StageWatchOnly(redeemDestination, timestamp);
 
             // add to address book or update label
             if (IsValidDestination(dest)) {
-                pwallet->SetAddressBook(dest, label, "receive");
+                staged.StageLabel(dest, label);
             }
 
             // Import private keys.
             if (keys.size()) {
                 for (size_t i = 0; i < keys.size(); i++) {
-                    const std::string& privkey = keys[i].get_str();
+                    if (!keys[i].isStr()) {
+                        throw JSONRPCError(RPC_TYPE_ERROR, "Private keys must be strings");
+                    }
 
-                    CKey key = DecodeSecret(privkey);
+                    const CKey& key = import_keys.at(i).key;
 
                     if (!key.IsValid()) {
                         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
                     }
 
-                    CPubKey pubkey = key.GetPubKey();
-                    assert(key.VerifyPubKey(pubkey));
+                    const CPubKey& pubkey = import_keys.at(i).pubkey;
 
                     CKeyID vchAddress = pubkey.GetID();
-                    pwallet->MarkDirty();
-                    pwallet->SetAddressBook(vchAddress, label, "receive");
+                    staged.StageLabel(vchAddress, label);
 
-                    if (pwallet->HaveKey(vchAddress)) {
+                    if (staged.HaveKey(vchAddress)) {
                         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Already have this key");
                     }
 
-                    pwallet->mapKeyMetadata[vchAddress].nCreateTime = timestamp;
-
-                    if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                    if (!staged.StageKey(key, pubkey, timestamp)) {
                         throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
                     }
-
-                    pwallet->UpdateTimeFirstKey(timestamp);
                 }
             }
 
@@ -986,50 +1074,43 @@ static UniValue ProcessImport(CWallet * const pwallet, const UniValue& data, con
 
                 CScript pubKeyScript = GetScriptForDestination(pubkey_dest);
 
-                if (::IsMine(*pwallet, pubKeyScript) == ISMINE_SPENDABLE) {
+                if (::IsMine(staged, pubKeyScript) == ISMINE_SPENDABLE) {
                     throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
                 }
 
-                pwallet->MarkDirty();
-
-                if (!pwallet->AddWatchOnly(pubKeyScript, timestamp)) {
-                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
-                }
+                staged.StageWatchOnly(pubKeyScript, timestamp);
 
                 // add to address book or update label
                 if (IsValidDestination(pubkey_dest)) {
-                    pwallet->SetAddressBook(pubkey_dest, label, "receive");
+                    staged.StageLabel(pubkey_dest, label);
                 }
 
                 // TODO Is this necessary?
                 CScript scriptRawPubKey = GetScriptForRawPubKey(pubKey);
 
-                if (::IsMine(*pwallet, scriptRawPubKey) == ISMINE_SPENDABLE) {
+                if (::IsMine(staged, scriptRawPubKey) == ISMINE_SPENDABLE) {
                     throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
                 }
 
-                pwallet->MarkDirty();
-
-                if (!pwallet->AddWatchOnly(scriptRawPubKey, timestamp)) {
-                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
-                }
+                staged.StageWatchOnly(scriptRawPubKey, timestamp);
 
                 success = true;
             }
 
             // Import private keys.
             if (keys.size()) {
-                const std::string& strPrivkey = keys[0].get_str();
+                if (!keys[0].isStr()) {
+                    throw JSONRPCError(RPC_TYPE_ERROR, "Private keys must be strings");
+                }
 
                 // Checks.
-                CKey key = DecodeSecret(strPrivkey);
+                const CKey& key = import_keys.at(0).key;
 
                 if (!key.IsValid()) {
                     throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
                 }
 
-                CPubKey pubKey = key.GetPubKey();
-                assert(key.VerifyPubKey(pubKey));
+                const CPubKey& pubKey = import_keys.at(0).pubkey;
 
                 CTxDestination pubkey_dest = pubKey.GetID();
 
@@ -1050,40 +1131,31 @@ static UniValue ProcessImport(CWallet * const pwallet, const UniValue& data, con
                 }
 
                 CKeyID vchAddress = pubKey.GetID();
-                pwallet->MarkDirty();
-                pwallet->SetAddressBook(vchAddress, label, "receive");
+                staged.StageLabel(vchAddress, label);
 
-                if (pwallet->HaveKey(vchAddress)) {
+                if (staged.HaveKey(vchAddress)) {
                     throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
                 }
 
-                pwallet->mapKeyMetadata[vchAddress].nCreateTime = timestamp;
-
-                if (!pwallet->AddKeyPubKey(key, pubKey)) {
+                if (!staged.StageKey(key, pubKey, timestamp)) {
                     throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
                 }
 
-                pwallet->UpdateTimeFirstKey(timestamp);
-
                 success = true;
             }
 
             // Import scriptPubKey only.
             if (pubKeys.size() == 0 && keys.size() == 0) {
-                if (::IsMine(*pwallet, script) == ISMINE_SPENDABLE) {
+                if (::IsMine(staged, script) == ISMINE_SPENDABLE) {
                     throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
                 }
 
-                pwallet->MarkDirty();
-
-                if (!pwallet->AddWatchOnly(script, timestamp)) {
-                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
-                }
+                staged.StageWatchOnly(script, timestamp);
 
                 if (scriptPubKey.getType() == UniValue::VOBJ) {
                     // add to address book or update label
                     if (IsValidDestination(dest)) {
-                        pwallet->SetAddressBook(dest, label, "receive");
+                        staged.StageLabel(dest, label);
                     }
                 }
 
@@ -1190,6 +1262,8 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
 
+    const std::vector<std::vector<ImportKey>> import_keys = DecodeImportKeys(requests);
+
     int64_t now = 0;
     bool fRunScan = false;
     int64_t nLowestTimestamp = 0;
@@ -1212,9 +1286,14 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
             fRescan = false;
         }
 
-        for (const UniValue& data : requests.getValues()) {
+        // The imports of all requests are written in one database
+        // transaction, rather than each record being written and flushed on
+        // its own, and the wallet in memory only changes once it is committed.
+        StagedImports staged(*pwallet);
+        for (size_t i = 0; i < requests.size(); ++i) {
+            const UniValue& data = requests[i];
             const int64_t timestamp = std::max(GetImportTimestamp(data, now), minimumTimestamp);
-            const UniValue result = ProcessImport(pwallet, data, timestamp);
+            const UniValue result = ProcessImport(pwallet, staged, data, import_keys[i], timestamp);
             response.push_back(result);
 
             if (!fRescan) {
@@ -1231,6 +1310,18 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
                 nLowestTimestamp = timestamp;
             }
         }
+        WalletBatch batch(pwallet->GetDBHandle());
+        if (!batch.TxnBegin()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error: failed to begin writing imports to the wallet database");
+        }
+        if (!pwallet->WriteImports(batch, staged.imports)) {
+            batch.TxnAbort();
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error: failed to write imports to the wallet database");
+        }
+        if (!batch.TxnCommit()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error: failed to commit imports to the wallet database");
+        }
+        pwallet->AddImports(staged.imports);
     }
     if (fRescan && fRunScan && requests.size()) {
         int64_t scannedTime = pwallet->RescanFromTime(nLowestTimestamp, reserver, true /* update */);
@@ -16,6 +16,7 @@
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
+#include <rpc/jsonstream.h>
 #include <rpc/mining.h>
 #include <rpc/rawtransaction.h>
 #include <rpc/server.h>
@@ -1291,6 +1292,9 @@ static UniValue sendmany(const JSONRPCRequest& request)
     // Shuffle recipient list
     std::shuffle(vecSend.begin(), vecSend.end(), FastRandomContext());
 
+    // Large payouts select their coins in a single pass
+    coin_control.m_batch_payout = vecSend.size() >= BATCH_PAYOUT_MIN_RECIPIENTS;
+
     // Send
     CReserveKey keyChange(pwallet);
     CAmount nFeeRequired = 0;
@@ -1895,6 +1899,94 @@ static void AcentryToJSON(const CAccountingEntry& acentry, const std::string& st
     }
 }
 
+/** Entries for one item of CWallet::wtxOrdered, in the order listtransactions collects them */
+static void ListOrderedItem(CWallet* const pwallet, const CWallet::TxPair& item, const std::string& strAccount, const isminefilter& filter, UniValue& ret)
+{
+    CWalletTx *const pwtx = item.first;
+    if (pwtx != nullptr)
+        ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+    if (IsDeprecatedRPCEnabled("accounts")) {
+        CAccountingEntry *const pacentry = item.second;
+        if (pacentry != nullptr) AcentryToJSON(*pacentry, strAccount, ret);
+    }
+}
+
+/** Number of entries collected under the wallet lock before they are written to the stream */
+static const size_t LIST_TRANSACTIONS_STREAM_BATCH = 1000;
+
+/**
+ * Write the entries listtransactions returns to a stream, oldest to newest.
+ * The wallet is only locked while a batch of entries is collected, not while
+ * it is written, as writing waits for the client to read the reply. Items
+ * added to the wallet after the call started are not listed.
+ */
+static void ListTransactions(JSONStreamWriter& stream, CWallet* const pwallet, const std::string& strAccount, int nCount, int nFrom, const isminefilter& filter)
+{
+    const CWallet::TxItems& txOrdered = pwallet->wtxOrdered;
+
+    // The next item to write is identified by its order position and its
+    // index among the items sharing that position, which stay meaningful
+    // while the wallet is unlocked.
+    int64_t nextKey = 0, lastKey = 0;
+    size_t nextDup = 0;
+    size_t nSkip = 0, nRemaining = 0;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+
+        // Walk backwards like listtransactions to find the oldest item it collects
+        const size_t nWant = (size_t)nFrom + nCount;
+        size_t nTotal = 0;
+        CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin();
+        for (; it != txOrdered.rend() && nTotal < nWant; ++it) {
+            UniValue entries(UniValue::VARR);
+            ListOrderedItem(pwallet, it->second, strAccount, filter, entries);
+            nTotal += entries.size();
+        }
+        if (nTotal > (size_t)nFrom) {
+            const CWallet::TxItems::const_iterator first = it.base();
+            nextKey = first->first;
+            nextDup = std::distance(txOrdered.lower_bound(nextKey), first);
+            lastKey = txOrdered.rbegin()->first;
+            // Written forwards, the entries skipped by 'from' come last
+            const size_t nEnd = std::min(nWant, nTotal);
+            nSkip = nTotal - nEnd;
+            nRemaining = nEnd - nFrom;
+        }
+    }
+
+    stream.BeginArray();
+    while (nRemaining > 0) {
+        std::vector<UniValue> batch;
+        {
+            LOCK2(cs_main, pwallet->cs_wallet);
+
+            CWallet::TxItems::const_iterator it = txOrdered.lower_bound(nextKey);
+            for (size_t i = 0; i < nextDup && it != txOrdered.end() && it->first == nextKey; ++i) ++it;
+            for (; it != txOrdered.end() && it->first <= lastKey && nRemaining > 0 && batch.size() < LIST_TRANSACTIONS_STREAM_BATCH; ++it) {
+                UniValue entries(UniValue::VARR);
+                ListOrderedItem(pwallet, it->second, strAccount, filter, entries);
+                // listtransactions reverses the entries of an item along with the whole list
+                const std::vector<UniValue>& values = entries.getValues();
+                for (auto entry = values.rbegin(); entry != values.rend() && nRemaining > 0; ++entry) {
+                    if (nSkip > 0) {
+                        --nSkip;
+                        continue;
+                    }
+                    batch.push_back(*entry);
+                    --nRemaining;
+                }
+                nextDup = it->first == nextKey ? nextDup + 1 : 1;
+                nextKey = it->first;
+            }
+            if (it == txOrdered.end() || it->first > lastKey) nRemaining = 0;
+        }
+        for (const UniValue& entry : batch) {
+            stream.Value(entry);
+        }
+    }
+    stream.EndArray();
+}
+
 UniValue listtransactions(const JSONRPCRequest& request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -2039,6 +2131,11 @@ UniValue listtransactions(const JSONRPCRequest& request)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
+    if (request.stream) {
+        ListTransactions(*request.stream, pwallet, strAccount, nCount, nFrom, filter);
+        return NullUniValue;
+    }
+
     UniValue ret(UniValue::VARR);
 
     {
@@ -2049,13 +2146,7 @@ UniValue listtransactions(const JSONRPCRequest& request)
         // iterate backwards until we have nCount items to return:
         for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
         {
-            CWalletTx *const pwtx = (*it).second.first;
-            if (pwtx != nullptr)
-                ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
-            if (IsDeprecatedRPCEnabled("accounts")) {
-                CAccountingEntry *const pacentry = (*it).second.second;
-                if (pacentry != nullptr) AcentryToJSON(*pacentry, strAccount, ret);
-            }
+            ListOrderedItem(pwallet, (*it).second, strAccount, filter, ret);
 
             if ((int)ret.size() >= (nCount+nFrom)) break;
         }
@@ -3027,6 +3118,11 @@ static UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"hdseedid\": \"<hash160>\"            (string, optional) the Hash160 of the HD seed (only present when HD is enabled)\n"
             "  \"hdmasterkeyid\": \"<hash160>\"       (string, optional) alias for hdseedid retained for backwards-compatibility. Will be removed in V0.18.\n"
             "  \"private_keys_enabled\": true|false (boolean) false if privatekeys are disabled for this wallet (enforced watch-only wallet)\n"
+            "  \"scanning\":                        (json object) current scanning details, or false if no scan is in progress\n"
+            "    {\n"
+            "      \"duration\" : xxxx              (numeric) elapsed seconds since scan start\n"
+            "      \"progress\" : x.xxxx,           (numeric) scanning progress percentage [0.0, 1.0]\n"
+            "    }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -3063,6 +3159,14 @@ static UniValue getwalletinfo(const JSONRPCRequest& request)
         obj.pushKV("hdmasterkeyid", seed_id.GetHex());
     }
     obj.pushKV("private_keys_enabled", !pwallet->IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
+    if (pwallet->IsScanning()) {
+        UniValue scanning(UniValue::VOBJ);
+        scanning.pushKV("duration", pwallet->ScanningDuration() / 1000);
+        scanning.pushKV("progress", pwallet->ScanningProgress());
+        obj.pushKV("scanning", scanning);
+    } else {
+        obj.pushKV("scanning", false);
+    }
     return obj;
 }
 
@@ -3239,7 +3343,6 @@ static UniValue unloadwallet(const JSONRPCRequest& request)
     if (!RemoveWallet(wallet)) {
         throw JSONRPCError(RPC_MISC_ERROR, "Requested wallet already unloaded");
     }
-    UnregisterValidationInterface(wallet.get());
 
     // The wallet can be in use so it's not possible to explicitly unload here.
     // Just notify the unload intent so that all shared pointers are released.
@@ -202,6 +202,16 @@ BOOST_AUTO_TEST_CASE(bnb_search_test)
     target = make_hard_case(14, utxo_pool);
     BOOST_CHECK(SelectCoinsBnB(GroupCoins(utxo_pool), target, 0, selection, value_ret, not_input_fees)); // Should not exhaust
 
+    // Search budget tests
+    CoinSelectionBudget budget;
+    budget.max_tries = 1000;
+    BOOST_CHECK(!SelectCoinsBnB(GroupCoins(utxo_pool), target, 0, selection, value_ret, not_input_fees, budget)); // Should exhaust
+    budget.max_tries = DEFAULT_BNB_TRIES;
+    budget.deadline = 1;
+    BOOST_CHECK(!SelectCoinsBnB(GroupCoins(utxo_pool), target, 0, selection, value_ret, not_input_fees, budget)); // Deadline has passed
+    budget.deadline = GetTimeMicros() + 3600 * 1000000LL;
+    BOOST_CHECK(SelectCoinsBnB(GroupCoins(utxo_pool), target, 0, selection, value_ret, not_input_fees, budget));
+
     // Test same value early bailout optimization
     add_coin(7 * CENT, 7, actual_selection);
     add_coin(7 * CENT, 7, actual_selection);
@@ -541,6 +551,12 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(nValueRet, 1003 * COIN);
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
 
+    // A passed deadline still gives a selection that pays the target
+    CoinSelectionBudget budget;
+    budget.deadline = 1;
+    BOOST_CHECK(KnapsackSolver(1003 * COIN, GroupCoins(vCoins), setCoinsRet, nValueRet, budget));
+    BOOST_CHECK(nValueRet >= 1003 * COIN);
+
     empty_wallet();
 }
 
@@ -0,0 +1,184 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <key_io.h>
+#include <test/test_bitcoin.h>
+#include <util.h>
+#include <wallet/leveldb.h>
+#include <wallet/wallet.h>
+#include <wallet/walletdb.h>
+
+#include <memory>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(db_tests, BasicTestingSetup)
+
+static std::vector<std::string> ReadAllKeys(DatabaseBatch& batch)
+{
+    std::vector<std::string> keys;
+    BOOST_REQUIRE(batch.StartCursor());
+    while (true) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        bool complete;
+        BOOST_REQUIRE(batch.ReadAtCursor(ssKey, ssValue, complete));
+        if (complete) break;
+        std::string key;
+        ssKey >> key;
+        keys.push_back(key);
+    }
+    batch.CloseCursor();
+    return keys;
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_records)
+{
+    const fs::path wallet_path = SetDataDir("db_tests") / "records";
+    {
+        LevelDBDatabase database(wallet_path);
+        std::unique_ptr<DatabaseBatch> batch = database.MakeBatch("cr+");
+        int version = 0;
+        BOOST_CHECK(batch->ReadVersion(version));
+        BOOST_CHECK_EQUAL(version, CLIENT_VERSION);
+
+        BOOST_CHECK(batch->Write(std::string("a"), 1));
+        BOOST_CHECK(!batch->Write(std::string("a"), 2, false));
+        BOOST_CHECK(batch->Write(std::string("b"), 3));
+        BOOST_CHECK(batch->Exists(std::string("a")));
+        int value = 0;
+        BOOST_CHECK(batch->Read(std::string("a"), value));
+        BOOST_CHECK_EQUAL(value, 1);
+        BOOST_CHECK(batch->Erase(std::string("b")));
+        BOOST_CHECK(!batch->Exists(std::string("b")));
+        BOOST_CHECK(batch->Erase(std::string("b")));
+        batch.reset();
+        database.Flush(true);
+    }
+    BOOST_CHECK(UseLevelDBWallet(wallet_path));
+
+    LevelDBDatabase database(wallet_path);
+    std::unique_ptr<DatabaseBatch> batch = database.MakeBatch("r");
+    int value = 0;
+    BOOST_CHECK(batch->Read(std::string("a"), value));
+    BOOST_CHECK_EQUAL(value, 1);
+    BOOST_CHECK(!batch->Read(std::string("b"), value));
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_cursor)
+{
+    LevelDBDatabase database(fs::path(), true /* mock */);
+    std::unique_ptr<DatabaseBatch> batch = database.MakeBatch();
+    for (const std::string key : {"ca", "aa", "da", "ba"}) {
+        BOOST_CHECK(batch->Write(key, key));
+    }
+    BOOST_CHECK(ReadAllKeys(*batch) == std::vector<std::string>({"aa", "ba", "ca", "da"}));
+
+    // Positioning the cursor at the first key not less than the given one
+    BOOST_REQUIRE(batch->StartCursor());
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssKey << std::string("bb");
+    bool complete;
+    BOOST_CHECK(batch->ReadAtCursor(ssKey, ssValue, complete, true /* setRange */));
+    BOOST_CHECK(!complete);
+    std::string key, value;
+    ssKey >> key;
+    ssValue >> value;
+    BOOST_CHECK_EQUAL(key, "ca");
+    BOOST_CHECK_EQUAL(value, "ca");
+    batch->CloseCursor();
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_txn)
+{
+    LevelDBDatabase database(fs::path(), true /* mock */);
+    std::unique_ptr<DatabaseBatch> batch = database.MakeBatch();
+    std::unique_ptr<DatabaseBatch> other = database.MakeBatch();
+    BOOST_CHECK(batch->Write(std::string("a"), 1));
+
+    BOOST_CHECK(batch->TxnBegin());
+    BOOST_CHECK(!batch->TxnBegin());
+    BOOST_CHECK(batch->Erase(std::string("a")));
+    BOOST_CHECK(batch->Write(std::string("b"), 2, false));
+    BOOST_CHECK(!batch->Write(std::string("b"), 3, false));
+    BOOST_CHECK(!batch->Exists(std::string("a")));
+    int value = 0;
+    BOOST_CHECK(batch->Read(std::string("b"), value));
+    BOOST_CHECK_EQUAL(value, 2);
+    // Nothing is visible outside the transaction before it commits
+    BOOST_CHECK(other->Exists(std::string("a")));
+    BOOST_CHECK(!other->Exists(std::string("b")));
+    BOOST_CHECK(batch->TxnCommit());
+    BOOST_CHECK(!other->Exists(std::string("a")));
+    BOOST_CHECK(other->Read(std::string("b"), value));
+    BOOST_CHECK_EQUAL(value, 2);
+
+    BOOST_CHECK(batch->TxnBegin());
+    BOOST_CHECK(batch->Write(std::string("c"), 4));
+    BOOST_CHECK(batch->TxnAbort());
+    BOOST_CHECK(!batch->Exists(std::string("c")));
+    BOOST_CHECK(!other->Exists(std::string("c")));
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_rewrite_backup)
+{
+    const fs::path wallet_path = SetDataDir("db_tests") / "rewrite";
+    LevelDBDatabase database(wallet_path);
+    {
+        std::unique_ptr<DatabaseBatch> batch = database.MakeBatch("cr+");
+        for (int i = 0; i < 10; ++i) {
+            BOOST_CHECK(batch->Write(std::make_pair(std::string("pool"), i), i));
+        }
+        BOOST_CHECK(batch->Write(std::string("pool_"), 10));
+        BOOST_CHECK(batch->Write(std::string("name"), 11));
+    }
+    BOOST_CHECK(database.Rewrite("\x04pool"));
+    {
+        std::unique_ptr<DatabaseBatch> batch = database.MakeBatch("r");
+        BOOST_CHECK(ReadAllKeys(*batch) == std::vector<std::string>({"name", "pool_", "version"}));
+    }
+
+    // A backup into a directory gets a database of its own inside of it
+    const fs::path backup_dir = wallet_path.parent_path() / "backup";
+    fs::create_directories(backup_dir);
+    BOOST_CHECK(database.Backup(backup_dir.string()));
+    BOOST_CHECK(!database.Backup((wallet_path / LEVELDB_WALLET_DIRNAME).string()));
+
+    LevelDBDatabase backup(backup_dir);
+    std::unique_ptr<DatabaseBatch> batch = backup.MakeBatch("r");
+    int value = 0;
+    BOOST_CHECK(batch->Read(std::string("name"), value));
+    BOOST_CHECK_EQUAL(value, 11);
+    BOOST_CHECK(ReadAllKeys(*batch) == std::vector<std::string>({"name", "pool_", "version"}));
+}
+
+BOOST_AUTO_TEST_CASE(leveldb_wallet_load)
+{
+    const fs::path wallet_path = SetDataDir("db_tests") / "wallet";
+    CTxDestination dest;
+    {
+        CWallet wallet("wallet", MakeUnique<LevelDBDatabase>(wallet_path));
+        bool first_run;
+        BOOST_CHECK(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+        BOOST_CHECK(first_run);
+        LOCK(wallet.cs_wallet);
+        WalletBatch batch(wallet.GetDBHandle());
+        CPubKey pubkey = wallet.GenerateNewKey(batch);
+        dest = pubkey.GetID();
+        BOOST_CHECK(wallet.SetAddressBook(dest, "label", "receive"));
+        wallet.Flush(true);
+    }
+
+    CWallet wallet("wallet", MakeUnique<LevelDBDatabase>(wallet_path));
+    bool first_run;
+    BOOST_CHECK(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+    BOOST_CHECK(!first_run);
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK(wallet.HaveKey(boost::get<CKeyID>(dest)));
+    BOOST_CHECK_EQUAL(wallet.mapAddressBook[dest].name, "label");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
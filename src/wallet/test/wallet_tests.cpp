@@ -4,6 +4,8 @@
 
 #include <wallet/wallet.h>
 
+#include <limits>
+#include <map>
 #include <memory>
 #include <set>
 #include <stdint.h>
@@ -11,10 +13,15 @@
 #include <vector>
 
 #include <consensus/validation.h>
+#include <key_io.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <test/test_bitcoin.h>
 #include <validation.h>
+#include <wallet/blockdispatcher.h>
 #include <wallet/coincontrol.h>
+#include <wallet/db.h>
+#include <wallet/leveldb.h>
 #include <wallet/test/wallet_test_fixture.h>
 #include <policy/policy.h>
 
@@ -24,6 +31,7 @@
 extern UniValue importmulti(const JSONRPCRequest& request);
 extern UniValue dumpwallet(const JSONRPCRequest& request);
 extern UniValue importwallet(const JSONRPCRequest& request);
+extern UniValue listtransactions(const JSONRPCRequest& request);
 
 BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
 
@@ -366,6 +374,44 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2U);
 }
 
+BOOST_AUTO_TEST_CASE(listtransactions_stream)
+{
+    // Transactions paying us on several outputs list an entry for each,
+    // which the streamed reply has to order like the collected one
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(m_wallet, key);
+    for (int i = 0; i < 6; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        mtx.vout.resize(i % 3 + 1);
+        for (CTxOut& out : mtx.vout) {
+            out.nValue = (i + 1) * COIN;
+            out.scriptPubKey = GetScriptForRawPubKey(key.GetPubKey());
+        }
+        BOOST_CHECK(m_wallet.AddToWallet(CWalletTx(&m_wallet, MakeTransactionRef(std::move(mtx)))));
+    }
+    std::shared_ptr<CWallet> wallet(&m_wallet, [](CWallet*) {});
+    AddWallet(wallet);
+
+    for (const std::pair<int, int>& count_from : std::vector<std::pair<int, int>>{{10, 0}, {3, 2}, {4, 3}, {1000, 0}, {2, 1000}, {0, 0}, {0, 5}}) {
+        JSONRPCRequest request;
+        request.params.setArray();
+        request.params.push_back("*");
+        request.params.push_back(count_from.first);
+        request.params.push_back(count_from.second);
+        const UniValue expected = listtransactions(request);
+
+        std::string out;
+        JSONStreamWriter stream([&](std::string&& chunk) { out += chunk; }, 64);
+        request.stream = &stream;
+        BOOST_CHECK(listtransactions(request).isNull());
+        out += stream.TakeBuffer();
+        BOOST_CHECK_EQUAL(out, expected.write());
+    }
+    RemoveWallet(wallet);
+}
+
 BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
 {
     std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>("dummy", WalletDatabase::CreateDummy());
@@ -418,4 +464,528 @@ BOOST_FIXTURE_TEST_CASE(dummy_input_size_test, TestChain100Setup)
     BOOST_CHECK_EQUAL(CalculateNestedKeyhashInputSize(true), DUMMY_NESTED_P2WPKH_INPUT_SIZE);
 }
 
+// The rescan filter must match every output IsMine() accepts, and should not
+// match unrelated outputs.
+BOOST_AUTO_TEST_CASE(scan_filter)
+{
+    CKey key, other_key, watch_key;
+    key.MakeNewKey(true);
+    other_key.MakeNewKey(true);
+    watch_key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+
+    const uint64_t generation = m_wallet.GetGeneration();
+    AddKey(m_wallet, key);
+    BOOST_CHECK(m_wallet.GetGeneration() != generation);
+
+    const CScript watch_script = GetScriptForMultisig(1, {watch_key.GetPubKey(), other_key.GetPubKey()});
+    {
+        LOCK(m_wallet.cs_wallet);
+        m_wallet.AddWatchOnly(watch_script, 0);
+    }
+
+    std::shared_ptr<const CWalletScanFilter> filter = m_wallet.GetScanFilter();
+    BOOST_CHECK_EQUAL(filter->m_generation, m_wallet.GetGeneration());
+
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+    std::vector<CScript> mine = {
+        GetScriptForRawPubKey(pubkey),
+        GetScriptForDestination(pubkey.GetID()),
+        p2wpkh,
+        GetScriptForDestination(CScriptID(p2wpkh)),
+        watch_script,
+    };
+    for (const CScript& script : mine) {
+        BOOST_CHECK(::IsMine(m_wallet, script) != ISMINE_NO);
+        BOOST_CHECK(filter->MayBeMine(script));
+    }
+
+    std::vector<CScript> not_mine = {
+        GetScriptForRawPubKey(other_key.GetPubKey()),
+        GetScriptForDestination(other_key.GetPubKey().GetID()),
+        GetScriptForDestination(WitnessV0KeyHash(other_key.GetPubKey().GetID())),
+        GetScriptForMultisig(1, {pubkey}),
+        CScript() << OP_RETURN,
+    };
+    for (const CScript& script : not_mine) {
+        BOOST_CHECK(!filter->MayBeMine(script));
+    }
+
+    CMutableTransaction tx;
+    tx.vout.emplace_back(1 * COIN, not_mine[0]);
+    BOOST_CHECK(!filter->MayBeMine(CTransaction(tx)));
+    tx.vout.emplace_back(1 * COIN, mine[1]);
+    BOOST_CHECK(filter->MayBeMine(CTransaction(tx)));
+}
+
+// Balances and available coins only visit transactions with unspent outputs.
+// Check that a transaction drops out once spent and comes back when the
+// spending transaction is abandoned.
+BOOST_AUTO_TEST_CASE(unspent_tracking)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(m_wallet, key);
+
+    CMutableTransaction receive;
+    receive.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+    receive.vout.emplace_back(1 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+    CWalletTx receive_wtx(&m_wallet, MakeTransactionRef(receive));
+
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(receive.GetHash(), 0));
+    spend.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+    CWalletTx spend_wtx(&m_wallet, MakeTransactionRef(spend));
+
+    LOCK2(cs_main, m_wallet.cs_wallet);
+    std::vector<COutput> coins;
+
+    BOOST_CHECK(m_wallet.AddToWallet(receive_wtx));
+    m_wallet.mapWallet.at(receive.GetHash()).fInMempool = true;
+    BOOST_CHECK_EQUAL(m_wallet.GetUnspentTxs().size(), 1U);
+    BOOST_CHECK_EQUAL(m_wallet.GetUnconfirmedBalance(), 1 * COIN);
+    m_wallet.AvailableCoins(coins, false);
+    BOOST_CHECK_EQUAL(coins.size(), 1U);
+
+    BOOST_CHECK(m_wallet.AddToWallet(spend_wtx));
+    BOOST_CHECK_EQUAL(m_wallet.GetUnspentTxs().size(), 0U);
+    BOOST_CHECK_EQUAL(m_wallet.GetUnconfirmedBalance(), 0);
+    m_wallet.AvailableCoins(coins, false);
+    BOOST_CHECK_EQUAL(coins.size(), 0U);
+
+    BOOST_CHECK(m_wallet.AbandonTransaction(spend.GetHash()));
+    BOOST_CHECK_EQUAL(m_wallet.GetUnspentTxs().size(), 1U);
+    BOOST_CHECK_EQUAL(m_wallet.GetUnconfirmedBalance(), 1 * COIN);
+    m_wallet.AvailableCoins(coins, false);
+    BOOST_CHECK_EQUAL(coins.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_batch)
+{
+    const fs::path wallet_path = GetDataDir() / "keypool_topup";
+    {
+        CWallet wallet("keypool_topup", MakeUnique<LevelDBDatabase>(wallet_path));
+        bool first_run;
+        BOOST_CHECK(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+        LOCK(wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_LATEST);
+        wallet.SetHDSeed(wallet.GenerateNewSeed());
+        BOOST_CHECK(wallet.TopUpKeyPool(300));
+        BOOST_CHECK_EQUAL(wallet.KeypoolCountExternalKeys(), 300U);
+        BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 600U);
+        BOOST_CHECK_EQUAL(wallet.GetHDChain().nExternalChainCounter, 300U);
+        BOOST_CHECK_EQUAL(wallet.GetHDChain().nInternalChainCounter, 300U);
+
+        // The keys are the ones deriving them one at a time gives
+        CKey seed;
+        BOOST_REQUIRE(wallet.GetKey(wallet.GetHDChain().seed_id, seed));
+        const uint32_t hardened = 0x80000000;
+        CExtKey master, account, chain, child;
+        master.SetSeed(seed.begin(), seed.size());
+        master.Derive(account, hardened);
+        account.Derive(chain, hardened);
+        for (uint32_t i = 0; i < 300; ++i) {
+            chain.Derive(child, i | hardened);
+            const CKeyID keyid = child.key.GetPubKey().GetID();
+            BOOST_CHECK(wallet.HaveKey(keyid));
+            BOOST_CHECK_EQUAL(wallet.mapKeyMetadata[keyid].hdKeypath, "m/0'/0'/" + std::to_string(i) + "'");
+        }
+        wallet.Flush(true);
+    }
+
+    CWallet wallet("keypool_topup", MakeUnique<LevelDBDatabase>(wallet_path));
+    bool first_run;
+    BOOST_CHECK(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.GetKeys().size(), 601U);
+    BOOST_CHECK_EQUAL(wallet.KeypoolCountExternalKeys(), 300U);
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 600U);
+    BOOST_CHECK_EQUAL(wallet.GetHDChain().nInternalChainCounter, 300U);
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_bdb)
+{
+    // A large top up fits in one BerkeleyDB transaction
+    const fs::path wallet_path = GetDataDir() / "keypool_topup_bdb";
+    {
+        CWallet wallet("keypool_topup_bdb", MakeUnique<BerkeleyDatabase>(wallet_path));
+        bool first_run;
+        BOOST_CHECK(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+        LOCK(wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_LATEST);
+        wallet.SetHDSeed(wallet.GenerateNewSeed());
+        BOOST_CHECK(wallet.TopUpKeyPool(10000));
+        BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 20000U);
+        wallet.Flush(false);
+    }
+
+    std::unique_ptr<CWallet> wallet = MakeUnique<CWallet>("keypool_topup_bdb", MakeUnique<BerkeleyDatabase>(wallet_path));
+    bool first_run;
+    BOOST_CHECK(wallet->LoadWallet(first_run) == DBErrors::LOAD_OK);
+    {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK_EQUAL(wallet->GetKeys().size(), 20001U);
+        BOOST_CHECK_EQUAL(wallet->KeypoolCountExternalKeys(), 10000U);
+        BOOST_CHECK_EQUAL(wallet->GetHDChain().nInternalChainCounter, 10000U);
+    }
+    wallet->Flush(true);
+}
+/** In-memory wallet database whose writes fail once m_writes_left reaches zero */
+class FailingDatabase : public WalletDatabase
+{
+public:
+    typedef std::map<CSerializeData, CSerializeData> Records;
+    Records m_records;
+    int m_writes_left = std::numeric_limits<int>::max();
+
+    std::unique_ptr<DatabaseBatch> MakeBatch(const char* pszMode = "r+", bool fFlushOnClose = true) override;
+    bool Rewrite(const char* pszSkip = nullptr) override { return true; }
+    bool Backup(const std::string& strDest) override { return false; }
+    void Flush(bool shutdown) override {}
+    bool PeriodicFlush() override { return true; }
+};
+
+class FailingBatch : public DatabaseBatch
+{
+public:
+    explicit FailingBatch(FailingDatabase& db) : m_db(db) {}
+
+    void Flush() override {}
+    void Close() override {}
+
+    bool StartCursor() override { return false; }
+    bool ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete, bool setRange = false) override { return false; }
+    void CloseCursor() override {}
+
+    bool TxnBegin() override
+    {
+        if (m_txn) return false;
+        m_txn.reset(new FailingDatabase::Records(m_db.m_records));
+        return true;
+    }
+    bool TxnCommit() override
+    {
+        if (!m_txn) return false;
+        m_db.m_records.swap(*m_txn);
+        m_txn.reset();
+        return true;
+    }
+    bool TxnAbort() override
+    {
+        if (!m_txn) return false;
+        m_txn.reset();
+        return true;
+    }
+
+protected:
+    bool ReadKey(const CDataStream& ssKey, CDataStream& ssValue) override
+    {
+        auto it = Records().find(CSerializeData(ssKey.begin(), ssKey.end()));
+        if (it == Records().end()) return false;
+        ssValue.write(it->second.data(), it->second.size());
+        return true;
+    }
+    bool WriteKey(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite) override
+    {
+        if (m_db.m_writes_left-- <= 0) return false;
+        CSerializeData key(ssKey.begin(), ssKey.end());
+        if (!fOverwrite && Records().count(key)) return false;
+        Records()[key] = CSerializeData(ssValue.begin(), ssValue.end());
+        return true;
+    }
+    bool EraseKey(const CDataStream& ssKey) override
+    {
+        Records().erase(CSerializeData(ssKey.begin(), ssKey.end()));
+        return true;
+    }
+    bool HasKey(const CDataStream& ssKey) override
+    {
+        return Records().count(CSerializeData(ssKey.begin(), ssKey.end()));
+    }
+
+private:
+    FailingDatabase& m_db;
+    std::unique_ptr<FailingDatabase::Records> m_txn;
+
+    FailingDatabase::Records& Records() { return m_txn ? *m_txn : m_db.m_records; }
+};
+
+std::unique_ptr<DatabaseBatch> FailingDatabase::MakeBatch(const char* pszMode, bool fFlushOnClose)
+{
+    return MakeUnique<FailingBatch>(*this);
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_failure)
+{
+    std::unique_ptr<FailingDatabase> database = MakeUnique<FailingDatabase>();
+    FailingDatabase& db = *database;
+    CWallet wallet("keypool_topup_failure", std::move(database));
+    LOCK(wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_LATEST);
+    wallet.SetHDSeed(wallet.GenerateNewSeed());
+    BOOST_CHECK(wallet.TopUpKeyPool(10));
+    const size_t keys = wallet.GetKeys().size();
+    const size_t metadata = wallet.mapKeyMetadata.size();
+    const size_t records = db.m_records.size();
+
+    // A top up that fails to be written leaves the wallet as it was, on disk
+    // and in memory
+    db.m_writes_left = 15;
+    BOOST_CHECK_THROW(wallet.TopUpKeyPool(20), std::runtime_error);
+    BOOST_CHECK_EQUAL(db.m_records.size(), records);
+    BOOST_CHECK_EQUAL(wallet.GetKeys().size(), keys);
+    BOOST_CHECK_EQUAL(wallet.mapKeyMetadata.size(), metadata);
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 20U);
+    BOOST_CHECK_EQUAL(wallet.GetHDChain().nExternalChainCounter, 10U);
+    BOOST_CHECK_EQUAL(wallet.GetHDChain().nInternalChainCounter, 10U);
+
+    // The next top up derives the keys the failed one did not add
+    db.m_writes_left = std::numeric_limits<int>::max();
+    BOOST_CHECK(wallet.TopUpKeyPool(20));
+    BOOST_CHECK_EQUAL(wallet.GetKeys().size(), keys + 20);
+    BOOST_CHECK_EQUAL(wallet.GetKeyPoolSize(), 40U);
+    BOOST_CHECK_EQUAL(wallet.GetHDChain().nExternalChainCounter, 20U);
+    BOOST_CHECK_EQUAL(db.m_records.size(), records + 20 * 3);
+}
+
+// Block transactions reach only the wallets whose keys or transactions they
+// involve, including keys added after the wallet was attached.
+BOOST_AUTO_TEST_CASE(block_dispatcher)
+{
+    auto wallet_a = std::make_shared<CWallet>("a", WalletDatabase::CreateDummy());
+    auto wallet_b = std::make_shared<CWallet>("b", WalletDatabase::CreateDummy());
+    CKey key_a, key_b, other_key;
+    key_a.MakeNewKey(true);
+    key_b.MakeNewKey(true);
+    other_key.MakeNewKey(true);
+    AddKey(*wallet_a, key_a);
+
+    WalletBlockDispatcher dispatcher;
+    dispatcher.AttachWallet(wallet_a);
+    dispatcher.AttachWallet(wallet_b);
+
+    CMutableTransaction pay_a, other, spend_a;
+    pay_a.vin.emplace_back(GetRandHash(), 0);
+    pay_a.vout.emplace_back(1 * COIN, GetScriptForDestination(key_a.GetPubKey().GetID()));
+    other.vin.emplace_back(GetRandHash(), 0);
+    other.vout.emplace_back(1 * COIN, GetScriptForDestination(other_key.GetPubKey().GetID()));
+    spend_a.vin.emplace_back(pay_a.GetHash(), 0);
+    spend_a.vout.emplace_back(1 * COIN, GetScriptForDestination(other_key.GetPubKey().GetID()));
+    auto block = std::make_shared<CBlock>();
+    block->vtx = {MakeTransactionRef(pay_a), MakeTransactionRef(other), MakeTransactionRef(spend_a)};
+    const uint256 block_hash = block->GetHash();
+    CBlockIndex index;
+    index.phashBlock = &block_hash;
+
+    dispatcher.BlockConnected(block, &index, {});
+    {
+        LOCK(wallet_a->cs_wallet);
+        BOOST_CHECK_EQUAL(wallet_a->mapWallet.size(), 2U);
+        BOOST_CHECK(wallet_a->mapWallet.count(pay_a.GetHash()));
+        BOOST_CHECK(wallet_a->mapWallet.count(spend_a.GetHash()));
+        BOOST_CHECK_EQUAL(wallet_a->mapWallet.at(spend_a.GetHash()).nIndex, 2);
+    }
+    {
+        LOCK(wallet_b->cs_wallet);
+        BOOST_CHECK(wallet_b->mapWallet.empty());
+    }
+
+    AddKey(*wallet_b, key_b);
+    CMutableTransaction pay_b;
+    pay_b.vin.emplace_back(GetRandHash(), 0);
+    pay_b.vout.emplace_back(1 * COIN, GetScriptForRawPubKey(key_b.GetPubKey()));
+    dispatcher.TransactionAddedToMempool(MakeTransactionRef(pay_b), 0 /* mempool_sequence */);
+    {
+        LOCK(wallet_b->cs_wallet);
+        BOOST_CHECK_EQUAL(wallet_b->mapWallet.size(), 1U);
+        BOOST_CHECK(wallet_b->mapWallet.at(pay_b.GetHash()).fInMempool);
+    }
+    dispatcher.TransactionRemovedFromMempool(MakeTransactionRef(pay_b), 0 /* mempool_sequence */);
+    {
+        LOCK(wallet_b->cs_wallet);
+        BOOST_CHECK(!wallet_b->mapWallet.at(pay_b.GetHash()).fInMempool);
+    }
+
+    dispatcher.DetachWallet(wallet_a);
+    dispatcher.DetachWallet(wallet_b);
+}
+
+static UniValue ImportRequest(const CKeyID& address, const std::string& key)
+{
+    UniValue script_pub_key(UniValue::VOBJ);
+    script_pub_key.pushKV("address", EncodeDestination(address));
+    UniValue keys(UniValue::VARR);
+    keys.push_back(key);
+    UniValue request(UniValue::VOBJ);
+    request.pushKV("scriptPubKey", script_pub_key);
+    request.pushKV("timestamp", "now");
+    request.pushKV("keys", keys);
+    request.pushKV("label", "imported");
+    return request;
+}
+
+// importmulti writes all requests in one database transaction, with the
+// private keys decoded on several threads, and still reports each request on
+// its own.
+BOOST_AUTO_TEST_CASE(importmulti_batch)
+{
+    const fs::path wallet_path = GetDataDir() / "importmulti_batch";
+    std::vector<CKey> keys(100);
+    CKey other;
+    other.MakeNewKey(true);
+    {
+        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>("importmulti_batch", MakeUnique<LevelDBDatabase>(wallet_path));
+        bool first_run;
+        BOOST_CHECK(wallet->LoadWallet(first_run) == DBErrors::LOAD_OK);
+        AddWallet(wallet);
+
+        UniValue requests(UniValue::VARR);
+        for (CKey& key : keys) {
+            key.MakeNewKey(true);
+            requests.push_back(ImportRequest(key.GetPubKey().GetID(), EncodeSecret(key)));
+        }
+        requests.push_back(ImportRequest(other.GetPubKey().GetID(), "not a key"));
+        requests.push_back(ImportRequest(other.GetPubKey().GetID(), EncodeSecret(keys[0])));
+        UniValue options(UniValue::VOBJ);
+        options.pushKV("rescan", false);
+        JSONRPCRequest request;
+        request.params.setArray();
+        request.params.push_back(requests);
+        request.params.push_back(options);
+
+        const UniValue response = importmulti(request);
+        BOOST_REQUIRE_EQUAL(response.size(), keys.size() + 2);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            BOOST_CHECK(response[i]["success"].get_bool());
+        }
+        BOOST_CHECK_EQUAL(response[keys.size()]["error"]["message"].get_str(), "Invalid private key encoding");
+        BOOST_CHECK_EQUAL(response[keys.size() + 1]["error"]["message"].get_str(), "Consistency check failed");
+        RemoveWallet(wallet);
+        wallet->Flush(true);
+    }
+
+    // The imported keys and labels were committed to the database
+    CWallet wallet("importmulti_batch", MakeUnique<LevelDBDatabase>(wallet_path));
+    bool first_run;
+    BOOST_CHECK(wallet.LoadWallet(first_run) == DBErrors::LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    for (const CKey& key : keys) {
+        const CKeyID keyid = key.GetPubKey().GetID();
+        BOOST_CHECK(wallet.HaveKey(keyid));
+        BOOST_CHECK_EQUAL(wallet.mapAddressBook.at(keyid).name, "imported");
+    }
+    BOOST_CHECK(!wallet.HaveKey(other.GetPubKey().GetID()));
+}
+
+static UniValue WatchOnlyRequest(const CKeyID& address)
+{
+    UniValue script_pub_key(UniValue::VOBJ);
+    script_pub_key.pushKV("address", EncodeDestination(address));
+    UniValue request(UniValue::VOBJ);
+    request.pushKV("scriptPubKey", script_pub_key);
+    request.pushKV("timestamp", "now");
+    request.pushKV("label", "watched");
+    return request;
+}
+
+static JSONRPCRequest ImportMultiRequest(const UniValue& requests)
+{
+    UniValue options(UniValue::VOBJ);
+    options.pushKV("rescan", false);
+    JSONRPCRequest request;
+    request.params.setArray();
+    request.params.push_back(requests);
+    request.params.push_back(options);
+    return request;
+}
+
+BOOST_AUTO_TEST_CASE(importmulti_bdb)
+{
+    // A large import fits in one BerkeleyDB transaction, and later requests
+    // are checked against the imports of earlier ones
+    const fs::path wallet_path = GetDataDir() / "importmulti_bdb";
+    std::vector<CKey> keys(10000);
+    {
+        std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>("importmulti_bdb", MakeUnique<BerkeleyDatabase>(wallet_path));
+        bool first_run;
+        BOOST_CHECK(wallet->LoadWallet(first_run) == DBErrors::LOAD_OK);
+        AddWallet(wallet);
+
+        UniValue requests(UniValue::VARR);
+        for (CKey& key : keys) {
+            key.MakeNewKey(true);
+            requests.push_back(ImportRequest(key.GetPubKey().GetID(), EncodeSecret(key)));
+        }
+        requests.push_back(ImportRequest(keys[0].GetPubKey().GetID(), EncodeSecret(keys[0])));
+        requests.push_back(WatchOnlyRequest(keys[1].GetPubKey().GetID()));
+        UniValue not_a_string = WatchOnlyRequest(keys[2].GetPubKey().GetID());
+        UniValue not_a_string_keys(UniValue::VARR);
+        not_a_string_keys.push_back(2);
+        not_a_string.pushKV("keys", not_a_string_keys);
+        requests.push_back(not_a_string);
+
+        const UniValue response = importmulti(ImportMultiRequest(requests));
+        BOOST_REQUIRE_EQUAL(response.size(), keys.size() + 3);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            BOOST_CHECK(response[i]["success"].get_bool());
+        }
+        BOOST_CHECK_EQUAL(response[keys.size()]["error"]["message"].get_str(), "The wallet already contains the private key for this address or script");
+        BOOST_CHECK_EQUAL(response[keys.size() + 1]["error"]["message"].get_str(), "The wallet already contains the private key for this address or script");
+        BOOST_CHECK_EQUAL(response[keys.size() + 2]["error"]["message"].get_str(), "Private keys must be strings");
+        RemoveWallet(wallet);
+        wallet->Flush(false);
+    }
+
+    std::unique_ptr<CWallet> wallet = MakeUnique<CWallet>("importmulti_bdb", MakeUnique<BerkeleyDatabase>(wallet_path));
+    bool first_run;
+    BOOST_CHECK(wallet->LoadWallet(first_run) == DBErrors::LOAD_OK);
+    {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK_EQUAL(wallet->GetKeys().size(), keys.size());
+        BOOST_CHECK(!wallet->HaveWatchOnly());
+        BOOST_CHECK_EQUAL(wallet->mapAddressBook.size(), keys.size());
+    }
+    wallet->Flush(true);
+}
+
+BOOST_AUTO_TEST_CASE(importmulti_failure)
+{
+    std::unique_ptr<FailingDatabase> database = MakeUnique<FailingDatabase>();
+    FailingDatabase& db = *database;
+    std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>("importmulti_failure", std::move(database));
+    AddWallet(wallet);
+
+    CKey key, watched;
+    key.MakeNewKey(true);
+    watched.MakeNewKey(true);
+    UniValue requests(UniValue::VARR);
+    requests.push_back(ImportRequest(key.GetPubKey().GetID(), EncodeSecret(key)));
+    requests.push_back(WatchOnlyRequest(watched.GetPubKey().GetID()));
+
+    // An import that fails to be written leaves the wallet as it was, on
+    // disk and in memory
+    db.m_writes_left = 3;
+    BOOST_CHECK_THROW(importmulti(ImportMultiRequest(requests)), UniValue);
+    BOOST_CHECK(db.m_records.empty());
+    {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK(wallet->GetKeys().empty());
+        BOOST_CHECK(!wallet->HaveWatchOnly());
+        BOOST_CHECK(wallet->mapAddressBook.empty());
+        BOOST_CHECK(wallet->mapKeyMetadata.empty());
+    }
+
+    db.m_writes_left = std::numeric_limits<int>::max();
+    const UniValue response = importmulti(ImportMultiRequest(requests));
+    BOOST_CHECK(response[0]["success"].get_bool());
+    BOOST_CHECK(response[1]["success"].get_bool());
+    {
+        LOCK(wallet->cs_wallet);
+        BOOST_CHECK(wallet->HaveKey(key.GetPubKey().GetID()));
+        BOOST_CHECK(wallet->HaveWatchOnly(GetScriptForDestination(watched.GetPubKey().GetID())));
+        BOOST_CHECK_EQUAL(wallet->mapAddressBook.size(), 2U);
+    }
+    RemoveWallet(wallet);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
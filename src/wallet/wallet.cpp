@@ -7,9 +7,11 @@
 
 #include <checkpoints.h>
 #include <chain.h>
+#include <wallet/blockdispatcher.h>
 #include <wallet/coincontrol.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/ripemd160.h>
 #include <fs.h>
 #include <key.h>
 #include <key_io.h>
@@ -31,7 +33,11 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -52,11 +58,14 @@ bool AddWallet(const std::shared_ptr<CWallet>& wallet)
 
 bool RemoveWallet(const std::shared_ptr<CWallet>& wallet)
 {
-    LOCK(cs_wallets);
-    assert(wallet);
-    std::vector<std::shared_ptr<CWallet>>::iterator i = std::find(vpwallets.begin(), vpwallets.end(), wallet);
-    if (i == vpwallets.end()) return false;
-    vpwallets.erase(i);
+    {
+        LOCK(cs_wallets);
+        assert(wallet);
+        std::vector<std::shared_ptr<CWallet>>::iterator i = std::find(vpwallets.begin(), vpwallets.end(), wallet);
+        if (i == vpwallets.end()) return false;
+        vpwallets.erase(i);
+    }
+    g_wallet_dispatcher.DetachWallet(wallet);
     return true;
 }
 
@@ -176,52 +185,69 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
 }
 
 CPubKey CWallet::GenerateNewKey(WalletBatch &batch, bool internal)
+{
+    AssertLockHeld(cs_wallet);
+    CHDChain hd_chain = hdChain;
+    const NewKeys keys = MakeNewKeys(hd_chain, 1, internal);
+    if (!WriteNewKeys(batch, keys)) {
+        throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+    }
+    // update the chain model in the database
+    if (IsHDEnabled() && !batch.WriteHDChain(hd_chain)) {
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+    }
+    SetHDChain(hd_chain, true);
+    AddNewKeys(keys);
+    return keys.pubkeys.front();
+}
+
+CWallet::NewKeys CWallet::MakeNewKeys(CHDChain& hd_chain, size_t count, bool internal)
 {
     assert(!IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
-    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    AssertLockHeld(cs_wallet);
     bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
-    CKey secret;
+    NewKeys keys;
+    if (count == 0) return keys;
+    keys.secrets.resize(count);
+    keys.pubkeys.resize(count);
 
     // Create new metadata
     int64_t nCreationTime = GetTime();
-    CKeyMetadata metadata(nCreationTime);
+    keys.metadata.assign(count, CKeyMetadata(nCreationTime));
 
     // use HD key derivation if HD was enabled during wallet creation
     if (IsHDEnabled()) {
-        DeriveNewChildKey(batch, metadata, secret, (CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false));
+        DeriveNewChildKeys(hd_chain, keys.metadata, keys.secrets, keys.pubkeys, (CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false));
     } else {
-        secret.MakeNewKey(fCompressed);
-    }
-
-    // Compressed public keys were introduced in version 0.6.0
-    if (fCompressed) {
-        SetMinVersion(FEATURE_COMPRPUBKEY);
-    }
-
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
-
-    mapKeyMetadata[pubkey.GetID()] = metadata;
-    UpdateTimeFirstKey(nCreationTime);
-
-    if (!AddKeyPubKeyWithDB(batch, secret, pubkey)) {
-        throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+        ParallelFor(count, MAX_KEY_THREADS, MIN_KEYS_PER_THREAD, [&](size_t i) {
+            keys.secrets[i].MakeNewKey(fCompressed);
+            keys.pubkeys[i] = keys.secrets[i].GetPubKey();
+            assert(keys.secrets[i].VerifyPubKey(keys.pubkeys[i]));
+        });
+    }
+
+    if (IsCrypted()) {
+        keys.crypted_secrets.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (!EncryptKey(keys.secrets[i], keys.pubkeys[i], keys.crypted_secrets[i])) {
+                throw std::runtime_error(std::string(__func__) + ": encrypting key failed");
+            }
+        }
     }
-    return pubkey;
+    return keys;
 }
 
-void CWallet::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey& secret, bool internal)
+void CWallet::DeriveNewChildKeys(CHDChain& hd_chain, std::vector<CKeyMetadata>& metadata, std::vector<CKey>& secrets, std::vector<CPubKey>& pubkeys, bool internal)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey seed;                     //seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
     CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the seed
-    if (!GetKey(hdChain.seed_id, seed))
+    if (!GetKey(hd_chain.seed_id, seed))
         throw std::runtime_error(std::string(__func__) + ": seed not found");
 
     masterKey.SetSeed(seed.begin(), seed.size());
@@ -234,27 +260,112 @@ void CWallet::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey
     assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
 
-    // derive child key at next index, skip keys already known to the wallet
-    do {
-        // always derive hardened keys
-        // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
-        // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
-        if (internal) {
-            chainChildKey.Derive(childKey, hdChain.nInternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/1'/" + std::to_string(hdChain.nInternalChainCounter) + "'";
-            hdChain.nInternalChainCounter++;
+    uint32_t& nChainCounter = internal ? hd_chain.nInternalChainCounter : hd_chain.nExternalChainCounter;
+    const std::string keypath_prefix = internal ? "m/0'/1'/" : "m/0'/0'/";
+
+    // derive child keys at the next indexes, skip keys already known to the wallet
+    size_t derived = 0;
+    while (derived < secrets.size()) {
+        const size_t nChildren = secrets.size() - derived;
+        std::vector<CExtKey> childKeys(nChildren); //keys at m/0'/0'/<n>'
+        std::vector<CPubKey> childPubKeys(nChildren);
+        ParallelFor(nChildren, MAX_KEY_THREADS, MIN_KEYS_PER_THREAD, [&](size_t i) {
+            // always derive hardened keys
+            // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
+            // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
+            chainChildKey.Derive(childKeys[i], (nChainCounter + i) | BIP32_HARDENED_KEY_LIMIT);
+            childPubKeys[i] = childKeys[i].key.GetPubKey();
+            assert(childKeys[i].key.VerifyPubKey(childPubKeys[i]));
+        });
+        for (size_t i = 0; i < nChildren; ++i) {
+            if (HaveKey(childPubKeys[i].GetID())) continue;
+            secrets[derived] = childKeys[i].key;
+            pubkeys[derived] = childPubKeys[i];
+            metadata[derived].hdKeypath = keypath_prefix + std::to_string(nChainCounter + i) + "'";
+            metadata[derived].hd_seed_id = hd_chain.seed_id;
+            ++derived;
+        }
+        nChainCounter += nChildren;
+    }
+}
+
+bool CWallet::WriteNewKeys(WalletBatch& batch, const NewKeys& keys)
+{
+    AssertLockHeld(cs_wallet);
+    for (size_t i = 0; i < keys.pubkeys.size(); ++i) {
+        const CPubKey& pubkey = keys.pubkeys[i];
+        // the keys replace watch-only scripts for them
+        for (const CScript& script : {GetScriptForDestination(pubkey.GetID()), GetScriptForRawPubKey(pubkey)}) {
+            if (HaveWatchOnly(script) && !batch.EraseWatchOnly(script)) return false;
+        }
+        if (keys.crypted_secrets.empty()) {
+            if (!batch.WriteKey(pubkey, keys.secrets[i].GetPrivKey(), keys.metadata[i])) return false;
+        } else {
+            if (!batch.WriteCryptedKey(pubkey, keys.crypted_secrets[i], keys.metadata[i])) return false;
         }
-        else {
-            chainChildKey.Derive(childKey, hdChain.nExternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/0'/" + std::to_string(hdChain.nExternalChainCounter) + "'";
-            hdChain.nExternalChainCounter++;
+    }
+    return true;
+}
+
+void CWallet::AddNewKeys(const NewKeys& keys)
+{
+    AssertLockHeld(cs_wallet);
+    // Compressed public keys were introduced in version 0.6.0
+    if (!keys.pubkeys.empty() && keys.pubkeys.front().IsCompressed()) {
+        SetMinVersion(FEATURE_COMPRPUBKEY);
+    }
+
+    for (size_t i = 0; i < keys.pubkeys.size(); ++i) {
+        const CPubKey& pubkey = keys.pubkeys[i];
+        LoadKeyMetadata(pubkey.GetID(), keys.metadata[i]);
+        if (!(keys.crypted_secrets.empty() ? LoadKey(keys.secrets[i], pubkey) : LoadCryptedKey(pubkey, keys.crypted_secrets[i]))) {
+            throw std::runtime_error(std::string(__func__) + ": AddKey failed");
         }
-    } while (HaveKey(childKey.key.GetPubKey().GetID()));
-    secret = childKey.key;
-    metadata.hd_seed_id = hdChain.seed_id;
-    // update the chain model in the database
-    if (!batch.WriteHDChain(hdChain))
-        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+        for (const CScript& script : {GetScriptForDestination(pubkey.GetID()), GetScriptForRawPubKey(pubkey)}) {
+            if (HaveWatchOnly(script)) {
+                CCryptoKeyStore::RemoveWatchOnly(script);
+                if (!HaveWatchOnly()) NotifyWatchonlyChanged(false);
+            }
+        }
+    }
+}
+
+bool CWallet::WriteImports(WalletBatch& batch, const Imports& imports)
+{
+    AssertLockHeld(cs_wallet);
+    for (const auto& entry : imports.watch_only) {
+        auto it = m_script_metadata.find(CScriptID(entry.first));
+        CKeyMetadata meta = it != m_script_metadata.end() ? it->second : CKeyMetadata();
+        meta.nCreateTime = entry.second;
+        if (!batch.WriteWatchOnly(entry.first, meta)) return false;
+    }
+    for (const CScript& script : imports.scripts) {
+        if (!batch.WriteCScript(Hash160(script), script)) return false;
+    }
+    for (const auto& label : imports.labels) {
+        const std::string address = EncodeDestination(label.first);
+        if (!batch.WritePurpose(address, "receive") || !batch.WriteName(address, label.second)) return false;
+    }
+    return WriteNewKeys(batch, imports.keys);
+}
+
+void CWallet::AddImports(const Imports& imports)
+{
+    AssertLockHeld(cs_wallet);
+    MarkDirty();
+    for (const auto& entry : imports.watch_only) {
+        m_script_metadata[CScriptID(entry.first)].nCreateTime = entry.second;
+        CCryptoKeyStore::AddWatchOnly(entry.first);
+        UpdateTimeFirstKey(entry.second);
+        NotifyWatchonlyChanged(true);
+    }
+    for (const CScript& script : imports.scripts) {
+        CCryptoKeyStore::AddCScript(script);
+    }
+    AddNewKeys(imports.keys);
+    for (const auto& label : imports.labels) {
+        UpdateAddressBook(label.first, label.second, "receive");
+    }
 }
 
 bool CWallet::AddKeyPubKeyWithDB(WalletBatch &batch, const CKey& secret, const CPubKey &pubkey)
@@ -278,11 +389,11 @@ bool CWallet::AddKeyPubKeyWithDB(WalletBatch &batch, const CKey& secret, const C
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(batch, script);
     }
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(batch, script);
     }
 
     if (!IsCrypted()) {
@@ -391,13 +502,19 @@ bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    WalletBatch batch(*database);
+    return RemoveWatchOnlyWithDB(batch, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(WalletBatch &batch, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!WalletBatch(*database).EraseWatchOnly(dest))
+    if (!batch.EraseWatchOnly(dest))
         return false;
 
     return true;
@@ -616,7 +733,9 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
+    AssertLockHeld(cs_wallet);
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
+    m_unspent_dirty.insert(outpoint.hash);
 
     setLockedCoins.erase(outpoint);
 
@@ -890,6 +1009,60 @@ bool CWallet::GetLabelDestination(CTxDestination &dest, const std::string& label
     return true;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet) {
+        pwallet->MarkUnspentDirty(GetHash());
+    }
+}
+
+bool CWallet::HasUnspentOutputs(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (!IsSpent(hash, i) && IsMine(wtx.tx->vout[i]) != ISMINE_NO) return true;
+    }
+    return false;
+}
+
+std::vector<const CWalletTx*> CWallet::GetUnspentTxs() const
+{
+    AssertLockHeld(cs_wallet);
+    for (const uint256& hash : m_unspent_dirty) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end() && HasUnspentOutputs(it->second)) {
+            m_unspent_txids.insert(hash);
+        } else {
+            m_unspent_txids.erase(hash);
+        }
+    }
+    m_unspent_dirty.clear();
+
+    std::vector<const CWalletTx*> result;
+    result.reserve(m_unspent_txids.size());
+    for (auto hash_it = m_unspent_txids.begin(); hash_it != m_unspent_txids.end();) {
+        auto it = mapWallet.find(*hash_it);
+        if (it == mapWallet.end()) {
+            // Removed by ZapWalletTx / ZapSelectTx
+            hash_it = m_unspent_txids.erase(hash_it);
+            continue;
+        }
+        result.push_back(&it->second);
+        ++hash_it;
+    }
+    return result;
+}
+
 void CWallet::MarkDirty()
 {
     {
@@ -1092,6 +1265,16 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockI
     return false;
 }
 
+bool CWallet::InvolvesWalletTransactions(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (mapWallet.count(tx.GetHash())) return true;
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout)) return true;
+    }
+    return false;
+}
+
 bool CWallet::TransactionCanBeAbandoned(const uint256& hashTx) const
 {
     LOCK2(cs_main, cs_wallet);
@@ -1228,7 +1411,7 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
     MarkInputsDirty(ptx);
 }
 
-void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
+void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx, uint64_t mempool_sequence) {
     LOCK2(cs_main, cs_wallet);
     SyncTransaction(ptx);
 
@@ -1238,7 +1421,7 @@ void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx) {
     }
 }
 
-void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
+void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx, uint64_t mempool_sequence) {
     LOCK(cs_wallet);
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
@@ -1258,11 +1441,11 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
 
     for (const CTransactionRef& ptx : vtxConflicted) {
         SyncTransaction(ptx);
-        TransactionRemovedFromMempool(ptx);
+        TransactionRemovedFromMempool(ptx, 0 /* mempool_sequence */);
     }
     for (size_t i = 0; i < pblock->vtx.size(); i++) {
         SyncTransaction(pblock->vtx[i], pindex, i);
-        TransactionRemovedFromMempool(pblock->vtx[i]);
+        TransactionRemovedFromMempool(pblock->vtx[i], 0 /* mempool_sequence */);
     }
 
     m_last_block_processed = pindex;
@@ -1278,6 +1461,80 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
 
 
 
+void CWallet::SyncMatchedTransactions(const std::vector<CTransactionRef>& txs, const std::vector<size_t>& matched, uint64_t generation, const CBlockIndex* pindex, bool removed_from_mempool)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    auto sync = [&](size_t pos) {
+        SyncTransaction(txs[pos], pindex, pindex ? pos : 0);
+        if (removed_from_mempool) TransactionRemovedFromMempool(txs[pos], 0 /* mempool_sequence */);
+    };
+
+    // Keys are added under cs_wallet, so once it is held only syncing a
+    // transaction (by a keypool top up) can move the keystore on
+    size_t next = 0;
+    if (GetGeneration() == generation) {
+        // Transactions were matched before the earlier ones were added to the
+        // wallet, so spends of those are not matched yet
+        std::set<uint256> added;
+        auto spends_added = [&](const CTransaction& tx) {
+            for (const CTxIn& txin : tx.vin) {
+                if (added.count(txin.prevout.hash)) return true;
+            }
+            return false;
+        };
+        auto next_match = matched.begin();
+        for (; next < txs.size(); ++next) {
+            if (next_match != matched.end() && *next_match == next) {
+                ++next_match;
+            } else if (added.empty() || !spends_added(*txs[next])) {
+                continue;
+            }
+            sync(next);
+            if (mapWallet.count(txs[next]->GetHash())) added.insert(txs[next]->GetHash());
+            if (GetGeneration() != generation) {
+                ++next;
+                break;
+            }
+        }
+        if (next == txs.size()) return;
+    }
+
+    // Keys were added since the transactions were matched: match the rest again
+    std::shared_ptr<const CWalletScanFilter> filter;
+    for (size_t pos = next; pos < txs.size(); ++pos) {
+        if (!filter || filter->m_generation != GetGeneration()) filter = GetScanFilter();
+        if (filter->MayBeMine(*txs[pos]) || InvolvesWalletTransactions(*txs[pos])) sync(pos);
+    }
+}
+
+void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx, const WalletMatches& matches)
+{
+    LOCK2(cs_main, cs_wallet);
+    SyncMatchedTransactions({ptx}, matches.txs, matches.generation, nullptr, false);
+
+    auto it = mapWallet.find(ptx->GetHash());
+    if (it != mapWallet.end()) {
+        it->second.fInMempool = true;
+    }
+}
+
+void CWallet::BlockConnected(const CBlock& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted, const WalletMatches& matches)
+{
+    LOCK2(cs_main, cs_wallet);
+    // Conflicts first, see BlockConnected above
+    SyncMatchedTransactions(vtxConflicted, matches.conflicted, matches.generation, nullptr, true);
+    SyncMatchedTransactions(block.vtx, matches.txs, matches.generation, pindex, true);
+
+    m_last_block_processed = pindex;
+}
+
+void CWallet::BlockDisconnected(const CBlock& block, const WalletMatches& matches)
+{
+    LOCK2(cs_main, cs_wallet);
+    SyncMatchedTransactions(block.vtx, matches.txs, matches.generation, nullptr, false);
+}
+
 void CWallet::BlockUntilSyncedToCurrentChain() {
     AssertLockNotHeld(cs_main);
     AssertLockNotHeld(cs_wallet);
@@ -1697,6 +1954,210 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+CWalletScanFilter::IdType CWalletScanFilter::GetScanId(const CScript& script, uint160& id)
+{
+    std::vector<std::vector<unsigned char>> solutions;
+    txnouttype type;
+    Solver(script, type, solutions);
+    switch (type) {
+    case TX_PUBKEY:
+        id = CPubKey(solutions[0]).GetID();
+        return IdType::KEY;
+    case TX_PUBKEYHASH:
+    case TX_WITNESS_V0_KEYHASH:
+        id = uint160(solutions[0]);
+        return IdType::KEY;
+    case TX_SCRIPTHASH:
+        id = uint160(solutions[0]);
+        return IdType::SCRIPT;
+    case TX_WITNESS_V0_SCRIPTHASH:
+        CRIPEMD160().Write(solutions[0].data(), solutions[0].size()).Finalize(id.begin());
+        return IdType::SCRIPT;
+    default:
+        // Bare multisig and everything else can only be mine as a watch-only script
+        return IdType::NONE;
+    }
+}
+
+bool CWalletScanFilter::MayBeMine(const CScript& script) const
+{
+    if (m_watch_only.count(script)) return true;
+
+    uint160 id;
+    switch (GetScanId(script, id)) {
+    case IdType::KEY:
+        return m_keys.count(CKeyID(id)) > 0;
+    case IdType::SCRIPT:
+        return m_scripts.count(CScriptID(id)) > 0;
+    case IdType::NONE:
+        return false;
+    }
+    assert(false);
+}
+
+bool CWalletScanFilter::MayBeMine(const CTransaction& tx) const
+{
+    for (const CTxOut& txout : tx.vout) {
+        if (MayBeMine(txout.scriptPubKey)) return true;
+    }
+    return false;
+}
+
+std::shared_ptr<const CWalletScanFilter> CWallet::GetScanFilter() const
+{
+    LOCK(cs_KeyStore);
+    return std::make_shared<const CWalletScanFilter>(GetKeys(), GetCScripts(), setWatchOnly, m_generation);
+}
+
+namespace {
+
+//! A block read and matched by a rescan worker, waiting to be applied to the wallet
+struct RescanBlock
+{
+    CBlockIndex* pindex = nullptr;
+    CBlock block;
+    bool read_ok = false;
+    //! Per transaction: whether any of its outputs may be mine
+    std::vector<bool> may_be_mine;
+    //! Generation of the filter may_be_mine was computed with
+    uint64_t generation = 0;
+
+    void Match(const CWalletScanFilter& filter)
+    {
+        may_be_mine.resize(block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            may_be_mine[i] = filter.MayBeMine(*block.vtx[i]);
+        }
+        generation = filter.m_generation;
+    }
+};
+
+/**
+ * Reads the blocks of a rescan on worker threads, up to RESCAN_PREFETCH_BLOCKS
+ * ahead of the block being applied, and matches their outputs against a
+ * CWalletScanFilter. Blocks are handed out in chain order by Take().
+ *
+ * Only the thread calling Take() walks the chain and looks up block
+ * positions, so the workers never need cs_main and the caller may hold it. Successors are looked up as blocks are
+ * taken, so blocks connected while the rescan runs are picked up as they
+ * would be by a sequential scan.
+ */
+class RescanBlockReader
+{
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Blocks queued for reading, and the sequence number of the first one
+    std::deque<std::pair<CBlockIndex*, CDiskBlockPos>> m_to_read;
+    int m_to_read_seq = 0;
+    std::map<int, RescanBlock> m_read;
+    int m_next_take_seq = 0;
+    bool m_interrupt = false;
+    std::shared_ptr<const CWalletScanFilter> m_filter;
+    std::vector<std::thread> m_threads;
+
+    // Only accessed by the thread calling Take()
+    CBlockIndex* const m_start;
+    CBlockIndex* const m_stop;
+    CBlockIndex* m_last_queued = nullptr;
+    int m_queued_seq = 0;
+
+    void ThreadRead()
+    {
+        RenameThread("litecoin-rescan");
+        while (true) {
+            RescanBlock item;
+            CDiskBlockPos pos;
+            int seq;
+            std::shared_ptr<const CWalletScanFilter> filter;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this] { return m_interrupt || !m_to_read.empty(); });
+                if (m_interrupt) return;
+                item.pindex = m_to_read.front().first;
+                pos = m_to_read.front().second;
+                m_to_read.pop_front();
+                seq = m_to_read_seq++;
+                filter = m_filter;
+            }
+            item.read_ok = ReadBlockFromDisk(item.block, pos, Params().GetConsensus()) && item.block.GetHash() == item.pindex->GetBlockHash();
+            if (item.read_ok) item.Match(*filter);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_read.emplace(seq, std::move(item));
+            }
+            m_cond.notify_all();
+        }
+    }
+
+    //! Queue the blocks following the last queued one, up to the prefetch limit
+    void QueueBlocks()
+    {
+        std::vector<std::pair<CBlockIndex*, CDiskBlockPos>> blocks;
+        {
+            LOCK(cs_main);
+            while (m_queued_seq + (int)blocks.size() < m_next_take_seq + RESCAN_PREFETCH_BLOCKS) {
+                CBlockIndex* last = blocks.empty() ? m_last_queued : blocks.back().first;
+                CBlockIndex* next = last ? (last == m_stop ? nullptr : chainActive.Next(last)) : (m_queued_seq == 0 ? m_start : nullptr);
+                if (!next) break;
+                blocks.emplace_back(next, next->GetBlockPos());
+            }
+        }
+        if (blocks.empty()) return;
+        m_last_queued = blocks.back().first;
+        m_queued_seq += blocks.size();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_to_read.insert(m_to_read.end(), blocks.begin(), blocks.end());
+        }
+        m_cond.notify_all();
+    }
+
+public:
+    RescanBlockReader(CBlockIndex* start, CBlockIndex* stop, std::shared_ptr<const CWalletScanFilter> filter, int threads)
+        : m_filter(std::move(filter)), m_start(start), m_stop(stop)
+    {
+        for (int i = 0; i < threads; ++i) {
+            m_threads.emplace_back(&RescanBlockReader::ThreadRead, this);
+        }
+    }
+
+    ~RescanBlockReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_interrupt = true;
+        }
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    //! Use filter for blocks matched from now on
+    void SetFilter(std::shared_ptr<const CWalletScanFilter> filter)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_filter = std::move(filter);
+    }
+
+    //! Wait for the next block in chain order. Returns false once the last block has been handed out.
+    bool Take(RescanBlock& item)
+    {
+        QueueBlocks();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_next_take_seq == m_queued_seq) return false;
+        m_cond.wait(lock, [this] { return m_read.count(m_next_take_seq) > 0; });
+        auto it = m_read.find(m_next_take_seq);
+        item = std::move(it->second);
+        m_read.erase(it);
+        ++m_next_take_seq;
+        return true;
+    }
+};
+
+} // namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1712,10 +2173,16 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * Caller needs to make sure pindexStop (and the optional pindexStart) are on
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
+ *
+ * Blocks are read and their outputs matched against the wallet's scripts on
+ * -rescanthreads worker threads (see RescanBlockReader). They are then applied
+ * in chain order, and only transactions that may be relevant are passed to
+ * SyncTransaction, so cs_wallet is only held briefly for each block.
  */
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver &reserver, bool fUpdate)
 {
     int64_t nNow = GetTime();
+    const int64_t nStartTime = GetTimeMillis();
     const CChainParams& chainParams = Params();
 
     assert(reserver.isReserved());
@@ -1745,37 +2212,74 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             }
         }
         double progress_current = progress_begin;
-        while (pindex && !fAbortRescan && !ShutdownRequested())
+
+        int nThreads = gArgs.GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+        if (nThreads <= 0) nThreads = GetNumCores();
+        nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
+        int64_t nBlocks = 0;
+        int64_t nTransactions = 0;
+        int64_t nLastLogTime = nStartTime;
+        int64_t nLastLogBlocks = 0;
+
+        RescanBlockReader reader(pindex, pindexStop, GetScanFilter(), nThreads);
+        RescanBlock item;
+        while (!fAbortRescan && !ShutdownRequested())
         {
+            if (!reader.Take(item)) {
+                pindex = nullptr;
+                break;
+            }
+            pindex = item.pindex;
+
             if (pindex->nHeight % 100 == 0 && progress_end - progress_begin > 0.0) {
                 ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), std::max(1, std::min(99, (int)((progress_current - progress_begin) / (progress_end - progress_begin) * 100))));
             }
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, progress_current);
+                const int64_t nTimeNow = GetTimeMillis();
+                WalletLogPrintf("Still rescanning. At block %d. Progress=%f (%.2f blocks/s)\n", pindex->nHeight, progress_current,
+                    (nBlocks - nLastLogBlocks) * 1000.0 / std::max<int64_t>(1, nTimeNow - nLastLogTime));
+                nLastLogTime = nTimeNow;
+                nLastLogBlocks = nBlocks;
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                LOCK2(cs_main, cs_wallet);
-                if (pindex && !chainActive.Contains(pindex)) {
-                    // Abort scan if current block is no longer active, to prevent
-                    // marking transactions as coming from the wrong block.
-                    ret = pindex;
-                    break;
-                }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    SyncTransaction(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+            if (item.read_ok) {
+                std::shared_ptr<const CWalletScanFilter> new_filter;
+                {
+                    LOCK2(cs_main, cs_wallet);
+                    if (!chainActive.Contains(pindex)) {
+                        // Abort scan if current block is no longer active, to prevent
+                        // marking transactions as coming from the wrong block.
+                        ret = pindex;
+                        break;
+                    }
+                    for (size_t posInBlock = 0; posInBlock < item.block.vtx.size(); ++posInBlock) {
+                        // Keys added since the block was matched (by a keypool
+                        // top up in SyncTransaction, or an import) must be
+                        // matched against the rest of the block as well.
+                        if (item.generation != GetGeneration()) {
+                            new_filter = GetScanFilter();
+                            item.Match(*new_filter);
+                        }
+                        const CTransactionRef& ptx = item.block.vtx[posInBlock];
+                        if (item.may_be_mine[posInBlock] || InvolvesWalletTransactions(*ptx)) {
+                            SyncTransaction(ptx, pindex, posInBlock, fUpdate);
+                        }
+                    }
                 }
+                if (new_filter) reader.SetFilter(std::move(new_filter));
             } else {
                 ret = pindex;
             }
+            ++nBlocks;
+            nTransactions += item.block.vtx.size();
             if (pindex == pindexStop) {
+                pindex = nullptr;
                 break;
             }
             {
                 LOCK(cs_main);
-                pindex = chainActive.Next(pindex);
                 progress_current = GuessVerificationProgress(chainParams.TxData(), pindex);
                 if (pindexStop == nullptr && tip != chainActive.Tip()) {
                     tip = chainActive.Tip();
@@ -1783,12 +2287,18 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                     progress_end = GuessVerificationProgress(chainParams.TxData(), tip);
                 }
             }
+            if (progress_end - progress_begin > 0.0) {
+                m_scanning_progress = (progress_current - progress_begin) / (progress_end - progress_begin);
+            }
         }
         if (pindex && fAbortRescan) {
             WalletLogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, progress_current);
         } else if (pindex && ShutdownRequested()) {
             WalletLogPrintf("Rescan interrupted by shutdown request at block %d. Progress=%f\n", pindex->nHeight, progress_current);
         }
+        const int64_t nElapsed = std::max<int64_t>(1, GetTimeMillis() - nStartTime);
+        WalletLogPrintf("Rescan scanned %d blocks (%d transactions) in %dms using %d threads (%.2f blocks/s)\n",
+            nBlocks, nTransactions, nElapsed, nThreads, nBlocks * 1000.0 / nElapsed);
         ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), 100); // hide progress dialog in GUI
     }
     return ret;
@@ -2113,9 +2623,8 @@ CAmount CWallet::GetBalance(const isminefilter& filter, const int min_depth) con
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        for (const CWalletTx* pcoin : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &entry.second;
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() >= min_depth) {
                 nTotal += pcoin->GetAvailableCredit(true, filter);
             }
@@ -2130,9 +2639,8 @@ CAmount CWallet::GetUnconfirmedBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        for (const CWalletTx* pcoin : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &entry.second;
             if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
                 nTotal += pcoin->GetAvailableCredit();
         }
@@ -2145,9 +2653,8 @@ CAmount CWallet::GetImmatureBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        for (const CWalletTx* pcoin : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &entry.second;
             nTotal += pcoin->GetImmatureCredit();
         }
     }
@@ -2159,9 +2666,8 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        for (const CWalletTx* pcoin : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &entry.second;
             if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
                 nTotal += pcoin->GetAvailableCredit(true, ISMINE_WATCH_ONLY);
         }
@@ -2174,9 +2680,8 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        for (const CWalletTx* pcoin : GetUnspentTxs())
         {
-            const CWalletTx* pcoin = &entry.second;
             nTotal += pcoin->GetImmatureWatchOnlyCredit();
         }
     }
@@ -2249,10 +2754,9 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
     vCoins.clear();
     CAmount nTotal = 0;
 
-    for (const auto& entry : mapWallet)
+    for (const CWalletTx* pcoin : GetUnspentTxs())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx* pcoin = &entry.second;
+        const uint256& wtxid = pcoin->GetHash();
 
         if (!CheckFinalTx(*pcoin->tx))
             continue;
@@ -2313,10 +2817,10 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
             if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(wtxid, i))
@@ -2413,7 +2917,7 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int out
     return ptx->vout[n];
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, const std::vector<OutputGroup>& groups,
                                  std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const
 {
     setCoinsRet.clear();
@@ -2431,9 +2935,10 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
         CAmount cost_of_change = GetDiscardRate(*this, ::feeEstimator).GetFee(coin_selection_params.change_spend_size) + coin_selection_params.effective_fee.GetFee(coin_selection_params.change_output_size);
 
         // Filter by the min conf specs and add to utxo_pool and calculate effective value
-        for (OutputGroup& group : groups) {
-            if (!group.EligibleForSpending(eligibility_filter)) continue;
+        for (const OutputGroup& eligible_group : groups) {
+            if (!eligible_group.EligibleForSpending(eligibility_filter)) continue;
 
+            OutputGroup group = eligible_group;
             group.fee = 0;
             group.long_term_fee = 0;
             group.effective_value = 0;
@@ -2450,20 +2955,23 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
                     it = group.Discard(coin);
                 }
             }
-            if (group.effective_value > 0) utxo_pool.push_back(group);
+            if (group.effective_value > 0) utxo_pool.push_back(std::move(group));
         }
         // Calculate the fees for things that aren't inputs
         CAmount not_input_fees = coin_selection_params.effective_fee.GetFee(coin_selection_params.tx_noinputs_size);
         bnb_used = true;
-        return SelectCoinsBnB(utxo_pool, nTargetValue, cost_of_change, setCoinsRet, nValueRet, not_input_fees);
+        return SelectCoinsBnB(utxo_pool, nTargetValue, cost_of_change, setCoinsRet, nValueRet, not_input_fees, coin_selection_params.budget);
     } else {
-        // Filter by the min conf specs and add to utxo_pool
+        bnb_used = false;
+        // Filter by the min conf specs, avoiding the copy when all groups are eligible
+        if (std::all_of(groups.begin(), groups.end(), [&](const OutputGroup& group) { return group.EligibleForSpending(eligibility_filter); })) {
+            return KnapsackSolver(nTargetValue, groups, setCoinsRet, nValueRet, coin_selection_params.budget);
+        }
         for (const OutputGroup& group : groups) {
             if (!group.EligibleForSpending(eligibility_filter)) continue;
             utxo_pool.push_back(group);
         }
-        bnb_used = false;
-        return KnapsackSolver(nTargetValue, utxo_pool, setCoinsRet, nValueRet);
+        return KnapsackSolver(nTargetValue, utxo_pool, setCoinsRet, nValueRet, coin_selection_params.budget);
     }
 }
 
@@ -2559,20 +3067,40 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
     AssertLockHeld(cs_wallet); // mapWallet
 
     // sign the new tx
-    int nIn = 0;
-    for (auto& input : tx.vin) {
+    std::vector<CTxOut> spent_outputs;
+    spent_outputs.reserve(tx.vin.size());
+    for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(*this, MutableTransactionSignatureCreator(&tx, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
-            return false;
+        spent_outputs.push_back(mi->second.tx->vout[input.prevout.n]);
+    }
+    return SignInputs(tx, spent_outputs);
+}
+
+bool CWallet::SignInputs(CMutableTransaction& tx, const std::vector<CTxOut>& spent_outputs) const
+{
+    assert(tx.vin.size() == spent_outputs.size());
+
+    // The segwit signature hashes of all inputs share these, so compute them once
+    const PrecomputedTransactionData txdata(tx);
+
+    // Produce all signatures before updating any input: the threads read tx
+    // while signing.
+    std::vector<SignatureData> sigdata(tx.vin.size());
+    std::atomic<bool> failed{false};
+    ParallelFor(tx.vin.size(), MAX_SIGNING_THREADS, MIN_INPUTS_PER_SIGNING_THREAD, [&](size_t nIn) {
+        if (failed) return;
+        const CTxOut& spent = spent_outputs[nIn];
+        if (!ProduceSignature(*this, MutableTransactionSignatureCreator(&tx, nIn, spent.nValue, &txdata, SIGHASH_ALL), spent.scriptPubKey, sigdata[nIn])) {
+            failed = true;
         }
-        UpdateInput(input, sigdata);
-        nIn++;
+    });
+    if (failed) return false;
+
+    for (size_t nIn = 0; nIn < tx.vin.size(); ++nIn) {
+        UpdateInput(tx.vin[nIn], sigdata[nIn]);
     }
     return true;
 }
@@ -2726,6 +3254,13 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CTransac
             std::vector<COutput> vAvailableCoins;
             AvailableCoins(vAvailableCoins, true, &coin_control);
             CoinSelectionParams coin_selection_params; // Parameters for coin selection, init with dummy
+            if (coin_control.m_max_selection_tries) {
+                coin_selection_params.budget.max_tries = *coin_control.m_max_selection_tries;
+            }
+            if (coin_control.m_selection_timeout) {
+                // One deadline for all selection attempts made while building this transaction
+                coin_selection_params.budget.deadline = GetTimeMicros() + *coin_control.m_selection_timeout * 1000;
+            }
 
             // Create change script that will be used if we need change
             // TODO: pass in scriptChange instead of reservekey so
@@ -2777,6 +3312,18 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CTransac
             // BnB selector is the only selector used when this is true.
             // That should only happen on the first pass through the loop.
             coin_selection_params.use_bnb = nSubtractFeeFromAmount == 0; // If we are doing subtract fee from recipient, then don't use BnB
+            if (coin_control.m_batch_payout && nSubtractFeeFromAmount == 0) {
+                // A changeless solution is unlikely with many outputs, so skip
+                // BnB and start with the fee for everything but the inputs.
+                // The fee for the inputs is then normally taken from the
+                // change, and the coins only have to be selected once.
+                coin_selection_params.use_bnb = false;
+                unsigned int tx_noinputs_size = 11 + coin_selection_params.change_output_size;
+                for (const auto& recipient : vecSend) {
+                    tx_noinputs_size += ::GetSerializeSize(CTxOut(recipient.nAmount, recipient.scriptPubKey), SER_NETWORK, PROTOCOL_VERSION);
+                }
+                nFeeRet = GetMinimumFee(*this, tx_noinputs_size, coin_control, ::mempool, ::feeEstimator, nullptr);
+            }
             // Start with no fee and loop until there is enough fee
             while (true)
             {
@@ -3003,21 +3550,15 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CTransac
 
         if (sign)
         {
-            int nIn = 0;
-            for (const auto& coin : selected_coins)
+            std::vector<CTxOut> spent_outputs;
+            spent_outputs.reserve(selected_coins.size());
+            for (const auto& coin : selected_coins) {
+                spent_outputs.push_back(coin.txout);
+            }
+            if (!SignInputs(txNew, spent_outputs))
             {
-                const CScript& scriptPubKey = coin.txout.scriptPubKey;
-                SignatureData sigdata;
-
-                if (!ProduceSignature(*this, MutableTransactionSignatureCreator(&txNew, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateInput(txNew.vin.at(nIn), sigdata);
-                }
-
-                nIn++;
+                strFailReason = _("Signing transaction failed");
+                return false;
             }
         }
 
@@ -3224,6 +3765,14 @@ DBErrors CWallet::ZapWalletTx(std::vector<CWalletTx>& vWtx)
 
 
 bool CWallet::SetAddressBook(const CTxDestination& address, const std::string& strName, const std::string& strPurpose)
+{
+    UpdateAddressBook(address, strName, strPurpose);
+    if (!strPurpose.empty() && !WalletBatch(*database).WritePurpose(EncodeDestination(address), strPurpose))
+        return false;
+    return WalletBatch(*database).WriteName(EncodeDestination(address), strName);
+}
+
+void CWallet::UpdateAddressBook(const CTxDestination& address, const std::string& strName, const std::string& strPurpose)
 {
     bool fUpdated = false;
     {
@@ -3236,9 +3785,6 @@ bool CWallet::SetAddressBook(const CTxDestination& address, const std::string& s
     }
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
                              strPurpose, (fUpdated ? CT_UPDATED : CT_NEW) );
-    if (!strPurpose.empty() && !WalletBatch(*database).WritePurpose(EncodeDestination(address), strPurpose))
-        return false;
-    return WalletBatch(*database).WriteName(EncodeDestination(address), strName);
 }
 
 bool CWallet::DelAddressBook(const CTxDestination& address)
@@ -3369,30 +3915,51 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
-        WalletBatch batch(*database);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
+        if (missingInternal + missingExternal > 0) {
+            // The new keys, their pool entries and the HD chain counters are
+            // committed together in one database transaction, and the wallet
+            // in memory is only changed once it is.
+            CHDChain hd_chain = hdChain;
+            const NewKeys external_keys = MakeNewKeys(hd_chain, missingExternal, false);
+            const NewKeys internal_keys = MakeNewKeys(hd_chain, missingInternal, true);
 
-            CPubKey pubkey(GenerateNewKey(batch, internal));
-            if (!batch.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+            WalletBatch batch(*database);
+            if (!batch.TxnBegin()) {
+                throw std::runtime_error(std::string(__func__) + ": TxnBegin failed");
+            }
+            int64_t index = m_max_keypool_index;
+            bool written = WriteNewKeys(batch, external_keys) && WriteNewKeys(batch, internal_keys);
+            for (bool internal : {false, true}) {
+                for (const CPubKey& pubkey : (internal ? internal_keys : external_keys).pubkeys) {
+                    assert(index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                    written = written && batch.WritePool(++index, CKeyPool(pubkey, internal));
+                }
+            }
+            if (IsHDEnabled()) {
+                written = written && batch.WriteHDChain(hd_chain);
+            }
+            if (!written) {
+                batch.TxnAbort();
+                throw std::runtime_error(std::string(__func__) + ": writing generated keys failed");
+            }
+            if (!batch.TxnCommit()) {
+                throw std::runtime_error(std::string(__func__) + ": committing generated keys failed");
             }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+            SetHDChain(hd_chain, true);
+            AddNewKeys(external_keys);
+            AddNewKeys(internal_keys);
+            for (bool internal : {false, true}) {
+                for (const CPubKey& pubkey : (internal ? internal_keys : external_keys).pubkeys) {
+                    int64_t pool_index = ++m_max_keypool_index;
+                    if (internal) {
+                        setInternalKeyPool.insert(pool_index);
+                    } else {
+                        setExternalKeyPool.insert(pool_index);
+                    }
+                    m_pool_key_to_index[pubkey.GetID()] = pool_index;
+                }
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
-        }
-        if (missingInternal + missingExternal > 0) {
             WalletLogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size() + set_pre_split_keypool.size(), setInternalKeyPool.size());
         }
     }
@@ -4332,8 +4899,8 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(const std::string& name,
 
     uiInterface.LoadWallet(walletInstance);
 
-    // Register with the validation interface. It's ok to do this after rescan since we're still holding cs_main.
-    RegisterValidationInterface(walletInstance.get());
+    // Receive validation notifications. It's ok to do this after rescan since we're still holding cs_main.
+    g_wallet_dispatcher.AttachWallet(walletInstance);
 
     walletInstance->SetBroadcastTransactions(gArgs.GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
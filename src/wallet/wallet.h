@@ -63,6 +63,24 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 static const bool DEFAULT_WALLET_RBF = false;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! -rescanthreads default (0 = auto)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of rescan worker threads
+static const int MAX_RESCAN_THREADS = 16;
+//! Number of blocks the rescan workers may read ahead of the block being applied to the wallet
+static const int RESCAN_PREFETCH_BLOCKS = 64;
+//! Number of recipients from which sendmany builds the transaction in batch payout mode
+static const size_t BATCH_PAYOUT_MIN_RECIPIENTS = 100;
+//! Maximum number of threads signing the inputs of a transaction
+static const int MAX_SIGNING_THREADS = 16;
+//! Minimum number of inputs per thread when signing a transaction
+static const size_t MIN_INPUTS_PER_SIGNING_THREAD = 8;
+//! Maximum number of threads deriving keypool keys or decoding wallet records at load
+static const int MAX_KEY_THREADS = 16;
+//! Minimum number of keys per thread when generating keys for the keypool
+static const size_t MIN_KEYS_PER_THREAD = 16;
+//! Minimum number of records per thread when loading a wallet
+static const size_t MIN_RECORDS_PER_LOAD_THREAD = 256;
 
 //! Pre-calculated constants for input size estimation in *virtual size*
 static constexpr size_t DUMMY_NESTED_P2WPKH_INPUT_SIZE = 91;
@@ -436,18 +454,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -655,11 +662,61 @@ struct CoinSelectionParams
     size_t change_spend_size = 0;
     CFeeRate effective_fee = CFeeRate(0);
     size_t tx_noinputs_size = 0;
+    CoinSelectionBudget budget;
 
     CoinSelectionParams(bool use_bnb, size_t change_output_size, size_t change_spend_size, CFeeRate effective_fee, size_t tx_noinputs_size) : use_bnb(use_bnb), change_output_size(change_output_size), change_spend_size(change_spend_size), effective_fee(effective_fee), tx_noinputs_size(tx_noinputs_size) {}
     CoinSelectionParams() {}
 };
 
+/**
+ * Immutable copy of the key IDs, script IDs and watch-only scripts of a wallet.
+ * Rescan worker threads use it to find the outputs that may belong to the
+ * wallet without holding cs_wallet. It errs on the side of matching: every
+ * output IsMine() accepts is matched, but not every matched output is mine.
+ */
+class CWalletScanFilter
+{
+private:
+    std::set<CKeyID> m_keys;
+    std::set<CScriptID> m_scripts;
+    std::set<CScript> m_watch_only;
+
+public:
+    //! Keystore generation (CBasicKeyStore::GetGeneration()) this filter was built from
+    const uint64_t m_generation;
+
+    CWalletScanFilter(std::set<CKeyID> keys, std::set<CScriptID> scripts, std::set<CScript> watch_only, uint64_t generation)
+        : m_keys(std::move(keys)), m_scripts(std::move(scripts)), m_watch_only(std::move(watch_only)), m_generation(generation) {}
+
+    enum class IdType { NONE, KEY, SCRIPT };
+    /** Get the key ID or script ID that a standard script pays to. Apart from
+     * watch-only scripts, a script may only be mine if its ID is in the filter. */
+    static IdType GetScanId(const CScript& script, uint160& id);
+
+    const std::set<CKeyID>& GetKeys() const { return m_keys; }
+    const std::set<CScriptID>& GetScripts() const { return m_scripts; }
+    const std::set<CScript>& GetWatchOnly() const { return m_watch_only; }
+
+    bool MayBeMine(const CScript& script) const;
+    //! Whether any output of tx may be mine
+    bool MayBeMine(const CTransaction& tx) const;
+};
+
+/**
+ * The transactions of a validation notification that may concern a wallet, as
+ * found by a WalletBlockDispatcher. The other transactions do not concern the
+ * wallet as long as its keystore is at generation.
+ */
+struct WalletMatches
+{
+    //! Keystore generation the transactions were matched against
+    uint64_t generation = 0;
+    //! Ascending positions of the matched transactions of the block (or the mempool transaction)
+    std::vector<size_t> txs;
+    //! Ascending positions of the matched conflicted transactions of a connected block
+    std::vector<size_t> conflicted;
+};
+
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
@@ -670,6 +727,8 @@ class CWallet final : public CCryptoKeyStore, public CValidationInterface
 private:
     std::atomic<bool> fAbortRescan{false};
     std::atomic<bool> fScanningWallet{false}; // controlled by WalletRescanReserver
+    std::atomic<int64_t> m_scanning_start{0};
+    std::atomic<double> m_scanning_progress{0};
     std::mutex mutexScanning;
     friend class WalletRescanReserver;
 
@@ -695,6 +754,25 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Transactions that may have unspent outputs which are mine, kept so that
+     * balance queries and AvailableCoins do not have to visit every wallet
+     * transaction. Transactions marked dirty (CWalletTx::MarkDirty) are
+     * rechecked by the next GetUnspentTxs() call. Fully spent ones are dropped
+     * until they are marked dirty again, which happens whenever a transaction
+     * spending them is added (AddToSpends), conflicted or abandoned.
+     */
+    mutable std::set<uint256> m_unspent_txids GUARDED_BY(cs_wallet);
+    mutable std::set<uint256> m_unspent_dirty GUARDED_BY(cs_wallet);
+    bool HasUnspentOutputs(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /**
+     * Whether tx is in the wallet, spends an output of a wallet transaction or
+     * conflicts with one. Together with IsMine(tx) this covers every way
+     * AddToWalletIfInvolvingMe can find tx relevant.
+     */
+    bool InvolvesWalletTransactions(const CTransaction& tx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     /**
      * Add a transaction to the wallet, or update it.  pIndex and posInBlock should
      * be set when the transaction was known to be included in a block.  When
@@ -722,11 +800,42 @@ private:
      * Should be called with pindexBlock and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, const CBlockIndex *pindex = nullptr, int posInBlock = 0, bool update_tx = true) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /** Sync the transactions of txs at the ascending positions in matched, and
+     * those spending outputs of synced ones. Once the keystore is no longer at
+     * generation, the remaining transactions are matched again against the
+     * current keys. */
+    void SyncMatchedTransactions(const std::vector<CTransactionRef>& txs, const std::vector<size_t>& matched, uint64_t generation, const CBlockIndex* pindex, bool removed_from_mempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, cs_wallet);
+
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
-    /* HD derive new child key (on internal or external chain) */
-    void DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey& secret, bool internal = false) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /* HD derive secrets.size() new child keys (on internal or external chain) and their public keys, filling in their metadata and advancing the counters of hd_chain past them */
+    void DeriveNewChildKeys(CHDChain& hd_chain, std::vector<CKeyMetadata>& metadata, std::vector<CKey>& secrets, std::vector<CPubKey>& pubkeys, bool internal = false) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+public:
+    /**
+     * New keys are made, written and added to the wallet in three steps, so
+     * that the wallet in memory only changes once the keys are in the
+     * database, possibly in a transaction that has to be committed first.
+     */
+    struct NewKeys
+    {
+        std::vector<CKey> secrets;
+        std::vector<CPubKey> pubkeys;
+        std::vector<CKeyMetadata> metadata;
+        //! The encrypted secrets, if the wallet is encrypted
+        std::vector<std::vector<unsigned char>> crypted_secrets;
+    };
+
+private:
+    /** Make count new keys, derived from hd_chain if HD is enabled, without changing the wallet */
+    NewKeys MakeNewKeys(CHDChain& hd_chain, size_t count, bool internal) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Write keys made by MakeNewKeys to the database, and erase any watch-only records they replace */
+    bool WriteNewKeys(WalletBatch& batch, const NewKeys& keys) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Add keys written by WriteNewKeys to the wallet in memory */
+    void AddNewKeys(const NewKeys& keys) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Set the label and, if not empty, the purpose of an address in memory, and notify about it */
+    void UpdateAddressBook(const CTxDestination& address, const std::string& strName, const std::string& strPurpose);
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -861,7 +970,7 @@ public:
      * completion the coin set and corresponding actual target value is
      * assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, const std::vector<OutputGroup>& groups,
         std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
@@ -879,6 +988,11 @@ public:
     void AbortRescan() { fAbortRescan = true; }
     bool IsAbortingRescan() { return fAbortRescan; }
     bool IsScanning() { return fScanningWallet; }
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - m_scanning_start : 0; }
+    double ScanningProgress() const { return fScanningWallet ? (double) m_scanning_progress : 0; }
+
+    //! Snapshot of the wallet's scripts for matching outputs outside cs_wallet
+    std::shared_ptr<const CWalletScanFilter> GetScanFilter() const;
 
     /**
      * keystore implementation
@@ -918,9 +1032,28 @@ public:
     //! Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript& dest, int64_t nCreateTime) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     bool RemoveWatchOnly(const CScript &dest) override EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    bool RemoveWatchOnlyWithDB(WalletBatch &batch, const CScript &dest) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
+    /** Keys, scripts, watch-only scripts and receiving address labels to import */
+    struct Imports
+    {
+        NewKeys keys;
+        std::vector<CScript> scripts;
+        //! Watch-only scripts and their creation times
+        std::map<CScript, int64_t> watch_only;
+        std::map<CTxDestination, std::string> labels;
+    };
+    /**
+     * Write imports to the database without changing the wallet in memory,
+     * so they can be written in a transaction and added with AddImports once
+     * it is committed.
+     */
+    bool WriteImports(WalletBatch& batch, const Imports& imports) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Add imports written by WriteImports to the wallet in memory */
+    void AddImports(const Imports& imports) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     //! Holds a timestamp at which point the wallet is scheduled (externally) to be relocked. Caller must arrange for actual relocking to occur via Lock().
     int64_t nRelockTime = 0;
 
@@ -941,14 +1074,27 @@ public:
     bool GetLabelDestination(CTxDestination &dest, const std::string& label, bool bForceNew = false);
 
     void MarkDirty();
+    //! Called by CWalletTx::MarkDirty(): the spent state of the transaction's outputs may have changed
+    void MarkUnspentDirty(const uint256& hash) const
+    {
+        AssertLockHeld(cs_wallet);
+        m_unspent_dirty.insert(hash);
+    }
+    //! Wallet transactions that may have unspent outputs which are mine, in txid order
+    std::vector<const CWalletTx*> GetUnspentTxs() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     void LoadToWallet(const CWalletTx& wtxIn);
-    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
+    /** Notifications from a WalletBlockDispatcher, which only passes on the
+     * transactions that match the wallet. */
+    void TransactionAddedToMempool(const CTransactionRef& ptx, const WalletMatches& matches);
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted, const WalletMatches& matches);
+    void BlockDisconnected(const CBlock& block, const WalletMatches& matches);
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate = false);
-    void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef &ptx, uint64_t mempool_sequence) override;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
@@ -969,6 +1115,11 @@ public:
      */
     bool FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl);
     bool SignTransaction(CMutableTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /**
+     * Sign all inputs of tx, the i-th of which spends spent_outputs[i].
+     * Transactions with many inputs are signed on several threads.
+     */
+    bool SignInputs(CMutableTransaction& tx, const std::vector<CTxOut>& spent_outputs) const;
 
     /**
      * Create a new transaction paying the recipients with a set of coins
@@ -1294,6 +1445,8 @@ public:
         if (m_wallet->fScanningWallet) {
             return false;
         }
+        m_wallet->m_scanning_start = GetTimeMillis();
+        m_wallet->m_scanning_progress = 0;
         m_wallet->fScanningWallet = true;
         m_could_reserve = true;
         return true;
@@ -14,6 +14,7 @@
 #include <sync.h>
 #include <util.h>
 #include <utiltime.h>
+#include <wallet/leveldb.h>
 #include <wallet/wallet.h>
 
 #include <atomic>
@@ -121,8 +122,8 @@ bool WalletBatch::WriteBestBlock(const CBlockLocator& locator)
 
 bool WalletBatch::ReadBestBlock(CBlockLocator& locator)
 {
-    if (m_batch.Read(std::string("bestblock"), locator) && !locator.vHave.empty()) return true;
-    return m_batch.Read(std::string("bestblock_nomerkle"), locator);
+    if (m_batch->Read(std::string("bestblock"), locator) && !locator.vHave.empty()) return true;
+    return m_batch->Read(std::string("bestblock_nomerkle"), locator);
 }
 
 bool WalletBatch::WriteOrderPosNext(int64_t nOrderPosNext)
@@ -132,7 +133,7 @@ bool WalletBatch::WriteOrderPosNext(int64_t nOrderPosNext)
 
 bool WalletBatch::ReadPool(int64_t nPool, CKeyPool& keypool)
 {
-    return m_batch.Read(std::make_pair(std::string("pool"), nPool), keypool);
+    return m_batch->Read(std::make_pair(std::string("pool"), nPool), keypool);
 }
 
 bool WalletBatch::WritePool(int64_t nPool, const CKeyPool& keypool)
@@ -153,7 +154,7 @@ bool WalletBatch::WriteMinVersion(int nVersion)
 bool WalletBatch::ReadAccount(const std::string& strAccount, CAccount& account)
 {
     account.SetNull();
-    return m_batch.Read(std::make_pair(std::string("acc"), strAccount), account);
+    return m_batch->Read(std::make_pair(std::string("acc"), strAccount), account);
 }
 
 bool WalletBatch::WriteAccount(const std::string& strAccount, const CAccount& account)
@@ -187,8 +188,7 @@ void WalletBatch::ListAccountCreditDebit(const std::string& strAccount, std::lis
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = m_batch.GetCursor();
-    if (!pcursor)
+    if (!m_batch->StartCursor())
         throw std::runtime_error(std::string(__func__) + ": cannot create DB cursor");
     bool setRange = true;
     while (true)
@@ -198,13 +198,14 @@ void WalletBatch::ListAccountCreditDebit(const std::string& strAccount, std::lis
         if (setRange)
             ssKey << std::make_pair(std::string("acentry"), std::make_pair((fAllAccounts ? std::string("") : strAccount), uint64_t(0)));
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        int ret = m_batch.ReadAtCursor(pcursor, ssKey, ssValue, setRange);
+        bool complete;
+        bool ret = m_batch->ReadAtCursor(ssKey, ssValue, complete, setRange);
         setRange = false;
-        if (ret == DB_NOTFOUND)
+        if (complete)
             break;
-        else if (ret != 0)
+        else if (!ret)
         {
-            pcursor->close();
+            m_batch->CloseCursor();
             throw std::runtime_error(std::string(__func__) + ": error scanning DB");
         }
 
@@ -223,7 +224,7 @@ void WalletBatch::ListAccountCreditDebit(const std::string& strAccount, std::lis
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    m_batch->CloseCursor();
 }
 
 class CWalletScanState {
@@ -246,15 +247,121 @@ public:
     }
 };
 
-static bool
-ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
-             CWalletScanState &wss, std::string& strType, std::string& strErr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+/** The part of reading a record that does not need the wallet: decoding
+ * "key", "wkey" and "tx" records and checking their keys and transactions,
+ * which LoadWallet does on several threads. */
+struct DecodedRecord
+{
+    std::string strType;
+    bool fOK = true;
+    std::string strErr;
+    CPubKey vchPubKey;
+    std::unique_ptr<CKey> key;
+    uint256 hash;
+    std::unique_ptr<CWalletTx> wtx;
+};
+
+static void
+DecodeRecord(CDataStream& ssKey, CDataStream& ssValue, DecodedRecord& record)
 {
     try {
         // Unserialize
         // Taking advantage of the fact that pair serialization
         // is just the two items serialized one after the other
-        ssKey >> strType;
+        ssKey >> record.strType;
+        if (record.strType == "tx")
+        {
+            ssKey >> record.hash;
+            record.wtx = MakeUnique<CWalletTx>(nullptr /* pwallet */, MakeTransactionRef());
+            ssValue >> *record.wtx;
+            CValidationState state;
+            record.fOK = CheckTransaction(*record.wtx->tx, state) && (record.wtx->GetHash() == record.hash) && state.IsValid();
+        }
+        else if (record.strType == "key" || record.strType == "wkey")
+        {
+            CPubKey& vchPubKey = record.vchPubKey;
+            ssKey >> vchPubKey;
+            if (!vchPubKey.IsValid())
+            {
+                record.strErr = "Error reading wallet database: CPubKey corrupt";
+                record.fOK = false;
+                return;
+            }
+            CPrivKey pkey;
+            uint256 hash;
+
+            if (record.strType == "key")
+            {
+                ssValue >> pkey;
+            } else {
+                CWalletKey wkey;
+                ssValue >> wkey;
+                pkey = wkey.vchPrivKey;
+            }
+
+            // Old wallets store keys as "key" [pubkey] => [privkey]
+            // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
+            // using EC operations as a checksum.
+            // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
+            // remaining backwards-compatible.
+            try
+            {
+                ssValue >> hash;
+            }
+            catch (...) {}
+
+            bool fSkipCheck = false;
+
+            if (!hash.IsNull())
+            {
+                // hash pubkey/privkey to accelerate wallet load
+                std::vector<unsigned char> vchKey;
+                vchKey.reserve(vchPubKey.size() + pkey.size());
+                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
+                vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
+
+                if (Hash(vchKey.begin(), vchKey.end()) != hash)
+                {
+                    record.strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+                    record.fOK = false;
+                    return;
+                }
+
+                fSkipCheck = true;
+            }
+
+            record.key = MakeUnique<CKey>();
+            if (!record.key->Load(pkey, vchPubKey, fSkipCheck))
+            {
+                record.strErr = "Error reading wallet database: CPrivKey corrupt";
+                record.fOK = false;
+                return;
+            }
+        }
+    } catch (...) {
+        record.fOK = false;
+    }
+}
+
+/** Read a record into the wallet. If record is given, DecodeRecord has
+ * already read the type from ssKey and decoded the record into it. */
+static bool
+ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
+             CWalletScanState &wss, std::string& strType, std::string& strErr,
+             const DecodedRecord* record = nullptr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+{
+    DecodedRecord decoded;
+    if (!record) {
+        DecodeRecord(ssKey, ssValue, decoded);
+        record = &decoded;
+    }
+    strType = record->strType;
+    try {
+        if (strType.empty())
+        {
+            // the type could not be read
+            return false;
+        }
         if (strType == "name")
         {
             std::string strAddress;
@@ -269,13 +376,10 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
-            CWalletTx wtx(nullptr /* pwallet */, MakeTransactionRef());
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            if (!record->fOK)
                 return false;
+            const uint256& hash = record->hash;
+            CWalletTx& wtx = *record->wtx;
 
             // Undo serialize changes in 31600
             if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
@@ -332,63 +436,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "key" || strType == "wkey")
         {
-            CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            if (!vchPubKey.IsValid())
-            {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
-            }
-            CKey key;
-            CPrivKey pkey;
-            uint256 hash;
-
             if (strType == "key")
-            {
                 wss.nKeys++;
-                ssValue >> pkey;
-            } else {
-                CWalletKey wkey;
-                ssValue >> wkey;
-                pkey = wkey.vchPrivKey;
-            }
-
-            // Old wallets store keys as "key" [pubkey] => [privkey]
-            // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
-            // using EC operations as a checksum.
-            // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
-            // remaining backwards-compatible.
-            try
+            if (!record->fOK)
             {
-                ssValue >> hash;
-            }
-            catch (...) {}
-
-            bool fSkipCheck = false;
-
-            if (!hash.IsNull())
-            {
-                // hash pubkey/privkey to accelerate wallet load
-                std::vector<unsigned char> vchKey;
-                vchKey.reserve(vchPubKey.size() + pkey.size());
-                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
-                vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
-
-                if (Hash(vchKey.begin(), vchKey.end()) != hash)
-                {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
-                }
-
-                fSkipCheck = true;
-            }
-
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
-            {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
+                strErr = record->strErr;
                 return false;
             }
-            if (!pwallet->LoadKey(key, vchPubKey))
+            if (!pwallet->LoadKey(*record->key, record->vchPubKey))
             {
                 strErr = "Error reading wallet database: LoadKey failed";
                 return false;
@@ -534,7 +589,7 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
     LOCK(pwallet->cs_wallet);
     try {
         int nMinVersion = 0;
-        if (m_batch.Read((std::string)"minversion", nMinVersion))
+        if (m_batch->Read((std::string)"minversion", nMinVersion))
         {
             if (nMinVersion > FEATURE_LATEST)
                 return DBErrors::TOO_NEW;
@@ -542,30 +597,47 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = m_batch.GetCursor();
-        if (!pcursor)
+        if (!m_batch->StartCursor())
         {
             pwallet->WalletLogPrintf("Error getting wallet database cursor\n");
             return DBErrors::CORRUPT;
         }
 
+        struct Record {
+            CDataStream ssKey{SER_DISK, CLIENT_VERSION};
+            CDataStream ssValue{SER_DISK, CLIENT_VERSION};
+            DecodedRecord decoded;
+        };
+        std::vector<Record> records;
         while (true)
         {
             // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = m_batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
+            Record record;
+            bool complete;
+            bool ret = m_batch->ReadAtCursor(record.ssKey, record.ssValue, complete);
+            if (complete)
                 break;
-            else if (ret != 0)
+            else if (!ret)
             {
                 pwallet->WalletLogPrintf("Error reading next record from wallet database\n");
                 return DBErrors::CORRUPT;
             }
+            records.push_back(std::move(record));
+        }
+        m_batch->CloseCursor();
+
+        // Decoding the records and checking the keys and transactions in them
+        // is most of the work of loading a large wallet, and needs no access
+        // to the wallet: do it on several threads.
+        ParallelFor(records.size(), MAX_KEY_THREADS, MIN_RECORDS_PER_LOAD_THREAD, [&](size_t i) {
+            DecodeRecord(records[i].ssKey, records[i].ssValue, records[i].decoded);
+        });
 
+        for (Record& record : records)
+        {
             // Try to be tolerant of single corrupt records:
             std::string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+            if (!ReadKeyValue(pwallet, record.ssKey, record.ssValue, wss, strType, strErr, &record.decoded))
             {
                 // losing keys is considered a catastrophic error, anything else
                 // we assume the user can live with:
@@ -585,7 +657,6 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 pwallet->WalletLogPrintf("%s\n", strErr);
         }
-        pcursor->close();
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -639,15 +710,14 @@ DBErrors WalletBatch::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CW
 
     try {
         int nMinVersion = 0;
-        if (m_batch.Read((std::string)"minversion", nMinVersion))
+        if (m_batch->Read((std::string)"minversion", nMinVersion))
         {
             if (nMinVersion > FEATURE_LATEST)
                 return DBErrors::TOO_NEW;
         }
 
         // Get cursor
-        Dbc* pcursor = m_batch.GetCursor();
-        if (!pcursor)
+        if (!m_batch->StartCursor())
         {
             LogPrintf("Error getting wallet database cursor\n");
             return DBErrors::CORRUPT;
@@ -658,10 +728,11 @@ DBErrors WalletBatch::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CW
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = m_batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
+            bool complete;
+            bool ret = m_batch->ReadAtCursor(ssKey, ssValue, complete);
+            if (complete)
                 break;
-            else if (ret != 0)
+            else if (!ret)
             {
                 LogPrintf("Error reading next record from wallet database\n");
                 return DBErrors::CORRUPT;
@@ -680,7 +751,7 @@ DBErrors WalletBatch::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CW
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        m_batch->CloseCursor();
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -768,7 +839,7 @@ void MaybeCompactWalletDB()
         }
 
         if (dbh.nLastFlushed != nUpdateCounter && GetTime() - dbh.nLastWalletUpdate >= 2) {
-            if (BerkeleyBatch::PeriodicFlush(dbh)) {
+            if (dbh.PeriodicFlush()) {
                 dbh.nLastFlushed = nUpdateCounter;
             }
         }
@@ -782,6 +853,10 @@ void MaybeCompactWalletDB()
 //
 bool WalletBatch::Recover(const fs::path& wallet_path, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue), std::string& out_backup_filename)
 {
+    if (UseLevelDBWallet(wallet_path)) {
+        LogPrintf("Salvage is not supported for LevelDB wallet %s\n", wallet_path.string());
+        return false;
+    }
     return BerkeleyBatch::Recover(wallet_path, callbackDataIn, recoverKVcallback, out_backup_filename);
 }
 
@@ -817,11 +892,23 @@ bool WalletBatch::RecoverKeysOnlyFilter(void *callbackData, CDataStream ssKey, C
 
 bool WalletBatch::VerifyEnvironment(const fs::path& wallet_path, std::string& errorStr)
 {
+    // LevelDB keeps no environment of its own next to the wallet
+    if (UseLevelDBWallet(wallet_path)) return true;
     return BerkeleyBatch::VerifyEnvironment(wallet_path, errorStr);
 }
 
 bool WalletBatch::VerifyDatabaseFile(const fs::path& wallet_path, std::string& warningStr, std::string& errorStr)
 {
+    if (UseLevelDBWallet(wallet_path)) {
+        // Opening the database replays its log and checks the table files it reads
+        try {
+            LevelDBDatabase database(wallet_path);
+        } catch (const std::exception& e) {
+            errorStr = strprintf(_("Error loading %s: %s"), wallet_path.string(), e.what());
+            return false;
+        }
+        return true;
+    }
     return BerkeleyBatch::VerifyDatabaseFile(wallet_path, warningStr, errorStr, WalletBatch::Recover);
 }
 
@@ -848,25 +935,25 @@ bool WalletBatch::WriteWalletFlags(const uint64_t flags)
 
 bool WalletBatch::TxnBegin()
 {
-    return m_batch.TxnBegin();
+    return m_batch->TxnBegin();
 }
 
 bool WalletBatch::TxnCommit()
 {
-    return m_batch.TxnCommit();
+    return m_batch->TxnCommit();
 }
 
 bool WalletBatch::TxnAbort()
 {
-    return m_batch.TxnAbort();
+    return m_batch->TxnAbort();
 }
 
 bool WalletBatch::ReadVersion(int& nVersion)
 {
-    return m_batch.ReadVersion(nVersion);
+    return m_batch->ReadVersion(nVersion);
 }
 
 bool WalletBatch::WriteVersion(int nVersion)
 {
-    return m_batch.WriteVersion(nVersion);
+    return m_batch->WriteVersion(nVersion);
 }
@@ -16,6 +16,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_SEQUENCE  = "sequence";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -76,7 +77,17 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        LogPrint(BCLog::ZMQ, "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outbound_message_high_water_mark);
+
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outbound_message_high_water_mark, sizeof(outbound_message_high_water_mark));
+        if (rc != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -90,6 +101,7 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
     }
     else
     {
+        // The socket keeps the high water mark of the notifier that created it
         LogPrint(BCLog::ZMQ, "zmq: Reusing socket for address %s\n", address);
 
         psocket = i->second->psocket;
@@ -191,7 +203,46 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    m_buffer.clear();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), m_buffer, 0) << transaction;
+    return SendMessage(MSG_RAWTX, m_buffer.data(), m_buffer.size());
+}
+
+bool CZMQPublishSequenceNotifier::SendSequenceMsg(const uint256& hash, char label, bool has_mempool_sequence, uint64_t mempool_sequence)
+{
+    /* 32 byte hash, 1 byte label and, for mempool events, a LE 8byte mempool sequence number */
+    unsigned char data[sizeof(uint256) + 1 + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < sizeof(uint256); i++)
+        data[sizeof(uint256) - 1 - i] = hash.begin()[i];
+    data[sizeof(uint256)] = label;
+    if (has_mempool_sequence) {
+        WriteLE64(&data[sizeof(uint256) + 1], mempool_sequence);
+    }
+    return SendMessage(MSG_SEQUENCE, data, has_mempool_sequence ? sizeof(data) : sizeof(uint256) + 1);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, /* Block (C)onnect */ 'C', false);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, /* Block (D)isconnect */ 'D', false);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool acceptance %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, /* Mempool (A)cceptance */ 'A', true, mempool_sequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, uint64_t mempool_sequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool removal %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, /* Mempool (R)emoval */ 'R', true, mempool_sequence);
 }
@@ -48,8 +48,28 @@ public:
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
+private:
+    std::vector<unsigned char> m_buffer; //!< reused serialization buffer
+
 public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+/**
+ * Publishes a message for every block connected or disconnected and every
+ * transaction added to or removed from the mempool (except removals for block
+ * inclusion, which are implied by the block message).
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    bool SendSequenceMsg(const uint256& hash, char label, bool has_mempool_sequence, uint64_t mempool_sequence = 0);
+
+public:
+    bool NotifyBlockConnect(const uint256 &hash) override;
+    bool NotifyBlockDisconnect(const uint256 &hash) override;
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence) override;
+    bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t mempool_sequence) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
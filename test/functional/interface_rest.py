@@ -189,10 +189,12 @@ class RESTTest (BitcoinTestFramework):
         self.test_rest_request("/getutxos/checkmempool", http_method='POST', req_type=ReqType.JSON, status=400, ret_type=RetType.OBJ)
 
         # Test limits
-        long_uri = '/'.join(["{}-{}".format(txid, n_) for n_ in range(20)])
-        self.test_rest_request("/getutxos/checkmempool/{}".format(long_uri), http_method='POST', status=400, ret_type=RetType.OBJ)
+        def bin_outpoints(count):
+            return b'\x01\xfd' + pack("<H", count) + b''.join(hex_str_to_bytes(txid) + pack("i", n_) for n_ in range(count))
+        self.test_rest_request("/getutxos", http_method='POST', req_type=ReqType.BIN, body=bin_outpoints(10001), status=400, ret_type=RetType.OBJ)
+        self.test_rest_request("/getutxos", http_method='POST', req_type=ReqType.BIN, body=bin_outpoints(10000), status=200, ret_type=RetType.BYTES)
 
-        long_uri = '/'.join(['{}-{}'.format(txid, n_) for n_ in range(15)])
+        long_uri = '/'.join(['{}-{}'.format(txid, n_) for n_ in range(20)])
         self.test_rest_request("/getutxos/checkmempool/{}".format(long_uri), http_method='POST', status=200)
 
         self.nodes[0].generate(1)  # generate block to not affect upcoming tests
@@ -244,6 +246,19 @@ class RESTTest (BitcoinTestFramework):
         json_obj = self.test_rest_request("/headers/5/{}".format(bb_hash))
         assert_equal(len(json_obj), 5)  # now we should have 5 header objects
 
+        self.log.info("Test the /blockrange URI")
+
+        start_height = self.nodes[0].getblock(bb_hash)['height']
+        expected = b''.join(hex_str_to_bytes(self.nodes[0].getblock(self.nodes[0].getblockhash(h), 0)) for h in range(start_height, start_height + 6))
+        assert_equal(self.test_rest_request("/blockrange/{}/6".format(start_height), req_type=ReqType.BIN, ret_type=RetType.BYTES), expected)
+        response_hex = self.test_rest_request("/blockrange/{}/6".format(start_height), req_type=ReqType.HEX, ret_type=RetType.BYTES)
+        assert_equal(hex_str_to_bytes(response_hex.decode('ascii').rstrip()), expected)
+        # The range is cut off at the tip
+        assert_equal(self.test_rest_request("/blockrange/{}/1000".format(start_height), req_type=ReqType.BIN, ret_type=RetType.BYTES), expected)
+        self.test_rest_request("/blockrange/{}/1001".format(start_height), req_type=ReqType.BIN, status=400, ret_type=RetType.OBJ)
+        self.test_rest_request("/blockrange/{}/1".format(start_height + 6), req_type=ReqType.BIN, status=404, ret_type=RetType.OBJ)
+        self.test_rest_request("/blockrange/{}/1".format(start_height), status=404, ret_type=RetType.OBJ)
+
         self.log.info("Test the /tx URI")
 
         tx_hash = block_json_obj['tx'][0]['txid']
@@ -78,6 +78,7 @@ class ZMQTest (BitcoinTestFramework):
     def run_test(self):
         try:
             self._zmq_test()
+            self._zmq_sequence_test()
         finally:
             # Destroy the ZMQ context.
             self.log.debug("Destroying ZMQ context")
@@ -122,5 +123,45 @@ class ZMQTest (BitcoinTestFramework):
         hex = self.rawtx.receive()
         assert_equal(payment_txid, bytes_to_hex_str(hash256(hex)))
 
+    def _zmq_sequence_test(self):
+        import zmq
+
+        self.log.info("Test the sequence topic")
+        # Start from an empty mempool
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        address = "tcp://127.0.0.1:28333"
+        socket = self.zmq_context.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        socket.connect(address)
+        sequence = ZMQSubscriber(socket, b"sequence")
+        self.restart_node(0, ["-zmqpubsequence=%s" % address])
+
+        def receive_event():
+            body = sequence.receive()
+            label = body[32:33]
+            mempool_sequence = struct.unpack('<Q', body[33:])[0] if label in (b'A', b'R') else None
+            assert_equal(len(body), 41 if mempool_sequence is not None else 33)
+            return bytes_to_hex_str(body[:32]), label, mempool_sequence
+
+        # Mempool snapshot lines up with the notification stream
+        snapshot = self.nodes[0].getrawmempool(False, True)
+        assert_equal(snapshot['txids'], [])
+        txid = self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
+        assert_equal(receive_event(), (txid, b'A', snapshot['mempool_sequence']))
+        assert_equal(self.nodes[0].getrawmempool(False, True), {'txids': [txid], 'mempool_sequence': snapshot['mempool_sequence'] + 1})
+
+        # Connecting a block publishes the block only
+        block_hash = self.nodes[0].generate(1)[0]
+        assert_equal(receive_event(), (block_hash, b'C', None))
+
+        # Disconnecting it returns the transaction to the mempool
+        self.nodes[0].invalidateblock(block_hash)
+        assert_equal(receive_event(), (block_hash, b'D', None))
+        assert_equal(receive_event()[:2], (txid, b'A'))
+        self.nodes[0].reconsiderblock(block_hash)
+        assert_equal(receive_event(), (block_hash, b'C', None))
+
 if __name__ == '__main__':
     ZMQTest().main()